@@ -1,4 +1,5 @@
 #define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -20,6 +21,25 @@
 #include <sys/time.h>
 #include <pty.h>
 #include <termios.h>
+#include <dirent.h>
+#include <sys/ioctl.h>
+#include <sys/prctl.h>
+#include <sys/file.h>
+#include <limits.h>
+#include <glob.h>
+#include <fnmatch.h>
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
+#include <sys/uio.h>
+#include <linux/sockios.h>
+#include <poll.h>
+#include <stdint.h>
+
+#include "awesh_arena.h"
+#include "awesh_roles.h"
+#include "awesh_trace.h"
+#include "awesh_metrics.h"
+#include "awesh_flight.h"
 
 static char socket_path[512];
 static char mmap_path[512] = "/tmp/awesh_sandbox_output.mmap";
@@ -36,14 +56,42 @@ static char frontend_socket_path[512];
 static int sandbox_socket_fd = -1;
 static char sandbox_socket_path[512];
 
+// Prometheus metrics served on ~/.awesh_metrics/awesh.<pid>.sock (awesh_metrics.c)
+static struct {
+    metric_t* input_lines;
+    metric_t* route_builtin;
+    metric_t* route_intent;
+    metric_t* route_speculative;
+    metric_t* route_ai;
+    metric_t* route_shell;
+    metric_t* route_shell_failed_ai;
+    metric_t* route_typo;
+    metric_t* route_interactive;
+    metric_t* verdict_bash;
+    metric_t* verdict_interactive;
+    metric_t* verdict_ai;
+    metric_t* verdict_not_found;
+    metric_t* verdict_error;
+    metric_t* prompt_cache_hit;
+    metric_t* prompt_cache_miss;
+    metric_t* result_cache_hit;
+    metric_t* result_cache_stale;
+    metric_t* result_cache_miss;
+    metric_t* restart_backend;
+    metric_t* restart_security_agent;
+    metric_t* restart_sandbox;
+    metric_t* line_seconds;
+    metric_t* backend_first_byte_seconds;
+    metric_t* sandbox_roundtrip_seconds;
+} frontend_metrics;
+
 // Function declarations
-void get_git_branch(char* branch, size_t size);
 void get_kubectl_context(char* context, size_t size);
 void get_kubectl_namespace(char* namespace, size_t size);
 char* parse_ai_mode(const char* input);
 void handle_ai_mode_detection(const char* input);
 void handle_ai_query(const char* query);
-int send_to_backend(const char* query, char* response, size_t response_size);
+int send_to_backend(const char* query, abuf_t* response);
 // Security agent communication removed - now handled transparently by middleware proxy
 void handle_interactive_bash(const char* cmd);
 void execute_command_securely(const char* cmd);
@@ -67,11 +115,61 @@ void check_ai_status(void);
 int restart_backend(void);
 int restart_security_agent(void);
 int restart_sandbox(void);
+pid_t spawn_helper_role(const char* role);
 void attempt_child_restart(void);
 // Verbose communication removed - middleware handles this transparently
 int init_sandbox_socket(void);
 void cleanup_sandbox_socket(void);
-int send_to_sandbox(const char* cmd, char* response, size_t response_size);
+int send_to_sandbox(const char* cmd, abuf_t* response);
+void send_to_backend_directly(const char* cmd);
+void await_backend_response(void);
+int is_ambiguous_bash_command(const char* cmd);
+int is_speculative_dispatch_enabled(void);
+int is_ambiguous_input_line(const char* cmd);
+int await_speculation_started(void);
+void cancel_speculative_backend_request(void);
+void speculative_dispatch(const char* cmd);
+void export_trace(const char* arg);
+void dump_flight_recorder(const char* reason);
+void print_startup_profile(const char* path);
+void init_frontend_metrics(void);
+void record_sandbox_verdict(int verdict);
+void sample_resources(void);
+void print_resource_table(void);
+void init_intent_engine(void);
+int add_intent_template(const char* phrase, const char* command);
+int match_local_intent(const char* line, char* command, size_t command_size);
+int handle_local_intent(const char* cmd);
+void build_typo_index(void);
+void typo_index_record_usage(const char* cmd);
+int suggest_command_corrections(const char* word, const char** suggestions);
+int handle_command_not_found(const char* cmd);
+void md_render_begin(void);
+void md_render_feed(const char* data, size_t len);
+void md_render_end(void);
+void render_backend_response(const char* first_chunk, size_t len);
+int is_package_index_enabled(void);
+void refresh_package_index(void);
+void reap_package_indexer(void);
+int show_package_hint(const char* name);
+int is_dir_index_enabled(void);
+void dir_index_record(const char* path);
+void record_directory_visit(void);
+void init_terminal_output(void);
+int term_progress_dot(void);
+void handle_dir_jump(const char* args);
+void handle_fanout(const char* args);
+void handle_watch(const char* args);
+int is_result_cache_enabled(void);
+int run_with_result_cache(const char* cmd, int* exit_code);
+void handle_result_cache(const char* args);
+int is_git_status_enabled(void);
+void git_status_follow(void);
+void git_status_flush(void);
+void git_status_segment(char* segment, size_t size);
+void git_status_stop(void);
+void print_git_status(void);
+void resolve_command_previews(void);
 
 // Frontend socket server functions
 int init_frontend_socket(void);
@@ -80,7 +178,6 @@ void handle_frontend_connections(void);
 
 // SECURE: In-memory cache for prompt data (eliminates popen() attack surface)
 static struct {
-    char git_branch[64];
     char k8s_context[64];
     char k8s_namespace[64];
     time_t last_update;
@@ -95,13 +192,10 @@ static struct {
     int bash_stdout_fd;
     int bash_stderr_fd;
     int bash_ready;
-    char output_buffer[64 * 1024];  // 64KB buffer
-    size_t output_length;
     int exit_code;
 } bash_sandbox = {0};
 
 // SECURE: Hardcoded fallback values (no external command execution)
-static const char* DEFAULT_GIT_BRANCH = "main";
 static const char* DEFAULT_K8S_CONTEXT = "default";
 static const char* DEFAULT_K8S_NAMESPACE = "default";
 
@@ -121,28 +215,47 @@ long get_time_ms() {
     return tv.tv_sec * 1000 + tv.tv_usec / 1000;
 }
 
+// FNV-1a, for the in-memory hash tables and the on-disk keys of the indexes
+#define FNV32_OFFSET 2166136261u
+#define FNV64_OFFSET 14695981039346656037ULL
+
+static uint32_t fnv1a(const void* data, size_t len) {
+    uint32_t hash = FNV32_OFFSET;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ ((const unsigned char*)data)[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// 64-bit, continuing from `hash` so several fields can be chained
+static uint64_t fnv1a64(uint64_t hash, const void* data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ ((const unsigned char*)data)[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
 // Function will be defined after state and constants
 
 // Optimized prompt data fetching with caching
-void get_prompt_data_cached(char* git_branch, char* k8s_context, char* k8s_namespace, size_t size) {
+void get_prompt_data_cached(char* k8s_context, char* k8s_namespace, size_t size) {
     time_t now = time(NULL);
     
     // Check if cache is valid (5 second TTL)
     if (prompt_cache.valid && (now - prompt_cache.last_update) < 5) {
-        strncpy(git_branch, prompt_cache.git_branch, size - 1);
+        metric_inc(frontend_metrics.prompt_cache_hit);
         strncpy(k8s_context, prompt_cache.k8s_context, size - 1);
         strncpy(k8s_namespace, prompt_cache.k8s_namespace, size - 1);
-        git_branch[size - 1] = '\0';
         k8s_context[size - 1] = '\0';
         k8s_namespace[size - 1] = '\0';
         return;
     }
     
     // Cache miss - fetch fresh data with secure in-memory functions
+    metric_inc(frontend_metrics.prompt_cache_miss);
     long fetch_start = get_time_ms();
     
     // SECURE: Use direct file parsing instead of popen() commands
-    get_git_branch(prompt_cache.git_branch, sizeof(prompt_cache.git_branch));
     get_kubectl_context(prompt_cache.k8s_context, sizeof(prompt_cache.k8s_context));
     get_kubectl_namespace(prompt_cache.k8s_namespace, sizeof(prompt_cache.k8s_namespace));
     
@@ -150,10 +263,8 @@ void get_prompt_data_cached(char* git_branch, char* k8s_context, char* k8s_names
     prompt_cache.cache_initialized = 1;
     
     // Copy to output
-    strncpy(git_branch, prompt_cache.git_branch, size - 1);
     strncpy(k8s_context, prompt_cache.k8s_context, size - 1);
     strncpy(k8s_namespace, prompt_cache.k8s_namespace, size - 1);
-    git_branch[size - 1] = '\0';
     k8s_context[size - 1] = '\0';
     k8s_namespace[size - 1] = '\0';
     
@@ -166,20 +277,6 @@ void get_prompt_data_cached(char* git_branch, char* k8s_context, char* k8s_names
 
 // REMOVED: Parallel popen structure - replaced with secure in-memory file parsing
 
-// SECURE: Pure in-memory git branch (no file operations)
-void get_git_branch(char* branch, size_t size) {
-    // Use cached value if available
-    if (prompt_cache.cache_initialized && prompt_cache.valid) {
-        strncpy(branch, prompt_cache.git_branch, size - 1);
-        branch[size - 1] = '\0';
-        return;
-    }
-    
-    // SECURE: Use hardcoded default (no file operations)
-    strncpy(branch, DEFAULT_GIT_BRANCH, size - 1);
-    branch[size - 1] = '\0';
-}
-
 // SECURE: Pure in-memory kubectl context (no file operations)
 void get_kubectl_context(char* context, size_t size) {
     // Use cached value if available
@@ -239,7 +336,14 @@ void handle_ai_query(const char* query) {
 // Performance: In-memory file parsing is faster than fork/exec/popen
 // Security: Eliminates command injection attack surface
 #define MAX_CMD_LEN 4096
-#define MAX_RESPONSE_LEN 65536
+#define RECV_CHUNK 8192
+
+// Per-line arena: response buffers and receive chunks come from here and are
+// released together when the main loop finishes the line
+static arena_t request_arena;
+
+// Trace id of the last line that was not itself an awet, for a bare "awet"
+static uint64_t last_line_trace_id = 0;
 
 typedef enum {
     AI_LOADING,
@@ -269,6 +373,15 @@ void debug_perf(const char* operation, long start_time) {
 int is_process_running(pid_t pid) {
     if (pid <= 0) return 0;
     
+    // The helpers are our children: reap one that has exited, or kill(0)
+    // keeps reporting its zombie as running
+    int status;
+    if (waitpid(pid, &status, WNOHANG) == pid) {
+        flight_record(FLIGHT_ERROR, "child.exit", WIFSIGNALED(status) ? -WTERMSIG(status) : WEXITSTATUS(status),
+                      WIFSIGNALED(status) ? "signal" : "status");
+        return 0;
+    }
+    
     // Use kill with signal 0 to check if process exists
     return (kill(pid, 0) == 0);
 }
@@ -286,6 +399,8 @@ void log_health_status(const char* process_name, pid_t pid, int is_running) {
 }
 
 void check_child_process_health(void) {
+    reap_package_indexer();
+    
     // Check backend health
     if (state.backend_pid > 0) {
         int backend_running = is_process_running(state.backend_pid);
@@ -295,6 +410,8 @@ void check_child_process_health(void) {
             if (state.verbose >= 1) {
                 fprintf(stderr, "⚠️ Backend process died, will attempt restart\n");
             }
+            flight_record(FLIGHT_ERROR, "child.died", state.backend_pid, "backend");
+            dump_flight_recorder("backend-died");
             state.backend_pid = -1;
             state.ai_status = AI_FAILED;
         }
@@ -309,6 +426,8 @@ void check_child_process_health(void) {
             if (state.verbose >= 1) {
                 fprintf(stderr, "⚠️ Security Agent process died, will attempt restart\n");
             }
+            flight_record(FLIGHT_ERROR, "child.died", state.security_agent_pid, "security_agent");
+            dump_flight_recorder("security_agent-died");
             state.security_agent_pid = -1;
             // Security agent socket removed - now uses stdin/stdout
         }
@@ -323,6 +442,8 @@ void check_child_process_health(void) {
             if (state.verbose >= 1) {
                 fprintf(stderr, "⚠️ Sandbox process died, will attempt restart\n");
             }
+            flight_record(FLIGHT_ERROR, "child.died", state.sandbox_pid, "sandbox");
+            dump_flight_recorder("sandbox-died");
             state.sandbox_pid = -1;
             sandbox_socket_fd = -1;
         }
@@ -411,6 +532,8 @@ int restart_backend(void) {
     } else if (new_backend_pid > 0) {
         state.backend_pid = new_backend_pid;
         state.ai_status = AI_LOADING;
+        metric_inc(frontend_metrics.restart_backend);
+        flight_record(FLIGHT_STATE, "child.restart", new_backend_pid, "backend");
         
         if (state.verbose >= 1) {
             fprintf(stderr, "✅ RESTART: Backend restarted (PID: %d)\n", new_backend_pid);
@@ -424,6 +547,71 @@ int restart_backend(void) {
     }
 }
 
+// Give a forked helper the process state exec would have: default signal
+// handlers (ignored signals stay ignored) and none of the frontend's fds
+static void reset_forked_process_state(void) {
+    struct sigaction sa;
+    for (int sig = 1; sig < NSIG; sig++) {
+        if (sigaction(sig, NULL, &sa) == 0 && sa.sa_handler != SIG_IGN && sa.sa_handler != SIG_DFL) {
+            signal(sig, SIG_DFL);
+        }
+    }
+    sigset_t none;
+    sigemptyset(&none);
+    sigprocmask(SIG_SETMASK, &none, NULL);
+    
+    DIR* fds = opendir("/proc/self/fd");
+    if (!fds) return;
+    struct dirent* entry;
+    while ((entry = readdir(fds)) != NULL) {
+        int fd = atoi(entry->d_name);
+        if (fd > 2 && fd != dirfd(fds)) {
+            close(fd);
+        }
+    }
+    closedir(fds);
+}
+
+// Start a helper role (awesh_sandbox, awesh_sec) as a child process. The
+// multi-call build enters the role in the forked image - no exec, and the
+// text pages stay shared with the frontend. Separate builds exec the helper
+// binary from ~/.local/bin, then ./
+pid_t spawn_helper_role(const char* role) {
+    fflush(stdout);
+    fflush(stderr);
+    
+    pid_t pid = fork();
+    if (pid != 0) {
+        return pid;
+    }
+    
+    // Child: ignore SIGINT to prevent Ctrl+C from reaching helpers
+    signal(SIGINT, SIG_IGN);
+    
+#ifdef AWESH_MULTICALL
+    const awesh_role_t* entry = find_awesh_role(role);
+    if (entry) {
+        reset_forked_process_state();
+        prctl(PR_SET_NAME, role, 0, 0, 0);  // Keep ps/pkill names as before
+        char* argv[] = {(char*)role, NULL};
+        exit(entry->main(1, argv));
+    }
+#endif
+    
+    const char* home = getenv("HOME");
+    if (home) {
+        char helper_path[512];
+        snprintf(helper_path, sizeof(helper_path), "%s/.local/bin/%s", home, role);
+        execl(helper_path, role, NULL);
+    }
+    // Fallback to local binary
+    char local_path[512];
+    snprintf(local_path, sizeof(local_path), "./%s", role);
+    execl(local_path, role, NULL);
+    fprintf(stderr, "Failed to start %s: %s\n", role, strerror(errno));
+    exit(1);
+}
+
 int restart_security_agent(void) {
     if (state.verbose >= 1) {
         fprintf(stderr, "🔄 RESTART: Attempting to restart Security Agent...\n");
@@ -435,22 +623,10 @@ int restart_security_agent(void) {
     // Socket initialization removed - middleware handles this
     
     // Start new security agent process
-    pid_t new_security_pid = fork();
-    if (new_security_pid == 0) {
-        // Child: ignore SIGINT and start security agent
-        signal(SIGINT, SIG_IGN);
-        
-        const char* home = getenv("HOME");
-        if (home) {
-            char security_agent_path[512];
-            snprintf(security_agent_path, sizeof(security_agent_path), "%s/.local/bin/awesh_sec", home);
-            execl(security_agent_path, "awesh_sec", NULL);
-        }
-        
-        execl("./awesh_sec", "awesh_sec", NULL);
-        perror("Failed to restart Security Agent");
-        exit(1);
-    } else if (new_security_pid > 0) {
+    pid_t new_security_pid = spawn_helper_role("awesh_sec");
+    if (new_security_pid > 0) {
+        metric_inc(frontend_metrics.restart_security_agent);
+        flight_record(FLIGHT_STATE, "child.restart", new_security_pid, "security_agent");
         if (state.verbose >= 1) {
             fprintf(stderr, "✅ RESTART: Security Agent restarted (PID: %d)\n", new_security_pid);
         }
@@ -480,23 +656,11 @@ int restart_sandbox(void) {
     }
     
     // Start new sandbox process
-    pid_t new_sandbox_pid = fork();
-    if (new_sandbox_pid == 0) {
-        // Child: ignore SIGINT and start sandbox
-        signal(SIGINT, SIG_IGN);
-        
-        const char* home = getenv("HOME");
-        if (home) {
-            char sandbox_path[512];
-            snprintf(sandbox_path, sizeof(sandbox_path), "%s/.local/bin/awesh_sandbox", home);
-            execl(sandbox_path, "awesh_sandbox", NULL);
-        }
-        
-        execl("./awesh_sandbox", "awesh_sandbox", NULL);
-        perror("Failed to start Sandbox");
-        exit(1);
-    } else if (new_sandbox_pid > 0) {
+    pid_t new_sandbox_pid = spawn_helper_role("awesh_sandbox");
+    if (new_sandbox_pid > 0) {
         state.sandbox_pid = new_sandbox_pid;
+        metric_inc(frontend_metrics.restart_sandbox);
+        flight_record(FLIGHT_STATE, "child.restart", new_sandbox_pid, "sandbox");
         if (state.verbose >= 1) {
             fprintf(stderr, "✅ RESTART: Sandbox restarted (PID: %d)\n", new_sandbox_pid);
         }
@@ -580,16 +744,19 @@ void get_security_agent_status(char* status, size_t size) {
 }
 
 // Send query to backend and get response
-int send_to_backend(const char* query, char* response, size_t response_size) {
+int send_to_backend(const char* query, abuf_t* response) {
     if (state.socket_fd < 0) {
         return -1;  // No backend connection
     }
     
     // Send query to backend
-    char buffer[MAX_CMD_LEN];
-    snprintf(buffer, sizeof(buffer), "QUERY:%s", query);
+    abuf_t request;
+    if (abuf_init(&request, &request_arena, strlen(query) + 16) != 0 ||
+        abuf_printf(&request, "QUERY:%s", query) < 0) {
+        return -1;
+    }
     
-    if (send(state.socket_fd, buffer, strlen(buffer), 0) < 0) {
+    if (trace_send(state.socket_fd, request.data, request.len, 0) < 0) {
         return -1;
     }
     
@@ -607,20 +774,21 @@ int send_to_backend(const char* query, char* response, size_t response_size) {
         int result = select(state.socket_fd + 1, &readfds, NULL, NULL, &timeout);
         
         if (result > 0) {
-            // Data available, read response
-            ssize_t bytes_received = recv(state.socket_fd, response, response_size - 1, 0);
+            // Data available, read response; take whatever else is already queued too
+            ssize_t bytes_received = abuf_recv(response, state.socket_fd, RECV_CHUNK, 0);
             if (bytes_received > 0) {
-                response[bytes_received] = '\0';
+                while (abuf_recv(response, state.socket_fd, RECV_CHUNK, MSG_DONTWAIT) > 0) {
+                }
                 return 0;  // Success
             }
         } else if (result == 0) {
             // Timeout - show thinking dots
             dots_shown++;
             if (dots_shown <= 6) {  // Show up to 6 dots (30 seconds)
-                printf(".");
-                fflush(stdout);
+                term_progress_dot();
             } else {
                 printf("\n❌ AI response timeout\n");
+                dump_flight_recorder("ai-timeout");
                 return -1;
             }
         } else {
@@ -685,7 +853,7 @@ void cleanup_sandbox_socket(void) {
 }
 
 // Send command to sandbox
-int send_to_sandbox(const char* cmd, char* response, size_t response_size) {
+int send_to_sandbox(const char* cmd, abuf_t* response) {
     if (sandbox_socket_fd < 0) {
         return -1;  // No sandbox connection
     }
@@ -708,7 +876,7 @@ int send_to_sandbox(const char* cmd, char* response, size_t response_size) {
     }
     
     // Send command to sandbox
-    if (send(client_fd, cmd, strlen(cmd), 0) < 0) {
+    if (trace_send(client_fd, cmd, strlen(cmd), 0) < 0) {
         close(client_fd);
         return -1;
     }
@@ -739,26 +907,37 @@ int send_to_sandbox(const char* cmd, char* response, size_t response_size) {
                 return -1;
             }
             
-            // Map the file into memory
-            char* mmap_ptr = mmap(NULL, 1024*1024, PROT_READ, MAP_SHARED, mmap_fd, 0);
+            // The sandbox grows the file for large results, so map its current size
+            struct stat st;
+            if (fstat(mmap_fd, &st) < 0 || st.st_size <= 0) {
+                close(mmap_fd);
+                return -1;
+            }
+            size_t map_size = (size_t)st.st_size;
+            char* mmap_ptr = mmap(NULL, map_size, PROT_READ, MAP_SHARED, mmap_fd, 0);
             if (mmap_ptr == MAP_FAILED) {
                 close(mmap_fd);
                 return -1;
             }
             
-            // Copy JSON response to output buffer
-            strncpy(response, mmap_ptr, response_size - 1);
-            response[response_size - 1] = '\0';
+            // Copy the result (up to its terminator) into the response buffer
+            const char* end = memchr(mmap_ptr, '\0', map_size);
+            size_t len = end ? (size_t)(end - mmap_ptr) : map_size;
+            abuf_clear(response);
+            int copied = abuf_append(response, mmap_ptr, len);
             
             // Cleanup
-            munmap(mmap_ptr, 1024*1024);
+            munmap(mmap_ptr, map_size);
             close(mmap_fd);
             
-            return 0;  // Success
+            return copied == 0 ? 0 : -1;
         }
     }
     
     close(client_fd);
+    if (result == 0) {
+        dump_flight_recorder("sandbox-timeout");
+    }
     return -1;  // Timeout or error
 }
 
@@ -873,8 +1052,20 @@ void handle_ai_mode_detection(const char* input) {
     }
     
     // Send to backend for AI mode detection
-    char response[MAX_RESPONSE_LEN];
-    if (send_to_backend(input, response, sizeof(response)) == 0) {
+    abuf_t reply;
+    if (abuf_init(&reply, &request_arena, RECV_CHUNK) != 0) {
+        printf("❌ Failed to get AI response\n");
+        return;
+    }
+    trace_span_t backend_span = trace_begin("backend_request");
+    uint64_t backend_start = trace_now_ns();
+    int sent = send_to_backend(input, &reply);
+    trace_end(&backend_span, sent == 0 ? "ok" : "error");
+    if (sent == 0) {
+        metric_observe_ms(frontend_metrics.backend_first_byte_seconds, (trace_now_ns() - backend_start) / 1e6);
+    }
+    if (sent == 0) {
+        char* response = reply.data;
         // Parse AI response for mode detection
         if (strncmp(response, "awesh_cmd:", 10) == 0) {
             // AI determined this is a command - extract and execute through security middleware
@@ -1167,6 +1358,9 @@ void cleanup_and_exit(int sig __attribute__((unused))) {
     // Cleanup Sandbox socket
     cleanup_sandbox_socket();
     
+    // Stop the git status worker
+    git_status_stop();
+    
     // Cleanup Frontend socket
     if (state.verbose >= 1) {
         printf("🔌 CLEANUP: Closing frontend socket server\n");
@@ -1235,6 +1429,7 @@ int start_backend() {
         perror("Failed to fork backend");
         return -1;
     }
+    trace_startup_mark("backend_forked");
     
     // Parent: wait for backend to start with retry mechanism
     int retries = 0;
@@ -1258,6 +1453,7 @@ int start_backend() {
     
         if (connect(state.socket_fd, (struct sockaddr*)&addr, sizeof(addr)) >= 0) {
             // Connection successful
+            trace_startup_mark("backend_connected");
             if (state.verbose >= 1) {
                 printf("🔌 Connected to backend after %d seconds\n", retries);
             }
@@ -1296,7 +1492,7 @@ void check_ai_status() {
     }
     
     // Send status check
-    if (send(state.socket_fd, "STATUS", 6, 0) < 0) {
+    if (trace_send(state.socket_fd, "STATUS", 6, 0) < 0) {
         if (state.verbose >= 1) {
             printf("🔧 Failed to send STATUS command\n");
         }
@@ -1308,6 +1504,7 @@ void check_ai_status() {
     ssize_t bytes = recv(state.socket_fd, response, sizeof(response) - 1, 0);
     if (bytes > 0) {
         response[bytes] = '\0';
+        flight_record(FLIGHT_STATE, "ai_status", 0, response);
         if (state.verbose >= 1) {
             printf("🔧 Status response: '%s' (%zd bytes)\n", response, bytes);
         }
@@ -1333,6 +1530,705 @@ void check_ai_status() {
     }
 }
 
+// ============================================================================
+// Terminal output over slow links.
+//
+// Over SSH each write becomes at least one packet, so a reply streamed a few
+// bytes at a time, progress dots and a colourful prompt redrawn after every
+// command all add up on a high-latency link. Low-bandwidth mode (on in SSH
+// sessions by default, LOW_BANDWIDTH=1/0 to force it) changes three things:
+// rendered AI output is queued in frames of arena blocks and written with one
+// writev per LOW_BANDWIDTH_FRAME_MS (default 40ms) instead of one write per
+// chunk; progress dots are not drawn; and the prompt's status line is printed
+// without colours, and only when it differs from the previous one.
+// ============================================================================
+
+#define TERM_FRAME_IOVECS 64            // A frame holding more blocks is written at once
+#define TERM_DEFAULT_FRAME_MS 40
+
+static struct {
+    int low_bandwidth;
+    int frame_ms;
+    struct iovec iov[TERM_FRAME_IOVECS];
+    int iov_count;
+    long frame_start_ms;                // When the current frame got its first byte, 0 while empty
+    long frames;                        // writev calls and bytes they carried, for awes
+    long frame_bytes;
+    char status_line[1000];             // Status line above the last prompt, in low-bandwidth mode
+} term = {0};
+
+void init_terminal_output(void) {
+    const char* mode = getenv("LOW_BANDWIDTH");
+    if (mode && strcmp(mode, "1") == 0) {
+        term.low_bandwidth = 1;
+    } else if (mode && strcmp(mode, "0") == 0) {
+        term.low_bandwidth = 0;
+    } else {
+        term.low_bandwidth = is_ssh_session() && isatty(STDOUT_FILENO);    // "auto"
+    }
+    const char* frame_ms = getenv("LOW_BANDWIDTH_FRAME_MS");
+    term.frame_ms = frame_ms && atoi(frame_ms) > 0 ? atoi(frame_ms) : TERM_DEFAULT_FRAME_MS;
+}
+
+// Write the queued frame with as few writev calls as the kernel allows
+static void term_flush(void) {
+    struct iovec* iov = term.iov;
+    int count = term.iov_count;
+    if (count > 0) {
+        term.frames++;
+    }
+    while (count > 0) {
+        ssize_t written = writev(STDOUT_FILENO, iov, count);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        term.frame_bytes += written;
+        while (count > 0 && (size_t)written >= iov->iov_len) {
+            written -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char*)iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+    term.iov_count = 0;
+    term.frame_start_ms = 0;
+}
+
+// Queue a block for the current frame. The block must stay untouched until
+// the frame is written; the markdown renderer hands over its output buffer
+// and takes a fresh one from the request arena
+static void term_queue(const char* data, size_t len) {
+    if (len == 0) return;
+    if (term.iov_count == TERM_FRAME_IOVECS) term_flush();
+    term.iov[term.iov_count].iov_base = (void*)data;
+    term.iov[term.iov_count].iov_len = len;
+    term.iov_count++;
+}
+
+// Whether the frame has waited long enough to go out
+static int term_frame_due(void) {
+    long now = get_time_ms();
+    if (!term.frame_start_ms) term.frame_start_ms = now;
+    return now - term.frame_start_ms >= term.frame_ms;
+}
+
+// One progress dot while waiting on the backend; 1 if it was drawn
+int term_progress_dot(void) {
+    if (term.low_bandwidth) return 0;
+    printf(".");
+    fflush(stdout);
+    return 1;
+}
+
+// ============================================================================
+// Streaming markdown renderer for AI output.
+//
+// A byte-at-a-time state machine: every byte is looked at once and either
+// written out or parked in a small bounded buffer (line prefix, current
+// word), so the work per byte is O(1) however long the answer gets and
+// nothing is ever re-rendered. Output only moves the cursor forward (text
+// and newlines) and is written once per chunk, or once per frame over SSH
+// (see above), and style changes no text uses are dropped. Covers headings, lists, quotes, rules, **bold**, `code`, and fenced
+// blocks with per-language keyword, string and comment highlighting. Prose
+// is word-wrapped to the terminal width; code is left to the terminal.
+// ============================================================================
+
+#define MD_WORD_MAX 128
+#define MD_PREFIX_MAX 16
+#define MD_LANG_NAME_MAX 16
+#define MD_OUT_BUFFER 4096
+#define MD_KEYWORD_SLOTS 128
+#define MD_DRAIN_WAIT_MS 20
+
+#define MD_STYLE_RESET "\033[0m"
+#define MD_STYLE_BOLD "\033[1m"
+#define MD_STYLE_HEADING "\033[1;4m"
+#define MD_STYLE_CODE "\033[36m"
+#define MD_STYLE_KEYWORD "\033[1;34m"
+#define MD_STYLE_STRING "\033[32m"
+#define MD_STYLE_DIM "\033[2m"
+
+typedef enum {
+    MD_LANG_NONE = 0,
+    MD_LANG_SH,
+    MD_LANG_PYTHON,
+    MD_LANG_C,
+    MD_LANG_JS,
+    MD_LANG_GO,
+    MD_LANG_RUST,
+    MD_LANG_COUNT
+} md_lang_t;
+
+static const char* md_lang_names[MD_LANG_COUNT][6] = {
+    [MD_LANG_SH]     = {"sh", "bash", "shell", "zsh", "console", NULL},
+    [MD_LANG_PYTHON] = {"python", "py", "python3", NULL},
+    [MD_LANG_C]      = {"c", "cpp", "c++", "h", "cc", NULL},
+    [MD_LANG_JS]     = {"js", "javascript", "ts", "typescript", "json", NULL},
+    [MD_LANG_GO]     = {"go", "golang", NULL},
+    [MD_LANG_RUST]   = {"rust", "rs", NULL},
+};
+
+static const char* md_lang_keywords[MD_LANG_COUNT][40] = {
+    [MD_LANG_SH] = {"if", "then", "else", "elif", "fi", "for", "while", "until", "do", "done",
+                    "case", "esac", "in", "function", "return", "local", "export", "readonly",
+                    "sudo", "set", "exit", "source", NULL},
+    [MD_LANG_PYTHON] = {"def", "class", "return", "if", "elif", "else", "for", "while", "in",
+                        "import", "from", "as", "with", "try", "except", "finally", "raise",
+                        "yield", "lambda", "pass", "break", "continue", "and", "or", "not",
+                        "is", "None", "True", "False", "async", "await", "global", NULL},
+    [MD_LANG_C] = {"if", "else", "for", "while", "do", "switch", "case", "default", "break",
+                   "continue", "return", "struct", "union", "enum", "typedef", "static",
+                   "const", "void", "int", "char", "long", "short", "unsigned", "signed",
+                   "float", "double", "size_t", "sizeof", "NULL", "class", "namespace",
+                   "template", "auto", "include", "define", NULL},
+    [MD_LANG_JS] = {"function", "return", "if", "else", "for", "while", "do", "switch", "case",
+                    "break", "continue", "const", "let", "var", "new", "class", "extends",
+                    "import", "export", "from", "async", "await", "try", "catch", "finally",
+                    "throw", "typeof", "null", "undefined", "true", "false", "this", NULL},
+    [MD_LANG_GO] = {"func", "package", "import", "return", "if", "else", "for", "range",
+                    "switch", "case", "default", "break", "continue", "go", "defer", "chan",
+                    "select", "struct", "interface", "type", "var", "const", "map", "nil",
+                    "true", "false", NULL},
+    [MD_LANG_RUST] = {"fn", "let", "mut", "pub", "use", "mod", "struct", "enum", "impl", "trait",
+                      "match", "if", "else", "for", "while", "loop", "in", "return", "break",
+                      "continue", "self", "Self", "crate", "where", "async", "await", "move",
+                      "ref", "true", "false", "Some", "None", "Ok", "Err", NULL},
+};
+
+// Open-addressed keyword sets, built on first use
+static const char* md_keyword_index[MD_LANG_COUNT][MD_KEYWORD_SLOTS];
+static int md_keyword_index_ready = 0;
+
+static struct {
+    int passthrough;       // Not a TTY or AI_RENDER=0: bytes go out unchanged
+    int width;
+    int column;            // Visible column of the cursor
+    int indent;            // Hanging indent for wrapped list items
+    int line_start;        // Still classifying the current line
+    char prefix[MD_PREFIX_MAX + 1];
+    int prefix_len;
+    int in_fence;
+    int fence_info;        // Reading the ```lang info string
+    char lang_name[MD_LANG_NAME_MAX];
+    int lang_name_len;
+    md_lang_t lang;
+    int heading;
+    int quote;
+    int bold;
+    int inline_code;
+    int pending_star;
+    int pending_slash;
+    char word[MD_WORD_MAX];
+    int word_len;
+    int word_width;
+    char in_string;        // Quote character of the open string literal
+    int string_escape;
+    int in_comment;
+    int in_escape;         // Passing through an ANSI sequence from the backend
+    int skip_line;         // Dropping the rest of a closing fence line
+    int style_clean;       // No SGR attribute is in effect
+    long sgr_run;          // Offset in out of a run of SGR sequences not yet applied to text, -1 if none
+    int sgr_run_clean;     // style_clean when that run began
+    char* out;             // MD_OUT_BUFFER bytes from the request arena
+    size_t out_len;
+} md = {0};
+
+static void md_build_keyword_index(void) {
+    for (int lang = 1; lang < MD_LANG_COUNT; lang++) {
+        for (int i = 0; md_lang_keywords[lang][i]; i++) {
+            const char* keyword = md_lang_keywords[lang][i];
+            unsigned int slot = fnv1a(keyword, strlen(keyword)) % MD_KEYWORD_SLOTS;
+            while (md_keyword_index[lang][slot]) slot = (slot + 1) % MD_KEYWORD_SLOTS;
+            md_keyword_index[lang][slot] = keyword;
+        }
+    }
+    md_keyword_index_ready = 1;
+}
+
+static int md_is_keyword(const char* word, int len) {
+    if (md.lang == MD_LANG_NONE) return 0;
+    unsigned int slot = fnv1a(word, (size_t)len) % MD_KEYWORD_SLOTS;
+    while (md_keyword_index[md.lang][slot]) {
+        const char* keyword = md_keyword_index[md.lang][slot];
+        if ((int)strlen(keyword) == len && memcmp(keyword, word, len) == 0) return 1;
+        slot = (slot + 1) % MD_KEYWORD_SLOTS;
+    }
+    return 0;
+}
+
+static void md_flush_output(void) {
+    md.sgr_run = -1;
+    if (md.out_len == 0) return;
+    char* fresh = term.low_bandwidth ? arena_alloc(&request_arena, MD_OUT_BUFFER) : NULL;
+    if (fresh) {
+        term_queue(md.out, md.out_len);     // The frame keeps this block; carry on in a new one
+        md.out = fresh;
+    } else {
+        if (term.low_bandwidth) term_flush();
+        fwrite(md.out, 1, md.out_len, stdout);
+    }
+    md.out_len = 0;
+}
+
+// Whether data is exactly one "ESC [ ... m" sequence
+static int md_is_sgr(const char* data, size_t len) {
+    if (len < 3 || data[0] != '\033' || data[1] != '[' || data[len - 1] != 'm') return 0;
+    for (size_t i = 2; i < len - 1; i++) {
+        if (!isdigit((unsigned char)data[i]) && data[i] != ';') return 0;
+    }
+    return 1;
+}
+
+static void md_emit(const char* data, size_t len) {
+    // Style changes that never reach any text are dropped: a reset makes the
+    // sequences since the last text moot, and resetting a clean state is a no-op
+    if (md_is_sgr(data, len)) {
+        if (len == 4 && data[2] == '0') {
+            if (md.style_clean) return;
+            if (md.sgr_run >= 0) {
+                md.out_len = md.sgr_run;
+                if (md.sgr_run_clean) {
+                    md.style_clean = 1;
+                    md.sgr_run = -1;
+                    return;
+                }
+            }
+        }
+        if (md.sgr_run < 0) {
+            md.sgr_run = md.out_len;
+            md.sgr_run_clean = md.style_clean;
+        }
+        md.style_clean = len == 4 && data[2] == '0';
+    } else {
+        md.sgr_run = -1;
+        if (memchr(data, '\033', len)) md.style_clean = 0;   // Passed-through escapes: assume the worst
+    }
+    
+    if (md.out_len + len > MD_OUT_BUFFER) {
+        long run = md.sgr_run;
+        md_flush_output();
+        if (run >= 0) {
+            md.sgr_run = 0;                 // This sequence starts the new block; what it follows is gone
+            md.sgr_run_clean = 0;
+        }
+    }
+    if (len > MD_OUT_BUFFER) {
+        if (term.low_bandwidth) term_flush();
+        fwrite(data, 1, len, stdout);
+        if (term.low_bandwidth) fflush(stdout);
+        md.sgr_run = -1;
+        return;
+    }
+    memcpy(md.out + md.out_len, data, len);
+    md.out_len += len;
+}
+
+static void md_emit_str(const char* s) {
+    md_emit(s, strlen(s));
+}
+
+// Display columns of one byte: continuation bytes are free, 4-byte (emoji) lead bytes take two
+static int md_byte_width(unsigned char c) {
+    if ((c & 0xC0) == 0x80) return 0;
+    if (c >= 0xF0) return 2;
+    return 1;
+}
+
+// Reset, then re-apply whatever prose styles are still open
+static void md_restore_style(void) {
+    md_emit_str(MD_STYLE_RESET);
+    if (md.heading) md_emit_str(MD_STYLE_HEADING);
+    if (md.quote) md_emit_str(MD_STYLE_DIM);
+    if (md.bold) md_emit_str(MD_STYLE_BOLD);
+    if (md.inline_code) md_emit_str(MD_STYLE_CODE);
+}
+
+static void md_newline(void) {
+    md_emit("\n", 1);
+    md.column = 0;
+}
+
+// Write the buffered word, wrapping first if it would cross the right edge
+static void md_flush_word(void) {
+    if (md.word_len == 0) return;
+    if (!md.in_fence && md.column > md.indent && md.column + md.word_width > md.width) {
+        md_newline();
+        for (int i = 0; i < md.indent; i++) md_emit(" ", 1);
+        md.column = md.indent;
+    }
+    md_emit(md.word, md.word_len);
+    md.column += md.word_width;
+    if (md.column > md.width) md.column %= md.width;  // The terminal wrapped it
+    md.word_len = 0;
+    md.word_width = 0;
+}
+
+static void md_word_append(unsigned char c) {
+    if (md.word_len == MD_WORD_MAX) md_flush_word();  // Overlong token (URL): let the terminal wrap
+    md.word[md.word_len++] = (char)c;
+    md.word_width += md_byte_width(c);
+}
+
+static void md_end_line(void) {
+    md_flush_word();
+    if (md.heading || md.quote || md.bold || md.inline_code || md.in_string || md.in_comment) {
+        md.heading = md.quote = md.bold = md.inline_code = 0;
+        md.in_string = 0;
+        md.in_comment = 0;
+        md_emit_str(MD_STYLE_RESET);
+    }
+    md.pending_star = md.pending_slash = 0;
+    md_newline();
+    md.indent = 0;
+    md.line_start = 1;
+    md.prefix_len = 0;
+}
+
+// Code inside a fence: identifiers are buffered so keywords can be coloured on completion
+static void md_code_byte(unsigned char c) {
+    int word_char = isalnum(c) || c == '_';
+    
+    if (md.in_comment) {
+        md_emit((const char*)&c, 1);
+        return;
+    }
+    if (md.in_string) {
+        md_emit((const char*)&c, 1);
+        if (md.string_escape) {
+            md.string_escape = 0;
+        } else if (c == '\\') {
+            md.string_escape = 1;
+        } else if (c == (unsigned char)md.in_string) {
+            md.in_string = 0;
+            md_emit_str(MD_STYLE_RESET);
+        }
+        return;
+    }
+    if (md.pending_slash) {
+        md.pending_slash = 0;
+        if (c == '/') {
+            md_emit_str(MD_STYLE_DIM "//");
+            md.in_comment = 1;
+            return;
+        }
+        md_emit("/", 1);
+    }
+    if (word_char) {
+        md_word_append(c);
+        return;
+    }
+    
+    if (md.word_len > 0) {
+        if (md_is_keyword(md.word, md.word_len)) {
+            md_emit_str(MD_STYLE_KEYWORD);
+            md_flush_word();
+            md_emit_str(MD_STYLE_RESET);
+        } else {
+            md_flush_word();
+        }
+    }
+    
+    int hash_comments = (md.lang == MD_LANG_SH || md.lang == MD_LANG_PYTHON);
+    int slash_comments = (md.lang == MD_LANG_C || md.lang == MD_LANG_JS ||
+                          md.lang == MD_LANG_GO || md.lang == MD_LANG_RUST);
+    
+    if (c == '#' && hash_comments) {
+        md_emit_str(MD_STYLE_DIM "#");
+        md.in_comment = 1;
+    } else if (c == '/' && slash_comments) {
+        md.pending_slash = 1;
+    } else if ((c == '"' || c == '\'' || c == '`') && md.lang != MD_LANG_NONE) {
+        md_emit_str(MD_STYLE_STRING);
+        md_emit((const char*)&c, 1);
+        md.in_string = (char)c;
+    } else {
+        md_emit((const char*)&c, 1);
+    }
+}
+
+// Prose: inline `code` and **bold**, word wrapping on spaces
+static void md_prose_byte(unsigned char c) {
+    if (md.pending_star) {
+        md.pending_star = 0;
+        if (c == '*') {
+            md_flush_word();
+            md.bold = !md.bold;
+            md_restore_style();
+            return;
+        }
+        md_word_append('*');  // A lone star is literal
+    }
+    
+    if (c == '`') {
+        md_flush_word();
+        md.inline_code = !md.inline_code;
+        md_restore_style();
+    } else if (c == '*' && !md.inline_code) {
+        md.pending_star = 1;
+    } else if (c == ' ' || c == '\t') {
+        md_flush_word();
+        if (md.column >= md.width) {
+            md_newline();
+            for (int i = 0; i < md.indent; i++) md_emit(" ", 1);
+            md.column = md.indent;
+        } else if (md.column > 0) {
+            md_emit(" ", 1);
+            md.column++;
+        }
+    } else {
+        md_word_append(c);
+    }
+}
+
+static void md_body_byte(unsigned char c) {
+    if (md.in_fence) {
+        md_code_byte(c);
+    } else {
+        md_prose_byte(c);
+    }
+}
+
+static void md_set_fence_language(void) {
+    md.lang = MD_LANG_NONE;
+    md.lang_name[md.lang_name_len] = '\0';
+    for (int lang = 1; lang < MD_LANG_COUNT; lang++) {
+        for (int i = 0; md_lang_names[lang][i]; i++) {
+            if (strcasecmp(md.lang_name, md_lang_names[lang][i]) == 0) md.lang = (md_lang_t)lang;
+        }
+    }
+}
+
+// Decide what the buffered line prefix is. Returns 0 while more bytes are needed.
+static int md_classify_line(int at_newline) {
+    const char* p = md.prefix;
+    int n = md.prefix_len;
+    int spaces = 0;
+    while (spaces < n && p[spaces] == ' ') spaces++;
+    const char* r = p + spaces;
+    int rn = n - spaces;
+    int full = (n == MD_PREFIX_MAX) || at_newline;
+    
+    if (rn == 0 && !full) return 0;
+    
+    // Fence markers are recognised inside and outside code
+    if (rn >= 3 && strncmp(r, "```", 3) == 0) {
+        md.prefix_len = 0;
+        if (md.in_fence) {
+            md.in_fence = 0;
+            md.lang = MD_LANG_NONE;
+            md_emit_str(MD_STYLE_DIM "└─" MD_STYLE_RESET);
+            md.fence_info = 0;
+            md.line_start = 0;
+            md.skip_line = 1;
+            return 1;
+        }
+        md.in_fence = 1;
+        md.fence_info = 1;
+        md.lang_name_len = 0;
+        for (int i = 3; i < rn && md.lang_name_len < MD_LANG_NAME_MAX - 1; i++) {
+            if (r[i] != ' ') md.lang_name[md.lang_name_len++] = r[i];
+        }
+        md.line_start = 0;
+        return 1;
+    }
+    if (rn < 3 && !full && r[0] == '`' && (rn < 2 || r[1] == '`')) return 0;
+    
+    int consumed = 0;
+    if (!md.in_fence) {
+        int hashes = 0;
+        while (hashes < rn && r[hashes] == '#') hashes++;
+        if (hashes > 0 && hashes <= 6 && hashes == rn && !full) return 0;
+        
+        if (hashes > 0 && hashes <= 6 && rn > hashes && r[hashes] == ' ') {
+            md.heading = 1;
+            md_emit_str(MD_STYLE_HEADING);
+            consumed = spaces + hashes + 1;
+        } else if (rn == 1 && (r[0] == '-' || r[0] == '*' || r[0] == '+' || r[0] == '>') && !full) {
+            return 0;
+        } else if (r[0] == '-' && strspn(r, "-") == (size_t)rn && !full) {
+            return 0;  // "---" is a rule only if nothing else follows
+        } else if (rn >= 2 && (r[0] == '-' || r[0] == '*' || r[0] == '+') && r[1] == ' ') {
+            for (int i = 0; i < spaces; i++) md_emit(" ", 1);
+            md_emit_str("• ");
+            md.column = spaces + 2;
+            md.indent = md.column;
+            consumed = spaces + 2;
+        } else if (rn >= 3 && strncmp(r, "---", 3) == 0 && at_newline) {
+            int rule = md.width < 60 ? md.width : 60;
+            md_emit_str(MD_STYLE_DIM);
+            for (int i = 0; i < rule; i++) md_emit_str("─");
+            md_emit_str(MD_STYLE_RESET);
+            consumed = n;
+        } else if (rn >= 1 && r[0] == '>') {
+            md.quote = 1;
+            md_emit_str(MD_STYLE_DIM "│ ");
+            md.column = 2;
+            md.indent = 2;
+            consumed = spaces + ((rn >= 2 && r[1] == ' ') ? 2 : 1);
+        } else {
+            int digits = 0;
+            while (digits < rn && isdigit((unsigned char)r[digits])) digits++;
+            if (digits > 0 && digits == rn && digits < 4 && !full) return 0;
+            if (digits > 0 && digits < 4 && rn > digits && r[digits] == '.' && !full && rn == digits + 1) return 0;
+            if (digits > 0 && rn > digits + 1 && r[digits] == '.' && r[digits + 1] == ' ') {
+                md.indent = spaces + digits + 2;  // Hang wrapped lines under the text
+            }
+        }
+    }
+    
+    // Replay whatever the marker did not consume through the normal path
+    md.line_start = 0;
+    char replay[MD_PREFIX_MAX];
+    int replay_len = n - consumed;
+    memcpy(replay, p + consumed, replay_len);
+    md.prefix_len = 0;
+    for (int i = 0; i < replay_len; i++) md_body_byte((unsigned char)replay[i]);
+    return 1;
+}
+
+static void md_feed_byte(unsigned char c) {
+    // ANSI sequences from the backend pass through untouched and take no columns
+    if (md.in_escape) {
+        md_emit((const char*)&c, 1);
+        if (c >= 0x40 && c <= 0x7E && c != '[') md.in_escape = 0;
+        return;
+    }
+    if (c == 0x1B) {
+        md_flush_word();
+        md_emit((const char*)&c, 1);
+        md.in_escape = 1;
+        return;
+    }
+    if (c == '\r') return;
+    
+    if (md.skip_line) {
+        if (c != '\n') return;
+        md.skip_line = 0;
+        md_end_line();
+        return;
+    }
+    
+    if (md.fence_info) {
+        if (c == '\n') {
+            md.fence_info = 0;
+            md_set_fence_language();
+            md_emit_str(MD_STYLE_DIM "┌─ ");
+            md_emit(md.lang_name, md.lang_name_len);
+            md_emit_str(MD_STYLE_RESET);
+            md_end_line();
+        } else if (c != ' ' && md.lang_name_len < MD_LANG_NAME_MAX - 1) {
+            md.lang_name[md.lang_name_len++] = (char)c;
+        }
+        return;
+    }
+    
+    if (md.line_start) {
+        if (c == '\n') {
+            md_classify_line(1);
+            md_end_line();
+            return;
+        }
+        md.prefix[md.prefix_len++] = (char)c;
+        md.prefix[md.prefix_len] = '\0';
+        md_classify_line(0);
+        return;
+    }
+    
+    if (c == '\n') {
+        if (md.pending_star) {
+            md.pending_star = 0;
+            md_word_append('*');
+        }
+        if (md.pending_slash) {
+            md.pending_slash = 0;
+            md_emit("/", 1);
+        }
+        md_end_line();
+        return;
+    }
+    md_body_byte(c);
+}
+
+static int md_terminal_width(void) {
+    struct winsize ws;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0) return ws.ws_col;
+    const char* columns = getenv("COLUMNS");
+    if (columns && atoi(columns) > 0) return atoi(columns);
+    return 80;
+}
+
+void md_render_begin(void) {
+    const char* enabled = getenv("AI_RENDER");
+    int passthrough = !isatty(STDOUT_FILENO) || (enabled && strcmp(enabled, "0") == 0);
+    
+    fflush(stdout);                         // Frames bypass stdio
+    memset(&md, 0, sizeof(md));
+    md.out = passthrough ? NULL : arena_alloc(&request_arena, MD_OUT_BUFFER);
+    md.passthrough = passthrough || !md.out;
+    md.style_clean = 1;
+    md.sgr_run = -1;
+    md.width = md_terminal_width();
+    md.line_start = 1;
+    if (!md_keyword_index_ready) md_build_keyword_index();
+}
+
+void md_render_feed(const char* data, size_t len) {
+    if (md.passthrough) {
+        fwrite(data, 1, len, stdout);
+    } else {
+        for (size_t i = 0; i < len; i++) md_feed_byte((unsigned char)data[i]);
+        if (term.low_bandwidth) {
+            if (term_frame_due()) {
+                md_flush_output();
+                term_flush();
+            }
+            return;                         // Otherwise more of this frame may be on its way
+        }
+        md_flush_output();
+    }
+    fflush(stdout);
+}
+
+void md_render_end(void) {
+    if (md.passthrough) return;
+    if (md.line_start && md.prefix_len > 0) md_classify_line(1);
+    if (md.pending_star) md_word_append('*');
+    if (md.pending_slash) md_emit("/", 1);
+    md_flush_word();
+    md_emit_str(MD_STYLE_RESET);
+    md_flush_output();
+    term_flush();
+    fflush(stdout);
+}
+
+// Render a backend reply: the first chunk is already in hand, the rest is
+// drained as it arrives so long answers start drawing immediately
+void render_backend_response(const char* first_chunk, size_t len) {
+    trace_span_t render_span = trace_begin("render_response");
+    md_render_begin();
+    md_render_feed(first_chunk, len);
+    
+    char* chunk = arena_alloc(&request_arena, RECV_CHUNK);
+    while (chunk && state.socket_fd >= 0) {
+        fd_set readfds;
+        FD_ZERO(&readfds);
+        FD_SET(state.socket_fd, &readfds);
+        struct timeval timeout = {0, MD_DRAIN_WAIT_MS * 1000};
+        if (select(state.socket_fd + 1, &readfds, NULL, NULL, &timeout) <= 0) break;
+        
+        ssize_t bytes = recv(state.socket_fd, chunk, RECV_CHUNK, 0);
+        if (bytes <= 0) break;
+        md_render_feed(chunk, (size_t)bytes);
+    }
+    md_render_end();
+    trace_end(&render_span, NULL);
+    resolve_command_previews();
+}
+
 void send_command(const char* cmd) {
     if (state.socket_fd < 0) {
         // No backend - execute directly with system()
@@ -1345,7 +2241,7 @@ void send_command(const char* cmd) {
     if (getcwd(cwd, sizeof(cwd))) {
         char sync_buffer[1100];
         snprintf(sync_buffer, sizeof(sync_buffer), "CWD:%s", cwd);
-        send(state.socket_fd, sync_buffer, strlen(sync_buffer), 0);
+        trace_send(state.socket_fd, sync_buffer, strlen(sync_buffer), 0);
         
         // Wait for sync acknowledgment (brief)
         fd_set readfds;
@@ -1365,7 +2261,9 @@ void send_command(const char* cmd) {
     char buffer[MAX_CMD_LEN];
     snprintf(buffer, sizeof(buffer), "%s", cmd);
     
-    if (send(state.socket_fd, buffer, strlen(buffer), 0) < 0) {
+    trace_span_t backend_span = trace_begin("backend_request");
+    uint64_t backend_start = trace_now_ns();
+    if (trace_send(state.socket_fd, buffer, strlen(buffer), 0) < 0) {
         perror("Failed to send command");
         return;
     }
@@ -1374,6 +2272,7 @@ void send_command(const char* cmd) {
     fd_set readfds;
     struct timeval timeout;
     int dots_shown = 0;
+    int dots_drawn = 0;
     
     while (1) {
         FD_ZERO(&readfds);
@@ -1388,8 +2287,7 @@ void send_command(const char* cmd) {
             break;
         } else if (select_result == 0) {
             // Timeout - show thinking dot
-            printf(".");
-            fflush(stdout);
+            dots_drawn += term_progress_dot();
             dots_shown++;
             
             // Stop after longer timeout for Ollama (120 dots = 10 minutes), shorter for others (64 dots = ~5.3 minutes)
@@ -1397,6 +2295,7 @@ void send_command(const char* cmd) {
             int max_dots = (strcmp(ai_provider, "ollama") == 0) ? 120 : 64;
             if (dots_shown >= max_dots) {
                 printf("\n❌ Backend timeout - no response after %d minutes\n", max_dots * 5 / 60);
+                dump_flight_recorder("backend-timeout");
                 return;
             }
         } else {
@@ -1405,19 +2304,24 @@ void send_command(const char* cmd) {
         }
     }
     
+    trace_end(&backend_span, NULL);
+    uint64_t first_byte_ns = trace_now_ns() - backend_start;
+    metric_observe_ms(frontend_metrics.backend_first_byte_seconds, first_byte_ns / 1e6);
+    flight_record(FLIGHT_TIMING, "backend.first_byte", (int64_t)(first_byte_ns / 1000), NULL);
+    
     // Clear dots line if any were shown
-    if (dots_shown > 0) {
+    if (dots_drawn > 0) {
         printf("\n");
     }
     
     int select_result = 1; // We know data is available
     if (select_result > 0) {
-        char response[MAX_RESPONSE_LEN];
-        ssize_t bytes = recv(state.socket_fd, response, sizeof(response) - 1, 0);
+        char* response = arena_alloc(&request_arena, RECV_CHUNK + 1);
+        ssize_t bytes = response ? recv(state.socket_fd, response, RECV_CHUNK, 0) : -1;
         if (bytes > 0) {
             response[bytes] = '\0';
             
-            printf("%s", response);
+            render_backend_response(response, (size_t)bytes);
             
             // Check AI status after command (efficient - we're already communicating)
             if (state.ai_status == AI_LOADING) {
@@ -1440,7 +2344,17 @@ int is_awesh_command(const char* cmd) {
             strcmp(cmd, "awes") == 0 ||
             strncmp(cmd, "awev", 4) == 0 ||
             strncmp(cmd, "awea", 4) == 0 ||
-            strncmp(cmd, "awem", 4) == 0);
+            strncmp(cmd, "awem", 4) == 0 ||
+            strncmp(cmd, "awet", 4) == 0 ||
+            strcmp(cmd, "awef") == 0 ||
+            strcmp(cmd, "awej") == 0 ||
+            strncmp(cmd, "awej ", 5) == 0 ||
+            strcmp(cmd, "awep") == 0 ||
+            strncmp(cmd, "awep ", 5) == 0 ||
+            strcmp(cmd, "awew") == 0 ||
+            strncmp(cmd, "awew ", 5) == 0 ||
+            strcmp(cmd, "awec") == 0 ||
+            strncmp(cmd, "awec ", 5) == 0);
 }
 
 // Get list of available Ollama models
@@ -1495,7 +2409,7 @@ void handle_awesh_command(const char* cmd) {
         printf("🎛️  Awesh Control Commands:\n");
         printf("\n📋 Help:\n");
         printf("  aweh              Show this help\n");
-        printf("  awes              Show verbose status (API provider, model, debug state)\n");
+        printf("  awes              Show verbose status and per-process resources\n");
         printf("\n🔧 Verbose Debug:\n");
         printf("  awev              Show verbose level status\n");
         printf("  awev 0            Set verbose level 0 (silent)\n");
@@ -1509,6 +2423,7 @@ void handle_awesh_command(const char* cmd) {
         printf("  awea openrouter   Switch to OpenRouter\n");
         printf("  awea ollama       Switch to Ollama (local models)\n");
         printf("  awea perplexity   Switch to Perplexity (web-enhanced AI)\n");
+        printf("  awea mock         Switch to the offline mock (no network, scripted replies)\n");
         printf("\n📋 Model:\n");
         printf("  awem              Show current model and supported models\n");
         printf("  awem gpt-4        Set model to GPT-4 (OpenAI)\n");
@@ -1518,6 +2433,26 @@ void handle_awesh_command(const char* cmd) {
         printf("  awem sonar        Set model to Sonar (Perplexity)\n");
         printf("  awem sonar-pro    Set model to Sonar Pro (Perplexity)\n");
         printf("  awem <name>       Set any Ollama model (e.g., awem llama3.2)\n");
+        printf("\n🧭 Tracing:\n");
+        printf("  awet              Export a Chrome trace of the previous line\n");
+        printf("  awet <id>         Export the trace with this id\n");
+        printf("  awet all          Export every recorded span\n");
+        printf("  awef              Dump the flight recorder (recent events from every process)\n");
+        printf("\n📁 Directories:\n");
+        printf("  awej <terms...>   Jump to the most frecent visited directory matching the terms\n");
+        printf("  awej -l [terms]   List the best matches with their scores\n");
+        printf("  awep <glob>... -- <cmd>   Run <cmd> in every matching directory, one worker per core\n");
+        printf("  awep -f <file> -- <cmd>   ... in the directories listed in <file>\n");
+        printf("  awep -z [terms] -- <cmd>  ... in directories from the awej index (-j N sets the workers)\n");
+        printf("  awep ai           Send the last awep run's failures to the AI\n");
+        printf("\n👀 Watch:\n");
+        printf("  awew <path>... -- <cmd>   Rerun <cmd> when the paths change, redrawing changed lines\n");
+        printf("  awew -n 2 -- <cmd>        Rerun every 2 seconds (-d MS sets the debounce)\n");
+        printf("\n⏱ Result Cache (RESULT_CACHE=1):\n");
+        printf("  awec              List cached results with their age and state\n");
+        printf("  awec rules        Show the TTL rules (~/.awesh_cache_rules first)\n");
+        printf("  awec clear [tool] Drop every cached result, or those of one tool\n");
+        printf("  awec fresh [cmd]  Rerun a command (default: the last one served cached) and store it\n");
         printf("\n💡 All commands use 'awe' prefix to avoid bash conflicts\n");
     } else if (strcmp(cmd, "awes") == 0) {
         const char* ai_provider = getenv("AI_PROVIDER") ? getenv("AI_PROVIDER") : "openai";
@@ -1543,6 +2478,20 @@ void handle_awesh_command(const char* cmd) {
         printf("📊 Backend PID: %d\n", state.backend_pid);
         printf("🔌 Socket FD: %d\n", state.socket_fd);
         printf("🔧 Verbose Level: %d (0=silent, 1=info, 2=debug)\n", state.verbose);
+        char metrics_path[600];
+        if (metrics_socket_path(metrics_path, sizeof(metrics_path)) == 0) {
+            printf("📈 Metrics: %s (every helper serves its own alongside)\n", metrics_path);
+        } else {
+            printf("📈 Metrics: off\n");
+        }
+        if (term.low_bandwidth) {
+            printf("🐢 Low-bandwidth output: on, %dms frames (%ld written, %ld bytes)\n",
+                   term.frame_ms, term.frames, term.frame_bytes);
+        } else {
+            printf("🐢 Low-bandwidth output: off%s\n", is_ssh_session() ? " (LOW_BANDWIDTH=0)" : "");
+        }
+        print_git_status();
+        print_resource_table();
     } else if (strncmp(cmd, "awev", 4) == 0) {
         // Parse awev command and arguments
         if (strcmp(cmd, "awev") == 0) {
@@ -1620,8 +2569,13 @@ void handle_awesh_command(const char* cmd) {
             update_config_file("AI_PROVIDER", "perplexity");
             send_command("AI_PROVIDER:perplexity");
             printf("🤖 Switching to Perplexity... (restart awesh to take effect)\n");
+        } else if (strcmp(cmd, "awea mock") == 0) {
+            // Switch to the offline mock provider
+            update_config_file("AI_PROVIDER", "mock");
+            send_command("AI_PROVIDER:mock");
+            printf("🤖 Switching to the offline mock... (restart awesh to take effect)\n");
         } else {
-            printf("Usage: awea [openai|openrouter|ollama|perplexity]\n");
+            printf("Usage: awea [openai|openrouter|ollama|perplexity|mock]\n");
         }
     } else if (strncmp(cmd, "awem", 4) == 0) {
         // Parse awem command and arguments
@@ -1728,6 +2682,26 @@ void handle_awesh_command(const char* cmd) {
             printf("🤖 Supported models: gpt-4, gpt-5, kimi-k2, claude-sonnet, llama3.2, gpt-oss:latest, <any-ollama-model>\n");
             printf("💡 Usage: awem [gpt-4|gpt-5|kimi-k2|claude-sonnet|llama3.2|gpt-oss:latest|<any-model>]\n");
         }
+    } else if (strcmp(cmd, "awet") == 0 || strncmp(cmd, "awet ", 5) == 0) {
+        export_trace(cmd[4] ? cmd + 5 : "");
+    } else if (strcmp(cmd, "awej") == 0 || strncmp(cmd, "awej ", 5) == 0) {
+        handle_dir_jump(cmd[4] ? cmd + 5 : "");
+    } else if (strcmp(cmd, "awep") == 0 || strncmp(cmd, "awep ", 5) == 0) {
+        handle_fanout(cmd[4] ? cmd + 5 : "");
+    } else if (strcmp(cmd, "awew") == 0 || strncmp(cmd, "awew ", 5) == 0) {
+        handle_watch(cmd[4] ? cmd + 5 : "");
+    } else if (strcmp(cmd, "awec") == 0 || strncmp(cmd, "awec ", 5) == 0) {
+        handle_result_cache(cmd[4] ? cmd + 5 : "");
+    } else if (strcmp(cmd, "awef") == 0) {
+        char path[700];
+        if (flight_dump("manual", path, sizeof(path)) == 0) {
+            printf("🛩️ Flight recorder: %s\n", path);
+            printf("   Decode with: python3 -m awesh_backend.flight_reader %s\n", path);
+        } else {
+            printf("🛩️ Flight recorder unavailable (disabled with FLIGHT_RECORDER=0, or no shared memory)\n");
+        }
+    } else {
+        printf("💡 Unknown awesh command: %s (try aweh)\n", cmd);
     }
 }
 
@@ -1925,10 +2899,20 @@ int test_command_in_sandbox(const char* cmd) {
     }
     
     // Use the new socket-based sandbox communication
-    char response[4096];
-    int result = send_to_sandbox(cmd, response, sizeof(response));
+    abuf_t reply;
+    if (abuf_init(&reply, &request_arena, RECV_CHUNK) != 0) {
+        return -1;
+    }
+    trace_span_t sandbox_span = trace_begin("sandbox_request");
+    uint64_t sandbox_start = trace_now_ns();
+    int result = send_to_sandbox(cmd, &reply);
+    uint64_t sandbox_ns = trace_now_ns() - sandbox_start;
+    metric_observe_ms(frontend_metrics.sandbox_roundtrip_seconds, sandbox_ns / 1e6);
+    flight_record(FLIGHT_TIMING, "sandbox.roundtrip", (int64_t)(sandbox_ns / 1000), result == 0 ? "ok" : "error");
+    trace_end(&sandbox_span, result == 0 ? "ok" : "error");
         
         if (result == 0) {
+        const char* response = reply.data;
         // Check if sandbox detected an interactive command
         if (strstr(response, "INTERACTIVE_COMMAND")) {
                 if (state.verbose >= 2) {
@@ -1939,28 +2923,31 @@ int test_command_in_sandbox(const char* cmd) {
         
         // Parse validation result from sandbox: EXIT_CODE:X\nSTDOUT_LEN:Y\nSTDOUT:...\nSTDERR_LEN:Z\nSTDERR:...\n
         int exit_code = 0;
-        char stderr_content[4096] = {0};
+        const char* stderr_content = "";
+        size_t stderr_len = 0;
         
         // Parse EXIT_CODE
-        char* exit_line = strstr(response, "EXIT_CODE:");
+        const char* exit_line = strstr(response, "EXIT_CODE:");
         if (exit_line) {
             exit_code = atoi(exit_line + 10);
         }
         
         // Parse STDERR_LEN and STDERR (we only care about stderr for validation)
-        char* stderr_len_line = strstr(response, "STDERR_LEN:");
+        // STDERR is read in place by its length - no copy and no size cap
+        const char* stderr_len_line = strstr(response, "STDERR_LEN:");
         if (stderr_len_line) {
-            size_t stderr_len = atoi(stderr_len_line + 11);
-            char* stderr_start = strstr(stderr_len_line, "STDERR:");
-            if (stderr_start && stderr_len > 0 && stderr_len < sizeof(stderr_content)) {
-                strncpy(stderr_content, stderr_start + 7, stderr_len);
-                stderr_content[stderr_len] = '\0';
+            size_t declared_len = strtoul(stderr_len_line + 11, NULL, 10);
+            const char* stderr_start = strstr(stderr_len_line, "STDERR:");
+            if (stderr_start && declared_len > 0) {
+                stderr_content = stderr_start + 7;
+                size_t available = reply.len - (size_t)(stderr_content - response);
+                stderr_len = declared_len < available ? declared_len : available;
             }
         }
         
         // Show debug info only in verbose mode
         if (state.verbose >= 2) {
-            printf("DEBUG: Sandbox validation - exit_code: %d, stderr: '%s'\n", exit_code, stderr_content);
+            printf("DEBUG: Sandbox validation - exit_code: %d, stderr: '%.*s'\n", exit_code, (int)stderr_len, stderr_content);
         }
         
         // Return validation result:
@@ -1979,7 +2966,7 @@ int test_command_in_sandbox(const char* cmd) {
         }
         
         // Check if command executed successfully in sandbox (valid bash)
-        if (exit_code == 0 && strlen(stderr_content) == 0) {
+        if (exit_code == 0 && stderr_len == 0) {
             if (state.verbose >= 2) {
                 printf("✅ Sandbox: Valid bash command - executing directly\n");
             }
@@ -2007,16 +2994,27 @@ void send_to_backend_directly(const char* cmd) {
     // Send directly to backend - middleware is transparent
     if (state.socket_fd >= 0) {
         // Send command to backend
-        if (send(state.socket_fd, cmd, strlen(cmd), 0) < 0) {
+        if (trace_send(state.socket_fd, cmd, strlen(cmd), 0) < 0) {
             printf("\n❌ Failed to send command to backend\n");
             return;
         }
         
-        // Show thinking dots while waiting for response (5 minute timeout)
-        time_t start_time = time(NULL);
-        time_t last_dot_time = start_time;
-        const int MAX_WAIT_SECONDS = 300;  // 5 minutes
-        const int DOT_INTERVAL_SECONDS = 5;  // Show dot every 5 seconds
+        await_backend_response();
+    } else {
+        printf("\n🚫 Backend not available\n");
+    }
+}
+
+// Wait for the response to a request already sent to the backend and print it
+void await_backend_response(void) {
+    if (state.socket_fd >= 0) {
+        // Show thinking dots while waiting for response (5 minute timeout)
+        time_t start_time = time(NULL);
+        time_t last_dot_time = start_time;
+        const int MAX_WAIT_SECONDS = 300;  // 5 minutes
+        const int DOT_INTERVAL_SECONDS = 5;  // Show dot every 5 seconds
+        trace_span_t backend_span = trace_begin("backend_request");
+        uint64_t backend_start = trace_now_ns();
         
         while (1) {
             // Check if data is available to read
@@ -2032,10 +3030,18 @@ void send_to_backend_directly(const char* cmd) {
             
             if (result > 0) {
                 // Data available - read response
-                char response[MAX_RESPONSE_LEN];
-                ssize_t bytes_received = recv(state.socket_fd, response, sizeof(response) - 1, 0);
+                char* response = arena_alloc(&request_arena, RECV_CHUNK + 1);
+                if (!response) {
+                    printf("\n❌ Error waiting for backend response\n");
+                    return;
+                }
+                ssize_t bytes_received = recv(state.socket_fd, response, RECV_CHUNK, 0);
                 if (bytes_received > 0) {
                     response[bytes_received] = '\0';
+                    trace_end(&backend_span, NULL);
+                    uint64_t first_byte_ns = trace_now_ns() - backend_start;
+                    metric_observe_ms(frontend_metrics.backend_first_byte_seconds, first_byte_ns / 1e6);
+                    flight_record(FLIGHT_TIMING, "backend.first_byte", (int64_t)(first_byte_ns / 1000), NULL);
                     
                     if (state.verbose >= 2) {
                         printf("\nDEBUG: Received %zd bytes from backend\n", bytes_received);
@@ -2043,22 +3049,22 @@ void send_to_backend_directly(const char* cmd) {
                     }
                     
                     // Clear thinking dots and show response
-                    printf("\r                    \r");  // Clear line
-                    printf("%s", response);
+                    printf("\r\033[K");  // Clear line
+                    render_backend_response(response, (size_t)bytes_received);
                     return;
                 }
             } else if (result == 0) {
                 // Timeout - check if we should show thinking dots
                 time_t current_time = time(NULL);
                 if (current_time - last_dot_time >= DOT_INTERVAL_SECONDS) {
-                    printf(".");
-                    fflush(stdout);
+                    term_progress_dot();
                     last_dot_time = current_time;
                 }
                 
                 // Check for overall timeout
                 if (current_time - start_time >= MAX_WAIT_SECONDS) {
                     printf("\n⏰ Backend response timeout\n");
+                    dump_flight_recorder("backend-timeout");
                     return;
             }
         } else {
@@ -2072,6 +3078,341 @@ void send_to_backend_directly(const char* cmd) {
     }
 }
 
+// Speculative dual dispatch: for ambiguous lines the AI request and the sandbox
+// validation run at the same time, and the loser is cancelled on the sandbox verdict.
+// The backend only generates until COMMIT; nothing the reply asks for runs before.
+#define SPECULATION_CANCELLED_MARKER "SPECULATION_CANCELLED"
+#define SPECULATION_STARTED_MARKER "SPECULATION_STARTED\n"
+
+int is_speculative_dispatch_enabled(void) {
+    const char* enabled = getenv("SPECULATIVE_DISPATCH");
+    return !(enabled && strcmp(enabled, "0") == 0);  // Enabled by default
+}
+
+// Ambiguous = starts with a word that is both a command and plain English
+// ("find large files in logs"), has 3+ words and no shell syntax
+int is_ambiguous_input_line(const char* cmd) {
+    if (!is_ambiguous_bash_command(cmd)) return 0;
+    
+    if (strchr(cmd, '|') || strchr(cmd, '>') || strchr(cmd, '<') || strchr(cmd, '&') ||
+        strchr(cmd, ';') || strchr(cmd, '`') || strchr(cmd, '$') || strchr(cmd, '-') ||
+        strchr(cmd, '/') || strchr(cmd, '*') || strchr(cmd, '=')) {
+        return 0;  // Shell syntax - clearly bash
+    }
+    
+    int word_count = 0;
+    int in_word = 0;
+    for (const char* p = cmd; *p; p++) {
+        if (*p == ' ' || *p == '\t') {
+            in_word = 0;
+        } else if (!in_word) {
+            in_word = 1;
+            word_count++;
+        }
+    }
+    return word_count >= 3;
+}
+
+// Wait for the backend's SPECULATE ack. Requests are not framed and the backend
+// reads one per recv, so COMMIT/CANCEL sent before it could arrive in the same
+// read as SPECULATE and be lost. Nothing precedes the ack on the stream.
+int await_speculation_started(void) {
+    char ack[sizeof(SPECULATION_STARTED_MARKER)];
+    size_t want = strlen(SPECULATION_STARTED_MARKER);
+    size_t got = 0;
+    long deadline = get_time_ms() + 2000;
+    
+    while (got < want && get_time_ms() < deadline) {
+        fd_set readfds;
+        FD_ZERO(&readfds);
+        FD_SET(state.socket_fd, &readfds);
+        
+        struct timeval timeout;
+        timeout.tv_sec = 0;
+        timeout.tv_usec = 100000;  // 100ms
+        
+        if (select(state.socket_fd + 1, &readfds, NULL, NULL, &timeout) <= 0) {
+            continue;
+        }
+        
+        ssize_t bytes = recv(state.socket_fd, ack + got, want - got, 0);
+        if (bytes <= 0) {
+            return -1;
+        }
+        got += (size_t)bytes;
+    }
+    
+    if (got < want || memcmp(ack, SPECULATION_STARTED_MARKER, want) != 0) {
+        if (state.verbose >= 1) {
+            fprintf(stderr, "⚠️ Speculation: backend did not acknowledge SPECULATE\n");
+        }
+        return -1;
+    }
+    return 0;
+}
+
+// Cancel the in-flight speculative backend request and discard whatever it produced
+void cancel_speculative_backend_request(void) {
+    if (state.socket_fd < 0) return;
+    
+    if (trace_send(state.socket_fd, "CANCEL", 6, 0) < 0) {
+        return;
+    }
+    
+    // Drain until the backend acknowledges; a response that raced the cancel
+    // arrives before the marker and is dropped with it
+    char drain[RECV_CHUNK];
+    size_t tail_len = 0;
+    long deadline = get_time_ms() + 2000;
+    
+    while (get_time_ms() < deadline) {
+        fd_set readfds;
+        FD_ZERO(&readfds);
+        FD_SET(state.socket_fd, &readfds);
+        
+        struct timeval timeout;
+        timeout.tv_sec = 0;
+        timeout.tv_usec = 100000;  // 100ms
+        
+        if (select(state.socket_fd + 1, &readfds, NULL, NULL, &timeout) <= 0) {
+            continue;
+        }
+        
+        ssize_t bytes = recv(state.socket_fd, drain + tail_len, sizeof(drain) - tail_len - 1, 0);
+        if (bytes <= 0) {
+            return;
+        }
+        drain[tail_len + bytes] = '\0';
+        
+        if (strstr(drain, SPECULATION_CANCELLED_MARKER)) {
+            return;
+        }
+        
+        // Keep only a marker-sized tail so a split marker is still found
+        size_t total = tail_len + bytes;
+        size_t keep = strlen(SPECULATION_CANCELLED_MARKER);
+        if (total > keep) {
+            memmove(drain, drain + total - keep, keep);
+            tail_len = keep;
+        } else {
+            tail_len = total;
+        }
+    }
+    
+    if (state.verbose >= 1) {
+        fprintf(stderr, "⚠️ Speculation: backend did not acknowledge CANCEL\n");
+    }
+}
+
+// Race the AI request against sandbox validation. Total wait is the maximum
+// of the two paths instead of shell-first-then-AI.
+void speculative_dispatch(const char* cmd) {
+    char request[MAX_CMD_LEN];
+    snprintf(request, sizeof(request), "SPECULATE:%s", cmd);
+    
+    long dispatch_start = get_time_ms();
+    
+    // Fire the AI request first - the provider round trip is the long pole
+    if (trace_send(state.socket_fd, request, strlen(request), 0) < 0) {
+        system(cmd);
+        return;
+    }
+    
+    // Sandbox validation runs while the backend is already working
+    int verdict = test_command_in_sandbox(cmd);
+    debug_perf("speculative sandbox verdict", dispatch_start);
+    record_sandbox_verdict(verdict);
+    
+    // Long since arrived in practice; COMMIT/CANCEL must not go out before it
+    await_speculation_started();
+    
+    if (verdict == 0 || verdict == -103) {
+        // Confident bash verdict - the AI loses
+        if (state.verbose >= 2) {
+            printf("⚡ Speculation: sandbox says bash (%d) - cancelling AI request\n", verdict);
+        }
+        cancel_speculative_backend_request();
+        
+        if (verdict == -103 && isatty(STDIN_FILENO)) {
+            run_interactive_command(cmd);
+            return;
+        }
+        
+        int result = system(cmd);
+        if (WEXITSTATUS(result) != 0 && state.verbose >= 1) {
+            printf("❌ Command failed (exit %d)\n", WEXITSTATUS(result));
+        }
+        return;
+    }
+    
+    // Natural language, not found, or no confident verdict - the AI wins
+    if (state.verbose >= 2) {
+        printf("⚡ Speculation: sandbox verdict %d - using AI response\n", verdict);
+    }
+    // The backend only generated so far; its commands and edits run from here on
+    if (trace_send(state.socket_fd, "COMMIT", 6, 0) < 0) {
+        return;
+    }
+    printf("🤔 Thinking");
+    fflush(stdout);
+    await_backend_response();
+    debug_perf("speculative dispatch total", dispatch_start);
+}
+
+// ============================================================================
+// Cross-process trace export (awet).
+//
+// Each process keeps its own span ring (awesh_trace.c). Export asks the
+// helpers for theirs with SIGUSR2, writes the frontend's own, then merges the
+// per-process JSON lines into one Chrome Trace Event array, filtered to one
+// trace id. Load the result in ui.perfetto.dev or chrome://tracing.
+// ============================================================================
+
+#define TRACE_COLLECT_TIMEOUT_MS 1000
+
+static int is_trace_part_file(const char* name) {
+    size_t len = strlen(name);
+    return len > 6 && strcmp(name + len - 6, ".jsonl") == 0;
+}
+
+static int count_trace_part_files(const char* dir_path, int remove) {
+    DIR* dir = opendir(dir_path);
+    if (!dir) return 0;
+    
+    int count = 0;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (!is_trace_part_file(entry->d_name)) continue;
+        if (remove) {
+            char path[1024];
+            snprintf(path, sizeof(path), "%s/%s", dir_path, entry->d_name);
+            unlink(path);
+        }
+        count++;
+    }
+    closedir(dir);
+    return count;
+}
+
+// Append the events of one per-process file; metadata lines are always kept
+// so the merged timeline has process names
+static int merge_trace_part(FILE* out, const char* path, const char* id_filter, int written) {
+    FILE* in = fopen(path, "r");
+    if (!in) return written;
+    
+    char* event = NULL;
+    size_t cap = 0;
+    ssize_t len;
+    while ((len = getline(&event, &cap, in)) > 0) {
+        if (event[len - 1] == '\n') event[--len] = '\0';
+        if (len == 0) continue;
+        if (id_filter && !strstr(event, "\"ph\":\"M\"") && !strstr(event, id_filter)) continue;
+        fprintf(out, "%s%s", written ? ",\n" : "", event);
+        written++;
+    }
+    free(event);
+    fclose(in);
+    return written;
+}
+
+void export_trace(const char* arg) {
+    if (!trace_enabled()) {
+        printf("🧭 Tracing is disabled (TRACING=0)\n");
+        return;
+    }
+    
+    uint64_t trace_id = last_line_trace_id;
+    if (strcmp(arg, "all") == 0) {
+        trace_id = 0;
+    } else if (*arg) {
+        char* end = NULL;
+        trace_id = strtoull(arg, &end, 16);
+        if (!end || *end != '\0' || trace_id == 0) {
+            printf("💡 Usage: awet [all|<trace id>]\n");
+            return;
+        }
+    } else if (trace_id == 0) {
+        printf("🧭 Nothing traced yet - run a command first\n");
+        return;
+    }
+    
+    char dir[512];
+    if (trace_dir(dir, sizeof(dir)) != 0) {
+        printf("❌ Cannot create ~/%s\n", TRACE_DIR_NAME);
+        return;
+    }
+    count_trace_part_files(dir, 1);
+    
+    // The backend only installs its handler once it is serving, and SIGUSR2
+    // would kill it before that
+    int expected = 1;
+    pid_t helpers[3] = {
+        state.socket_fd >= 0 ? state.backend_pid : 0,
+        state.sandbox_pid,
+        state.security_agent_pid,
+    };
+    for (int i = 0; i < 3; i++) {
+        if (helpers[i] > 0 && kill(helpers[i], SIGUSR2) == 0) {
+            expected++;
+        }
+    }
+    
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/awesh.%d.jsonl", dir, (int)getpid());
+    trace_export(path);
+    
+    long deadline = get_time_ms() + TRACE_COLLECT_TIMEOUT_MS;
+    int found;
+    while ((found = count_trace_part_files(dir, 0)) < expected && get_time_ms() < deadline) {
+        usleep(20000);
+    }
+    if (found < expected && state.verbose >= 1) {
+        printf("⚠️ Only %d of %d processes exported their spans\n", found, expected);
+    }
+    
+    char id_hex[17] = "all";
+    char id_filter[48];
+    if (trace_id) {
+        snprintf(id_hex, sizeof(id_hex), "%016llx", (unsigned long long)trace_id);
+        snprintf(id_filter, sizeof(id_filter), "\"trace_id\":\"%s\"", id_hex);
+    }
+    
+    char out_path[1024];
+    snprintf(out_path, sizeof(out_path), "%s/trace-%s.json", dir, id_hex);
+    FILE* out = fopen(out_path, "w");
+    if (!out) {
+        printf("❌ Cannot write %s\n", out_path);
+        return;
+    }
+    
+    fprintf(out, "[\n");
+    int written = 0;
+    DIR* parts = opendir(dir);
+    struct dirent* entry;
+    while (parts && (entry = readdir(parts)) != NULL) {
+        if (!is_trace_part_file(entry->d_name)) continue;
+        snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+        written = merge_trace_part(out, path, trace_id ? id_filter : NULL, written);
+    }
+    if (parts) closedir(parts);
+    fprintf(out, "\n]\n");
+    fclose(out);
+    
+    printf("🧭 Trace %s: %d events from %d processes\n", id_hex, written, found);
+    printf("   %s\n", out_path);
+    printf("   Open in ui.perfetto.dev or chrome://tracing\n");
+}
+
+// Something went wrong (a timeout, a helper died): keep the flight
+// recorder's view of the moments before it, from every process
+void dump_flight_recorder(const char* reason) {
+    flight_record(FLIGHT_ERROR, reason, 0, NULL);
+    char path[700];
+    if (flight_dump(reason, path, sizeof(path)) == 0 && state.verbose >= 1) {
+        fprintf(stderr, "🛩️ Flight recorder dumped to %s\n", path);
+    }
+}
+
 // Old middleware functions removed - now handled transparently by proxy
 
 // Check if we're in an SSH session
@@ -2159,189 +3500,5357 @@ int is_ai_query(const char* cmd) {
             }
         }
     }
-    
-    return 0;  // Default to not AI query
+    
+    return 0;  // Default to not AI query
+}
+
+// ============================================================================
+// Local intent engine: stock natural-language ops requests ("show disk usage",
+// "what's listening on port 8080") are matched against a table of templates
+// and answered with a proposed command - no provider round trip.
+//
+// Templates are compiled once at startup into a token trie (the automaton).
+// Literal edges are matched by hash + strcmp, slot edges ({port}, {path},
+// {name}, {n}) capture one token each. Matching is a bounded DFS over the
+// normalized input and takes microseconds.
+// ============================================================================
+
+#define INTENT_MAX_TOKENS 32
+#define INTENT_MAX_TOKEN_LEN 128
+#define INTENT_MAX_SLOTS 4
+
+typedef enum {
+    INTENT_SLOT_NONE = 0,
+    INTENT_SLOT_PORT,     // 1-65535
+    INTENT_SLOT_NUMBER,   // digits
+    INTENT_SLOT_PATH,     // path-safe characters
+    INTENT_SLOT_NAME      // identifier-like word
+} intent_slot_t;
+
+typedef struct {
+    char* token;          // Literal token, or slot name for slot edges
+    unsigned int hash;    // FNV-1a of literal token
+    intent_slot_t slot;   // INTENT_SLOT_NONE for literal edges
+    int first_child;
+    int next_sibling;
+    int template_index;   // Accepting state: index into intent_templates, or -1
+} intent_node_t;
+
+typedef struct {
+    char* phrase;
+    char* command;
+} intent_template_t;
+
+static struct {
+    intent_node_t* nodes;
+    int node_count;
+    int node_capacity;
+    intent_template_t* templates;
+    int template_count;
+    int template_capacity;
+    int ready;
+} intent_engine = {0};
+
+// Built-in table; ~/.awesh_intents adds to it ("phrase => command" per line)
+static const char* builtin_intents[][2] = {
+    {"show disk usage", "df -h"},
+    {"disk usage", "df -h"},
+    {"check disk space", "df -h"},
+    {"how much disk space is left", "df -h"},
+    {"show free space", "df -h"},
+    {"what is listening on port {port}", "ss -ltnp 'sport = :{port}'"},
+    {"whats listening on port {port}", "ss -ltnp 'sport = :{port}'"},
+    {"who is using port {port}", "ss -ltnp 'sport = :{port}'"},
+    {"what process is using port {port}", "ss -ltnp 'sport = :{port}'"},
+    {"show listening ports", "ss -tulpn"},
+    {"list open ports", "ss -tulpn"},
+    {"largest files here", "du -ah . 2>/dev/null | sort -rh | head -20"},
+    {"show largest files", "du -ah . 2>/dev/null | sort -rh | head -20"},
+    {"find largest files", "du -ah . 2>/dev/null | sort -rh | head -20"},
+    {"largest files in {path}", "du -ah {path} 2>/dev/null | sort -rh | head -20"},
+    {"find large files in {path}", "find {path} -type f -size +100M -exec ls -lh {} +"},
+    {"show memory usage", "free -h"},
+    {"check memory", "free -h"},
+    {"show running processes", "ps aux --sort=-%cpu | head -20"},
+    {"top processes by memory", "ps aux --sort=-%mem | head -20"},
+    {"find files named {name}", "find . -name '{name}'"},
+    {"show last {n} lines of {path}", "tail -n {n} {path}"},
+    {"follow {path}", "tail -f {path}"},
+    {"count lines in {path}", "wc -l {path}"},
+    {"show my ip address", "ip -brief address"},
+    {"what is my ip", "ip -brief address"},
+    {"show uptime", "uptime"},
+    {"show git status", "git status"},
+    {"show environment variables", "env"},
+};
+
+// Words that carry no intent; dropped from both templates and input
+static const char* intent_filler_words[] = {
+    "please", "me", "the", "a", "an", "my", "all", "can", "you", NULL
+};
+
+static int intent_is_filler(const char* word) {
+    for (int i = 0; intent_filler_words[i]; i++) {
+        if (strcmp(word, intent_filler_words[i]) == 0) return 1;
+    }
+    return 0;
+}
+
+static intent_slot_t intent_slot_type(const char* slot_name) {
+    if (strcmp(slot_name, "port") == 0) return INTENT_SLOT_PORT;
+    if (strcmp(slot_name, "n") == 0 || strcmp(slot_name, "count") == 0 ||
+        strcmp(slot_name, "lines") == 0 || strcmp(slot_name, "number") == 0) return INTENT_SLOT_NUMBER;
+    if (strcmp(slot_name, "path") == 0 || strcmp(slot_name, "dir") == 0 ||
+        strcmp(slot_name, "file") == 0) return INTENT_SLOT_PATH;
+    return INTENT_SLOT_NAME;
+}
+
+// Split a line into normalized tokens. `lower` gets the case-folded form used
+// for literal matching, `raw` keeps the user's spelling for slot values.
+static int intent_tokenize(const char* line, char lower[][INTENT_MAX_TOKEN_LEN],
+                           char raw[][INTENT_MAX_TOKEN_LEN], int max_tokens) {
+    int count = 0;
+    const char* p = line;
+    
+    while (*p && count < max_tokens) {
+        while (*p && isspace((unsigned char)*p)) p++;
+        if (!*p) break;
+        
+        size_t len = 0;
+        char word[INTENT_MAX_TOKEN_LEN];
+        while (*p && !isspace((unsigned char)*p)) {
+            // Apostrophes vanish ("what's" -> "whats")
+            if (*p != '\'' && len < sizeof(word) - 1) {
+                word[len++] = *p;
+            }
+            p++;
+        }
+        // Trailing sentence punctuation is not part of the token
+        while (len > 0 && strchr("?!,.:;", word[len - 1])) len--;
+        word[len] = '\0';
+        if (len == 0) continue;
+        
+        char folded[INTENT_MAX_TOKEN_LEN];
+        for (size_t i = 0; i <= len; i++) {
+            folded[i] = (char)tolower((unsigned char)word[i]);
+        }
+        if (intent_is_filler(folded)) continue;
+        
+        memcpy(lower[count], folded, len + 1);
+        memcpy(raw[count], word, len + 1);
+        count++;
+    }
+    return count;
+}
+
+static int intent_new_node(const char* token, intent_slot_t slot) {
+    if (intent_engine.node_count == intent_engine.node_capacity) {
+        int new_capacity = intent_engine.node_capacity ? intent_engine.node_capacity * 2 : 64;
+        intent_node_t* grown = realloc(intent_engine.nodes, new_capacity * sizeof(intent_node_t));
+        if (!grown) return -1;
+        intent_engine.nodes = grown;
+        intent_engine.node_capacity = new_capacity;
+    }
+    
+    int index = intent_engine.node_count++;
+    intent_node_t* node = &intent_engine.nodes[index];
+    node->token = token ? strdup(token) : NULL;
+    node->hash = token ? fnv1a(token, strlen(token)) : 0;
+    node->slot = slot;
+    node->first_child = -1;
+    node->next_sibling = -1;
+    node->template_index = -1;
+    return index;
+}
+
+// Find or create the child edge of `parent` for a literal token or slot
+static int intent_child(int parent, const char* token, intent_slot_t slot) {
+    unsigned int hash = fnv1a(token, strlen(token));
+    int last = -1;
+    for (int c = intent_engine.nodes[parent].first_child; c >= 0; c = intent_engine.nodes[c].next_sibling) {
+        intent_node_t* node = &intent_engine.nodes[c];
+        if (node->slot == slot && node->hash == hash && strcmp(node->token, token) == 0) {
+            return c;
+        }
+        last = c;
+    }
+    
+    int child = intent_new_node(token, slot);
+    if (child < 0) return -1;
+    // Literal edges are tried before slot edges: keep slots at the tail
+    if (slot == INTENT_SLOT_NONE && intent_engine.nodes[parent].first_child >= 0 &&
+        intent_engine.nodes[intent_engine.nodes[parent].first_child].slot != INTENT_SLOT_NONE) {
+        intent_engine.nodes[child].next_sibling = intent_engine.nodes[parent].first_child;
+        intent_engine.nodes[parent].first_child = child;
+    } else if (last >= 0) {
+        intent_engine.nodes[last].next_sibling = child;
+    } else {
+        intent_engine.nodes[parent].first_child = child;
+    }
+    return child;
+}
+
+int add_intent_template(const char* phrase, const char* command) {
+    if (!intent_engine.nodes && intent_new_node(NULL, INTENT_SLOT_NONE) < 0) {
+        return -1;  // Root node
+    }
+    
+    char lower[INTENT_MAX_TOKENS][INTENT_MAX_TOKEN_LEN];
+    char raw[INTENT_MAX_TOKENS][INTENT_MAX_TOKEN_LEN];
+    int count = intent_tokenize(phrase, lower, raw, INTENT_MAX_TOKENS);
+    if (count == 0) return -1;
+    
+    int node = 0;
+    for (int i = 0; i < count && node >= 0; i++) {
+        size_t len = strlen(lower[i]);
+        if (lower[i][0] == '{' && len > 2 && lower[i][len - 1] == '}') {
+            char slot_name[INTENT_MAX_TOKEN_LEN];
+            memcpy(slot_name, lower[i] + 1, len - 2);
+            slot_name[len - 2] = '\0';
+            node = intent_child(node, slot_name, intent_slot_type(slot_name));
+        } else {
+            node = intent_child(node, lower[i], INTENT_SLOT_NONE);
+        }
+    }
+    if (node < 0) return -1;
+    
+    if (intent_engine.template_count == intent_engine.template_capacity) {
+        int new_capacity = intent_engine.template_capacity ? intent_engine.template_capacity * 2 : 32;
+        intent_template_t* grown = realloc(intent_engine.templates, new_capacity * sizeof(intent_template_t));
+        if (!grown) return -1;
+        intent_engine.templates = grown;
+        intent_engine.template_capacity = new_capacity;
+    }
+    
+    // Later definitions (user file) override earlier ones for the same phrase
+    intent_engine.templates[intent_engine.template_count].phrase = strdup(phrase);
+    intent_engine.templates[intent_engine.template_count].command = strdup(command);
+    intent_engine.nodes[node].template_index = intent_engine.template_count++;
+    return 0;
+}
+
+void init_intent_engine(void) {
+    const char* enabled = getenv("INTENT_ENGINE");
+    if (enabled && strcmp(enabled, "0") == 0) return;
+    
+    long compile_start = get_time_ms();
+    
+    for (size_t i = 0; i < sizeof(builtin_intents) / sizeof(builtin_intents[0]); i++) {
+        add_intent_template(builtin_intents[i][0], builtin_intents[i][1]);
+    }
+    
+    // User templates: "phrase => command", '#' comments
+    const char* home = getenv("HOME");
+    if (home) {
+        char intents_path[512];
+        snprintf(intents_path, sizeof(intents_path), "%s/.awesh_intents", home);
+        FILE* file = fopen(intents_path, "r");
+        if (file) {
+            char line[1024];
+            while (fgets(line, sizeof(line), file)) {
+                line[strcspn(line, "\n")] = '\0';
+                if (line[0] == '\0' || line[0] == '#') continue;
+                
+                char* arrow = strstr(line, "=>");
+                if (!arrow) continue;
+                *arrow = '\0';
+                char* command = arrow + 2;
+                while (*command == ' ' || *command == '\t') command++;
+                if (*command == '\0') continue;
+                
+                add_intent_template(line, command);
+            }
+            fclose(file);
+        }
+    }
+    
+    intent_engine.ready = 1;
+    debug_perf("intent automaton compile", compile_start);
+    if (state.verbose >= 2) {
+        fprintf(stderr, "🐛 DEBUG: intent automaton: %d templates, %d states\n",
+                intent_engine.template_count, intent_engine.node_count);
+    }
+}
+
+static int intent_slot_accepts(intent_slot_t slot, const char* value) {
+    if (!*value) return 0;
+    switch (slot) {
+        case INTENT_SLOT_PORT: {
+            for (const char* p = value; *p; p++) {
+                if (!isdigit((unsigned char)*p)) return 0;
+            }
+            long port = strtol(value, NULL, 10);
+            return strlen(value) <= 5 && port >= 1 && port <= 65535;
+        }
+        case INTENT_SLOT_NUMBER:
+            for (const char* p = value; *p; p++) {
+                if (!isdigit((unsigned char)*p)) return 0;
+            }
+            return strlen(value) <= 9;
+        case INTENT_SLOT_PATH:
+            // No quoting or shell metacharacters - values are spliced into a command
+            for (const char* p = value; *p; p++) {
+                if (!isalnum((unsigned char)*p) && !strchr("/._-~+@:,%", *p)) return 0;
+            }
+            return 1;
+        case INTENT_SLOT_NAME:
+            for (const char* p = value; *p; p++) {
+                if (!isalnum((unsigned char)*p) && !strchr("._-*", *p)) return 0;
+            }
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+typedef struct {
+    const char* names[INTENT_MAX_SLOTS];
+    const char* values[INTENT_MAX_SLOTS];
+    int count;
+} intent_captures_t;
+
+static int intent_walk(int node, int pos, int token_count, char lower[][INTENT_MAX_TOKEN_LEN],
+                       char raw[][INTENT_MAX_TOKEN_LEN], intent_captures_t* captures) {
+    if (pos == token_count) {
+        return intent_engine.nodes[node].template_index;
+    }
+    
+    unsigned int hash = fnv1a(lower[pos], strlen(lower[pos]));
+    for (int c = intent_engine.nodes[node].first_child; c >= 0; c = intent_engine.nodes[c].next_sibling) {
+        intent_node_t* child = &intent_engine.nodes[c];
+        if (child->slot == INTENT_SLOT_NONE) {
+            if (child->hash != hash || strcmp(child->token, lower[pos]) != 0) continue;
+            int found = intent_walk(c, pos + 1, token_count, lower, raw, captures);
+            if (found >= 0) return found;
+        } else if (captures->count < INTENT_MAX_SLOTS && intent_slot_accepts(child->slot, raw[pos])) {
+            captures->names[captures->count] = child->token;
+            captures->values[captures->count] = raw[pos];
+            captures->count++;
+            int found = intent_walk(c, pos + 1, token_count, lower, raw, captures);
+            if (found >= 0) return found;
+            captures->count--;
+        }
+    }
+    return -1;
+}
+
+// Match a line against the intent table. On success writes the proposed
+// command (slots substituted) to `command` and returns the template index.
+int match_local_intent(const char* line, char* command, size_t command_size) {
+    if (!intent_engine.ready || intent_engine.node_count == 0) return -1;
+    
+    char lower[INTENT_MAX_TOKENS][INTENT_MAX_TOKEN_LEN];
+    char raw[INTENT_MAX_TOKENS][INTENT_MAX_TOKEN_LEN];
+    int count = intent_tokenize(line, lower, raw, INTENT_MAX_TOKENS);
+    if (count == 0) return -1;
+    
+    intent_captures_t captures = {0};
+    int template_index = intent_walk(0, 0, count, lower, raw, &captures);
+    if (template_index < 0) return -1;
+    
+    // Expand {slot} placeholders in the command template
+    const char* src = intent_engine.templates[template_index].command;
+    size_t out = 0;
+    while (*src && out < command_size - 1) {
+        if (*src == '{') {
+            const char* close = strchr(src, '}');
+            if (close) {
+                size_t name_len = close - src - 1;
+                const char* value = NULL;
+                for (int i = 0; i < captures.count; i++) {
+                    if (strlen(captures.names[i]) == name_len && strncmp(captures.names[i], src + 1, name_len) == 0) {
+                        value = captures.values[i];
+                        break;
+                    }
+                }
+                if (value) {
+                    size_t value_len = strlen(value);
+                    if (out + value_len >= command_size) break;
+                    memcpy(command + out, value, value_len);
+                    out += value_len;
+                    src = close + 1;
+                    continue;
+                }
+            }
+        }
+        command[out++] = *src++;
+    }
+    command[out] = '\0';
+    return template_index;
+}
+
+// Propose a locally matched command. Returns 1 if the line was handled here,
+// 0 if it should continue to the backend (no match, or user chose the LLM).
+int handle_local_intent(const char* cmd) {
+    if (!intent_engine.ready) return 0;
+    // Confirmation needs a terminal; scripted input keeps the old routing
+    if (!isatty(STDIN_FILENO)) return 0;
+    
+    char proposed[MAX_CMD_LEN];
+    long match_start = get_time_ms();
+    if (match_local_intent(cmd, proposed, sizeof(proposed)) < 0) {
+        return 0;
+    }
+    debug_perf("local intent match", match_start);
+    
+    printf("💡 %s\n", proposed);
+    char* answer = readline("   Run it? [Y/n/a=ask AI] ");
+    if (!answer) {
+        printf("\n");
+        return 1;
+    }
+    
+    char choice = answer[0] ? (char)tolower((unsigned char)answer[0]) : 'y';
+    free(answer);
+    
+    if (choice == 'a') {
+        return 0;  // Escalate to the LLM
+    }
+    if (choice == 'y') {
+        add_history(proposed);
+        int result = system(proposed);
+        if (WEXITSTATUS(result) != 0 && state.verbose >= 1) {
+            printf("❌ Command failed (exit %d)\n", WEXITSTATUS(result));
+        }
+    }
+    return 1;
+}
+
+// ============================================================================
+// Offline "which package provides this command" index.
+//
+// A forked indexer walks the local package databases (dpkg, pacman, rpm, the
+// nix store) and cached repository file lists (apt-file Contents files and
+// ~/.awesh_pkglists/) and writes ~/.awesh_pkgindex: a header, a table of
+// fixed-size records sorted by command name, and a string pool. The frontend
+// mmaps it and binary-searches at command-not-found time - no network, no
+// LLM. The indexer reruns in the background whenever a source is newer.
+// ============================================================================
+
+#define PKG_INDEX_MAGIC "AWPKGIX1"
+#define PKG_INDEX_MAX_HINTS 3
+#define PKG_INDEX_MAX_NAME_LEN 64
+
+enum {
+    PKG_SOURCE_DPKG = 1,
+    PKG_SOURCE_APT_CONTENTS,
+    PKG_SOURCE_PACMAN,
+    PKG_SOURCE_RPM,
+    PKG_SOURCE_NIX,
+    PKG_SOURCE_USER_LIST
+};
+
+typedef struct {
+    char magic[8];
+    uint32_t record_count;
+    uint32_t pool_size;
+} pkg_index_header_t;
+
+typedef struct {
+    uint32_t name_offset;     // Command name in the string pool
+    uint32_t package_offset;  // Providing package
+    uint32_t dir_offset;      // Install directory ("" unless installed)
+    uint8_t source;
+    uint8_t installed;
+    uint16_t reserved;
+} pkg_index_record_t;
+
+static struct {
+    const pkg_index_header_t* header;
+    const pkg_index_record_t* records;
+    const char* pool;
+    size_t mapped_size;
+    ino_t mapped_inode;
+    time_t mapped_mtime;
+    pid_t indexer_pid;
+    char path[512];
+} pkg_index = {0};
+
+// Directories whose direct children count as commands (no leading slash)
+static const char* pkg_bin_dirs[] = {
+    "usr/local/sbin/", "usr/local/bin/", "usr/sbin/", "usr/bin/", "sbin/", "bin/", "usr/games/",
+    NULL
+};
+
+// Anything newer than the index triggers a rebuild
+static const char* pkg_index_sources[] = {
+    "/var/lib/dpkg/status", "/var/lib/apt/lists", "/var/lib/pacman/local",
+    "/var/lib/rpm", "/nix/var/nix/db/db.sqlite",
+    NULL
+};
+
+// Builder state - only ever populated inside the indexer child
+typedef struct {
+    pkg_index_record_t* records;
+    uint32_t count;
+    uint32_t capacity;
+    char* pool;
+    uint32_t pool_size;
+    uint32_t pool_capacity;
+    uint32_t dir_offsets[8];  // Interned "/usr/bin" etc., parallel to pkg_bin_dirs
+} pkg_index_builder_t;
+
+static const char* pkg_sort_pool;
+
+int is_package_index_enabled(void) {
+    const char* enabled = getenv("PACKAGE_INDEX");
+    return !(enabled && strcmp(enabled, "0") == 0);  // Enabled by default
+}
+
+static uint32_t pkg_builder_intern(pkg_index_builder_t* builder, const char* text, size_t len) {
+    if (builder->pool_size + len + 1 > builder->pool_capacity) {
+        uint32_t new_capacity = builder->pool_capacity ? builder->pool_capacity * 2 : 64 * 1024;
+        while (builder->pool_size + len + 1 > new_capacity) new_capacity *= 2;
+        char* grown = realloc(builder->pool, new_capacity);
+        if (!grown) return UINT32_MAX;
+        builder->pool = grown;
+        builder->pool_capacity = new_capacity;
+    }
+    uint32_t offset = builder->pool_size;
+    memcpy(builder->pool + offset, text, len);
+    builder->pool[offset + len] = '\0';
+    builder->pool_size += (uint32_t)len + 1;
+    return offset;
+}
+
+// Record `package` as providing `file_path` if it is a direct child of a bin dir
+static void pkg_builder_add(pkg_index_builder_t* builder, const char* file_path, size_t path_len,
+                            const char* package, size_t package_len, int source, int installed) {
+    while (path_len > 0 && *file_path == '/') {
+        file_path++;
+        path_len--;
+    }
+    if (package_len == 0) return;
+    
+    for (int i = 0; pkg_bin_dirs[i]; i++) {
+        size_t dir_len = strlen(pkg_bin_dirs[i]);
+        if (path_len <= dir_len || strncmp(file_path, pkg_bin_dirs[i], dir_len) != 0) continue;
+        
+        const char* name = file_path + dir_len;
+        size_t name_len = path_len - dir_len;
+        if (memchr(name, '/', name_len) || name_len >= PKG_INDEX_MAX_NAME_LEN) return;
+        
+        if (builder->count == builder->capacity) {
+            uint32_t new_capacity = builder->capacity ? builder->capacity * 2 : 4096;
+            pkg_index_record_t* grown = realloc(builder->records, new_capacity * sizeof(pkg_index_record_t));
+            if (!grown) return;
+            builder->records = grown;
+            builder->capacity = new_capacity;
+        }
+        
+        pkg_index_record_t record = {0};
+        record.name_offset = pkg_builder_intern(builder, name, name_len);
+        record.package_offset = pkg_builder_intern(builder, package, package_len);
+        record.dir_offset = installed ? builder->dir_offsets[i] : 0;
+        record.source = (uint8_t)source;
+        record.installed = (uint8_t)installed;
+        if (record.name_offset == UINT32_MAX || record.package_offset == UINT32_MAX) return;
+        builder->records[builder->count++] = record;
+        return;
+    }
+}
+
+// dpkg: one /var/lib/dpkg/info/<package>[:arch].list per installed package
+static void pkg_index_scan_dpkg(pkg_index_builder_t* builder) {
+    DIR* dir = opendir("/var/lib/dpkg/info");
+    if (!dir) return;
+    
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        size_t len = strlen(entry->d_name);
+        if (len <= 5 || strcmp(entry->d_name + len - 5, ".list") != 0) continue;
+        
+        char package[256];
+        snprintf(package, sizeof(package), "%.*s", (int)(len - 5), entry->d_name);
+        package[strcspn(package, ":")] = '\0';
+        
+        char list_path[512];
+        snprintf(list_path, sizeof(list_path), "/var/lib/dpkg/info/%s", entry->d_name);
+        FILE* file = fopen(list_path, "r");
+        if (!file) continue;
+        
+        char line[1024];
+        while (fgets(line, sizeof(line), file)) {
+            size_t line_len = strcspn(line, "\n");
+            pkg_builder_add(builder, line, line_len, package, strlen(package), PKG_SOURCE_DPKG, 1);
+        }
+        fclose(file);
+    }
+    closedir(dir);
+}
+
+// pacman: /var/lib/pacman/local/<pkg-ver>/{desc,files}
+static void pkg_index_scan_pacman(pkg_index_builder_t* builder) {
+    DIR* dir = opendir("/var/lib/pacman/local");
+    if (!dir) return;
+    
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') continue;
+        
+        char file_path[512];
+        char line[1024];
+        char package[256] = {0};
+        
+        snprintf(file_path, sizeof(file_path), "/var/lib/pacman/local/%s/desc", entry->d_name);
+        FILE* file = fopen(file_path, "r");
+        if (!file) continue;
+        while (fgets(line, sizeof(line), file)) {
+            if (strcmp(line, "%NAME%\n") == 0) {
+                if (fgets(line, sizeof(line), file)) {
+                    line[strcspn(line, "\n")] = '\0';
+                    snprintf(package, sizeof(package), "%.255s", line);
+                }
+                break;
+            }
+        }
+        fclose(file);
+        if (package[0] == '\0') continue;
+        
+        snprintf(file_path, sizeof(file_path), "/var/lib/pacman/local/%s/files", entry->d_name);
+        file = fopen(file_path, "r");
+        if (!file) continue;
+        int in_files = 0;
+        while (fgets(line, sizeof(line), file)) {
+            size_t line_len = strcspn(line, "\n");
+            if (line_len == 0) {
+                in_files = 0;
+            } else if (line[0] == '%') {
+                in_files = (strncmp(line, "%FILES%", 7) == 0);
+            } else if (in_files) {
+                pkg_builder_add(builder, line, line_len, package, strlen(package), PKG_SOURCE_PACMAN, 1);
+            }
+        }
+        fclose(file);
+    }
+    closedir(dir);
+}
+
+// rpm keeps its database in BDB/sqlite, so ask the local rpm binary
+static void pkg_index_scan_rpm(pkg_index_builder_t* builder) {
+    if (access("/var/lib/rpm", F_OK) != 0) return;
+    
+    FILE* pipe = popen("rpm -qa --qf '[%{FILENAMES}\\t%{NAME}\\n]' 2>/dev/null", "r");
+    if (!pipe) return;
+    
+    char line[1024];
+    while (fgets(line, sizeof(line), pipe)) {
+        line[strcspn(line, "\n")] = '\0';
+        char* tab = strchr(line, '\t');
+        if (!tab) continue;
+        pkg_builder_add(builder, line, (size_t)(tab - line), tab + 1, strlen(tab + 1), PKG_SOURCE_RPM, 1);
+    }
+    pclose(pipe);
+}
+
+// nix: /nix/store/<32-char hash>-<name>-<version>/bin/*
+static void pkg_index_scan_nix(pkg_index_builder_t* builder) {
+    DIR* store = opendir("/nix/store");
+    if (!store) return;
+    
+    struct dirent* entry;
+    while ((entry = readdir(store)) != NULL) {
+        if (strlen(entry->d_name) <= 33 || entry->d_name[32] != '-') continue;
+        
+        // Attribute name is the store name up to the first "-<digit>"
+        const char* store_name = entry->d_name + 33;
+        size_t name_len = strlen(store_name);
+        for (size_t i = 0; store_name[i]; i++) {
+            if (store_name[i] == '-' && isdigit((unsigned char)store_name[i + 1])) {
+                name_len = i;
+                break;
+            }
+        }
+        
+        char bin_path[512];
+        snprintf(bin_path, sizeof(bin_path), "/nix/store/%s/bin", entry->d_name);
+        DIR* bin = opendir(bin_path);
+        if (!bin) continue;
+        
+        struct dirent* command;
+        while ((command = readdir(bin)) != NULL) {
+            if (command->d_name[0] == '.') continue;
+            char file_path[320];
+            int len = snprintf(file_path, sizeof(file_path), "bin/%s", command->d_name);
+            if (len <= 0 || (size_t)len >= sizeof(file_path)) continue;
+            pkg_builder_add(builder, file_path, (size_t)len, store_name, name_len, PKG_SOURCE_NIX, 0);
+        }
+        closedir(bin);
+    }
+    closedir(store);
+}
+
+// Contents format: "usr/bin/foo    section/pkg1,section/pkg2"
+static void pkg_index_parse_contents(pkg_index_builder_t* builder, FILE* file, int source) {
+    char line[2048];
+    while (fgets(line, sizeof(line), file)) {
+        size_t len = strcspn(line, "\n");
+        line[len] = '\0';
+        
+        char* packages = strrchr(line, ' ');
+        char* tab = strrchr(line, '\t');
+        if (!packages || (tab && tab > packages)) packages = tab;
+        if (!packages) continue;
+        
+        char* path_end = packages;
+        while (path_end > line && (path_end[-1] == ' ' || path_end[-1] == '\t')) path_end--;
+        packages++;
+        
+        char* save = NULL;
+        for (char* package = strtok_r(packages, ",", &save); package; package = strtok_r(NULL, ",", &save)) {
+            char* slash = strrchr(package, '/');
+            if (slash) package = slash + 1;
+            pkg_builder_add(builder, line, (size_t)(path_end - line), package, strlen(package), source, 0);
+        }
+    }
+}
+
+static void pkg_index_scan_contents_dir(pkg_index_builder_t* builder, const char* dir_path,
+                                        const char* name_filter, int source) {
+    DIR* dir = opendir(dir_path);
+    if (!dir) return;
+    
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        const char* name = entry->d_name;
+        if (name[0] == '.' || (name_filter && !strstr(name, name_filter))) continue;
+        if (strstr(name, ".diff") || strchr(name, '\'')) continue;
+        
+        char file_path[1024];
+        snprintf(file_path, sizeof(file_path), "%s/%s", dir_path, name);
+        size_t len = strlen(name);
+        
+        // apt-file stores these compressed; decompress locally through a pipe
+        const char* decompressor = NULL;
+        if (len > 3 && strcmp(name + len - 3, ".gz") == 0) decompressor = "gzip -dc";
+        else if (len > 4 && strcmp(name + len - 4, ".lz4") == 0) decompressor = "lz4 -dc";
+        else if (len > 3 && strcmp(name + len - 3, ".xz") == 0) decompressor = "xz -dc";
+        
+        if (decompressor) {
+            char command[1200];
+            snprintf(command, sizeof(command), "%s '%s' 2>/dev/null", decompressor, file_path);
+            FILE* pipe = popen(command, "r");
+            if (!pipe) continue;
+            pkg_index_parse_contents(builder, pipe, source);
+            pclose(pipe);
+        } else {
+            FILE* file = fopen(file_path, "r");
+            if (!file) continue;
+            pkg_index_parse_contents(builder, file, source);
+            fclose(file);
+        }
+    }
+    closedir(dir);
+}
+
+static int pkg_record_compare(const void* a, const void* b) {
+    const pkg_index_record_t* left = a;
+    const pkg_index_record_t* right = b;
+    int result = strcmp(pkg_sort_pool + left->name_offset, pkg_sort_pool + right->name_offset);
+    if (result != 0) return result;
+    // Installed providers first so they survive deduplication and rank first
+    if (left->installed != right->installed) return right->installed - left->installed;
+    return strcmp(pkg_sort_pool + left->package_offset, pkg_sort_pool + right->package_offset);
+}
+
+// Runs in the indexer child: scan every source, sort, write, rename into place
+static int write_package_index(const char* index_path) {
+    pkg_index_builder_t builder = {0};
+    pkg_builder_intern(&builder, "", 0);  // Offset 0 is the empty string
+    for (int i = 0; pkg_bin_dirs[i] && i < 8; i++) {
+        char dir[64];
+        snprintf(dir, sizeof(dir), "/%.*s", (int)strlen(pkg_bin_dirs[i]) - 1, pkg_bin_dirs[i]);
+        builder.dir_offsets[i] = pkg_builder_intern(&builder, dir, strlen(dir));
+    }
+    
+    pkg_index_scan_dpkg(&builder);
+    pkg_index_scan_pacman(&builder);
+    pkg_index_scan_rpm(&builder);
+    pkg_index_scan_nix(&builder);
+    pkg_index_scan_contents_dir(&builder, "/var/lib/apt/lists", "Contents-", PKG_SOURCE_APT_CONTENTS);
+    
+    const char* home = getenv("HOME");
+    if (home) {
+        char lists_dir[512];
+        snprintf(lists_dir, sizeof(lists_dir), "%s/.awesh_pkglists", home);
+        pkg_index_scan_contents_dir(&builder, lists_dir, NULL, PKG_SOURCE_USER_LIST);
+    }
+    
+    pkg_sort_pool = builder.pool;
+    if (builder.count > 0) {
+        qsort(builder.records, builder.count, sizeof(pkg_index_record_t), pkg_record_compare);
+    }
+    
+    // The same name/package pair usually shows up in several sources
+    uint32_t unique = 0;
+    for (uint32_t i = 0; i < builder.count; i++) {
+        if (unique > 0) {
+            const pkg_index_record_t* last = &builder.records[unique - 1];
+            const pkg_index_record_t* cur = &builder.records[i];
+            if (strcmp(builder.pool + last->name_offset, builder.pool + cur->name_offset) == 0 &&
+                strcmp(builder.pool + last->package_offset, builder.pool + cur->package_offset) == 0) {
+                continue;
+            }
+        }
+        builder.records[unique++] = builder.records[i];
+    }
+    
+    char temp_path[600];
+    snprintf(temp_path, sizeof(temp_path), "%s.%d.tmp", index_path, (int)getpid());
+    FILE* out = fopen(temp_path, "wb");
+    if (!out) return -1;
+    
+    pkg_index_header_t header = {0};
+    memcpy(header.magic, PKG_INDEX_MAGIC, sizeof(header.magic));
+    header.record_count = unique;
+    header.pool_size = builder.pool_size;
+    
+    int ok = fwrite(&header, sizeof(header), 1, out) == 1 &&
+             (unique == 0 || fwrite(builder.records, sizeof(pkg_index_record_t), unique, out) == unique) &&
+             fwrite(builder.pool, 1, builder.pool_size, out) == builder.pool_size;
+    ok = (fclose(out) == 0) && ok;
+    
+    free(builder.records);
+    free(builder.pool);
+    
+    if (!ok || rename(temp_path, index_path) != 0) {
+        unlink(temp_path);
+        return -1;
+    }
+    return 0;
+}
+
+// Newest mtime across the package databases and cached file lists
+static time_t package_sources_mtime(void) {
+    time_t newest = 0;
+    struct stat st;
+    for (int i = 0; pkg_index_sources[i]; i++) {
+        if (stat(pkg_index_sources[i], &st) == 0 && st.st_mtime > newest) newest = st.st_mtime;
+    }
+    const char* home = getenv("HOME");
+    if (home) {
+        char lists_dir[512];
+        snprintf(lists_dir, sizeof(lists_dir), "%s/.awesh_pkglists", home);
+        if (stat(lists_dir, &st) == 0 && st.st_mtime > newest) newest = st.st_mtime;
+    }
+    return newest;
+}
+
+// Called at startup: fork the indexer if the on-disk index is missing or stale
+void refresh_package_index(void) {
+    if (!is_package_index_enabled() || pkg_index.indexer_pid > 0) return;
+    
+    const char* home = getenv("HOME");
+    if (!home) return;
+    snprintf(pkg_index.path, sizeof(pkg_index.path), "%s/.awesh_pkgindex", home);
+    
+    struct stat st;
+    if (stat(pkg_index.path, &st) == 0 && st.st_mtime >= package_sources_mtime()) return;
+    
+    pid_t pid = fork();
+    if (pid == 0) {
+        // Indexer child: stay out of the way of the interactive shell
+        signal(SIGINT, SIG_IGN);
+        if (nice(10) == -1) { /* best effort */ }
+        long build_start = get_time_ms();
+        int result = write_package_index(pkg_index.path);
+        debug_perf("package index build", build_start);
+        _exit(result == 0 ? 0 : 1);
+    }
+    if (pid > 0) {
+        pkg_index.indexer_pid = pid;
+        if (state.verbose >= 2) {
+            printf("📦 Package index: rebuilding in background (pid %d)\n", pid);
+        }
+    }
+}
+
+// Collect the indexer once it exits, so it does not linger as a zombie
+void reap_package_indexer(void) {
+    if (pkg_index.indexer_pid > 0 && waitpid(pkg_index.indexer_pid, NULL, WNOHANG) != 0) {
+        pkg_index.indexer_pid = 0;
+    }
+}
+
+// Map (or remap after a rebuild) the index; returns 0 when usable
+static int map_package_index(void) {
+    reap_package_indexer();
+    if (pkg_index.path[0] == '\0') return -1;
+    
+    struct stat st;
+    if (stat(pkg_index.path, &st) != 0) return -1;
+    if (pkg_index.header && st.st_ino == pkg_index.mapped_inode && st.st_mtime == pkg_index.mapped_mtime) {
+        return 0;
+    }
+    
+    if (pkg_index.header) {
+        munmap((void*)pkg_index.header, pkg_index.mapped_size);
+        pkg_index.header = NULL;
+    }
+    if ((size_t)st.st_size < sizeof(pkg_index_header_t)) return -1;
+    
+    int fd = open(pkg_index.path, O_RDONLY);
+    if (fd < 0) return -1;
+    void* mapped = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) return -1;
+    
+    const pkg_index_header_t* header = mapped;
+    size_t expected = sizeof(pkg_index_header_t) +
+                      (size_t)header->record_count * sizeof(pkg_index_record_t) + header->pool_size;
+    int valid = memcmp(header->magic, PKG_INDEX_MAGIC, sizeof(header->magic)) == 0 &&
+                expected == (size_t)st.st_size && header->pool_size > 0;
+    
+    // Lookups trust every offset, so a corrupt file is rejected here, once
+    const pkg_index_record_t* records = (const pkg_index_record_t*)(header + 1);
+    const char* pool = (const char*)(records + (valid ? header->record_count : 0));
+    valid = valid && pool[header->pool_size - 1] == '\0';
+    for (uint32_t i = 0; valid && i < header->record_count; i++) {
+        valid = records[i].name_offset < header->pool_size && records[i].package_offset < header->pool_size &&
+                records[i].dir_offset < header->pool_size;
+    }
+    if (!valid) {
+        munmap(mapped, (size_t)st.st_size);
+        return -1;
+    }
+    
+    pkg_index.header = header;
+    pkg_index.records = records;
+    pkg_index.pool = pool;
+    pkg_index.mapped_size = (size_t)st.st_size;
+    pkg_index.mapped_inode = st.st_ino;
+    pkg_index.mapped_mtime = st.st_mtime;
+    return 0;
+}
+
+// Fill `records` with up to `max` providers of `name`; returns how many
+int lookup_command_packages(const char* name, const pkg_index_record_t** records, int max) {
+    if (!is_package_index_enabled() || map_package_index() != 0) return 0;
+    
+    uint32_t low = 0;
+    uint32_t high = pkg_index.header->record_count;
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        if (strcmp(pkg_index.pool + pkg_index.records[mid].name_offset, name) < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    
+    int found = 0;
+    for (uint32_t i = low; i < pkg_index.header->record_count && found < max; i++) {
+        if (strcmp(pkg_index.pool + pkg_index.records[i].name_offset, name) != 0) break;
+        records[found++] = &pkg_index.records[i];
+    }
+    return found;
+}
+
+static const char* package_install_command(int source) {
+    switch (source) {
+        case PKG_SOURCE_DPKG:
+        case PKG_SOURCE_APT_CONTENTS: return "sudo apt install";
+        case PKG_SOURCE_PACMAN:       return "sudo pacman -S";
+        case PKG_SOURCE_RPM:          return "sudo dnf install";
+        case PKG_SOURCE_NIX:          return "nix-shell -p";
+        default: break;
+    }
+    // User lists: use whatever package manager this host has
+    if (access("/var/lib/dpkg", F_OK) == 0) return "sudo apt install";
+    if (access("/var/lib/pacman", F_OK) == 0) return "sudo pacman -S";
+    if (access("/var/lib/rpm", F_OK) == 0) return "sudo dnf install";
+    return "install";
+}
+
+// Print an install hint for `name`; returns 1 if the index knew it
+int show_package_hint(const char* name) {
+    long lookup_start = get_time_ms();
+    const pkg_index_record_t* records[PKG_INDEX_MAX_HINTS];
+    int count = lookup_command_packages(name, records, PKG_INDEX_MAX_HINTS);
+    debug_perf("package index lookup", lookup_start);
+    if (count == 0) return 0;
+    
+    const char* package = pkg_index.pool + records[0]->package_offset;
+    if (records[0]->installed) {
+        printf("📦 %s is installed by package %s at %s/%s, but that directory is not on PATH\n",
+               name, package, pkg_index.pool + records[0]->dir_offset, name);
+    } else {
+        printf("📦 %s is provided by package %s - install with: %s %s\n",
+               name, package, package_install_command(records[0]->source), package);
+    }
+    if (count > 1) {
+        printf("   (also in:");
+        for (int i = 1; i < count; i++) printf(" %s", pkg_index.pool + records[i]->package_offset);
+        printf(")\n");
+    }
+    return 1;
+}
+
+// ============================================================================
+// Typo correction index for command-not-found (exit 127).
+//
+// A BK-tree over PATH executables, shell builtins, awesh builtins and aliases,
+// with Damerau (optimal string alignment) distance so "gti" -> "git" is one
+// edit. Each name carries a usage weight from ~/.bash_history and this
+// session's successful commands, used to rank equally close candidates.
+// Built lazily on the first miss and rebuilt when PATH changes.
+// ============================================================================
+
+#define TYPO_MAX_NAME_LEN 64
+#define TYPO_MAX_SUGGESTIONS 3
+#define TYPO_HISTORY_SCAN_LINES 5000
+
+typedef struct {
+    char name[TYPO_MAX_NAME_LEN];
+    int weight;            // Usage count from history
+    int distance;          // Edit distance to parent
+    int first_child;
+    int next_sibling;
+} typo_node_t;
+
+static struct {
+    typo_node_t* nodes;
+    int count;
+    int capacity;
+    char* path_snapshot;   // PATH the index was built from
+    int ready;
+} typo_index = {0};
+
+static const char* shell_builtin_names[] = {
+    "alias", "bg", "bind", "break", "builtin", "caller", "cd", "command", "compgen",
+    "complete", "continue", "declare", "dirs", "disown", "echo", "enable", "eval",
+    "exec", "exit", "export", "false", "fc", "fg", "getopts", "hash", "help",
+    "history", "jobs", "kill", "let", "local", "logout", "popd", "printf", "pushd",
+    "pwd", "read", "readonly", "return", "set", "shift", "shopt", "source",
+    "suspend", "test", "times", "trap", "true", "type", "typeset", "ulimit",
+    "umask", "unalias", "unset", "wait",
+    // awesh builtins
+    "aweh", "awes", "awev", "awea", "awem", "awej", "awep", "awew", "awec", "awet", "awef", "quit",
+    NULL
+};
+
+// Optimal string alignment distance, abandoned once every cell exceeds max
+static int osa_distance(const char* a, const char* b, int max) {
+    int la = (int)strlen(a);
+    int lb = (int)strlen(b);
+    if (abs(la - lb) > max) return max + 1;
+    if (la >= TYPO_MAX_NAME_LEN || lb >= TYPO_MAX_NAME_LEN) return max + 1;
+    
+    int rows[3][TYPO_MAX_NAME_LEN + 1];
+    int* prev2 = rows[0];
+    int* prev = rows[1];
+    int* cur = rows[2];
+    
+    for (int j = 0; j <= lb; j++) prev[j] = j;
+    
+    for (int i = 1; i <= la; i++) {
+        cur[0] = i;
+        int row_min = cur[0];
+        for (int j = 1; j <= lb; j++) {
+            int cost = (a[i - 1] == b[j - 1]) ? 0 : 1;
+            int best = prev[j] + 1;
+            if (cur[j - 1] + 1 < best) best = cur[j - 1] + 1;
+            if (prev[j - 1] + cost < best) best = prev[j - 1] + cost;
+            if (i > 1 && j > 1 && a[i - 1] == b[j - 2] && a[i - 2] == b[j - 1] &&
+                prev2[j - 2] + 1 < best) {
+                best = prev2[j - 2] + 1;
+            }
+            cur[j] = best;
+            if (best < row_min) row_min = best;
+        }
+        if (row_min > max) return max + 1;
+        int* rotate = prev2;
+        prev2 = prev;
+        prev = cur;
+        cur = rotate;
+    }
+    return prev[lb];
+}
+
+// Insert a name; returns the node index (existing node if already present)
+static int typo_index_insert(const char* name) {
+    size_t len = strlen(name);
+    if (len == 0 || len >= TYPO_MAX_NAME_LEN) return -1;
+    
+    if (typo_index.count == typo_index.capacity) {
+        int new_capacity = typo_index.capacity ? typo_index.capacity * 2 : 1024;
+        typo_node_t* grown = realloc(typo_index.nodes, new_capacity * sizeof(typo_node_t));
+        if (!grown) return -1;
+        typo_index.nodes = grown;
+        typo_index.capacity = new_capacity;
+    }
+    
+    typo_node_t fresh;
+    memcpy(fresh.name, name, len + 1);
+    fresh.weight = 0;
+    fresh.first_child = -1;
+    fresh.next_sibling = -1;
+    
+    if (typo_index.count == 0) {
+        fresh.distance = 0;
+        typo_index.nodes[typo_index.count++] = fresh;
+        return 0;
+    }
+    
+    int node = 0;
+    while (1) {
+        int d = osa_distance(name, typo_index.nodes[node].name, TYPO_MAX_NAME_LEN);
+        if (d == 0) return node;
+        
+        int child = typo_index.nodes[node].first_child;
+        int last = -1;
+        while (child >= 0 && typo_index.nodes[child].distance != d) {
+            last = child;
+            child = typo_index.nodes[child].next_sibling;
+        }
+        if (child >= 0) {
+            node = child;
+            continue;
+        }
+        
+        fresh.distance = d;
+        int index = typo_index.count++;
+        typo_index.nodes[index] = fresh;
+        if (last >= 0) {
+            typo_index.nodes[last].next_sibling = index;
+        } else {
+            typo_index.nodes[node].first_child = index;
+        }
+        return index;
+    }
+}
+
+// Exact lookup (distance 0 walk)
+static int typo_index_find(const char* name) {
+    if (typo_index.count == 0) return -1;
+    int node = 0;
+    while (node >= 0) {
+        int d = osa_distance(name, typo_index.nodes[node].name, TYPO_MAX_NAME_LEN);
+        if (d == 0) return node;
+        int child = typo_index.nodes[node].first_child;
+        while (child >= 0 && typo_index.nodes[child].distance != d) {
+            child = typo_index.nodes[child].next_sibling;
+        }
+        node = child;
+    }
+    return -1;
+}
+
+void typo_index_record_usage(const char* cmd) {
+    if (!typo_index.ready) return;  // History is picked up when the index is built
+    char first_word[TYPO_MAX_NAME_LEN] = {0};
+    if (sscanf(cmd, "%63s", first_word) != 1) return;
+    int node = typo_index_find(first_word);
+    if (node >= 0) typo_index.nodes[node].weight++;
+}
+
+static void typo_index_count_history_line(const char* line) {
+    char first_word[TYPO_MAX_NAME_LEN] = {0};
+    if (sscanf(line, "%63s", first_word) != 1) return;
+    int node = typo_index_find(first_word);
+    if (node >= 0) typo_index.nodes[node].weight++;
+}
+
+static void typo_index_load_aliases(const char* path) {
+    FILE* file = fopen(path, "r");
+    if (!file) return;
+    char line[512];
+    while (fgets(line, sizeof(line), file)) {
+        char* p = line;
+        while (*p == ' ' || *p == '\t') p++;
+        if (strncmp(p, "alias ", 6) != 0) continue;
+        p += 6;
+        char* equals = strchr(p, '=');
+        if (!equals) continue;
+        *equals = '\0';
+        typo_index_insert(p);
+    }
+    fclose(file);
+}
+
+void build_typo_index(void) {
+    long build_start = get_time_ms();
+    
+    typo_index.count = 0;
+    typo_index.ready = 0;
+    free(typo_index.path_snapshot);
+    
+    const char* path_env = getenv("PATH");
+    typo_index.path_snapshot = strdup(path_env ? path_env : "");
+    
+    for (int i = 0; shell_builtin_names[i]; i++) {
+        typo_index_insert(shell_builtin_names[i]);
+    }
+    
+    // PATH executables (directory entries; no per-file stat for speed)
+    if (path_env) {
+        char* path_copy = strdup(path_env);
+        char* saveptr = NULL;
+        for (char* dir = strtok_r(path_copy, ":", &saveptr); dir; dir = strtok_r(NULL, ":", &saveptr)) {
+            DIR* d = opendir(dir);
+            if (!d) continue;
+            struct dirent* entry;
+            while ((entry = readdir(d)) != NULL) {
+                if (entry->d_name[0] == '.') continue;
+                if (entry->d_type == DT_DIR) continue;
+                typo_index_insert(entry->d_name);
+            }
+            closedir(d);
+        }
+        free(path_copy);
+    }
+    
+    const char* home = getenv("HOME");
+    if (home) {
+        char alias_path[512];
+        snprintf(alias_path, sizeof(alias_path), "%s/.bash_aliases", home);
+        typo_index_load_aliases(alias_path);
+        snprintf(alias_path, sizeof(alias_path), "%s/.bashrc", home);
+        typo_index_load_aliases(alias_path);
+    }
+    
+    // Usage weights: tail of ~/.bash_history plus this session's readline history
+    if (home) {
+        char history_path[512];
+        snprintf(history_path, sizeof(history_path), "%s/.bash_history", home);
+        FILE* file = fopen(history_path, "r");
+        if (file) {
+            // Skip to roughly the last TYPO_HISTORY_SCAN_LINES lines
+            if (fseek(file, 0, SEEK_END) == 0) {
+                long size = ftell(file);
+                long start = size - (long)TYPO_HISTORY_SCAN_LINES * 40;
+                if (start > 0) {
+                    fseek(file, start, SEEK_SET);
+                    char skip[512];
+                    if (!fgets(skip, sizeof(skip), file)) { /* partial line */ }
+                } else {
+                    fseek(file, 0, SEEK_SET);
+                }
+            }
+            char line[512];
+            while (fgets(line, sizeof(line), file)) {
+                typo_index_count_history_line(line);
+            }
+            fclose(file);
+        }
+    }
+    HIST_ENTRY** entries = history_list();
+    if (entries) {
+        for (int i = 0; entries[i]; i++) {
+            typo_index_count_history_line(entries[i]->line);
+        }
+    }
+    
+    typo_index.ready = 1;
+    debug_perf("typo index build", build_start);
+    if (state.verbose >= 2) {
+        fprintf(stderr, "🐛 DEBUG: typo index: %d names\n", typo_index.count);
+    }
+}
+
+static void typo_index_search(int node, const char* word, int max, int* best_d,
+                              int* found, int* found_d, int* found_count) {
+    // BK-tree pruning needs the exact distance, not a cut-off one
+    int d = osa_distance(word, typo_index.nodes[node].name, TYPO_MAX_NAME_LEN);
+    if (d <= max && d > 0) {
+        // Keep the TYPO_MAX_SUGGESTIONS best by (distance, weight desc)
+        int pos = *found_count;
+        while (pos > 0) {
+            typo_node_t* other = &typo_index.nodes[found[pos - 1]];
+            if (found_d[pos - 1] < d || (found_d[pos - 1] == d && other->weight >= typo_index.nodes[node].weight)) break;
+            pos--;
+        }
+        if (pos < TYPO_MAX_SUGGESTIONS) {
+            int last = (*found_count < TYPO_MAX_SUGGESTIONS) ? *found_count : TYPO_MAX_SUGGESTIONS - 1;
+            for (int i = last; i > pos; i--) {
+                found[i] = found[i - 1];
+                found_d[i] = found_d[i - 1];
+            }
+            found[pos] = node;
+            found_d[pos] = d;
+            if (*found_count < TYPO_MAX_SUGGESTIONS) (*found_count)++;
+        }
+        if (d < *best_d) *best_d = d;
+    }
+    
+    // Triangle inequality: only children with |child.distance - d| <= max can match
+    for (int c = typo_index.nodes[node].first_child; c >= 0; c = typo_index.nodes[c].next_sibling) {
+        if (abs(typo_index.nodes[c].distance - d) <= max) {
+            typo_index_search(c, word, max, best_d, found, found_d, found_count);
+        }
+    }
+}
+
+// Fill `suggestions` with up to TYPO_MAX_SUGGESTIONS names; returns how many
+int suggest_command_corrections(const char* word, const char** suggestions) {
+    const char* path_env = getenv("PATH");
+    if (!typo_index.ready || strcmp(typo_index.path_snapshot, path_env ? path_env : "") != 0) {
+        build_typo_index();
+    }
+    if (typo_index.count == 0) return 0;
+    
+    int len = (int)strlen(word);
+    int max = (len <= 4) ? 1 : 2;
+    int best_d = max + 1;
+    int found[TYPO_MAX_SUGGESTIONS];
+    int found_d[TYPO_MAX_SUGGESTIONS];
+    int found_count = 0;
+    
+    typo_index_search(0, word, max, &best_d, found, found_d, &found_count);
+    
+    for (int i = 0; i < found_count; i++) {
+        suggestions[i] = typo_index.nodes[found[i]].name;
+    }
+    return found_count;
+}
+
+// Exit 127: offer an install hint or "did you mean" from the local indexes.
+// Returns 1 if handled, 0 if nothing fits and the line should go to the backend.
+int handle_command_not_found(const char* cmd) {
+    char first_word[TYPO_MAX_NAME_LEN] = {0};
+    if (sscanf(cmd, "%63s", first_word) != 1) return 0;
+    if (strchr(first_word, '/')) return 0;  // Explicit paths are not typos
+    
+    long search_start = get_time_ms();
+    const char* suggestions[TYPO_MAX_SUGGESTIONS];
+    int count = suggest_command_corrections(first_word, suggestions);
+    debug_perf("typo index lookup", search_start);
+    
+    // The first word exists - 127 came from somewhere inside the command
+    if (typo_index_find(first_word) >= 0) return 0;
+    
+    // A real command that just isn't installed beats a guess at a typo
+    if (show_package_hint(first_word)) return 1;
+    if (count == 0) return 0;
+    
+    // Rebuild the line with the corrected first word
+    const char* rest = strstr(cmd, first_word) + strlen(first_word);
+    char corrected[MAX_CMD_LEN];
+    snprintf(corrected, sizeof(corrected), "%s%s", suggestions[0], rest);
+    
+    printf("💡 Did you mean: %s", corrected);
+    if (count > 1) {
+        printf("  (also:");
+        for (int i = 1; i < count; i++) printf(" %s", suggestions[i]);
+        printf(")");
+    }
+    printf("\n");
+    
+    if (!isatty(STDIN_FILENO)) return 1;
+    
+    char* answer = readline("   Run it? [Y/n] ");
+    if (!answer) {
+        printf("\n");
+        return 1;
+    }
+    char choice = answer[0] ? (char)tolower((unsigned char)answer[0]) : 'y';
+    free(answer);
+    
+    if (choice == 'y') {
+        add_history(corrected);
+        int result = system(corrected);
+        if (WEXITSTATUS(result) == 0) {
+            typo_index_record_usage(corrected);
+        } else if (state.verbose >= 1) {
+            printf("❌ Command failed (exit %d)\n", WEXITSTATUS(result));
+        }
+    }
+    return 1;
+}
+
+// ============================================================================
+// Frecency directory index (awej).
+//
+// Every successful chdir is recorded in ~/.awesh_dirs, one file shared by all
+// awesh sessions and mapped MAP_SHARED: a header, then variable-size entries
+// (rank, last visit, path hash, character set, path, case-folded path) packed
+// back to back. The character set is a 64-bit mask that rules out most
+// entries before any string compare. A visit adds 1 to
+// the directory's rank; once the ranks sum past DIR_INDEX_MAX_RANK they are
+// all scaled down and entries that fall below 1 are dropped, so the file stays
+// a few hundred KB however many visits it has seen. awej ranks directories by
+// how well they match, then by rank weighted by recency. Sessions serialise on
+// flock(); a session that finds the file grown by another simply remaps it.
+// ============================================================================
+
+#define DIR_INDEX_MAGIC "AWDIRDB1"
+#define DIR_INDEX_MAX_RANK 10000.0f         // Aging threshold for the sum of all ranks
+#define DIR_INDEX_INITIAL_SIZE (64 * 1024)
+#define DIR_JUMP_MAX_TERMS 8
+#define DIR_JUMP_MAX_RESULTS 10
+
+typedef struct {
+    char magic[8];
+    uint32_t used;            // Bytes of entries after the header
+    uint32_t count;
+    float total_rank;
+    uint32_t reserved;
+} dir_index_header_t;
+
+typedef struct {
+    float rank;               // 0 = forgotten, dropped at the next aging
+    uint32_t last_visit;      // Unix time
+    uint64_t characters;      // dir_character_mask() of the path
+    uint32_t hash;            // FNV-1a of the path
+    uint16_t length;          // Path length, without the NUL
+    uint16_t size;            // Whole entry, padded to 8 bytes
+} dir_entry_t;                // char path[length + 1], then the path case-folded, follow
+
+typedef struct {
+    char path[PATH_MAX];
+    float score;
+    int quality;              // 3 = last term in the last component, 2 = substrings in order, 1 = subsequence
+} dir_match_t;
+
+static struct {
+    dir_index_header_t* header;
+    size_t mapped_size;
+    int fd;
+    char path[512];
+} dir_index = {NULL, 0, -1, ""};
+
+int is_dir_index_enabled(void) {
+    const char* enabled = getenv("DIR_INDEX");
+    return !(enabled && strcmp(enabled, "0") == 0);  // Enabled by default
+}
+
+// One bit per case-folded letter and digit, the rest share the high bits
+static uint64_t dir_character_mask(const char* text) {
+    uint64_t mask = 0;
+    for (const unsigned char* c = (const unsigned char*)text; *c; c++) {
+        int folded = tolower(*c);
+        if (folded >= 'a' && folded <= 'z') mask |= 1ull << (folded - 'a');
+        else if (folded >= '0' && folded <= '9') mask |= 1ull << (26 + folded - '0');
+        else mask |= 1ull << (36 + folded % 28);
+    }
+    return mask;
+}
+
+static dir_entry_t* dir_entry_at(uint32_t offset) {
+    return (dir_entry_t*)((char*)(dir_index.header + 1) + offset);
+}
+
+static const char* dir_entry_path(const dir_entry_t* entry) {
+    return (const char*)(entry + 1);
+}
+
+// The entry at `offset` if it lies within the used bytes and holds its two
+// paths, else NULL. The file is shared, so a zero or oversized size from a
+// corrupt or truncated copy must not stall or overrun a walk
+static dir_entry_t* dir_entry_checked(uint32_t offset) {
+    uint32_t used = dir_index.header->used;
+    if (sizeof(dir_index_header_t) + used > dir_index.mapped_size || offset > used || used - offset < sizeof(dir_entry_t)) return NULL;
+    dir_entry_t* entry = dir_entry_at(offset);
+    if (entry->size < sizeof(dir_entry_t) + 2 * ((size_t)entry->length + 1) || entry->size > used - offset) return NULL;
+    const char* path = dir_entry_path(entry);
+    if (path[entry->length] != '\0' || path[2 * entry->length + 1] != '\0') return NULL;
+    return entry;
+}
+
+// Cut the index back to its valid entries; called with LOCK_EX held
+static void dir_index_repair(void) {
+    dir_index_header_t* header = dir_index.header;
+    uint32_t offset = 0, count = 0;
+    float total = 0;
+    dir_entry_t* entry;
+    if (sizeof(dir_index_header_t) + header->used > dir_index.mapped_size) {
+        header->used = (uint32_t)(dir_index.mapped_size - sizeof(dir_index_header_t));    // Truncated file
+    }
+    while (offset < header->used && (entry = dir_entry_checked(offset)) != NULL) {
+        count++;
+        total += entry->rank;
+        offset += entry->size;
+    }
+    if (offset == header->used) return;
+    header->used = offset;
+    header->count = count;
+    header->total_rank = total;
+    if (state.verbose >= 1) {
+        fprintf(stderr, "⚠️ %s was damaged; kept its first %u directories\n", dir_index.path, count);
+    }
+}
+
+static int dir_index_valid(void) {
+    if (sizeof(dir_index_header_t) + dir_index.header->used > dir_index.mapped_size) return 0;
+    uint32_t offset = 0;
+    dir_entry_t* entry;
+    while (offset < dir_index.header->used && (entry = dir_entry_checked(offset)) != NULL) offset += entry->size;
+    return offset == dir_index.header->used;
+}
+
+// Map the file at its current size; called with the lock held
+static int dir_index_remap(void) {
+    struct stat st;
+    if (fstat(dir_index.fd, &st) != 0) return -1;
+    if (dir_index.header && (size_t)st.st_size == dir_index.mapped_size) return 0;
+    if (dir_index.header) {
+        munmap(dir_index.header, dir_index.mapped_size);
+        dir_index.header = NULL;
+    }
+    
+    if (st.st_size == 0) {
+        // New file: the first session to get here lays out the header
+        if (ftruncate(dir_index.fd, DIR_INDEX_INITIAL_SIZE) != 0) return -1;
+        st.st_size = DIR_INDEX_INITIAL_SIZE;
+    } else if ((size_t)st.st_size < sizeof(dir_index_header_t)) {
+        return -1;
+    }
+    
+    void* mapped = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, dir_index.fd, 0);
+    if (mapped == MAP_FAILED) return -1;
+    dir_index_header_t* header = mapped;
+    if (header->magic[0] == '\0') {
+        memcpy(header->magic, DIR_INDEX_MAGIC, sizeof(header->magic));
+    }
+    if (memcmp(header->magic, DIR_INDEX_MAGIC, sizeof(header->magic)) != 0) {
+        munmap(mapped, (size_t)st.st_size);
+        return -1;
+    }
+    dir_index.header = header;
+    dir_index.mapped_size = (size_t)st.st_size;
+    return 0;
+}
+
+// Open on first use and take the lock (LOCK_SH to read, LOCK_EX to write)
+static int dir_index_lock(int operation) {
+    if (!is_dir_index_enabled()) return -1;
+    if (dir_index.fd < 0) {
+        const char* home = getenv("HOME");
+        if (!home) return -1;
+        snprintf(dir_index.path, sizeof(dir_index.path), "%s/.awesh_dirs", home);
+        dir_index.fd = open(dir_index.path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+        if (dir_index.fd < 0) return -1;
+    }
+    if (flock(dir_index.fd, operation) != 0) return -1;
+    if (dir_index_remap() != 0) {
+        flock(dir_index.fd, LOCK_UN);
+        return -1;
+    }
+    if (!dir_index_valid()) {
+        // Rebuild from the entries that are still whole, under the write lock
+        if (operation != LOCK_EX && (flock(dir_index.fd, LOCK_EX) != 0 || dir_index_remap() != 0)) {
+            flock(dir_index.fd, LOCK_UN);
+            return -1;
+        }
+        dir_index_repair();
+        if (operation != LOCK_EX) flock(dir_index.fd, operation);
+    }
+    return 0;
+}
+
+static void dir_index_unlock(void) {
+    flock(dir_index.fd, LOCK_UN);
+}
+
+// Scale every rank so they sum to 90% of the limit, dropping entries below 1
+static void dir_index_age(void) {
+    dir_index_header_t* header = dir_index.header;
+    float scale = 0.9f * DIR_INDEX_MAX_RANK / header->total_rank;
+    uint32_t read = 0, write = 0, count = 0;
+    float total = 0;
+    while (read < header->used) {
+        dir_entry_t* entry = dir_entry_checked(read);
+        if (!entry) break;
+        uint16_t size = entry->size;
+        entry->rank *= scale;
+        if (entry->rank >= 1.0f) {
+            if (write != read) memmove(dir_entry_at(write), entry, size);
+            write += size;
+            count++;
+            total += dir_entry_at(write - size)->rank;
+        }
+        read += size;
+    }
+    header->used = write;
+    header->count = count;
+    header->total_rank = total;
+}
+
+// Find `path` in the index, or NULL
+static dir_entry_t* dir_index_find(const char* path, size_t len, uint32_t hash) {
+    dir_entry_t* entry;
+    for (uint32_t offset = 0; offset < dir_index.header->used; offset += entry->size) {
+        entry = dir_entry_checked(offset);
+        if (!entry) break;
+        if (entry->hash == hash && entry->length == len && memcmp(dir_entry_path(entry), path, len) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+// One visit to `path`: bump its rank, or append it
+void dir_index_record(const char* path) {
+    size_t len = strlen(path);
+    if (len == 0 || len >= PATH_MAX || dir_index_lock(LOCK_EX) != 0) return;
+    
+    uint32_t hash = fnv1a(path, len);
+    dir_entry_t* entry = dir_index_find(path, len, hash);
+    if (!entry) {
+        size_t size = (sizeof(dir_entry_t) + 2 * (len + 1) + 7) & ~(size_t)7;
+        size_t needed = sizeof(dir_index_header_t) + dir_index.header->used + size;
+        if (needed > dir_index.mapped_size) {
+            size_t grown = dir_index.mapped_size * 2;
+            while (grown < needed) grown *= 2;
+            if (ftruncate(dir_index.fd, (off_t)grown) != 0 || dir_index_remap() != 0) {
+                dir_index_unlock();
+                return;
+            }
+        }
+        entry = dir_entry_at(dir_index.header->used);
+        entry->rank = 0;
+        entry->characters = dir_character_mask(path);
+        entry->hash = hash;
+        entry->length = (uint16_t)len;
+        entry->size = (uint16_t)size;
+        char* stored = (char*)(entry + 1);
+        memcpy(stored, path, len + 1);
+        for (size_t i = 0; i <= len; i++) stored[len + 1 + i] = (char)tolower((unsigned char)path[i]);
+        dir_index.header->used += (uint32_t)size;
+        dir_index.header->count++;
+    }
+    entry->rank += 1.0f;
+    entry->last_visit = (uint32_t)time(NULL);
+    dir_index.header->total_rank += 1.0f;
+    if (dir_index.header->total_rank > DIR_INDEX_MAX_RANK) dir_index_age();
+    dir_index_unlock();
+}
+
+// After a successful chdir
+void record_directory_visit(void) {
+    char cwd[PATH_MAX];
+    if (getcwd(cwd, sizeof(cwd))) dir_index_record(cwd);
+}
+
+// Drop a directory that no longer exists from future matches
+static void dir_index_forget(const char* path) {
+    size_t len = strlen(path);
+    if (dir_index_lock(LOCK_EX) != 0) return;
+    dir_entry_t* entry = dir_index_find(path, len, fnv1a(path, len));
+    if (entry) {
+        dir_index.header->total_rank -= entry->rank;
+        entry->rank = 0;
+    }
+    dir_index_unlock();
+}
+
+// Rank weighted by how recently the directory was visited
+static float dir_frecency(const dir_entry_t* entry, time_t now) {
+    time_t age = now - (time_t)entry->last_visit;
+    if (age < 3600) return entry->rank * 4.0f;
+    if (age < 86400) return entry->rank * 2.0f;
+    if (age < 7 * 86400) return entry->rank * 0.5f;
+    return entry->rank * 0.25f;
+}
+
+// How well `path` matches the terms, 0 if not at all. Each term must be found
+// after the previous one; failing that, all their characters in order
+static int dir_match_quality(const char* path, const char** terms, int term_count) {
+    const char* position = path;
+    const char* last_match = NULL;
+    int substrings = 1;
+    for (int i = 0; i < term_count; i++) {
+        last_match = strstr(position, terms[i]);
+        if (!last_match) {
+            substrings = 0;
+            break;
+        }
+        position = last_match + strlen(terms[i]);
+    }
+    if (substrings) {
+        const char* last_slash = strrchr(path, '/');
+        return (!last_slash || last_match > last_slash) ? 3 : 2;
+    }
+    
+    const char* p = path;
+    for (int i = 0; i < term_count; i++) {
+        for (const char* t = terms[i]; *t; t++) {
+            while (*p && *p != *t) p++;
+            if (!*p) return 0;
+            p++;
+        }
+    }
+    return 1;
+}
+
+static int dir_match_better(const dir_match_t* a, int quality, float score) {
+    return quality > a->quality || (quality == a->quality && score > a->score);
+}
+
+// Best `max` matches for the terms, best first; returns how many. No terms
+// lists the index by frecency. Lower-case terms match case-insensitively.
+// A jump skips the current directory, a listing keeps it
+int find_directory_matches(const char** terms, int term_count, dir_match_t* matches, int max, int skip_cwd) {
+    if (dir_index_lock(LOCK_SH) != 0) return 0;
+    
+    // Smart case: all-lower-case terms are matched against the folded path
+    int ignore_case = 1;
+    uint64_t needed = 0;
+    for (int i = 0; i < term_count; i++) {
+        for (const char* c = terms[i]; *c; c++) {
+            if (isupper((unsigned char)*c)) ignore_case = 0;
+        }
+        needed |= dir_character_mask(terms[i]);
+    }
+    
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd))) cwd[0] = '\0';
+    time_t now = time(NULL);
+    int found = 0;
+    
+    const dir_entry_t* entry;
+    for (uint32_t offset = 0; offset < dir_index.header->used; offset += entry->size) {
+        entry = dir_entry_checked(offset);
+        if (!entry) break;
+        if (entry->rank <= 0 || (entry->characters & needed) != needed) continue;
+        const char* path = dir_entry_path(entry);
+        int quality = 3;
+        if (term_count > 0) {
+            quality = dir_match_quality(ignore_case ? path + entry->length + 1 : path, terms, term_count);
+            if (quality == 0 || (skip_cwd && strcmp(path, cwd) == 0)) continue;
+        }
+        
+        // Insertion into the sorted top `max`
+        float score = dir_frecency(entry, now);
+        int slot = found < max ? found : max;
+        while (slot > 0 && dir_match_better(&matches[slot - 1], quality, score)) slot--;
+        if (slot >= max) continue;
+        int last = found < max ? found : max - 1;
+        memmove(&matches[slot + 1], &matches[slot], (size_t)(last - slot) * sizeof(dir_match_t));
+        snprintf(matches[slot].path, sizeof(matches[slot].path), "%s", path);
+        matches[slot].score = score;
+        matches[slot].quality = quality;
+        if (found < max) found++;
+    }
+    dir_index_unlock();
+    return found;
+}
+
+// awej [-l] [terms...]: jump to the best match, or list matches
+void handle_dir_jump(const char* args) {
+    if (!is_dir_index_enabled()) {
+        printf("📁 Directory index disabled (DIR_INDEX=0)\n");
+        return;
+    }
+    
+    char buffer[MAX_CMD_LEN];
+    snprintf(buffer, sizeof(buffer), "%s", args);
+    const char* terms[DIR_JUMP_MAX_TERMS];
+    int term_count = 0;
+    int list = 0;
+    for (char* word = strtok(buffer, " \t"); word; word = strtok(NULL, " \t")) {
+        if (strcmp(word, "-l") == 0) {
+            list = 1;
+        } else if (term_count < DIR_JUMP_MAX_TERMS) {
+            terms[term_count++] = word;
+        }
+    }
+    if (term_count == 0) list = 1;
+    
+    long lookup_start = get_time_ms();
+    dir_match_t matches[DIR_JUMP_MAX_RESULTS];
+    int count = find_directory_matches(terms, term_count, matches, DIR_JUMP_MAX_RESULTS, !list);
+    debug_perf("directory index lookup", lookup_start);
+    
+    if (list) {
+        if (count == 0) printf("📁 No directories recorded%s\n", term_count ? " that match" : " yet");
+        for (int i = 0; i < count; i++) {
+            printf("%8.1f  %s\n", matches[i].score, matches[i].path);
+        }
+        return;
+    }
+    
+    for (int i = 0; i < count; i++) {
+        if (chdir(matches[i].path) == 0) {
+            record_directory_visit();
+            printf("%s\n", matches[i].path);
+            return;
+        }
+        dir_index_forget(matches[i].path);
+    }
+    printf("awej: no directory matches '%s'\n", args);
+}
+
+// ============================================================================
+// Parallel fan-out (awep): one command in many directories.
+//
+// The directory set comes from globs, a file with one directory per line, or
+// the frecency index. A bounded pool (one worker per core unless -j says
+// otherwise) forks `bash -c <command>` in each directory with stdout and
+// stderr going straight to that directory's log in ~/.awesh_fanout/<run>/,
+// so the frontend only launches and reaps. A progress line is redrawn while
+// workers run; at the end, failures are listed with the tail of their output
+// and `awep ai` sends them all to the AI as one BASH_FAILED request.
+// ============================================================================
+
+#define FANOUT_MAX_DIRS 1024
+#define FANOUT_MAX_INDEX_DIRS 256       // Directories taken from the frecency index
+#define FANOUT_MAX_RUNS 10              // Log directories kept
+#define FANOUT_POLL_MS 20
+#define FANOUT_PROGRESS_MS 100
+#define FANOUT_TAIL_LINES 3             // Output lines shown per failure
+#define FANOUT_AI_BYTES_PER_DIR 2048    // Output tail per failure in the AI request
+
+typedef struct {
+    char* dir;
+    pid_t pid;
+    int status;
+    long start_ms;
+    long elapsed_ms;
+} fanout_job_t;
+
+static struct {
+    char run_dir[PATH_MAX];
+    char command[MAX_CMD_LEN];
+    int failed;
+    int first_exit_code;
+} fanout_last = {0};
+
+static volatile sig_atomic_t fanout_interrupted = 0;
+
+static void fanout_sigint(int sig __attribute__((unused))) {
+    fanout_interrupted = 1;             // Workers get the same Ctrl+C; stop launching more
+}
+
+// Append `dir` unless it is not a directory or already listed
+static int fanout_add_dir(char** dirs, int count, const char* dir) {
+    char resolved[PATH_MAX];
+    struct stat st;
+    if (count >= FANOUT_MAX_DIRS || !realpath(dir, resolved) || stat(resolved, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        return count;
+    }
+    for (int i = 0; i < count; i++) {
+        if (strcmp(dirs[i], resolved) == 0) return count;
+    }
+    dirs[count] = strdup(resolved);
+    return dirs[count] ? count + 1 : count;
+}
+
+static int fanout_dirs_from_file(char** dirs, int count, const char* path) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        printf("awep: %s: %s\n", path, strerror(errno));
+        return count;
+    }
+    char line[PATH_MAX];
+    while (fgets(line, sizeof(line), file)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] && line[0] != '#') count = fanout_add_dir(dirs, count, line);
+    }
+    fclose(file);
+    return count;
+}
+
+static int fanout_dirs_from_index(char** dirs, int count, const char** terms, int term_count) {
+    dir_match_t* matches = malloc(FANOUT_MAX_INDEX_DIRS * sizeof(dir_match_t));
+    if (!matches) return count;
+    int found = find_directory_matches(terms, term_count, matches, FANOUT_MAX_INDEX_DIRS, 0);
+    for (int i = 0; i < found; i++) count = fanout_add_dir(dirs, count, matches[i].path);
+    free(matches);
+    return count;
+}
+
+static int is_fanout_run_dir(const struct dirent* entry) {
+    return entry->d_name[0] != '.';
+}
+
+// ~/.awesh_fanout/<local time>-<pid>; older runs beyond FANOUT_MAX_RUNS are removed
+static int fanout_create_run_dir(char* path, size_t size) {
+    const char* home = getenv("HOME");
+    if (!home) return -1;
+    char base[512];
+    snprintf(base, sizeof(base), "%s/.awesh_fanout", home);
+    if (mkdir(base, 0700) != 0 && errno != EEXIST) return -1;
+    
+    // Names start with the time, so alphabetical order is oldest first
+    struct dirent** runs;
+    int run_count = scandir(base, &runs, is_fanout_run_dir, alphasort);
+    for (int i = 0; i < run_count; i++) {
+        if (i < run_count - (FANOUT_MAX_RUNS - 1)) {
+            char run[800];
+            snprintf(run, sizeof(run), "%s/%s", base, runs[i]->d_name);
+            DIR* logs = opendir(run);
+            struct dirent* log;
+            while (logs && (log = readdir(logs)) != NULL) {
+                if (log->d_name[0] == '.') continue;
+                char file[1100];
+                snprintf(file, sizeof(file), "%s/%s", run, log->d_name);
+                unlink(file);
+            }
+            if (logs) closedir(logs);
+            rmdir(run);
+        }
+        free(runs[i]);
+    }
+    if (run_count >= 0) free(runs);
+    
+    char stamp[32];
+    time_t now = time(NULL);
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", localtime(&now));
+    snprintf(path, size, "%s/%s-%d", base, stamp, (int)getpid());
+    return mkdir(path, 0700) == 0 || errno == EEXIST ? 0 : -1;
+}
+
+static void fanout_log_path(char* path, size_t size, const char* run_dir, int index) {
+    snprintf(path, size, "%s/%03d.log", run_dir, index);
+}
+
+static pid_t fanout_launch(const char* dir, const char* command, const char* log_path) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid != 0) return pid;
+    
+    reset_forked_process_state();
+    int log_fd = open(log_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    int null_fd = open("/dev/null", O_RDONLY);
+    if (log_fd < 0 || null_fd < 0) _exit(126);
+    dup2(null_fd, STDIN_FILENO);        // Nothing may wait on the terminal
+    dup2(log_fd, STDOUT_FILENO);
+    dup2(log_fd, STDERR_FILENO);
+    if (chdir(dir) != 0) {
+        fprintf(stderr, "awep: cd %s: %s\n", dir, strerror(errno));
+        _exit(126);
+    }
+    execl("/bin/bash", "bash", "-c", command, (char*)NULL);
+    fprintf(stderr, "awep: bash: %s\n", strerror(errno));
+    _exit(127);
+}
+
+static int fanout_exit_code(int status) {
+    if (WIFEXITED(status)) return WEXITSTATUS(status);
+    if (WIFSIGNALED(status)) return 128 + WTERMSIG(status);
+    return 1;
+}
+
+static void fanout_progress(int done, int total, int running, int failed, long elapsed_ms, int final) {
+    if (!isatty(STDOUT_FILENO)) return;
+    printf("\r\033[K⚡ awep: %d/%d done, %d running, %d failed, %.1fs%s",
+           done, total, running, failed, elapsed_ms / 1000.0, final ? "\n" : "");
+    fflush(stdout);
+}
+
+// Last `max_lines` lines (at most `max_bytes`) of a job's log
+static size_t fanout_log_tail(const char* log_path, char* out, size_t max_bytes, int max_lines) {
+    out[0] = '\0';
+    int fd = open(log_path, O_RDONLY);
+    if (fd < 0) return 0;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+    size_t want = (size_t)st.st_size < max_bytes - 1 ? (size_t)st.st_size : max_bytes - 1;
+    ssize_t got = pread(fd, out, want, st.st_size - (off_t)want);
+    close(fd);
+    if (got <= 0) return 0;
+    size_t len = (size_t)got;
+    while (len > 0 && out[len - 1] == '\n') len--;
+    out[len] = '\0';
+    
+    size_t start = len;
+    for (int lines = 0; start > 0; start--) {
+        if (out[start - 1] == '\n' && ++lines == max_lines) break;
+    }
+    memmove(out, out + start, len - start + 1);
+    return len - start;
+}
+
+// Write the failures' outputs to <run>/failures.txt for a BASH_FAILED request
+static int fanout_write_failures(const char* run_dir, fanout_job_t* jobs, int count, char* path, size_t size) {
+    snprintf(path, size, "%s/failures.txt", run_dir);
+    FILE* file = fopen(path, "w");
+    if (!file) return -1;
+    char tail[FANOUT_AI_BYTES_PER_DIR];
+    char log_path[PATH_MAX];
+    for (int i = 0; i < count; i++) {
+        int code = fanout_exit_code(jobs[i].status);
+        if (code == 0) continue;
+        fanout_log_path(log_path, sizeof(log_path), run_dir, i);
+        fanout_log_tail(log_path, tail, sizeof(tail), INT_MAX);
+        fprintf(file, "=== %s (exit %d) ===\n%s\n\n", jobs[i].dir, code, tail);
+    }
+    return fclose(file);
+}
+
+// Run `command` in every directory with at most `workers` at a time
+static void fanout_run(char** dirs, int count, const char* command, int workers) {
+    char run_dir[PATH_MAX];
+    if (fanout_create_run_dir(run_dir, sizeof(run_dir)) != 0) {
+        printf("awep: cannot create ~/.awesh_fanout: %s\n", strerror(errno));
+        return;
+    }
+    fanout_job_t* jobs = calloc((size_t)count, sizeof(fanout_job_t));
+    if (!jobs) return;
+    
+    struct sigaction interrupt = {0}, previous;
+    interrupt.sa_handler = fanout_sigint;
+    sigemptyset(&interrupt.sa_mask);
+    fanout_interrupted = 0;
+    sigaction(SIGINT, &interrupt, &previous);
+    
+    long run_start = get_time_ms();
+    long last_progress = 0;
+    int next = 0, running = 0, done = 0, failed = 0;
+    char log_path[PATH_MAX];
+    
+    while (done < next || (next < count && !fanout_interrupted)) {
+        while (running < workers && next < count && !fanout_interrupted) {
+            fanout_log_path(log_path, sizeof(log_path), run_dir, next);
+            jobs[next].dir = dirs[next];
+            jobs[next].start_ms = get_time_ms();
+            jobs[next].pid = fanout_launch(dirs[next], command, log_path);
+            if (jobs[next].pid < 0) {
+                jobs[next].status = 126 << 8;
+                done++;
+                failed++;
+            } else {
+                running++;
+            }
+            next++;
+        }
+        
+        for (int i = 0; i < next; i++) {
+            if (jobs[i].pid <= 0) continue;
+            if (waitpid(jobs[i].pid, &jobs[i].status, WNOHANG) == jobs[i].pid) {
+                jobs[i].pid = 0;
+                jobs[i].elapsed_ms = get_time_ms() - jobs[i].start_ms;
+                running--;
+                done++;
+                if (fanout_exit_code(jobs[i].status) != 0) failed++;
+            }
+        }
+        
+        long now = get_time_ms();
+        if (now - last_progress >= FANOUT_PROGRESS_MS) {
+            fanout_progress(done, count, running, failed, now - run_start, 0);
+            last_progress = now;
+        }
+        if (done < next) {
+            struct timespec pause = {0, FANOUT_POLL_MS * 1000000L};
+            nanosleep(&pause, NULL);
+        }
+    }
+    sigaction(SIGINT, &previous, NULL);
+    long wall_ms = get_time_ms() - run_start;
+    fanout_progress(done, count, 0, failed, wall_ms, 1);
+    
+    // Failures with the tail of their output, then the totals
+    long serial_ms = 0;
+    int first_exit_code = 0;
+    char tail[1024];
+    for (int i = 0; i < next; i++) {
+        serial_ms += jobs[i].elapsed_ms;
+        int code = fanout_exit_code(jobs[i].status);
+        if (code == 0) continue;
+        if (!first_exit_code) first_exit_code = code;
+        printf("❌ exit %-3d %6.1fs  %s\n", code, jobs[i].elapsed_ms / 1000.0, jobs[i].dir);
+        fanout_log_path(log_path, sizeof(log_path), run_dir, i);
+        if (fanout_log_tail(log_path, tail, sizeof(tail), FANOUT_TAIL_LINES) > 0) {
+            for (char* line = strtok(tail, "\n"); line; line = strtok(NULL, "\n")) {
+                printf("     | %s\n", line);
+            }
+        }
+    }
+    if (next < count) {
+        printf("⏹️  Interrupted: %d of %d directories not started\n", count - next, count);
+    }
+    printf("⚡ awep: %d ok, %d failed in %.1fs (%.1fs one after another)\n",
+           next - failed, failed, wall_ms / 1000.0, serial_ms / 1000.0);
+    printf("📄 Logs: %s\n", run_dir);
+    
+    FILE* index = NULL;
+    char index_path[PATH_MAX + 16];
+    snprintf(index_path, sizeof(index_path), "%s/index.txt", run_dir);
+    if ((index = fopen(index_path, "w")) != NULL) {
+        fprintf(index, "# %s\n", command);
+        for (int i = 0; i < next; i++) {
+            fprintf(index, "%03d %d %.1f %s\n", i, fanout_exit_code(jobs[i].status), jobs[i].elapsed_ms / 1000.0, jobs[i].dir);
+        }
+        fclose(index);
+    }
+    
+    snprintf(fanout_last.run_dir, sizeof(fanout_last.run_dir), "%s", run_dir);
+    snprintf(fanout_last.command, sizeof(fanout_last.command), "%s", command);
+    fanout_last.failed = failed;
+    fanout_last.first_exit_code = first_exit_code;
+    if (failed > 0 && fanout_write_failures(run_dir, jobs, next, index_path, sizeof(index_path)) == 0) {
+        printf("💡 awep ai hands the %d failure%s to the AI\n", failed, failed == 1 ? "" : "s");
+    }
+    free(jobs);
+}
+
+// awep ai: the last run's failures as one BASH_FAILED request
+static void fanout_send_failures(void) {
+    if (fanout_last.failed == 0) {
+        printf("awep: no failures from the last run\n");
+        return;
+    }
+    if (state.socket_fd < 0 || state.ai_status != AI_READY) {
+        printf("🚫 Backend not available\n");
+        return;
+    }
+    // The request is colon-separated, so the command's own colons are dropped
+    char label[MAX_CMD_LEN + 96];
+    snprintf(label, sizeof(label), "%s (failed in %d directories, run in parallel by awep)",
+             fanout_last.command, fanout_last.failed);
+    for (char* c = label; *c; c++) {
+        if (*c == ':') *c = ' ';
+    }
+    char request[sizeof(label) + PATH_MAX + 64];
+    snprintf(request, sizeof(request), "BASH_FAILED:%d:%s:%s/failures.txt",
+             fanout_last.first_exit_code, label, fanout_last.run_dir);
+    printf("🤔 Thinking");
+    fflush(stdout);
+    send_to_backend_directly(request);
+}
+
+static void fanout_usage(void) {
+    printf("Usage: awep [-j N] <glob>... -- <command>\n");
+    printf("       awep [-j N] -f <file> -- <command>     (one directory per line)\n");
+    printf("       awep [-j N] -z [terms...] -- <command> (directories from the awej index)\n");
+    printf("       awep ai                                (send the last run's failures to the AI)\n");
+}
+
+// awep: parse the directory set and the command, then fan out
+void handle_fanout(const char* args) {
+    if (strcmp(args, "ai") == 0) {
+        fanout_send_failures();
+        return;
+    }
+    // Directory set, then " -- ", then the command
+    const char* separator = strncmp(args, "-- ", 3) == 0 ? args : strstr(args, " -- ");
+    const char* command = separator ? separator + (separator == args ? 3 : 4) : NULL;
+    while (command && (*command == ' ' || *command == '\t')) command++;
+    if (!command || !*command) {
+        fanout_usage();
+        return;
+    }
+    char spec[MAX_CMD_LEN];
+    snprintf(spec, sizeof(spec), "%.*s", (int)(separator - args), args);
+    
+    char** dirs = calloc(FANOUT_MAX_DIRS, sizeof(char*));
+    if (!dirs) return;
+    int count = 0;
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int workers = cores > 0 ? (int)cores : 4;
+    int from_index = 0;
+    const char* terms[DIR_JUMP_MAX_TERMS];
+    int term_count = 0;
+    
+    for (char* word = strtok(spec, " \t"); word; word = strtok(NULL, " \t")) {
+        if (strcmp(word, "-j") == 0) {
+            char* value = strtok(NULL, " \t");
+            if (value && atoi(value) > 0) workers = atoi(value);
+        } else if (strcmp(word, "-f") == 0) {
+            char* file = strtok(NULL, " \t");
+            if (file) count = fanout_dirs_from_file(dirs, count, file);
+        } else if (strcmp(word, "-z") == 0) {
+            from_index = 1;
+        } else if (from_index) {
+            if (term_count < DIR_JUMP_MAX_TERMS) terms[term_count++] = word;
+        } else {
+            glob_t matches;
+            if (glob(word, GLOB_TILDE | GLOB_BRACE | GLOB_ONLYDIR, NULL, &matches) == 0) {
+                for (size_t i = 0; i < matches.gl_pathc; i++) count = fanout_add_dir(dirs, count, matches.gl_pathv[i]);
+                globfree(&matches);
+            }
+        }
+    }
+    if (from_index) count = fanout_dirs_from_index(dirs, count, terms, term_count);
+    
+    if (count == 0) {
+        printf("awep: no directories matched\n");
+    } else {
+        if (workers > count) workers = count;
+        fanout_run(dirs, count, command, workers);
+    }
+    for (int i = 0; i < count; i++) free(dirs[i]);
+    free(dirs);
+}
+
+// ============================================================================
+// Watch mode (awew): rerun a command when files change.
+//
+// Paths are watched with inotify - directories recursively (hidden ones such
+// as .git skipped), files through their parent directory so editors that save
+// by rename are still seen. A burst of events is debounced into one run, and
+// events raised while the command runs (its own build output) are dropped.
+// Without paths, or with -n, the command also reruns on an interval. Output
+// is drawn on the alternate screen and only lines that differ from the last
+// run are rewritten. q or Ctrl+C leaves.
+// ============================================================================
+
+#define WATCH_MAX_WATCHES 4096
+#define WATCH_MAX_OUTPUT (1024 * 1024)
+#define WATCH_DEFAULT_DEBOUNCE_MS 100
+#define WATCH_DEFAULT_INTERVAL_S 2.0
+
+typedef struct {
+    int wd;
+    char* path;                 // The watched directory
+    char* name;                 // Only this entry of it, NULL for all (and its new subdirectories)
+} watch_target_t;
+
+static struct {
+    int fd;
+    watch_target_t* targets;
+    int target_count;
+    int directory_count;
+    int rows;
+    int columns;
+} watcher = {-1, NULL, 0, 0, 0, 0};
+
+static volatile sig_atomic_t watch_interrupted = 0;
+
+static void watch_sigint(int sig __attribute__((unused))) {
+    watch_interrupted = 1;
+}
+
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_MODIFY | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB)
+
+static int watch_add(const char* path, const char* name) {
+    if (watcher.target_count >= WATCH_MAX_WATCHES) return -1;
+    int wd = inotify_add_watch(watcher.fd, path, WATCH_EVENTS);
+    if (wd < 0) return -1;
+    watch_target_t* target = &watcher.targets[watcher.target_count++];
+    target->wd = wd;
+    target->path = strdup(path);
+    target->name = name ? strdup(name) : NULL;
+    return 0;
+}
+
+static void watch_directory_tree(const char* path) {
+    if (watch_add(path, NULL) != 0) return;
+    watcher.directory_count++;
+    DIR* dir = opendir(path);
+    if (!dir) return;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.' || (entry->d_type != DT_DIR && entry->d_type != DT_UNKNOWN)) continue;
+        char child[PATH_MAX];
+        struct stat st;
+        if (snprintf(child, sizeof(child), "%s/%s", path, entry->d_name) >= (int)sizeof(child)) continue;
+        if (entry->d_type == DT_UNKNOWN && (stat(child, &st) != 0 || !S_ISDIR(st.st_mode))) continue;
+        watch_directory_tree(child);
+    }
+    closedir(dir);
+}
+
+static int watch_path(const char* path) {
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        printf("awew: %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    if (S_ISDIR(st.st_mode)) {
+        watch_directory_tree(path);
+        return 0;
+    }
+    char parent[PATH_MAX];
+    snprintf(parent, sizeof(parent), "%s", path);
+    char* slash = strrchr(parent, '/');
+    const char* name = slash ? slash + 1 : path;
+    if (slash == parent) {
+        parent[1] = '\0';
+    } else if (slash) {
+        *slash = '\0';
+    } else {
+        strcpy(parent, ".");
+    }
+    return watch_add(parent, name);
+}
+
+// Editor droppings: swap files, backups, vim's write test
+static int watch_ignored_name(const char* name) {
+    size_t len = strlen(name);
+    return name[0] == '.' || (len > 0 && name[len - 1] == '~') || strcmp(name, "4913") == 0;
+}
+
+// Drain pending events; returns 1 if any of them matter. A new directory
+// inside a watched tree is watched too
+static int watch_read_events(void) {
+    char buffer[16 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+    int relevant = 0;
+    ssize_t len;
+    while ((len = read(watcher.fd, buffer, sizeof(buffer))) > 0) {
+        for (char* p = buffer; p < buffer + len; p += sizeof(struct inotify_event) + ((struct inotify_event*)p)->len) {
+            const struct inotify_event* event = (const struct inotify_event*)p;
+            if (event->mask & IN_Q_OVERFLOW) {
+                relevant = 1;
+                continue;
+            }
+            const char* name = event->len ? event->name : "";
+            int count = watcher.target_count;     // Not the subtrees added below
+            for (int i = 0; i < count; i++) {
+                watch_target_t* target = &watcher.targets[i];
+                if (target->wd != event->wd || !target->path) continue;
+                if (target->name ? strcmp(target->name, name) != 0 : watch_ignored_name(name)) continue;
+                relevant = 1;
+                if (!target->name && (event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_MOVED_TO))) {
+                    char child[PATH_MAX];
+                    if (snprintf(child, sizeof(child), "%s/%s", target->path, name) < (int)sizeof(child)) {
+                        watch_directory_tree(child);
+                    }
+                }
+                break;
+            }
+        }
+    }
+    return relevant;
+}
+
+// Run the command, capturing stdout and stderr together (at most WATCH_MAX_OUTPUT)
+static int watch_run_command(const char* command, abuf_t* output) {
+    int pipe_fds[2];
+    if (pipe(pipe_fds) != 0) return -1;
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        int null_fd = open("/dev/null", O_RDONLY);
+        if (null_fd >= 0) dup2(null_fd, STDIN_FILENO);
+        dup2(pipe_fds[1], STDOUT_FILENO);
+        dup2(pipe_fds[1], STDERR_FILENO);
+        reset_forked_process_state();       // Closes everything above stderr
+        execl("/bin/bash", "bash", "-c", command, (char*)NULL);
+        _exit(127);
+    }
+    close(pipe_fds[1]);
+    ssize_t got;
+    while ((got = abuf_read(output, pipe_fds[0], RECV_CHUNK)) != 0) {
+        if (got < 0) {
+            if (errno == EINTR && !watch_interrupted) continue;
+            break;
+        }
+        if (output->len > WATCH_MAX_OUTPUT) abuf_truncate(output, WATCH_MAX_OUTPUT);  // Keep draining the pipe
+    }
+    close(pipe_fds[0]);
+    if (watch_interrupted) kill(pid, SIGTERM);
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+static void watch_terminal_size(void) {
+    struct winsize ws;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_row > 0 && ws.ws_col > 0) {
+        watcher.rows = ws.ws_row;
+        watcher.columns = ws.ws_col;
+    } else {
+        watcher.rows = 24;
+        watcher.columns = 80;
+    }
+}
+
+// Bytes of `line` (up to `len`) that fit in the terminal width
+static size_t watch_fit_line(const char* line, size_t len) {
+    int columns = 0;
+    size_t i = 0;
+    for (; i < len; i++) {
+        int width = line[i] == '\t' ? 8 - columns % 8 : md_byte_width((unsigned char)line[i]);
+        if (columns + width > watcher.columns) break;
+        columns += width;
+    }
+    while (i < len && ((unsigned char)line[i] & 0xC0) == 0x80) i--;   // Never split a character
+    return i;
+}
+
+// Rewrite the lines that differ from the previous run; returns how many.
+// `screen` holds NUL-terminated lines that live in the run's output buffer
+static int watch_redraw(char* output, size_t len, char** screen, int* screen_lines, int full) {
+    int body_rows = watcher.rows - 2;
+    char** lines = malloc((size_t)(body_rows > 0 ? body_rows : 1) * sizeof(char*));
+    if (!lines) return 0;
+    int count = 0;
+    char* p = output;
+    char* end = output + len;
+    while (p < end && count < body_rows) {
+        char* newline = memchr(p, '\n', (size_t)(end - p));
+        char* line_end = newline ? newline : end;
+        if (line_end > p && line_end[-1] == '\r') line_end--;
+        *line_end = '\0';
+        p[watch_fit_line(p, (size_t)(line_end - p))] = '\0';
+        lines[count++] = p;
+        p = newline ? newline + 1 : end;
+    }
+    
+    int changed = 0;
+    int rows = count > *screen_lines ? count : *screen_lines;
+    for (int i = 0; i < rows; i++) {
+        const char* now = i < count ? lines[i] : "";
+        const char* before = i < *screen_lines ? screen[i] : "";
+        if (!full && strcmp(now, before) == 0) continue;
+        printf("\033[%d;1H%s\033[K", i + 3, now);
+        changed++;
+    }
+    memcpy(screen, lines, (size_t)count * sizeof(char*));
+    *screen_lines = count;
+    free(lines);
+    return changed;
+}
+
+static void watch_usage(void) {
+    printf("Usage: awew [-n SECONDS] [-d MS] [path...] -- <command>\n");
+    printf("  Reruns <command> when a path changes (directories recursively), or every\n");
+    printf("  SECONDS (default %.0f when no path is given). -d sets the debounce (default %dms).\n",
+           WATCH_DEFAULT_INTERVAL_S, WATCH_DEFAULT_DEBOUNCE_MS);
+}
+
+// awew: watch paths and rerun the command until q or Ctrl+C
+void handle_watch(const char* args) {
+    const char* separator = strncmp(args, "-- ", 3) == 0 ? args : strstr(args, " -- ");
+    const char* command = separator ? separator + (separator == args ? 3 : 4) : NULL;
+    while (command && (*command == ' ' || *command == '\t')) command++;
+    if (!command || !*command) {
+        watch_usage();
+        return;
+    }
+    char spec[MAX_CMD_LEN];
+    snprintf(spec, sizeof(spec), "%.*s", (int)(separator - args), args);
+    
+    watcher.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    watcher.targets = calloc(WATCH_MAX_WATCHES, sizeof(watch_target_t));
+    if (watcher.fd < 0 || !watcher.targets) {
+        printf("awew: inotify unavailable: %s\n", strerror(errno));
+        if (watcher.fd >= 0) close(watcher.fd);
+        free(watcher.targets);
+        return;
+    }
+    watcher.target_count = 0;
+    watcher.directory_count = 0;
+    
+    double interval = 0;
+    int debounce_ms = WATCH_DEFAULT_DEBOUNCE_MS;
+    int path_count = 0;
+    int failed = 0;
+    for (char* word = strtok(spec, " \t"); word; word = strtok(NULL, " \t")) {
+        if (strcmp(word, "-n") == 0) {
+            char* value = strtok(NULL, " \t");
+            if (value && atof(value) > 0) interval = atof(value);
+        } else if (strcmp(word, "-d") == 0) {
+            char* value = strtok(NULL, " \t");
+            if (value && atoi(value) >= 0) debounce_ms = atoi(value);
+        } else {
+            path_count++;
+            if (watch_path(word) != 0) failed = 1;
+        }
+    }
+    if (path_count == 0 && interval == 0) interval = WATCH_DEFAULT_INTERVAL_S;
+    
+    int interactive = isatty(STDIN_FILENO) && isatty(STDOUT_FILENO);
+    struct termios saved_termios;
+    if (!failed && interactive && tcgetattr(STDIN_FILENO, &saved_termios) == 0) {
+        struct termios raw = saved_termios;
+        raw.c_lflag &= ~(ICANON | ECHO);
+        raw.c_cc[VMIN] = 0;
+        raw.c_cc[VTIME] = 0;
+        tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+        printf("\033[?1049h\033[?25l\033[2J");        // Alternate screen, hide the cursor
+    } else {
+        interactive = 0;
+    }
+    
+    struct sigaction interrupt = {0}, previous;
+    interrupt.sa_handler = watch_sigint;
+    sigemptyset(&interrupt.sa_mask);
+    watch_interrupted = 0;
+    sigaction(SIGINT, &interrupt, &previous);
+    
+    // Two arenas: the lines on screen live in the previous run's output
+    arena_t arenas[2];
+    arena_init(&arenas[0], 64 * 1024);
+    arena_init(&arenas[1], 64 * 1024);
+    int current = 0;
+    watch_terminal_size();
+    char** screen = calloc((size_t)(watcher.rows > 2 ? watcher.rows : 3), sizeof(char*));
+    int screen_lines = 0;
+    int runs = 0;
+    char watching[96];
+    if (path_count > 0) {
+        snprintf(watching, sizeof(watching), "%d path%s, %d director%s", path_count, path_count == 1 ? "" : "s",
+                 watcher.directory_count, watcher.directory_count == 1 ? "y" : "ies");
+    } else {
+        snprintf(watching, sizeof(watching), "every %.1fs", interval);
+    }
+    
+    while (!failed && !watch_interrupted && screen) {
+        // Run
+        abuf_t output;
+        arena_reset(&arenas[current]);
+        if (abuf_init(&output, &arenas[current], RECV_CHUNK) != 0) break;
+        long run_start = get_time_ms();
+        int exit_code = watch_run_command(command, &output);
+        long run_ms = get_time_ms() - run_start;
+        watch_read_events();            // Changes made by the command itself
+        runs++;
+        
+        char clock[16];
+        time_t now = time(NULL);
+        strftime(clock, sizeof(clock), "%H:%M:%S", localtime(&now));
+        if (interactive) {
+            int rows = watcher.rows, columns = watcher.columns;
+            watch_terminal_size();
+            int full = rows != watcher.rows || columns != watcher.columns;
+            if (full) {
+                char** grown = realloc(screen, (size_t)(watcher.rows > 2 ? watcher.rows : 3) * sizeof(char*));
+                if (!grown) break;
+                screen = grown;
+                if (screen_lines > watcher.rows - 2) screen_lines = watcher.rows - 2;
+                printf("\033[2J");
+            }
+            int changed = watch_redraw(output.data, output.len, screen, &screen_lines, full || runs == 1);
+            char header[512];
+            snprintf(header, sizeof(header), "awew run %d at %s, exit %d, %ldms, %d line%s changed | q quits | %s | %s",
+                     runs, clock, exit_code, run_ms, changed, changed == 1 ? "" : "s", watching, command);
+            header[watch_fit_line(header, strlen(header))] = '\0';
+            printf("\033[1;1H%s%s\033[0m\033[K", exit_code == 0 ? "\033[1m" : "\033[1;31m", header);
+            fflush(stdout);
+            current = 1 - current;
+        } else {
+            printf("=== awew run %d at %s, exit %d, %ldms\n", runs, clock, exit_code, run_ms);
+            fwrite(output.data, 1, output.len, stdout);
+            fflush(stdout);
+        }
+        
+        // Wait for a relevant change (then let the burst settle), the interval, or q
+        long deadline = interval > 0 ? get_time_ms() + (long)(interval * 1000) : 0;
+        int triggered = 0;
+        while (!triggered && !watch_interrupted) {
+            struct pollfd fds[2] = {{watcher.fd, POLLIN, 0}, {STDIN_FILENO, POLLIN, 0}};
+            int timeout = -1;
+            if (deadline) {
+                timeout = (int)(deadline - get_time_ms());
+                if (timeout <= 0) break;
+            }
+            if (poll(fds, interactive ? 2 : 1, timeout) < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            if (fds[0].revents & POLLIN) triggered = watch_read_events();
+            if (interactive && (fds[1].revents & POLLIN)) {
+                char key = 0;
+                if (read(STDIN_FILENO, &key, 1) == 1 && (key == 'q' || key == 'Q')) watch_interrupted = 1;
+            }
+        }
+        while (triggered && debounce_ms > 0 && !watch_interrupted) {
+            struct pollfd settle = {watcher.fd, POLLIN, 0};
+            if (poll(&settle, 1, debounce_ms) <= 0) break;
+            watch_read_events();
+        }
+    }
+    
+    sigaction(SIGINT, &previous, NULL);
+    if (interactive) {
+        printf("\033[?25h\033[?1049l");
+        fflush(stdout);
+        tcsetattr(STDIN_FILENO, TCSANOW, &saved_termios);
+    }
+    if (runs > 0) printf("👀 awew: %d run%s\n", runs, runs == 1 ? "" : "s");
+    
+    free(screen);
+    arena_destroy(&arenas[0]);
+    arena_destroy(&arenas[1]);
+    for (int i = 0; i < watcher.target_count; i++) {
+        free(watcher.targets[i].path);
+        free(watcher.targets[i].name);
+    }
+    free(watcher.targets);
+    watcher.targets = NULL;
+    close(watcher.fd);
+    watcher.fd = -1;
+}
+
+// ============================================================================
+// Result cache (awec)
+//
+// Opt-in (RESULT_CACHE=1). Slow read-only commands - kubectl get, docker ps,
+// gcloud ... list - are answered from ~/.awesh_cache/ when the same command
+// ran in the same directory, with the same KUBECONFIG, AWS_PROFILE, ..., less
+// than its rule's TTL ago. For the rule's stale window after that the old
+// output is shown at once and the command reruns in the background for next
+// time. Rules are "<ttl> <stale> <pattern>" lines (fnmatch patterns over the
+// whole command); ~/.awesh_cache_rules is checked before the built-in ones,
+// and a TTL of 0 turns a pattern off. Any other command of a cached tool
+// (kubectl apply, docker rm) drops that tool's entries. Only successful runs
+// are stored. awesh_backend/result_cache.py reads and writes the same entries
+// for the ExecutionAgent, so AI iterations share them.
+// ============================================================================
+
+#define CACHE_MAX_RULES 64
+#define CACHE_MAX_OUTPUT (1024 * 1024)  // Larger outputs are shown but not stored
+#define CACHE_MAX_AGE_S 3600            // Entries are pruned after this, whatever their rule
+#define CACHE_LOCK_STALE_S 120          // A refresh lock older than this is abandoned
+#define CACHE_MAGIC "AWCACHE1"
+
+// Same list as DEFAULT_RULES in awesh_backend/result_cache.py
+static const char* default_cache_rules[] = {
+    "10 60 kubectl get *",
+    "10 60 kubectl describe *",
+    "5 30 kubectl top *",
+    "300 3600 kubectl api-resources*",
+    "3 30 docker ps*",
+    "30 300 docker images*",
+    "15 120 helm list*",
+    "15 120 helm ls*",
+    "60 600 gcloud * list*",
+    "60 600 aws * describe-*",
+    "60 600 aws * list-*",
+};
+
+// Environment that changes what these commands talk to, part of the key.
+// RESULT_CACHE_ENV adds more names (space or comma separated)
+static const char* cache_key_env[] = {
+    "KUBECONFIG", "AWS_PROFILE", "AWS_REGION", "AWS_DEFAULT_REGION", "CLOUDSDK_CORE_PROJECT",
+    "CLOUDSDK_ACTIVE_CONFIG_NAME", "DOCKER_HOST", "DOCKER_CONTEXT", "HELM_NAMESPACE",
+};
+
+typedef struct {
+    int ttl;                    // Seconds an entry is served as is
+    int stale;                  // Further seconds it is served while being refreshed
+    int user;                   // From ~/.awesh_cache_rules
+    char pattern[256];
+} cache_rule_t;
+
+typedef struct {
+    long stored_ms;
+    long duration_ms;
+    char tool[64];
+    const char* command;        // Into the read buffer
+    const char* cwd;
+    const char* output;
+    size_t output_len;
+} cache_entry_t;
+
+static struct {
+    cache_rule_t rules[CACHE_MAX_RULES];
+    int count;
+    time_t rules_mtime;         // Of ~/.awesh_cache_rules when loaded, -1 before the first load
+    char last_command[MAX_CMD_LEN];     // Last one served from the cache, for "awec fresh"
+} result_cache = {.rules_mtime = -1};
+
+int is_result_cache_enabled(void) {
+    const char* enabled = getenv("RESULT_CACHE");
+    return enabled && strcmp(enabled, "1") == 0;    // Disabled by default
+}
+
+static int cache_dir(char* path, size_t size) {
+    const char* home = getenv("HOME");
+    if (!home) return -1;
+    snprintf(path, size, "%s/.awesh_cache", home);
+    return 0;
+}
+
+static void cache_add_rule(const char* line, int user) {
+    int ttl, stale, offset = 0;
+    if (result_cache.count >= CACHE_MAX_RULES || sscanf(line, "%d %d %n", &ttl, &stale, &offset) != 2) return;
+    const char* pattern = line + offset;
+    size_t len = strcspn(pattern, "\r\n");
+    while (len > 0 && isspace((unsigned char)pattern[len - 1])) len--;
+    if (len == 0 || ttl < 0 || stale < 0) return;
+    cache_rule_t* rule = &result_cache.rules[result_cache.count++];
+    rule->ttl = ttl;
+    rule->stale = stale;
+    rule->user = user;
+    snprintf(rule->pattern, sizeof(rule->pattern), "%.*s", (int)len, pattern);
+}
+
+// (Re)load the rules when ~/.awesh_cache_rules appeared, changed or went away
+static void cache_load_rules(void) {
+    char path[PATH_MAX];
+    const char* home = getenv("HOME");
+    snprintf(path, sizeof(path), "%s/.awesh_cache_rules", home ? home : "");
+    struct stat st;
+    time_t mtime = stat(path, &st) == 0 ? st.st_mtime : 0;
+    if (mtime == result_cache.rules_mtime) return;
+    
+    result_cache.count = 0;
+    result_cache.rules_mtime = mtime;
+    FILE* file = mtime ? fopen(path, "r") : NULL;
+    if (file) {
+        char line[512];
+        while (fgets(line, sizeof(line), file)) {
+            if (line[0] != '#') cache_add_rule(line, 1);
+        }
+        fclose(file);
+    }
+    for (size_t i = 0; i < sizeof(default_cache_rules) / sizeof(default_cache_rules[0]); i++) {
+        cache_add_rule(default_cache_rules[i], 0);
+    }
+}
+
+// Redirections, lists and substitutions may write or depend on more than the
+// command line says; pipes into grep and friends are fine
+static int cache_command_is_plain(const char* cmd) {
+    if (strpbrk(cmd, "<>;&`") || strstr(cmd, "$(")) return 0;
+    char words[MAX_CMD_LEN];
+    snprintf(words, sizeof(words), "%s", cmd);
+    for (char* word = strtok(words, " \t"); word; word = strtok(NULL, " \t")) {
+        if (strcmp(word, "-w") == 0 || strncmp(word, "--watch", 7) == 0 || strcmp(word, "--follow") == 0) {
+            return 0;                   // Never finishes
+        }
+    }
+    return 1;
+}
+
+static const cache_rule_t* cache_rule_for(const char* cmd) {
+    cache_load_rules();
+    if (!cache_command_is_plain(cmd)) return NULL;
+    for (int i = 0; i < result_cache.count; i++) {
+        if (fnmatch(result_cache.rules[i].pattern, cmd, 0) == 0) {
+            return result_cache.rules[i].ttl > 0 ? &result_cache.rules[i] : NULL;
+        }
+    }
+    return NULL;
+}
+
+static void cache_tool(const char* cmd, char* tool, size_t size) {
+    while (*cmd == ' ' || *cmd == '\t') cmd++;
+    size_t len = strcspn(cmd, " \t");
+    snprintf(tool, size, "%.*s", (int)len, cmd);
+}
+
+// Whether some rule caches commands of this tool
+static int cache_tool_has_rules(const char* tool) {
+    size_t len = strlen(tool);
+    for (int i = 0; i < result_cache.count; i++) {
+        const char* pattern = result_cache.rules[i].pattern;
+        if (result_cache.rules[i].ttl > 0 && strncmp(pattern, tool, len) == 0 && pattern[len] == ' ') return 1;
+    }
+    return 0;
+}
+
+// FNV-1a, 64-bit, over "command\0cwd\0" and "NAME=value\0" for each key
+// variable that is set. result_cache.py computes the same
+static uint64_t cache_hash(uint64_t hash, const char* text) {
+    return fnv1a64(hash, text, strlen(text) + 1);
+}
+
+static uint64_t cache_env_hash(uint64_t hash, const char* name) {
+    const char* value = getenv(name);
+    if (!value) return hash;
+    char pair[1024];
+    snprintf(pair, sizeof(pair), "%s=%s", name, value);
+    return cache_hash(hash, pair);
+}
+
+static uint64_t cache_key(const char* cmd, const char* cwd) {
+    uint64_t hash = cache_hash(cache_hash(FNV64_OFFSET, cmd), cwd);
+    for (size_t i = 0; i < sizeof(cache_key_env) / sizeof(cache_key_env[0]); i++) {
+        hash = cache_env_hash(hash, cache_key_env[i]);
+    }
+    const char* extra = getenv("RESULT_CACHE_ENV");
+    if (extra && *extra) {
+        char names[512];
+        snprintf(names, sizeof(names), "%s", extra);
+        for (char* name = strtok(names, " ,"); name; name = strtok(NULL, " ,")) hash = cache_env_hash(hash, name);
+    }
+    return hash;
+}
+
+static int cache_entry_path(const char* cmd, const char* cwd, char* path, size_t size) {
+    char dir[PATH_MAX];
+    if (cache_dir(dir, sizeof(dir)) != 0) return -1;
+    snprintf(path, size, "%s/%016llx", dir, (unsigned long long)cache_key(cmd, cwd));
+    return 0;
+}
+
+// Entry file: "AWCACHE1 <stored ms> <duration ms> <tool>\n<command>\n<cwd>\n<output>"
+static int cache_parse(char* data, size_t len, cache_entry_t* entry) {
+    char* command = memchr(data, '\n', len);
+    char* cwd = command ? memchr(command + 1, '\n', len - (command + 1 - data)) : NULL;
+    char* output = cwd ? memchr(cwd + 1, '\n', len - (cwd + 1 - data)) : NULL;
+    if (!output) return -1;
+    *command++ = '\0';
+    *cwd++ = '\0';
+    *output++ = '\0';
+    char magic[16];
+    if (sscanf(data, "%15s %ld %ld %63s", magic, &entry->stored_ms, &entry->duration_ms, entry->tool) != 4 ||
+        strcmp(magic, CACHE_MAGIC) != 0) {
+        return -1;
+    }
+    entry->command = command;
+    entry->cwd = cwd;
+    entry->output = output;
+    entry->output_len = len - (output - data);
+    return 0;
+}
+
+static int cache_read(const char* path, abuf_t* buf, cache_entry_t* entry) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    ssize_t got;
+    while ((got = abuf_read(buf, fd, RECV_CHUNK)) > 0 || (got < 0 && errno == EINTR)) {}
+    close(fd);
+    return got == 0 ? cache_parse(buf->data, buf->len, entry) : -1;
+}
+
+// Only the start of an entry, for listing and invalidation
+static int cache_read_header(const char* path, char* header, size_t size, cache_entry_t* entry) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    ssize_t got = read(fd, header, size - 1);
+    close(fd);
+    if (got <= 0) return -1;
+    header[got] = '\0';
+    return cache_parse(header, got, entry);
+}
+
+static int is_cache_entry(const struct dirent* entry) {
+    return strlen(entry->d_name) == 16 && strspn(entry->d_name, "0123456789abcdef") == 16;
+}
+
+// Drop entries past CACHE_MAX_AGE_S, and leftover temporary and lock files
+static void cache_prune(const char* dir) {
+    DIR* entries = opendir(dir);
+    if (!entries) return;
+    time_t now = time(NULL);
+    struct dirent* entry;
+    while ((entry = readdir(entries)) != NULL) {
+        if (entry->d_name[0] == '.') continue;
+        char path[PATH_MAX + 64];
+        snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+        struct stat st;
+        if (stat(path, &st) != 0) continue;
+        long limit = is_cache_entry(entry) ? CACHE_MAX_AGE_S : CACHE_LOCK_STALE_S;
+        if (now - st.st_mtime > limit) unlink(path);
+    }
+    closedir(entries);
+}
+
+static void cache_store(const char* path, const char* cmd, const char* cwd, const char* data, size_t len, long duration_ms) {
+    char dir[PATH_MAX];
+    if (cache_dir(dir, sizeof(dir)) != 0 || (mkdir(dir, 0700) != 0 && errno != EEXIST)) return;
+    cache_prune(dir);
+    
+    char tool[64], temp[PATH_MAX + 32];
+    cache_tool(cmd, tool, sizeof(tool));
+    snprintf(temp, sizeof(temp), "%s.%d.tmp", path, (int)getpid());
+    int fd = open(temp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);   // Output may hold secrets
+    FILE* file = fd >= 0 ? fdopen(fd, "w") : NULL;
+    if (!file) {
+        if (fd >= 0) close(fd);
+        return;
+    }
+    fprintf(file, "%s %ld %ld %s\n%s\n%s\n", CACHE_MAGIC, get_time_ms(), duration_ms, tool, cmd, cwd);
+    fwrite(data, 1, len, file);
+    if (fclose(file) != 0 || rename(temp, path) != 0) unlink(temp);    // Readers never see half an entry
+}
+
+// Drop every entry of a tool; returns how many went
+static int cache_invalidate(const char* tool) {
+    char dir[PATH_MAX];
+    if (cache_dir(dir, sizeof(dir)) != 0) return 0;
+    DIR* entries = opendir(dir);
+    if (!entries) return 0;
+    int removed = 0;
+    struct dirent* entry;
+    while ((entry = readdir(entries)) != NULL) {
+        if (!is_cache_entry(entry)) continue;
+        char path[PATH_MAX + 256], header[MAX_CMD_LEN + PATH_MAX + 128];
+        cache_entry_t parsed;
+        snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+        if (!tool || (cache_read_header(path, header, sizeof(header), &parsed) == 0 && strcmp(parsed.tool, tool) == 0)) {
+            removed += unlink(path) == 0;
+        }
+    }
+    closedir(entries);
+    return removed;
+}
+
+// Run the command with stdout and stderr captured together, copying them to
+// tee_fd as they arrive (-1: nowhere). Ctrl+C stops the command, not awesh
+static int cache_run_command(const char* cmd, abuf_t* output, int tee_fd, int* too_big) {
+    int pipe_fds[2];
+    if (pipe(pipe_fds) != 0) return -1;
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        dup2(pipe_fds[1], STDOUT_FILENO);
+        dup2(pipe_fds[1], STDERR_FILENO);
+        reset_forked_process_state();
+        execl("/bin/bash", "bash", "-c", cmd, (char*)NULL);
+        _exit(127);
+    }
+    struct sigaction ignore = {0}, previous;
+    ignore.sa_handler = SIG_IGN;
+    sigaction(SIGINT, &ignore, &previous);
+    close(pipe_fds[1]);
+    
+    *too_big = 0;
+    ssize_t got;
+    while ((got = abuf_read(output, pipe_fds[0], RECV_CHUNK)) != 0) {
+        if (got < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (tee_fd >= 0 && write(tee_fd, output->data + output->len - got, got) < 0) tee_fd = -1;
+        if (output->len > CACHE_MAX_OUTPUT) {
+            *too_big = 1;
+            abuf_clear(output);         // Keep draining; it will not be stored
+        }
+    }
+    close(pipe_fds[0]);
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+    sigaction(SIGINT, &previous, NULL);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+static int cache_run_and_store(const char* cmd, const char* cwd, const char* path, int tee_fd) {
+    abuf_t output;
+    if (abuf_init(&output, &request_arena, RECV_CHUNK) != 0) return -1;
+    int too_big;
+    long start = get_time_ms();
+    int exit_code = cache_run_command(cmd, &output, tee_fd, &too_big);
+    if (exit_code == 0 && !too_big) cache_store(path, cmd, cwd, output.data, output.len, get_time_ms() - start);
+    return exit_code;
+}
+
+// Rerun a stale entry's command detached from the terminal. A lock file next
+// to the entry keeps the frontend and the backend from refreshing it twice
+static void cache_refresh_in_background(const char* cmd, const char* cwd, const char* path) {
+    char lock[PATH_MAX + 8];
+    snprintf(lock, sizeof(lock), "%s.lock", path);
+    struct stat st;
+    if (stat(lock, &st) == 0 && time(NULL) - st.st_mtime > CACHE_LOCK_STALE_S) unlink(lock);
+    int lock_fd = open(lock, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (lock_fd < 0) return;            // Already being refreshed
+    close(lock_fd);
+    
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (fork() != 0) _exit(0);      // The grandchild is reparented; nothing for the shell to reap
+        setsid();
+        reset_forked_process_state();
+        int null_fd = open("/dev/null", O_RDWR);
+        if (null_fd >= 0) {
+            dup2(null_fd, STDIN_FILENO);
+            dup2(null_fd, STDOUT_FILENO);
+            dup2(null_fd, STDERR_FILENO);
+        }
+        cache_run_and_store(cmd, cwd, path, -1);
+        unlink(lock);
+        _exit(0);
+    }
+    if (pid > 0) {
+        while (waitpid(pid, NULL, 0) < 0 && errno == EINTR) {}
+    } else {
+        unlink(lock);
+    }
+}
+
+static void cache_format_age(long ms, char* out, size_t size) {
+    if (ms < 1000) snprintf(out, size, "<1s");
+    else if (ms < 60000) snprintf(out, size, "%lds", ms / 1000);
+    else if (ms < 3600000) snprintf(out, size, "%ldm", ms / 60000);
+    else snprintf(out, size, "%ldh", ms / 3600000);
+}
+
+// Run a shell command through the cache. Returns 0 when no rule covers it (the
+// caller runs it as usual), 1 when it was answered or run here
+int run_with_result_cache(const char* cmd, int* exit_code) {
+    if (!is_result_cache_enabled()) return 0;
+    const cache_rule_t* rule = cache_rule_for(cmd);
+    if (!rule) {
+        char tool[64];
+        cache_tool(cmd, tool, sizeof(tool));
+        if (cache_tool_has_rules(tool)) cache_invalidate(tool);    // May have changed what those show
+        return 0;
+    }
+    char cwd[PATH_MAX], path[PATH_MAX + 32];
+    if (!getcwd(cwd, sizeof(cwd)) || cache_entry_path(cmd, cwd, path, sizeof(path)) != 0) return 0;
+    
+    abuf_t buf;
+    cache_entry_t entry;
+    if (abuf_init(&buf, &request_arena, RECV_CHUNK) == 0 && cache_read(path, &buf, &entry) == 0 &&
+        strcmp(entry.command, cmd) == 0 && strcmp(entry.cwd, cwd) == 0) {
+        long age_ms = get_time_ms() - entry.stored_ms;
+        if (age_ms >= 0 && age_ms < (rule->ttl + (long)rule->stale) * 1000) {
+            int stale = age_ms >= rule->ttl * 1000L;
+            fflush(stdout);
+            if (write(STDOUT_FILENO, entry.output, entry.output_len) < 0) {}
+            if (stale) cache_refresh_in_background(cmd, cwd, path);
+            char age[16];
+            cache_format_age(age_ms, age, sizeof(age));
+            fprintf(stderr, "\033[2m⏱ cached %s ago%s (took %.1fs) · awec fresh reruns it\033[0m\n",
+                    age, stale ? ", refreshing" : "", entry.duration_ms / 1000.0);
+            snprintf(result_cache.last_command, sizeof(result_cache.last_command), "%s", cmd);
+            metric_inc(stale ? frontend_metrics.result_cache_stale : frontend_metrics.result_cache_hit);
+            *exit_code = 0;
+            return 1;
+        }
+    }
+    metric_inc(frontend_metrics.result_cache_miss);
+    *exit_code = cache_run_and_store(cmd, cwd, path, STDOUT_FILENO);
+    return 1;
+}
+
+static void cache_list(void) {
+    char dir[PATH_MAX];
+    struct dirent** entries;
+    int count = cache_dir(dir, sizeof(dir)) == 0 ? scandir(dir, &entries, is_cache_entry, alphasort) : -1;
+    if (!is_result_cache_enabled()) printf("⏱ Result cache is off - export RESULT_CACHE=1 to enable it\n");
+    if (count <= 0) {
+        printf("⏱ No cached results\n");
+        if (count == 0) free(entries);
+        return;
+    }
+    long now = get_time_ms();
+    printf("%-6s %-8s %-7s %-9s %s\n", "AGE", "STATE", "TOOK", "BYTES", "COMMAND (DIRECTORY)");
+    for (int i = 0; i < count; i++) {
+        char path[PATH_MAX + 256];
+        snprintf(path, sizeof(path), "%s/%s", dir, entries[i]->d_name);
+        abuf_t buf;
+        cache_entry_t entry;
+        if (abuf_init(&buf, &request_arena, RECV_CHUNK) == 0 && cache_read(path, &buf, &entry) == 0) {
+            const cache_rule_t* rule = cache_rule_for(entry.command);
+            long age_ms = now - entry.stored_ms;
+            const char* state = !rule ? "no rule" : age_ms < rule->ttl * 1000L ? "fresh" :
+                                age_ms < (rule->ttl + (long)rule->stale) * 1000 ? "stale" : "expired";
+            char age[16];
+            cache_format_age(age_ms, age, sizeof(age));
+            printf("%-6s %-8s %-7.1f %-9zu %s (%s)\n", age, state, entry.duration_ms / 1000.0, entry.output_len,
+                   entry.command, entry.cwd);
+        }
+        free(entries[i]);
+    }
+    free(entries);
+}
+
+static void cache_print_rules(void) {
+    cache_load_rules();
+    printf("%-6s %-6s %-6s %s\n", "TTL", "STALE", "FROM", "PATTERN");
+    for (int i = 0; i < result_cache.count; i++) {
+        const cache_rule_t* rule = &result_cache.rules[i];
+        printf("%-6d %-6d %-6s %s\n", rule->ttl, rule->stale, rule->user ? "file" : "built", rule->pattern);
+    }
+    printf("Rules in ~/.awesh_cache_rules (\"<ttl> <stale> <pattern>\") come first; a ttl of 0 disables a pattern\n");
+}
+
+// awec: list, rules, clear [tool], fresh [command]
+void handle_result_cache(const char* args) {
+    while (*args == ' ') args++;
+    if (!*args || strcmp(args, "list") == 0) {
+        cache_list();
+    } else if (strcmp(args, "rules") == 0) {
+        cache_print_rules();
+    } else if (strcmp(args, "clear") == 0 || strncmp(args, "clear ", 6) == 0) {
+        const char* tool = args[5] ? args + 6 : NULL;
+        int removed = cache_invalidate(tool && *tool ? tool : NULL);
+        printf("⏱ Removed %d cached result%s\n", removed, removed == 1 ? "" : "s");
+    } else if (strcmp(args, "fresh") == 0 || strncmp(args, "fresh ", 6) == 0) {
+        const char* cmd = args[5] ? args + 6 : "";
+        while (*cmd == ' ') cmd++;
+        if (!*cmd) cmd = result_cache.last_command;
+        char cwd[PATH_MAX], path[PATH_MAX + 32];
+        if (!*cmd) {
+            printf("awec: nothing was served from the cache yet\n");
+        } else if (!getcwd(cwd, sizeof(cwd)) || cache_entry_path(cmd, cwd, path, sizeof(path)) != 0) {
+            printf("awec: cannot locate the cache\n");
+        } else {
+            char command[MAX_CMD_LEN];
+            snprintf(command, sizeof(command), "%s", cmd);      // last_command may be overwritten
+            if (cache_rule_for(command)) cache_run_and_store(command, cwd, path, STDOUT_FILENO);
+            else if (system(command) < 0) printf("awec: %s\n", strerror(errno));
+        }
+    } else {
+        printf("Usage: awec [list | rules | clear [tool] | fresh [command]]\n");
+    }
+}
+
+void execute_command_securely(const char* cmd) {
+    // Check if any children are ready
+    int backend_ready = (state.backend_pid > 0 && is_process_running(state.backend_pid) && state.socket_fd >= 0);
+    
+    if (state.verbose >= 2) {
+        printf("DEBUG: execute_command_securely called with: %s\n", cmd);
+    }
+    
+    // Handle built-in commands that must run in the current process
+    char cmd_copy[MAX_CMD_LEN];
+    strncpy(cmd_copy, cmd, sizeof(cmd_copy) - 1);
+    cmd_copy[sizeof(cmd_copy) - 1] = '\0';
+    
+    // Extract first word
+    char* first_word = strtok(cmd_copy, " \t");
+    if (first_word && strcmp(first_word, "cd") == 0) {
+        // Handle cd command - must change directory in current process
+        metric_inc(frontend_metrics.route_builtin);
+        char* target_dir = strtok(NULL, " \t");
+        if (!target_dir || strlen(target_dir) == 0) {
+            // cd with no arguments - go to home directory
+            const char* home = getenv("HOME");
+            if (home) {
+                if (chdir(home) == 0) {
+                    record_directory_visit();
+                    if (state.verbose >= 2) {
+                        printf("✅ Changed directory to %s\n", home);
+                    }
+                } else {
+                    printf("cd: %s: No such file or directory\n", home);
+                }
+            } else {
+                printf("cd: HOME not set\n");
+            }
+        } else {
+            // cd to specified directory
+            if (chdir(target_dir) == 0) {
+                record_directory_visit();
+                if (state.verbose >= 2) {
+                    printf("✅ Changed directory to %s\n", target_dir);
+                }
+            } else {
+                printf("cd: %s: No such file or directory\n", target_dir);
+            }
+        }
+        return;
+    }
+    
+    // Stock natural-language requests are answered from the local intent table
+    if (handle_local_intent(cmd)) {
+        metric_inc(frontend_metrics.route_intent);
+        return;
+    }
+    
+    // Ambiguous lines race the AI against the sandbox instead of paying for both in turn
+    if (backend_ready && state.ai_status == AI_READY && is_speculative_dispatch_enabled() &&
+        state.sandbox_pid > 0 && is_ambiguous_input_line(cmd)) {
+        if (state.verbose >= 2) {
+            printf("⚡ Ambiguous input - speculative dispatch: %s\n", cmd);
+        }
+        metric_inc(frontend_metrics.route_speculative);
+        speculative_dispatch(cmd);
+        return;
+    }
+    
+    // Check if this looks like an AI query first (BEFORE executing)
+    if (is_ai_query(cmd) && backend_ready) {
+        if (state.verbose >= 2) {
+            printf("🤖 AI query detected: %s\n", cmd);
+        }
+        metric_inc(frontend_metrics.route_ai);
+        // Show thinking dots while processing
+        printf("🤔 Thinking");
+        fflush(stdout);
+        
+        // Send directly to backend - backend will check with security agent
+        send_to_backend_directly(cmd);
+        return;
+    }
+    
+    // UNFILTERED EXECUTION: Run command directly (fast execution)
+    if (state.verbose >= 2) {
+        printf("🖥️ Running command directly (unfiltered): %s\n", cmd);
+    }
+    
+    // Execute command directly (unfiltered) - only if NOT an AI query
+    metric_inc(frontend_metrics.route_shell);
+    int exit_code;
+    if (!run_with_result_cache(cmd, &exit_code)) {
+        int result = system(cmd);
+        exit_code = WEXITSTATUS(result);
+    }
+    
+    if (state.verbose >= 2) {
+        printf("DEBUG: Command result - exit_code=%d\n", exit_code);
+    }
+    
+    // POST-FACTO DETECTION: Only treat non-zero exit codes as anomalous
+    int is_anomalous = (exit_code != 0);
+    if (is_anomalous && state.verbose >= 2) {
+        printf("🚨 Anomalous exit code detected: %d\n", exit_code);
+    }
+
+    // If anomalous and looks like an interactive program, rerun with TTY
+    if (is_anomalous) {
+        char first_word[64] = {0};
+        sscanf(cmd, "%63s", first_word);
+        if (strcmp(first_word, "top") == 0 || strcmp(first_word, "watch") == 0 ||
+            strcmp(first_word, "vi") == 0 || strcmp(first_word, "vim") == 0 ||
+            strcmp(first_word, "less") == 0) {
+            // Only rerun interactively if we have a TTY (real user session)
+            if (isatty(STDIN_FILENO)) {
+                if (state.verbose >= 2) {
+                    printf("🖥️ Detected interactive program after failure - rerunning with TTY: %s\n", first_word);
+                }
+                metric_inc(frontend_metrics.route_interactive);
+                run_interactive_command(cmd);
+                return;
+            }
+        }
+    }
+    
+    // If no anomalies detected, command executed successfully
+    if (!is_anomalous) {
+        typo_index_record_usage(cmd);
+        if (state.verbose >= 2) {
+            printf("✅ Command executed successfully (no anomalies)\n");
+        }
+        return;
+    }
+    
+    // Command not found: a local edit-distance search answers most of these
+    if (exit_code == 127 && handle_command_not_found(cmd)) {
+        metric_inc(frontend_metrics.route_typo);
+        return;
+    }
+    
+    // ANOMALOUS RESULT DETECTED - Get backend assistance
+    if (backend_ready) {
+        if (state.verbose >= 2) {
+            printf("🤔 Anomalous result detected - getting backend assistance\n");
+        }
+        metric_inc(frontend_metrics.route_shell_failed_ai);
+        
+        // Show thinking dots while processing
+        printf("🤔 Thinking");
+        fflush(stdout);
+        
+        // Send to backend with context about the anomaly
+        send_to_backend_directly(cmd);
+    } else {
+        // No backend available - show error
+        if (state.verbose >= 1) {
+            printf("❌ Command failed (exit %d)\n", exit_code);
+        }
+    }
+}
+
+void handle_bash_with_ai_fallback(const char* cmd) {
+    // If AI is ready, try bash and capture output for AI context
+    if (state.socket_fd >= 0 && state.ai_status == AI_READY) {
+        // Capture both stdout and stderr for AI context
+        char temp_file[] = "/tmp/awesh_bash_XXXXXX";
+        int fd = mkstemp(temp_file);
+        if (fd != -1) {
+            close(fd);
+            
+            char bash_cmd[MAX_CMD_LEN + 100];
+            snprintf(bash_cmd, sizeof(bash_cmd), "%s >%s 2>&1", cmd, temp_file);
+            int result = system(bash_cmd);
+            
+            if (result == 0) {
+                // Bash succeeded - show output and clean up immediately
+                char cat_cmd[200];
+                snprintf(cat_cmd, sizeof(cat_cmd), "cat %s", temp_file);
+                system(cat_cmd);
+                unlink(temp_file);
+                return; // Exit immediately - no AI processing needed
+            } else {
+                // Bash failed - send command and output to AI as context
+                if (state.verbose >= 1) {
+                    printf("Command failed (exit %d), trying AI assistance...\n", result);
+                    // Debug: show what was captured
+                    printf("🔧 Error output captured in temp file:\n");
+                    char cat_debug[200];
+                    snprintf(cat_debug, sizeof(cat_debug), "cat %s", temp_file);
+                    system(cat_debug);
+                    printf("🔧 End of captured output\n");
+                }
+                
+                // Send command with bash failure context to backend
+                char context_cmd[MAX_CMD_LEN + 200];
+                snprintf(context_cmd, sizeof(context_cmd), "BASH_FAILED:%d:%s:%s", result, cmd, temp_file);
+                send_command(context_cmd);
+                unlink(temp_file);
+            }
+        } else {
+            // Fallback if temp file creation fails
+            int result = system(cmd);
+            if (result != 0 && state.verbose >= 1) {
+                printf("Command failed (exit %d), trying AI assistance...\n", result);
+                send_command(cmd);
+            }
+        }
+    } else {
+        // No AI available, run bash normally (show errors)
+        system(cmd);
+    }
+}
+
+// Readline calls this about ten times a second while it waits for a key,
+// so scrapes are answered while the shell sits at the prompt
+static int frontend_idle_hook(void) {
+    metrics_serve();
+    metrics_write_textfile(0);
+    return 0;
+}
+
+void init_frontend_metrics(void) {
+    metrics_init("awesh");
+    
+    frontend_metrics.input_lines = metrics_counter("awesh_input_lines_total", NULL, "Lines entered at the prompt");
+    
+    const char* route_help = "Input lines by the path that handled them";
+    frontend_metrics.route_builtin = metrics_counter("awesh_routes_total", "route=\"builtin\"", route_help);
+    frontend_metrics.route_intent = metrics_counter("awesh_routes_total", "route=\"intent\"", route_help);
+    frontend_metrics.route_speculative = metrics_counter("awesh_routes_total", "route=\"speculative\"", route_help);
+    frontend_metrics.route_ai = metrics_counter("awesh_routes_total", "route=\"ai\"", route_help);
+    frontend_metrics.route_shell = metrics_counter("awesh_routes_total", "route=\"shell\"", route_help);
+    frontend_metrics.route_shell_failed_ai = metrics_counter("awesh_routes_total", "route=\"shell_failed_ai\"", route_help);
+    frontend_metrics.route_typo = metrics_counter("awesh_routes_total", "route=\"typo\"", route_help);
+    frontend_metrics.route_interactive = metrics_counter("awesh_routes_total", "route=\"interactive\"", route_help);
+    
+    const char* verdict_help = "Sandbox verdicts on ambiguous lines";
+    frontend_metrics.verdict_bash = metrics_counter("awesh_sandbox_verdicts_total", "verdict=\"bash\"", verdict_help);
+    frontend_metrics.verdict_interactive = metrics_counter("awesh_sandbox_verdicts_total", "verdict=\"interactive\"", verdict_help);
+    frontend_metrics.verdict_ai = metrics_counter("awesh_sandbox_verdicts_total", "verdict=\"ai\"", verdict_help);
+    frontend_metrics.verdict_not_found = metrics_counter("awesh_sandbox_verdicts_total", "verdict=\"not_found\"", verdict_help);
+    frontend_metrics.verdict_error = metrics_counter("awesh_sandbox_verdicts_total", "verdict=\"error\"", verdict_help);
+    
+    const char* cache_help = "Prompt kubectl cache lookups";
+    frontend_metrics.prompt_cache_hit = metrics_counter("awesh_prompt_cache_lookups_total", "result=\"hit\"", cache_help);
+    frontend_metrics.prompt_cache_miss = metrics_counter("awesh_prompt_cache_lookups_total", "result=\"miss\"", cache_help);
+    
+    const char* result_help = "Result cache lookups for commands covered by a rule";
+    frontend_metrics.result_cache_hit = metrics_counter("awesh_result_cache_lookups_total", "result=\"hit\"", result_help);
+    frontend_metrics.result_cache_stale = metrics_counter("awesh_result_cache_lookups_total", "result=\"stale\"", result_help);
+    frontend_metrics.result_cache_miss = metrics_counter("awesh_result_cache_lookups_total", "result=\"miss\"", result_help);
+    
+    const char* restart_help = "Helper processes restarted after dying";
+    frontend_metrics.restart_backend = metrics_counter("awesh_child_restarts_total", "child=\"backend\"", restart_help);
+    frontend_metrics.restart_security_agent = metrics_counter("awesh_child_restarts_total", "child=\"security_agent\"", restart_help);
+    frontend_metrics.restart_sandbox = metrics_counter("awesh_child_restarts_total", "child=\"sandbox\"", restart_help);
+    
+    frontend_metrics.line_seconds = metrics_histogram("awesh_line_seconds", NULL,
+                                                      "Time from Enter to the line being fully handled");
+    frontend_metrics.backend_first_byte_seconds = metrics_histogram("awesh_backend_first_byte_seconds", NULL,
+                                                                    "Time from sending a request to the first byte of the backend's reply");
+    frontend_metrics.sandbox_roundtrip_seconds = metrics_histogram("awesh_sandbox_roundtrip_seconds", NULL,
+                                                                   "Sandbox validation round trip, socket plus shared result file");
+    
+    const char* textfile_dir = getenv("METRICS_TEXTFILE_DIR");
+    if (metrics_listen() >= 0 || (textfile_dir && *textfile_dir)) {
+        rl_event_hook = frontend_idle_hook;
+    }
+}
+
+void record_sandbox_verdict(int verdict) {
+    switch (verdict) {
+        case 0:
+            metric_inc(frontend_metrics.verdict_bash);
+            break;
+        case -103:
+            metric_inc(frontend_metrics.verdict_interactive);
+            break;
+        case -109:
+            metric_inc(frontend_metrics.verdict_not_found);
+            break;
+        case -1:
+            metric_inc(frontend_metrics.verdict_error);
+            break;
+        default:
+            metric_inc(frontend_metrics.verdict_ai);
+            break;
+    }
+}
+
+// ============================================================================
+// Git status in the prompt
+//
+// `git status` reads every file of the worktree - seconds in a large repo -
+// so the prompt never runs it. A worker process (awesh_git) follows the
+// repository the shell is in: it parses .git/index, checks every tracked
+// file against it and walks the worktree for untracked files once, then
+// keeps an inotify watch on each directory and rechecks only the paths that
+// events name. Each entry remembers what its file looked like when its
+// content was last compared (the stat cache), so an unchanged file is never
+// hashed twice. A rewritten index (git add, commit, checkout) is merged with
+// the previous one and only entries whose blob or mode changed are checked
+// again. The worker publishes the branch and counts in a shared mapping
+// behind a sequence counter; the prompt copies them and does nothing else.
+// Without enough inotify watches it rescans every GIT_STATUS_RESCAN_S.
+// ============================================================================
+
+#define GIT_STATUS_DEBOUNCE_MS 50       // A batch of events ends after this long without more
+#define GIT_STATUS_MAX_BATCH_MS 500     // ... or this long after it started
+#define GIT_STATUS_DEFAULT_RESCAN_S 30
+#define GIT_STATUS_FLUSH_WAIT_MS 100    // The prompt waits at most this long for a flush
+#define GIT_WATCH_EVENTS (IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)
+
+enum { GIT_STATUS_SCANNING, GIT_STATUS_READY, GIT_STATUS_UNSUPPORTED };
+enum { GIT_ENTRY_UNKNOWN, GIT_ENTRY_CLEAN, GIT_ENTRY_DIRTY };
+
+typedef struct {
+    volatile uint32_t seq;              // Odd while the worker writes
+    int32_t state;
+    uint32_t clean;                     // Tracked files that match the index
+    uint32_t dirty;                     // Modified, deleted or unmerged
+    uint32_t untracked;                 // Neither tracked nor ignored (files, as git status -uall)
+    uint32_t watches;                   // 0: only interval rescans notice changes
+    uint32_t scan_ms;                   // Last full scan
+    char branch[64];
+    volatile uint32_t flush_request;    // Bumped by the prompt before it signals the worker
+    volatile uint32_t flushed;          // Last request whose events are in the counts
+} git_status_shared_t;
+
+static struct {
+    git_status_shared_t* shared;        // MAP_SHARED | MAP_ANONYMOUS, one per worker
+    git_status_shared_t last;           // Last consistent copy
+    pid_t worker_pid;
+    char root[PATH_MAX];                // Worktree being followed, "" outside one
+    char last_cwd[PATH_MAX];
+} git_status = {0};
+
+// Worker side
+
+typedef struct {
+    uint32_t path;                      // Offset in the path pool
+    uint32_t path_len;
+    uint32_t mode;
+    uint32_t size;                      // Index stat data, truncated to 32 bits as git stores it
+    uint32_t mtime_s;
+    uint32_t mtime_ns;
+    uint32_t ino;
+    uint32_t seen_size;                 // Stat cache: the file when its content was last compared
+    uint32_t seen_mtime_s;
+    uint32_t seen_mtime_ns;
+    uint32_t seen_ino;
+    unsigned char oid[20];
+    uint8_t stage;
+    uint8_t skip;                       // Never checked: skip-worktree, gitlink, unmerged, intent-to-add
+    uint8_t state;
+    uint8_t seen_valid;
+    uint8_t seen_clean;
+} git_entry_t;
+
+typedef struct {
+    char** keys;                        // NULL free, git_set_tombstone deleted
+    void** values;
+    size_t capacity;
+    size_t count;
+    size_t used;                        // count plus tombstones
+} git_path_set_t;
+
+typedef struct {
+    char* pattern;
+    uint8_t negate;
+    uint8_t dir_only;
+    uint8_t anchored;                   // Matched against the path below the .gitignore, not the name
+} git_ignore_rule_t;
+
+typedef struct {
+    size_t dir_len;                     // Length of the directory prefix it applies to
+    git_ignore_rule_t* rules;
+    int count;
+} git_ignore_list_t;
+
+static char git_set_tombstone[1];
+
+static struct {
+    char root[PATH_MAX];
+    char git_dir[PATH_MAX];
+    int sha1;                           // 0 in SHA-256 repositories: stat data only, no hashing
+    int supported;
+    git_entry_t* entries;
+    size_t entry_count;
+    char* pool;
+    struct timespec index_mtime;
+    git_path_set_t untracked;
+    git_path_set_t pending;             // Paths named by events, directories with a trailing '/'
+    git_path_set_t ignore_lists;        // Directory ("" or "a/b/") -> git_ignore_list_t*
+    git_ignore_list_t excludes;         // info/exclude, then the user's global ignore file
+    int inotify_fd;
+    int git_dir_wd;
+    char** watch_dirs;                  // Relative directory by watch descriptor
+    int watch_capacity;
+    int watches;
+    int watch_failed;
+    int index_changed;
+    int head_changed;
+    int rescan;
+    uint32_t scan_ms;
+    git_status_shared_t* shared;
+} git_worker;
+
+static long git_set_find(const git_path_set_t* set, const char* path, size_t len) {
+    if (!set->capacity) return -1;
+    size_t mask = set->capacity - 1;
+    for (size_t i = fnv1a(path, len) & mask;; i = (i + 1) & mask) {
+        const char* key = set->keys[i];
+        if (!key) return -1;
+        if (key != git_set_tombstone && strncmp(key, path, len) == 0 && key[len] == '\0') return (long)i;
+    }
+}
+
+static void git_set_grow(git_path_set_t* set) {
+    size_t capacity = 64;
+    while (capacity < set->count * 4) capacity *= 2;
+    char** keys = calloc(capacity, sizeof(char*));
+    void** values = calloc(capacity, sizeof(void*));
+    if (!keys || !values) {
+        free(keys);
+        free(values);
+        return;
+    }
+    for (size_t i = 0; i < set->capacity; i++) {
+        char* key = set->keys[i];
+        if (!key || key == git_set_tombstone) continue;
+        size_t slot = fnv1a(key, strlen(key)) & (capacity - 1);
+        while (keys[slot]) slot = (slot + 1) & (capacity - 1);
+        keys[slot] = key;
+        values[slot] = set->values[i];
+    }
+    free(set->keys);
+    free(set->values);
+    set->keys = keys;
+    set->values = values;
+    set->capacity = capacity;
+    set->used = set->count;
+}
+
+static void git_set_add(git_path_set_t* set, const char* path, size_t len, void* value) {
+    if (git_set_find(set, path, len) >= 0) return;
+    if ((set->used + 1) * 2 > set->capacity) git_set_grow(set);
+    if ((set->used + 1) * 2 > set->capacity) return;
+    size_t mask = set->capacity - 1;
+    size_t i = fnv1a(path, len) & mask;
+    while (set->keys[i] && set->keys[i] != git_set_tombstone) i = (i + 1) & mask;
+    if (!set->keys[i]) set->used++;
+    set->keys[i] = strndup(path, len);
+    set->values[i] = value;
+    set->count++;
+}
+
+static void git_set_remove_slot(git_path_set_t* set, size_t i) {
+    free(set->keys[i]);
+    set->keys[i] = git_set_tombstone;
+    set->values[i] = NULL;
+    set->count--;
+}
+
+static void git_set_remove(git_path_set_t* set, const char* path, size_t len) {
+    long i = git_set_find(set, path, len);
+    if (i >= 0) git_set_remove_slot(set, (size_t)i);
+}
+
+// Every path under prefix (which ends in '/'), prefix included
+static void git_set_remove_prefix(git_path_set_t* set, const char* prefix, size_t len) {
+    for (size_t i = 0; i < set->capacity && set->count; i++) {
+        const char* key = set->keys[i];
+        if (key && key != git_set_tombstone && strncmp(key, prefix, len) == 0) git_set_remove_slot(set, i);
+    }
+}
+
+static void git_set_clear(git_path_set_t* set) {
+    for (size_t i = 0; i < set->capacity; i++) {
+        if (set->keys[i] && set->keys[i] != git_set_tombstone) free(set->keys[i]);
+        set->keys[i] = NULL;
+        set->values[i] = NULL;
+    }
+    set->count = 0;
+    set->used = 0;
+}
+
+// SHA-1 of a blob, to compare a file whose stat data changed with the index
+
+typedef struct {
+    uint32_t h[5];
+    uint64_t length;
+    unsigned char block[64];
+    size_t used;
+} git_sha1_t;
+
+#define GIT_ROL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+static void git_sha1_block(git_sha1_t* ctx, const unsigned char* p) {
+    uint32_t w[80];
+    for (int i = 0; i < 16; i++) {
+        w[i] = (uint32_t)p[i * 4] << 24 | (uint32_t)p[i * 4 + 1] << 16 | (uint32_t)p[i * 4 + 2] << 8 | p[i * 4 + 3];
+    }
+    for (int i = 16; i < 80; i++) {
+        w[i] = GIT_ROL(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+    uint32_t a = ctx->h[0], b = ctx->h[1], c = ctx->h[2], d = ctx->h[3], e = ctx->h[4];
+    for (int i = 0; i < 80; i++) {
+        uint32_t f, k;
+        if (i < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5a827999;
+        } else if (i < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ed9eba1;
+        } else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8f1bbcdc;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xca62c1d6;
+        }
+        uint32_t t = GIT_ROL(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = GIT_ROL(b, 30);
+        b = a;
+        a = t;
+    }
+    ctx->h[0] += a;
+    ctx->h[1] += b;
+    ctx->h[2] += c;
+    ctx->h[3] += d;
+    ctx->h[4] += e;
+}
+
+static void git_sha1_init(git_sha1_t* ctx) {
+    static const uint32_t initial[5] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0};
+    memcpy(ctx->h, initial, sizeof(initial));
+    ctx->length = 0;
+    ctx->used = 0;
+}
+
+static void git_sha1_update(git_sha1_t* ctx, const void* data, size_t len) {
+    const unsigned char* p = data;
+    ctx->length += len;
+    if (ctx->used) {
+        size_t take = 64 - ctx->used < len ? 64 - ctx->used : len;
+        memcpy(ctx->block + ctx->used, p, take);
+        ctx->used += take;
+        p += take;
+        len -= take;
+        if (ctx->used < 64) return;
+        git_sha1_block(ctx, ctx->block);
+        ctx->used = 0;
+    }
+    for (; len >= 64; p += 64, len -= 64) git_sha1_block(ctx, p);
+    memcpy(ctx->block, p, len);
+    ctx->used = len;
+}
+
+static void git_sha1_final(git_sha1_t* ctx, unsigned char out[20]) {
+    uint64_t bits = ctx->length * 8;
+    unsigned char pad[72] = {0x80};
+    size_t pad_len = (ctx->used < 56 ? 56 : 120) - ctx->used;
+    for (int i = 0; i < 8; i++) pad[pad_len + i] = (unsigned char)(bits >> (56 - i * 8));
+    git_sha1_update(ctx, pad, pad_len + 8);
+    for (int i = 0; i < 20; i++) out[i] = (unsigned char)(ctx->h[i / 4] >> (24 - (i % 4) * 8));
+}
+
+// 1 if the file (or symlink target) hashes to the entry's blob
+static int git_blob_matches(const char* path, const git_entry_t* entry, off_t size) {
+    git_sha1_t ctx;
+    char header[32];
+    unsigned char oid[20];
+    git_sha1_init(&ctx);
+    git_sha1_update(&ctx, header, (size_t)snprintf(header, sizeof(header), "blob %lld", (long long)size) + 1);
+
+    if ((entry->mode & S_IFMT) == S_IFLNK) {
+        char target[PATH_MAX];
+        ssize_t len = readlink(path, target, sizeof(target));
+        if (len != size) return 0;
+        git_sha1_update(&ctx, target, (size_t)len);
+    } else {
+        int fd = open(path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+        if (fd < 0) return 0;
+        char buffer[64 * 1024];
+        off_t total = 0;
+        ssize_t n;
+        while ((n = read(fd, buffer, sizeof(buffer))) > 0) {
+            git_sha1_update(&ctx, buffer, (size_t)n);
+            total += n;
+        }
+        close(fd);
+        if (n < 0 || total != size) return 0;       // Changed while being read
+    }
+    git_sha1_final(&ctx, oid);
+    return memcmp(oid, entry->oid, sizeof(oid)) == 0;
+}
+
+// Index
+
+static const char* git_entry_path(const git_entry_t* entry) {
+    return git_worker.pool + entry->path;
+}
+
+static int git_entry_compare(const git_entry_t* entry, const char* path, size_t len) {
+    size_t shorter = entry->path_len < len ? entry->path_len : len;
+    int cmp = memcmp(git_entry_path(entry), path, shorter);
+    if (cmp) return cmp;
+    return entry->path_len < len ? -1 : entry->path_len > len;
+}
+
+// First entry not before path (the index is sorted by path, then stage)
+static size_t git_lower_bound(const char* path, size_t len) {
+    size_t low = 0, high = git_worker.entry_count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (git_entry_compare(&git_worker.entries[mid], path, len) < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+static git_entry_t* git_find_entry(const char* path, size_t len) {
+    size_t i = git_lower_bound(path, len);
+    if (i < git_worker.entry_count && git_entry_compare(&git_worker.entries[i], path, len) == 0) {
+        return &git_worker.entries[i];
+    }
+    return NULL;
+}
+
+// 1 if some tracked path starts with prefix (which ends in '/')
+static int git_tracked_under(const char* prefix, size_t len) {
+    size_t i = git_lower_bound(prefix, len);
+    return i < git_worker.entry_count && git_worker.entries[i].path_len > len &&
+           memcmp(git_entry_path(&git_worker.entries[i]), prefix, len) == 0;
+}
+
+static uint32_t git_be32(const unsigned char* p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+// Parse .git/index (versions 2 to 4). Returns 0, or -1 if it cannot be
+// read or uses a split index, whose entries live in another file
+static int git_read_index(git_entry_t** entries_out, size_t* count_out, char** pool_out, struct timespec* mtime) {
+    char path[PATH_MAX + 16];
+    snprintf(path, sizeof(path), "%s/index", git_worker.git_dir);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        // A fresh repository has no index yet: nothing is tracked
+        *entries_out = NULL;
+        *count_out = 0;
+        *pool_out = NULL;
+        memset(mtime, 0, sizeof(*mtime));
+        return errno == ENOENT ? 0 : -1;
+    }
+    struct stat st;
+    size_t hash_len = git_worker.sha1 ? 20 : 32;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < 12 + hash_len) {
+        close(fd);
+        return -1;
+    }
+    size_t size = (size_t)st.st_size;
+    const unsigned char* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return -1;
+    *mtime = st.st_mtim;
+
+    uint32_t version = git_be32(data + 4);
+    uint32_t count = git_be32(data + 8);
+    size_t end = size - hash_len;                   // Trailing checksum
+    git_entry_t* entries = calloc(count ? count : 1, sizeof(git_entry_t));
+    size_t pool_size = size;
+    char* pool = malloc(pool_size);
+    char previous[PATH_MAX] = "";
+    size_t previous_len = 0;
+    size_t pool_used = 0;
+    size_t offset = 12;
+    int ok = memcmp(data, "DIRC", 4) == 0 && version >= 2 && version <= 4 && entries && pool;
+
+    for (uint32_t i = 0; ok && i < count; i++) {
+        size_t fixed = 40 + hash_len + 2;
+        if (offset + fixed > end) {
+            ok = 0;
+            break;
+        }
+        const unsigned char* p = data + offset;
+        git_entry_t* entry = &entries[i];
+        entry->mtime_s = git_be32(p + 8);
+        entry->mtime_ns = git_be32(p + 12);
+        entry->ino = git_be32(p + 20);
+        entry->mode = git_be32(p + 24);
+        entry->size = git_be32(p + 36);
+        memcpy(entry->oid, p + 40, sizeof(entry->oid));
+        uint16_t flags = (uint16_t)(p[40 + hash_len] << 8 | p[41 + hash_len]);
+        uint16_t extended = 0;
+        if (flags & 0x4000) {
+            if (version < 3 || offset + fixed + 2 > end) {
+                ok = 0;
+                break;
+            }
+            extended = (uint16_t)(p[fixed] << 8 | p[fixed + 1]);
+            fixed += 2;
+        }
+
+        const char* name;
+        size_t name_len;
+        if (version < 4) {
+            name = (const char*)p + fixed;
+            name_len = strnlen(name, end - offset - fixed);
+            offset += (fixed + name_len + 8) & ~(size_t)7;      // 1 to 8 NULs of padding
+        } else {
+            // Prefix compression: drop `strip` bytes from the previous path, append the suffix
+            size_t at = offset + fixed;
+            size_t strip = data[at] & 127;
+            while (data[at++] & 128 && at < end) strip = ((strip + 1) << 7) | (data[at] & 127);
+            const char* suffix = (const char*)data + at;
+            size_t suffix_len = strnlen(suffix, end - at);
+            if (strip > previous_len || previous_len - strip + suffix_len >= PATH_MAX) {
+                ok = 0;
+                break;
+            }
+            memcpy(previous + previous_len - strip, suffix, suffix_len);
+            previous_len = previous_len - strip + suffix_len;
+            previous[previous_len] = '\0';
+            name = previous;
+            name_len = previous_len;
+            offset = at + suffix_len + 1;
+        }
+        if (pool_used + name_len + 1 > pool_size) {
+            pool_size = pool_size * 2 + name_len + 1;
+            char* grown = realloc(pool, pool_size);
+            if (!grown) {
+                ok = 0;
+                break;
+            }
+            pool = grown;
+        }
+        memcpy(pool + pool_used, name, name_len);
+        pool[pool_used + name_len] = '\0';
+        entry->path = (uint32_t)pool_used;
+        entry->path_len = (uint32_t)name_len;
+        pool_used += name_len + 1;
+
+        entry->stage = (flags >> 12) & 3;
+        uint32_t type = entry->mode & S_IFMT;
+        if (entry->stage || (extended & 0x2000)) {
+            entry->skip = 1;                            // Unmerged or intent-to-add: dirty until git says otherwise
+            entry->state = GIT_ENTRY_DIRTY;
+        } else if ((extended & 0x4000) || type == 0160000 || type == S_IFDIR) {
+            entry->skip = 1;                            // Skip-worktree, submodule, sparse directory
+            entry->state = GIT_ENTRY_CLEAN;
+        }
+    }
+
+    // Extensions follow the entries; a split index keeps them elsewhere
+    while (ok && offset + 8 <= end) {
+        if (memcmp(data + offset, "link", 4) == 0) ok = 0;
+        offset += 8 + git_be32(data + offset + 4);
+    }
+    munmap((void*)data, size);
+    if (!ok) {
+        free(entries);
+        free(pool);
+        return -1;
+    }
+    *entries_out = entries;
+    *count_out = count;
+    *pool_out = pool;
+    return 0;
+}
+
+// Compare one tracked file with the index, through the stat cache
+static void git_check_entry(git_entry_t* entry) {
+    if (entry->skip) return;
+    char path[PATH_MAX];
+    if (snprintf(path, sizeof(path), "%s/%s", git_worker.root, git_entry_path(entry)) >= (int)sizeof(path)) return;
+
+    entry->state = GIT_ENTRY_DIRTY;
+    struct stat st;
+    if (lstat(path, &st) != 0) return;                  // Deleted
+    int is_link = (entry->mode & S_IFMT) == S_IFLNK;
+    if (is_link ? !S_ISLNK(st.st_mode) : !S_ISREG(st.st_mode)) return;
+    if (!is_link && !(st.st_mode & S_IXUSR) != !(entry->mode & S_IXUSR)) return;
+
+    uint32_t size = (uint32_t)st.st_size;
+    uint32_t mtime_s = (uint32_t)st.st_mtim.tv_sec;
+    uint32_t mtime_ns = (uint32_t)st.st_mtim.tv_nsec;
+    uint32_t ino = (uint32_t)st.st_ino;
+    if (!entry->seen_valid || entry->seen_size != size || entry->seen_mtime_s != mtime_s ||
+        entry->seen_mtime_ns != mtime_ns || entry->seen_ino != ino) {
+        // Changed since the last comparison. A file modified after the index
+        // was written may still match its stat data (racy git), so only an
+        // older one is trusted without hashing
+        int racy = st.st_mtim.tv_sec > git_worker.index_mtime.tv_sec ||
+                   (st.st_mtim.tv_sec == git_worker.index_mtime.tv_sec &&
+                    st.st_mtim.tv_nsec >= git_worker.index_mtime.tv_nsec);
+        if (size != entry->size) {
+            entry->seen_clean = 0;
+        } else if (!racy && mtime_s == entry->mtime_s && mtime_ns == entry->mtime_ns && ino == entry->ino) {
+            entry->seen_clean = 1;
+        } else {
+            entry->seen_clean = git_worker.sha1 && git_blob_matches(path, entry, st.st_size);
+        }
+        entry->seen_size = size;
+        entry->seen_mtime_s = mtime_s;
+        entry->seen_mtime_ns = mtime_ns;
+        entry->seen_ino = ino;
+        entry->seen_valid = 1;
+    }
+    entry->state = entry->seen_clean ? GIT_ENTRY_CLEAN : GIT_ENTRY_DIRTY;
+}
+
+// Ignore rules
+
+// gitignore globbing: '*' and '?' stay within a path component, "**"
+// spans components, "**/" also matches no directory at all
+static int git_glob_match(const char* pattern, const char* text) {
+    for (; *pattern; pattern++, text++) {
+        if (*pattern == '*') {
+            if (pattern[1] == '*') {
+                pattern += 2;
+                if (!*pattern) return 1;
+                if (*pattern == '/') {
+                    pattern++;
+                    for (;;) {
+                        if (git_glob_match(pattern, text)) return 1;
+                        text = strchr(text, '/');
+                        if (!text) return 0;
+                        text++;
+                    }
+                }
+                for (;; text++) {
+                    if (git_glob_match(pattern, text)) return 1;
+                    if (!*text) return 0;
+                }
+            }
+            for (pattern++;; text++) {
+                if (git_glob_match(pattern, text)) return 1;
+                if (!*text || *text == '/') return 0;
+            }
+        }
+        if (!*text) return 0;
+        if (*pattern == '?') {
+            if (*text == '/') return 0;
+            continue;
+        }
+        if (*pattern == '[') {
+            const char* close = pattern + 1;
+            if (*close == '!' || *close == '^') close++;
+            if (*close == ']') close++;
+            while (*close && *close != ']') close++;
+            if (*close) {
+                char class[128];
+                char single[2] = {*text, '\0'};
+                size_t len = (size_t)(close - pattern + 1);
+                if (len >= sizeof(class) || *text == '/') return 0;
+                memcpy(class, pattern, len);
+                class[len] = '\0';
+                if (class[1] == '^') class[1] = '!';
+                if (fnmatch(class, single, 0) != 0) return 0;
+                pattern = close;
+                continue;
+            }
+        }
+        if (*pattern == '\\' && pattern[1]) pattern++;
+        if (*pattern != *text) return 0;
+    }
+    return !*text;
+}
+
+static void git_ignore_load(git_ignore_list_t* list, const char* path) {
+    FILE* file = fopen(path, "r");
+    if (!file) return;
+    char line[1024];
+    while (fgets(line, sizeof(line), file)) {
+        size_t len = strcspn(line, "\r\n");
+        while (len > 0 && line[len - 1] == ' ' && (len < 2 || line[len - 2] != '\\')) len--;
+        line[len] = '\0';
+        char* pattern = line;
+        if (!*pattern || *pattern == '#') continue;
+        git_ignore_rule_t rule = {0};
+        if (*pattern == '!') {
+            rule.negate = 1;
+            pattern++;
+        } else if (*pattern == '\\' && (pattern[1] == '!' || pattern[1] == '#')) {
+            pattern++;
+        }
+        len = strlen(pattern);
+        if (len > 0 && pattern[len - 1] == '/') {
+            rule.dir_only = 1;
+            pattern[--len] = '\0';
+        }
+        if (!len) continue;
+        rule.anchored = strchr(pattern, '/') != NULL;
+        if (*pattern == '/') pattern++;
+
+        git_ignore_rule_t* grown = realloc(list->rules, (size_t)(list->count + 1) * sizeof(git_ignore_rule_t));
+        if (!grown) break;
+        list->rules = grown;
+        rule.pattern = strdup(pattern);
+        list->rules[list->count++] = rule;
+    }
+    fclose(file);
+}
+
+// Rules of the .gitignore in dir ("" or "a/b/"), read on first use
+static git_ignore_list_t* git_ignore_list(const char* dir, size_t len) {
+    long slot = git_set_find(&git_worker.ignore_lists, dir, len);
+    if (slot >= 0) return git_worker.ignore_lists.values[slot];
+    git_ignore_list_t* list = calloc(1, sizeof(git_ignore_list_t));
+    if (!list) return NULL;
+    list->dir_len = len;
+    char path[PATH_MAX + 16];
+    snprintf(path, sizeof(path), "%s/%.*s.gitignore", git_worker.root, (int)len, dir);
+    git_ignore_load(list, path);
+    git_set_add(&git_worker.ignore_lists, dir, len, list);
+    return list;
+}
+
+static void git_ignore_forget(const char* dir, size_t len) {
+    long slot = git_set_find(&git_worker.ignore_lists, dir, len);
+    if (slot < 0) return;
+    git_ignore_list_t* list = git_worker.ignore_lists.values[slot];
+    for (int i = 0; i < list->count; i++) free(list->rules[i].pattern);
+    free(list->rules);
+    free(list);
+    git_set_remove_slot(&git_worker.ignore_lists, (size_t)slot);
+}
+
+// 1 ignored, 0 re-included, -1 no rule of the list matched
+static int git_ignore_match(const git_ignore_list_t* list, const char* path, int is_dir) {
+    const char* name = strrchr(path, '/');
+    name = name ? name + 1 : path;
+    for (int i = list->count - 1; i >= 0; i--) {
+        const git_ignore_rule_t* rule = &list->rules[i];
+        if (rule->dir_only && !is_dir) continue;
+        if (git_glob_match(rule->pattern, rule->anchored ? path + list->dir_len : name)) return !rule->negate;
+    }
+    return -1;
+}
+
+// Whether path itself is ignored; the directories above it are the caller's
+// business. The nearest .gitignore wins, then info/exclude, then the global file
+static int git_ignored(const char* path, int is_dir) {
+    size_t len = strlen(path);
+    for (;;) {
+        while (len > 0 && path[len - 1] != '/') len--;
+        git_ignore_list_t* list = git_ignore_list(path, len);
+        int verdict = list ? git_ignore_match(list, path, is_dir) : -1;
+        if (verdict >= 0) return verdict;
+        if (len == 0) break;
+        len--;
+    }
+    return git_ignore_match(&git_worker.excludes, path, is_dir) == 1;
+}
+
+// Whether path or any directory above it is ignored
+static int git_ignored_path(const char* path, int is_dir) {
+    char prefix[PATH_MAX];
+    for (const char* slash = strchr(path, '/'); slash; slash = strchr(slash + 1, '/')) {
+        size_t len = (size_t)(slash - path);
+        memcpy(prefix, path, len);
+        prefix[len] = '\0';
+        if (git_ignored(prefix, 1)) return 1;
+    }
+    return git_ignored(path, is_dir);
+}
+
+static void git_load_excludes(void) {
+    char path[PATH_MAX + 32];
+    const char* config_home = getenv("XDG_CONFIG_HOME");
+    const char* home = getenv("HOME");
+    if (config_home && *config_home) {
+        snprintf(path, sizeof(path), "%s/git/ignore", config_home);
+        git_ignore_load(&git_worker.excludes, path);
+    } else if (home) {
+        snprintf(path, sizeof(path), "%s/.config/git/ignore", home);
+        git_ignore_load(&git_worker.excludes, path);
+    }
+    // Loaded last so it wins: rules are tried from the end
+    snprintf(path, sizeof(path), "%s/info/exclude", git_worker.git_dir);
+    git_ignore_load(&git_worker.excludes, path);
+}
+
+// Worktree walk
+
+static void git_watch_dir(const char* dir, size_t len) {
+    if (git_worker.inotify_fd < 0 || git_worker.watch_failed) return;
+    char path[PATH_MAX + 8];
+    snprintf(path, sizeof(path), "%s/%.*s", git_worker.root, (int)len, dir);
+    int wd = inotify_add_watch(git_worker.inotify_fd, path, GIT_WATCH_EVENTS | IN_ONLYDIR);
+    if (wd < 0) {
+        if (errno == ENOSPC || errno == ENOMEM) git_worker.watch_failed = 1;
+        return;
+    }
+    if (wd >= git_worker.watch_capacity) {
+        int capacity = git_worker.watch_capacity ? git_worker.watch_capacity : 1024;
+        while (capacity <= wd) capacity *= 2;
+        char** grown = realloc(git_worker.watch_dirs, (size_t)capacity * sizeof(char*));
+        if (!grown) return;
+        memset(grown + git_worker.watch_capacity, 0, (size_t)(capacity - git_worker.watch_capacity) * sizeof(char*));
+        git_worker.watch_dirs = grown;
+        git_worker.watch_capacity = capacity;
+    }
+    if (git_worker.watch_dirs[wd]) {
+        free(git_worker.watch_dirs[wd]);        // Already watched under this descriptor
+    } else {
+        git_worker.watches++;
+    }
+    git_worker.watch_dirs[wd] = strndup(dir, len);
+}
+
+static void git_walk(char* dir, size_t len, int ignored);
+
+// Account for one worktree path, named relative to the root in a PATH_MAX
+// buffer: an untracked file, or a directory to walk. parent_ignored says
+// the directory it is in is ignored
+static void git_visit(char* path, size_t len, int is_dir, int parent_ignored) {
+    if (is_dir) {
+        git_entry_t* entry = git_find_entry(path, len);
+        if (entry && (entry->mode & S_IFMT) == 0160000) return;        // Submodule
+        if (len + 2 >= PATH_MAX) return;
+        path[len] = '/';
+        path[len + 1] = '\0';
+        int tracked = git_tracked_under(path, len + 1);
+        path[len] = '\0';
+        int ignored = parent_ignored || git_ignored(path, 1);
+        if (ignored && !tracked) return;
+
+        char nested[PATH_MAX + 16];
+        struct stat st;
+        snprintf(nested, sizeof(nested), "%s/%s/.git", git_worker.root, path);
+        if (!tracked && lstat(nested, &st) == 0) {
+            path[len] = '/';
+            git_set_add(&git_worker.untracked, path, len + 1, NULL);   // Another repository: one entry
+            path[len] = '\0';
+            return;
+        }
+        path[len] = '/';
+        path[len + 1] = '\0';
+        git_walk(path, len + 1, ignored);
+        path[len] = '\0';
+        return;
+    }
+    if (parent_ignored || git_find_entry(path, len) || git_ignored(path, 0)) return;
+    git_set_add(&git_worker.untracked, path, len, NULL);
+}
+
+// Watch dir ("" or ending in '/') and visit its entries. Inside an ignored
+// directory only the watches matter: tracked files there still change
+static void git_walk(char* dir, size_t len, int ignored) {
+    git_watch_dir(dir, len);
+    char path[PATH_MAX + 8];
+    snprintf(path, sizeof(path), "%s/%s", git_worker.root, dir);
+    DIR* handle = opendir(path);
+    if (!handle) return;
+    struct dirent* entry;
+    while ((entry = readdir(handle)) != NULL) {
+        const char* name = entry->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0 || strcmp(name, ".git") == 0) continue;
+        size_t name_len = strlen(name);
+        if (len + name_len + 2 >= PATH_MAX) continue;
+        memcpy(dir + len, name, name_len + 1);
+        int is_dir = entry->d_type == DT_DIR;
+        if (entry->d_type == DT_UNKNOWN) {
+            struct stat st;
+            snprintf(path, sizeof(path), "%s/%s", git_worker.root, dir);
+            is_dir = lstat(path, &st) == 0 && S_ISDIR(st.st_mode);
+        }
+        git_visit(dir, len + name_len, is_dir, ignored);
+    }
+    dir[len] = '\0';
+    closedir(handle);
+}
+
+static void git_full_scan(void) {
+    long start = get_time_ms();
+    for (size_t i = 0; i < git_worker.entry_count; i++) {
+        git_check_entry(&git_worker.entries[i]);
+    }
+    git_set_clear(&git_worker.untracked);
+    git_set_clear(&git_worker.pending);
+    char dir[PATH_MAX] = "";
+    git_walk(dir, 0, 0);
+    git_worker.scan_ms = (uint32_t)(get_time_ms() - start);
+    git_worker.rescan = 0;
+}
+
+// Bring one path named by an event up to date: tracked entries at or under
+// it, and its untracked state. Directories end in '/'
+static void git_recheck(const char* name, size_t len) {
+    char path[PATH_MAX];
+    int was_dir = len > 0 && name[len - 1] == '/';
+    if (was_dir) len--;
+    if (len == 0 || len + 2 >= PATH_MAX) return;
+    memcpy(path, name, len);
+    path[len] = '\0';
+
+    for (size_t i = git_lower_bound(path, len); i < git_worker.entry_count; i++) {
+        git_entry_t* entry = &git_worker.entries[i];
+        if (git_entry_compare(entry, path, len) != 0) break;
+        git_check_entry(entry);
+    }
+    path[len] = '/';
+    for (size_t i = git_lower_bound(path, len + 1); i < git_worker.entry_count; i++) {
+        git_entry_t* entry = &git_worker.entries[i];
+        if (entry->path_len <= len || memcmp(git_entry_path(entry), path, len + 1) != 0) break;
+        git_check_entry(entry);
+    }
+    if (was_dir) git_set_remove_prefix(&git_worker.untracked, path, len + 1);
+    path[len] = '\0';
+    git_set_remove(&git_worker.untracked, path, len);
+
+    char full[PATH_MAX * 2];
+    struct stat st;
+    snprintf(full, sizeof(full), "%s/%s", git_worker.root, path);
+    if (lstat(full, &st) != 0) return;
+    char* slash = strrchr(path, '/');
+    int parent_ignored = 0;
+    if (slash) {
+        *slash = '\0';
+        parent_ignored = git_ignored_path(path, 1);
+        *slash = '/';
+    }
+    git_visit(path, len, S_ISDIR(st.st_mode), parent_ignored);
+}
+
+// Merge a rewritten index into the current one: entries whose blob and mode
+// are unchanged keep their verdict and stat cache
+static void git_reload_index(void) {
+    git_entry_t* entries;
+    size_t count;
+    char* pool;
+    struct timespec mtime;
+    if (git_read_index(&entries, &count, &pool, &mtime) != 0) {
+        git_worker.supported = 0;
+        return;
+    }
+
+    git_entry_t* old_entries = git_worker.entries;
+    size_t old_count = git_worker.entry_count;
+    char* old_pool = git_worker.pool;
+    git_path_set_t dropped = {0};
+    size_t i = 0, j = 0;
+    while (i < old_count || j < count) {
+        int cmp;
+        if (i == old_count) {
+            cmp = 1;
+        } else if (j == count) {
+            cmp = -1;
+        } else {
+            git_entry_t* before = &old_entries[i];
+            size_t shorter = before->path_len < entries[j].path_len ? before->path_len : entries[j].path_len;
+            cmp = memcmp(old_pool + before->path, pool + entries[j].path, shorter);
+            if (!cmp) cmp = (int)before->path_len - (int)entries[j].path_len;
+            if (!cmp) cmp = (int)before->stage - (int)entries[j].stage;
+        }
+        if (cmp < 0) {
+            git_set_add(&dropped, old_pool + old_entries[i].path, old_entries[i].path_len, NULL);
+            i++;
+        } else if (cmp > 0) {
+            git_set_remove(&git_worker.untracked, pool + entries[j].path, entries[j].path_len);
+            if (!entries[j].skip) entries[j].state = GIT_ENTRY_UNKNOWN;
+            j++;
+        } else {
+            git_entry_t* before = &old_entries[i];
+            git_entry_t* after = &entries[j];
+            if (!after->skip && !before->skip && before->mode == after->mode &&
+                memcmp(before->oid, after->oid, sizeof(after->oid)) == 0) {
+                after->state = before->state;
+                after->seen_valid = before->seen_valid;
+                after->seen_clean = before->seen_clean;
+                after->seen_size = before->seen_size;
+                after->seen_mtime_s = before->seen_mtime_s;
+                after->seen_mtime_ns = before->seen_mtime_ns;
+                after->seen_ino = before->seen_ino;
+            } else if (!after->skip) {
+                after->state = GIT_ENTRY_UNKNOWN;
+            }
+            i++;
+            j++;
+        }
+    }
+
+    git_worker.entries = entries;
+    git_worker.entry_count = count;
+    git_worker.pool = pool;
+    git_worker.index_mtime = mtime;
+    free(old_entries);
+    free(old_pool);
+
+    if (!git_worker.supported) {
+        git_worker.supported = 1;
+        git_worker.rescan = 1;
+    }
+    for (size_t k = 0; k < count; k++) {
+        if (entries[k].state == GIT_ENTRY_UNKNOWN) git_check_entry(&entries[k]);
+    }
+    // No longer tracked: now untracked, unless ignored or gone
+    for (size_t k = 0; k < dropped.capacity; k++) {
+        const char* path = dropped.keys[k];
+        if (path && path != git_set_tombstone) git_recheck(path, strlen(path));
+    }
+    git_set_clear(&dropped);
+    free(dropped.keys);
+    free(dropped.values);
+}
+
+static void git_read_branch(char* branch, size_t size) {
+    char path[PATH_MAX + 8];
+    char head[256] = "";
+    snprintf(path, sizeof(path), "%s/HEAD", git_worker.git_dir);
+    FILE* file = fopen(path, "r");
+    if (file) {
+        if (!fgets(head, sizeof(head), file)) head[0] = '\0';
+        fclose(file);
+    }
+    head[strcspn(head, "\r\n")] = '\0';
+    if (strncmp(head, "ref: refs/heads/", 16) == 0) {
+        snprintf(branch, size, "%s", head + 16);
+    } else if (strncmp(head, "ref: ", 5) == 0) {
+        snprintf(branch, size, "%s", head + 5);
+    } else {
+        snprintf(branch, size, "%.7s", head);           // Detached: short commit id
+    }
+}
+
+static void git_publish(int status) {
+    uint32_t clean = 0, dirty = 0;
+    for (size_t i = 0; i < git_worker.entry_count; i++) {
+        const git_entry_t* entry = &git_worker.entries[i];
+        if (entry->stage && i > 0 && git_entry_compare(&git_worker.entries[i - 1], git_entry_path(entry),
+                                                       entry->path_len) == 0) {
+            continue;                                   // One unmerged path, several stages
+        }
+        if (entry->state == GIT_ENTRY_CLEAN) clean++;
+        if (entry->state == GIT_ENTRY_DIRTY) dirty++;
+    }
+    char branch[64];
+    git_read_branch(branch, sizeof(branch));
+
+    git_status_shared_t* shared = git_worker.shared;
+    shared->seq++;
+    __sync_synchronize();
+    shared->state = git_worker.supported ? status : GIT_STATUS_UNSUPPORTED;
+    shared->clean = clean;
+    shared->dirty = dirty;
+    shared->untracked = (uint32_t)git_worker.untracked.count;
+    shared->watches = git_worker.watch_failed ? 0 : (uint32_t)git_worker.watches;
+    shared->scan_ms = git_worker.scan_ms;
+    memcpy(shared->branch, branch, sizeof(branch));
+    __sync_synchronize();
+    shared->seq++;
+}
+
+// Collect one read's worth of events into the pending set
+static void git_read_events(void) {
+    char buffer[64 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t len;
+    while ((len = read(git_worker.inotify_fd, buffer, sizeof(buffer))) > 0) {
+        for (char* p = buffer; p < buffer + len; p += sizeof(struct inotify_event) + ((struct inotify_event*)p)->len) {
+            const struct inotify_event* event = (const struct inotify_event*)p;
+            const char* name = event->len ? event->name : "";
+            if (event->mask & IN_Q_OVERFLOW) {
+                git_worker.rescan = 1;
+                continue;
+            }
+            if (event->wd == git_worker.git_dir_wd) {
+                if (strcmp(name, "index") == 0) git_worker.index_changed = 1;
+                if (strcmp(name, "HEAD") == 0) git_worker.head_changed = 1;
+                continue;
+            }
+            if (event->wd < 0 || event->wd >= git_worker.watch_capacity || !git_worker.watch_dirs[event->wd]) continue;
+            const char* dir = git_worker.watch_dirs[event->wd];
+            if (event->mask & IN_IGNORED) {
+                free(git_worker.watch_dirs[event->wd]);  // Directory gone
+                git_worker.watch_dirs[event->wd] = NULL;
+                git_worker.watches--;
+                continue;
+            }
+            if (!*name || strcmp(name, ".git") == 0) continue;
+            if (strcmp(name, ".gitignore") == 0) {
+                git_ignore_forget(dir, strlen(dir));
+                git_worker.rescan = 1;                  // Any untracked file below may flip
+            }
+            char path[PATH_MAX];
+            int path_len = snprintf(path, sizeof(path), "%s%s%s", dir, name, (event->mask & IN_ISDIR) ? "/" : "");
+            if (path_len > 0 && path_len < (int)sizeof(path)) {
+                git_set_add(&git_worker.pending, path, (size_t)path_len, NULL);
+            }
+        }
+    }
+}
+
+static int git_status_rescan_s(void) {
+    const char* value = getenv("GIT_STATUS_RESCAN_S");
+    int seconds = value ? atoi(value) : 0;
+    return seconds > 0 ? seconds : GIT_STATUS_DEFAULT_RESCAN_S;
+}
+
+static void git_status_worker(git_status_shared_t* shared, const char* root, const char* git_dir, pid_t parent) {
+    memset(&git_worker, 0, sizeof(git_worker));
+    git_worker.shared = shared;
+    git_worker.inotify_fd = -1;
+    git_worker.git_dir_wd = -1;
+    snprintf(git_worker.root, sizeof(git_worker.root), "%s", root);
+    snprintf(git_worker.git_dir, sizeof(git_worker.git_dir), "%s", git_dir);
+
+    char config_path[PATH_MAX + 8];
+    char line[256];
+    git_worker.sha1 = 1;
+    snprintf(config_path, sizeof(config_path), "%s/config", git_dir);
+    FILE* config = fopen(config_path, "r");
+    while (config && fgets(line, sizeof(line), config)) {
+        if (strstr(line, "objectformat") && strstr(line, "sha256")) git_worker.sha1 = 0;
+    }
+    if (config) fclose(config);
+
+    // SIGUSR1 from the prompt asks for pending events to be taken in now. It is
+    // blocked before the first publish, the earliest the prompt sends it
+    sigset_t flush_signal;
+    sigemptyset(&flush_signal);
+    sigaddset(&flush_signal, SIGUSR1);
+    sigprocmask(SIG_BLOCK, &flush_signal, NULL);
+    int flush_fd = signalfd(-1, &flush_signal, SFD_NONBLOCK | SFD_CLOEXEC);
+
+    git_worker.supported = git_read_index(&git_worker.entries, &git_worker.entry_count, &git_worker.pool,
+                                          &git_worker.index_mtime) == 0;
+    git_load_excludes();
+    git_worker.inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (git_worker.inotify_fd >= 0) {
+        git_worker.git_dir_wd = inotify_add_watch(git_worker.inotify_fd, git_dir, IN_MOVED_TO | IN_CLOSE_WRITE);
+    } else {
+        git_worker.watch_failed = 1;
+    }
+    if (git_worker.supported) git_full_scan();
+    git_publish(GIT_STATUS_READY);
+
+    int rescan_ms = git_status_rescan_s() * 1000;
+    long last_scan = get_time_ms();
+    struct pollfd pfds[2] = {{git_worker.inotify_fd, POLLIN, 0}, {flush_fd, POLLIN, 0}};  // poll skips fds < 0
+    for (;;) {
+        if (getppid() != parent) _exit(0);
+        int timeout = git_worker.watch_failed ? rescan_ms : 5000;
+        int ready = poll(pfds, 2, timeout);
+        int interval_due = git_worker.watch_failed && get_time_ms() - last_scan >= rescan_ms;
+        if (ready <= 0 && !interval_due) continue;
+
+        if (ready > 0 && (pfds[0].revents & POLLIN) && !(pfds[1].revents & POLLIN)) {
+            // Debounce: a checkout or build raises thousands of events at once.
+            // A flush request ends the batch early
+            long batch_start = get_time_ms();
+            do {
+                git_read_events();
+            } while (get_time_ms() - batch_start < GIT_STATUS_MAX_BATCH_MS &&
+                     poll(pfds, 2, GIT_STATUS_DEBOUNCE_MS) > 0 && !(pfds[1].revents & POLLIN));
+        }
+        int flushing = ready > 0 && (pfds[1].revents & POLLIN);
+        uint32_t flush_request = 0;
+        if (flushing) {
+            struct signalfd_siginfo info;
+            while (read(flush_fd, &info, sizeof(info)) == (ssize_t)sizeof(info)) {}
+            flush_request = git_worker.shared->flush_request;
+            __sync_synchronize();
+            git_read_events();                          // The command has exited, its events are queued
+        }
+        if (git_worker.index_changed) {
+            git_worker.index_changed = 0;
+            git_reload_index();
+        }
+        git_worker.head_changed = 0;                    // Read again by git_publish
+        if ((git_worker.rescan || interval_due) && git_worker.supported) {
+            git_full_scan();
+            last_scan = get_time_ms();
+        } else if (git_worker.supported) {
+            git_path_set_t* pending = &git_worker.pending;
+            for (size_t i = 0; i < pending->capacity; i++) {
+                const char* path = pending->keys[i];
+                if (path && path != git_set_tombstone) git_recheck(path, strlen(path));
+            }
+        }
+        git_set_clear(&git_worker.pending);
+        git_publish(GIT_STATUS_READY);
+        if (flushing) git_worker.shared->flushed = flush_request;
+    }
+}
+
+// Frontend side
+
+int is_git_status_enabled(void) {
+    const char* enabled = getenv("GIT_STATUS");
+    return !enabled || strcmp(enabled, "0") != 0;      // Enabled by default
+}
+
+// Worktree root and git directory of the repository containing cwd
+static int git_find_repository(const char* cwd, char* root, char* git_dir) {
+    if (strstr(cwd, "/.git/") || (strlen(cwd) >= 5 && strcmp(cwd + strlen(cwd) - 5, "/.git") == 0)) return -1;
+    char dir[PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s", cwd);
+    for (;;) {
+        char dot_git[PATH_MAX];
+        struct stat st;
+        if (snprintf(dot_git, sizeof(dot_git), "%s/.git", strcmp(dir, "/") == 0 ? "" : dir) >= (int)sizeof(dot_git)) {
+            return -1;
+        }
+        if (stat(dot_git, &st) == 0) {
+            snprintf(root, PATH_MAX, "%s", dir);
+            if (S_ISDIR(st.st_mode)) {
+                snprintf(git_dir, PATH_MAX, "%s", dot_git);
+                return 0;
+            }
+            // Linked worktree or submodule: "gitdir: <path>"
+            char line[PATH_MAX + 16] = "";
+            FILE* file = fopen(dot_git, "r");
+            if (!file) return -1;
+            if (!fgets(line, sizeof(line), file)) line[0] = '\0';
+            fclose(file);
+            line[strcspn(line, "\r\n")] = '\0';
+            if (strncmp(line, "gitdir: ", 8) != 0) return -1;
+            if (line[8] == '/') {
+                snprintf(git_dir, PATH_MAX, "%s", line + 8);
+            } else if (snprintf(git_dir, PATH_MAX, "%s/%s", dir, line + 8) >= PATH_MAX) {
+                return -1;
+            }
+            return 0;
+        }
+        char* slash = strrchr(dir, '/');
+        if (!slash || slash == dir) {
+            if (strcmp(dir, "/") == 0) return -1;
+            strcpy(dir, "/");
+            continue;
+        }
+        *slash = '\0';
+    }
+}
+
+void git_status_stop(void) {
+    if (git_status.worker_pid > 0) {
+        kill(git_status.worker_pid, SIGKILL);
+        waitpid(git_status.worker_pid, NULL, 0);
+        git_status.worker_pid = 0;
+    }
+    if (git_status.shared) {
+        munmap(git_status.shared, sizeof(git_status_shared_t));
+        git_status.shared = NULL;
+    }
+    git_status.root[0] = '\0';
+}
+
+// Start, switch or stop the worker as the shell changes directory. Runs
+// before every prompt; unless the directory changed that is one getcwd and
+// one waitpid
+void git_status_follow(void) {
+    if (!is_git_status_enabled()) {
+        if (git_status.shared) git_status_stop();
+        git_status.last_cwd[0] = '\0';
+        return;
+    }
+    if (git_status.worker_pid > 0 && waitpid(git_status.worker_pid, NULL, WNOHANG) != 0) {
+        git_status.worker_pid = 0;                      // Died: counts go, until the next repository
+    }
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd)) || strcmp(cwd, git_status.last_cwd) == 0) return;
+    snprintf(git_status.last_cwd, sizeof(git_status.last_cwd), "%s", cwd);
+
+    char root[PATH_MAX] = "";
+    char git_dir[PATH_MAX] = "";
+    if (git_find_repository(cwd, root, git_dir) != 0) root[0] = '\0';
+    if (strcmp(root, git_status.root) == 0) return;     // Same repository, or still none
+    git_status_stop();
+    if (!root[0]) return;
+
+    git_status_shared_t* shared = mmap(NULL, sizeof(git_status_shared_t), PROT_READ | PROT_WRITE,
+                                       MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED) return;
+    memset(shared, 0, sizeof(*shared));
+    shared->state = GIT_STATUS_SCANNING;
+    memset(&git_status.last, 0, sizeof(git_status.last));
+    git_status.last.state = GIT_STATUS_SCANNING;
+
+    fflush(stdout);
+    pid_t parent = getpid();
+    pid_t pid = fork();
+    if (pid == 0) {
+        // Worker: stays out of the way of the shell, dies with it
+        reset_forked_process_state();
+        signal(SIGINT, SIG_IGN);
+        prctl(PR_SET_NAME, "awesh_git", 0, 0, 0);
+        prctl(PR_SET_PDEATHSIG, SIGKILL, 0, 0, 0);
+        if (nice(10) == -1) { /* best effort */ }
+        git_status_worker(shared, root, git_dir, parent);
+        _exit(0);
+    }
+    if (pid < 0) {
+        munmap(shared, sizeof(git_status_shared_t));
+        return;
+    }
+    git_status.shared = shared;
+    git_status.worker_pid = pid;
+    snprintf(git_status.root, sizeof(git_status.root), "%s", root);
+}
+
+// Before a prompt: have the worker take in what the last command changed
+// now, not after its debounce, so the counts are not a prompt behind. Skipped
+// while the first scan runs; a worker busy rescanning costs at most the wait
+void git_status_flush(void) {
+    git_status_shared_t* shared = git_status.shared;
+    if (!shared || git_status.worker_pid <= 0 || shared->state != GIT_STATUS_READY) return;
+    uint32_t request = shared->flush_request + 1;
+    shared->flush_request = request;
+    __sync_synchronize();
+    if (kill(git_status.worker_pid, SIGUSR1) != 0) return;
+    long deadline = get_time_ms() + GIT_STATUS_FLUSH_WAIT_MS;
+    while (shared->flushed != request && get_time_ms() < deadline) {
+        struct timespec pause = {0, 200 * 1000};
+        nanosleep(&pause, NULL);
+    }
+}
+
+// Copy of the published status; the last consistent one if the worker is
+// mid-write, so the prompt never waits
+static const git_status_shared_t* git_status_snapshot(void) {
+    git_status_shared_t* shared = git_status.shared;
+    if (!shared) return NULL;
+    for (int tries = 0; tries < 4; tries++) {
+        uint32_t seq = shared->seq;
+        if (seq & 1) continue;
+        __sync_synchronize();
+        git_status_shared_t copy;
+        memcpy(&copy, (const void*)shared, sizeof(copy));
+        __sync_synchronize();
+        if (shared->seq == seq) {
+            git_status.last = copy;
+            break;
+        }
+    }
+    return &git_status.last;
+}
+
+// Prompt segment: the branch, then ✎dirty ?untracked, ✓ when both are 0,
+// … until the first scan is done
+void git_status_segment(char* segment, size_t size) {
+    segment[0] = '\0';
+    const git_status_shared_t* status = git_status_snapshot();
+    if (!status || !status->branch[0]) return;
+    int length = snprintf(segment, size, "%s", status->branch);
+    if (length < 0 || (size_t)length >= size || !git_status.worker_pid) return;
+    if (status->state == GIT_STATUS_SCANNING) {
+        snprintf(segment + length, size - (size_t)length, " …");
+    } else if (status->state == GIT_STATUS_READY) {
+        if (!status->dirty && !status->untracked) {
+            snprintf(segment + length, size - (size_t)length, " ✓");
+        } else if (!status->untracked) {
+            snprintf(segment + length, size - (size_t)length, " ✎%u", status->dirty);
+        } else if (!status->dirty) {
+            snprintf(segment + length, size - (size_t)length, " ?%u", status->untracked);
+        } else {
+            snprintf(segment + length, size - (size_t)length, " ✎%u ?%u", status->dirty, status->untracked);
+        }
+    }
+}
+
+// One line for awes
+void print_git_status(void) {
+    const git_status_shared_t* status = git_status_snapshot();
+    if (!is_git_status_enabled()) {
+        printf("🌿 Git status: off (GIT_STATUS=0)\n");
+    } else if (!status) {
+        printf("🌿 Git status: not in a repository\n");
+    } else if (!git_status.worker_pid) {
+        printf("🌿 Git status: %s, worker stopped\n", git_status.root);
+    } else if (status->state == GIT_STATUS_UNSUPPORTED) {
+        printf("🌿 Git status: %s, index not readable (split index?), branch only\n", git_status.root);
+    } else if (status->state == GIT_STATUS_SCANNING) {
+        printf("🌿 Git status: %s, first scan running (pid %d)\n", git_status.root, git_status.worker_pid);
+    } else {
+        printf("🌿 Git status: %s - %u clean, %u dirty, %u untracked; scan %ums, ", git_status.root,
+               status->clean, status->dirty, status->untracked, status->scan_ms);
+        if (status->watches) {
+            printf("%u directories watched\n", status->watches);
+        } else {
+            printf("rescanned every %ds (inotify watches exhausted)\n", git_status_rescan_s());
+        }
+    }
+}
+
+// ============================================================================
+// Command previews
+//
+// An AI command that may change files is not run by the backend: the sandbox
+// runs it in a copy-on-write overlay of the project tree, and the reply shows
+// its output and the files it would change. The backend queues each such
+// command in ~/.awesh_preview/pending.<our pid> ("dir\treason\tcwd\tcommand",
+// "-" for an empty field), one queue per session. Once the reply is drawn the frontend asks once for all of
+// them. Applying moves the overlays' files onto the real tree
+// (PREVIEW_COMMIT), so nothing runs twice; commands the overlay cannot hold
+// (a cluster, a cloud API, another host) run for real only then. Anything
+// other than "y" throws the overlays away.
+// ============================================================================
+
+#define PREVIEW_MAX_PENDING 32
+
+typedef struct {
+    const char* dir;                // Overlay holding its changes, NULL if it did not run in one
+    const char* reason;             // Why it runs for real when applied, NULL to commit the overlay
+    const char* cwd;
+    const char* command;
+} preview_entry_t;
+
+static const char* preview_field(char** line) {
+    char* field = strsep(line, "\t");
+    if (!field || strcmp(field, "-") == 0) return NULL;
+    return arena_strdup(&request_arena, field);
+}
+
+// Read and remove the queue the backend wrote while answering; how many entries
+static int read_pending_previews(preview_entry_t* entries, int max) {
+    const char* home = getenv("HOME");
+    if (!home) return 0;
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/.awesh_preview/pending.%d", home, (int)getpid());
+    FILE* file = fopen(path, "r");
+    if (!file) return 0;
+    unlink(path);
+    
+    int count = 0;
+    char* line = NULL;
+    size_t size = 0;
+    ssize_t len;
+    while (count < max && (len = getline(&line, &size, file)) > 0) {
+        if (line[len - 1] == '\n') line[len - 1] = '\0';
+        char* rest = line;
+        preview_entry_t* entry = &entries[count];
+        entry->dir = preview_field(&rest);
+        entry->reason = preview_field(&rest);
+        entry->cwd = preview_field(&rest);
+        entry->command = rest ? arena_strdup(&request_arena, rest) : NULL;
+        if (entry->cwd && entry->command) count++;
+    }
+    free(line);
+    fclose(file);
+    return count;
+}
+
+// Print a sandbox reply's STDOUT and STDERR, each read by its declared length
+static void print_sandbox_output(const char* reply) {
+    const char* cursor = reply;
+    const char* names[] = {"STDOUT", "STDERR"};
+    for (int i = 0; i < 2; i++) {
+        char label[16];
+        snprintf(label, sizeof(label), "%s_LEN:", names[i]);
+        const char* len_line = strstr(cursor, label);
+        if (!len_line) return;
+        size_t len = strtoul(len_line + strlen(label), NULL, 10);
+        snprintf(label, sizeof(label), "\n%s:", names[i]);
+        const char* value = strstr(len_line, label);
+        if (!value) return;
+        value += strlen(label);
+        size_t available = strlen(value);
+        len = len < available ? len : available;
+        if (len > 0) printf("   %.*s%s", (int)len, value, value[len - 1] == '\n' ? "" : "\n");
+        cursor = value + len;
+    }
+}
+
+// PREVIEW_COMMIT or PREVIEW_DISCARD one overlay (and the ones it builds on); the sandbox's exit code
+static int preview_request(const char* verb, const char* dir, int show) {
+    char request[PATH_MAX + 32];
+    snprintf(request, sizeof(request), "%s:%s", verb, dir);
+    abuf_t reply;
+    if (abuf_init(&reply, &request_arena, 256) != 0 || send_to_sandbox(request, &reply) != 0) {
+        if (show) printf("   ❌ Sandbox not reachable; %s was left as it is\n", dir);
+        return -1;
+    }
+    const char* exit_line = strstr(reply.data, "EXIT_CODE:");
+    if (show) print_sandbox_output(reply.data);
+    return exit_line ? atoi(exit_line + 10) : -1;
+}
+
+static int preview_run_for_real(const preview_entry_t* entry) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) return -1;
+    if (pid == 0) {
+        reset_forked_process_state();
+        if (chdir(entry->cwd) != 0) {
+            fprintf(stderr, "awesh: cd %s: %s\n", entry->cwd, strerror(errno));
+            _exit(126);
+        }
+        execl("/bin/bash", "bash", "-c", entry->command, (char*)NULL);
+        fprintf(stderr, "awesh: bash: %s\n", strerror(errno));
+        _exit(127);
+    }
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + (WIFSIGNALED(status) ? WTERMSIG(status) : 0);
+}
+
+static void discard_previews(const preview_entry_t* entries, int from, int count) {
+    for (int i = from; i < count; i++) {
+        if (entries[i].dir) preview_request("PREVIEW_DISCARD", entries[i].dir, 0);
+    }
+}
+
+// Apply in reply order. A run of plain previews forms one chain, committed
+// through its last overlay; an overlay that could not stack on the one
+// before it (another tree) is committed on its own.
+static void apply_previews(const preview_entry_t* entries, int count) {
+    int i = 0;
+    while (i < count) {
+        if (entries[i].reason) {
+            if (entries[i].dir) preview_request("PREVIEW_DISCARD", entries[i].dir, 0);
+            printf("▶ %s\n", entries[i].command);
+            int exit_code = preview_run_for_real(&entries[i]);
+            if (exit_code != 0 && i + 1 < count) {
+                printf("❌ Exit %d; the commands after it were not applied\n", exit_code);
+                discard_previews(entries, i + 1, count);
+                return;
+            }
+            if (exit_code != 0) printf("❌ Exit %d\n", exit_code);
+            i++;
+            continue;
+        }
+        
+        int end = i;
+        while (end + 1 < count && !entries[end + 1].reason) end++;
+        for (int j = end; j >= i; j--) {
+            struct stat st;
+            if (j < end && stat(entries[j].dir, &st) != 0) continue;     // Committed with the chain
+            if (preview_request("PREVIEW_COMMIT", entries[j].dir, 1) != 0) {
+                printf("❌ The commands from here on were not applied\n");
+                discard_previews(entries, i, count);
+                return;
+            }
+        }
+        i = end + 1;
+    }
+}
+
+// After a reply: confirm the commands it previewed or held back
+void resolve_command_previews(void) {
+    preview_entry_t entries[PREVIEW_MAX_PENDING];
+    int count = read_pending_previews(entries, PREVIEW_MAX_PENDING);
+    if (count == 0) return;
+    
+    if (!isatty(STDIN_FILENO)) {
+        discard_previews(entries, 0, count);
+        printf("\n🔍 %d previewed command%s discarded (no terminal to confirm on)\n", count, count == 1 ? "" : "s");
+        return;
+    }
+    
+    int for_real = 0;
+    for (int i = 0; i < count; i++) {
+        if (entries[i].reason) for_real++;
+    }
+    printf("\n🔍 %d command%s previewed, nothing changed yet", count, count == 1 ? "" : "s");
+    if (for_real > 0) printf("; applying also runs %d for real:", for_real);
+    printf("\n");
+    for (int i = 0; i < count; i++) {
+        if (entries[i].reason) printf("   ▶ %s  (%s)\n", entries[i].command, entries[i].reason);
+    }
+    
+    char* answer = readline("   Apply? [y/N] ");
+    if (!answer) printf("\n");
+    char choice = answer ? (char)tolower((unsigned char)answer[0]) : 'n';
+    free(answer);
+    
+    if (choice == 'y') {
+        apply_previews(entries, count);
+    } else {
+        discard_previews(entries, 0, count);
+        printf("   Discarded\n");
+    }
+}
+
+// ============================================================================
+// Resource view (awes)
+//
+// RSS, CPU, fds and threads for the frontend, its helpers and their workers,
+// read from /proc through fds kept open between samples - one pread per
+// file. The prompt loop samples every component, so awes can show CPU% over
+// the last few seconds rather than since the process started.
+// ============================================================================
+
+#define RESOURCE_MAX_PROCS 16
+#define RESOURCE_SAMPLES 16             // Ring of CPU samples per process
+#define RESOURCE_WINDOW_MS 10000        // CPU% covers at most this much history
+#define RESOURCE_MIN_INTERVAL_MS 500    // Closer samples are skipped, so the ring spans the window
+
+typedef struct {
+    pid_t pid;                  // 0 when the slot is free
+    char role[48];
+    int depth;                  // 1 for a helper's worker
+    int stat_fd;
+    int statm_fd;
+    int children_fd;            // -1 unless workers are listed
+    DIR* fd_dir;
+    uint64_t ticks[RESOURCE_SAMPLES];
+    long at_ms[RESOURCE_SAMPLES];
+    int samples;                // Total taken; the ring holds the last RESOURCE_SAMPLES
+    int current;                // Still part of the stack at the last sample
+    // Latest sample
+    char comm[32];
+    long rss_kb;
+    long threads;
+    int fds;
+} proc_watch_t;
+
+static proc_watch_t proc_watches[RESOURCE_MAX_PROCS];
+static long last_resource_sample_ms = 0;
+
+static int open_proc_file(pid_t pid, const char* name) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/%s", (int)pid, name);
+    return open(path, O_RDONLY | O_CLOEXEC);
+}
+
+static ssize_t pread_proc(int fd, char* buf, size_t size) {
+    if (fd < 0) return -1;
+    ssize_t n = pread(fd, buf, size - 1, 0);
+    if (n < 0) return -1;
+    buf[n] = '\0';
+    return n;
+}
+
+static void release_proc_watch(proc_watch_t* watch) {
+    if (watch->stat_fd >= 0) close(watch->stat_fd);
+    if (watch->statm_fd >= 0) close(watch->statm_fd);
+    if (watch->children_fd >= 0) close(watch->children_fd);
+    if (watch->fd_dir) closedir(watch->fd_dir);
+    memset(watch, 0, sizeof(*watch));
+}
+
+// Find or start watching a pid. A pid that changed role is a new process
+static proc_watch_t* watch_process(pid_t pid, const char* role, int depth, int list_children) {
+    if (pid <= 0) return NULL;
+    proc_watch_t* free_slot = NULL;
+    for (int i = 0; i < RESOURCE_MAX_PROCS; i++) {
+        proc_watch_t* watch = &proc_watches[i];
+        if (watch->pid == pid) {
+            watch->current = 1;
+            return watch;
+        }
+        if (!watch->pid && !free_slot) free_slot = watch;
+    }
+    if (!free_slot) return NULL;
+    
+    free_slot->pid = pid;
+    snprintf(free_slot->role, sizeof(free_slot->role), "%s", role);
+    free_slot->depth = depth;
+    free_slot->stat_fd = open_proc_file(pid, "stat");
+    free_slot->statm_fd = open_proc_file(pid, "statm");
+    free_slot->children_fd = -1;
+    if (list_children) {
+        char name[64];
+        snprintf(name, sizeof(name), "task/%d/children", (int)pid);
+        free_slot->children_fd = open_proc_file(pid, name);
+    }
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/fd", (int)pid);
+    free_slot->fd_dir = opendir(path);
+    free_slot->current = 1;
+    if (free_slot->stat_fd < 0) {
+        release_proc_watch(free_slot);
+        return NULL;
+    }
+    return free_slot;
 }
 
-void execute_command_securely(const char* cmd) {
-    // Check if any children are ready
-    int backend_ready = (state.backend_pid > 0 && is_process_running(state.backend_pid) && state.socket_fd >= 0);
-    
-    if (state.verbose >= 2) {
-        printf("DEBUG: execute_command_securely called with: %s\n", cmd);
+static void read_proc_watch(proc_watch_t* watch, long now) {
+    char buf[1024];
+    if (pread_proc(watch->stat_fd, buf, sizeof(buf)) <= 0) {
+        watch->current = 0;     // Gone; the slot is released below
+        return;
     }
     
-    // Handle built-in commands that must run in the current process
-    char cmd_copy[MAX_CMD_LEN];
-    strncpy(cmd_copy, cmd, sizeof(cmd_copy) - 1);
-    cmd_copy[sizeof(cmd_copy) - 1] = '\0';
+    // comm may hold spaces and parentheses; the fields follow the last ')'
+    char* open_paren = strchr(buf, '(');
+    char* close_paren = strrchr(buf, ')');
+    if (!open_paren || !close_paren || close_paren < open_paren) return;
+    snprintf(watch->comm, sizeof(watch->comm), "%.*s", (int)(close_paren - open_paren - 1), open_paren + 1);
     
-    // Extract first word
-    char* first_word = strtok(cmd_copy, " \t");
-    if (first_word && strcmp(first_word, "cd") == 0) {
-        // Handle cd command - must change directory in current process
-        char* target_dir = strtok(NULL, " \t");
-        if (!target_dir || strlen(target_dir) == 0) {
-            // cd with no arguments - go to home directory
-            const char* home = getenv("HOME");
-            if (home) {
-                if (chdir(home) == 0) {
-                    if (state.verbose >= 2) {
-                        printf("✅ Changed directory to %s\n", home);
-                    }
-                } else {
-                    printf("cd: %s: No such file or directory\n", home);
-                }
-            } else {
-                printf("cd: HOME not set\n");
-            }
-        } else {
-            // cd to specified directory
-            if (chdir(target_dir) == 0) {
-                if (state.verbose >= 2) {
-                    printf("✅ Changed directory to %s\n", target_dir);
-                }
-            } else {
-                printf("cd: %s: No such file or directory\n", target_dir);
-            }
-        }
+    unsigned long long utime = 0, stime = 0;
+    long threads = 0;
+    if (sscanf(close_paren + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu %*d %*d %*d %*d %ld",
+               &utime, &stime, &threads) != 3) {
         return;
     }
+    watch->threads = threads;
     
-    // Check if this looks like an AI query first (BEFORE executing)
-    if (is_ai_query(cmd) && backend_ready) {
-        if (state.verbose >= 2) {
-            printf("🤖 AI query detected: %s\n", cmd);
+    long size_pages = 0, resident_pages = 0;
+    if (pread_proc(watch->statm_fd, buf, sizeof(buf)) > 0 &&
+        sscanf(buf, "%ld %ld", &size_pages, &resident_pages) == 2) {
+        watch->rss_kb = resident_pages * (sysconf(_SC_PAGESIZE) / 1024);
+    }
+    
+    if (watch->fd_dir) {
+        rewinddir(watch->fd_dir);
+        int fds = 0;
+        struct dirent* entry;
+        while ((entry = readdir(watch->fd_dir)) != NULL) {
+            if (entry->d_name[0] != '.') fds++;
         }
-        // Show thinking dots while processing
-        printf("🤔 Thinking");
-        fflush(stdout);
-        
-        // Send directly to backend - backend will check with security agent
-        send_to_backend_directly(cmd);
-        return;
+        if (watch->pid == getpid()) fds--;     // Our own listing of /proc/self/fd
+        watch->fds = fds;
     }
     
-    // UNFILTERED EXECUTION: Run command directly (fast execution)
-    if (state.verbose >= 2) {
-        printf("🖥️ Running command directly (unfiltered): %s\n", cmd);
+    int slot = watch->samples % RESOURCE_SAMPLES;
+    watch->ticks[slot] = utime + stime;
+    watch->at_ms[slot] = now;
+    watch->samples++;
+}
+
+// Workers are a helper's direct children (the sandbox's bash, the backend's
+// man-page indexer). Needs /proc/<pid>/task/<pid>/children
+static void watch_children(proc_watch_t* parent) {
+    char buf[512];
+    if (pread_proc(parent->children_fd, buf, sizeof(buf)) <= 0) return;
+    
+    char* save = NULL;
+    for (char* token = strtok_r(buf, " \n", &save); token; token = strtok_r(NULL, " \n", &save)) {
+        char role[sizeof(parent->role)];
+        snprintf(role, sizeof(role), "%.32s worker", parent->role);
+        watch_process((pid_t)atoi(token), role, 1, 0);
+    }
+}
+
+// Cheap enough for every prompt: a few preads and one directory listing per process
+static void sample_resources_now(void) {
+    long now = get_time_ms();
+    last_resource_sample_ms = now;
+    for (int i = 0; i < RESOURCE_MAX_PROCS; i++) {
+        proc_watch_t* watch = &proc_watches[i];
+        watch->current = 0;
+        // A dead pid may come back as an unrelated process
+        if (watch->pid && watch->depth == 0 && watch->pid != getpid() && watch->pid != state.backend_pid &&
+            watch->pid != state.security_agent_pid && watch->pid != state.sandbox_pid &&
+            watch->pid != git_status.worker_pid) {
+            release_proc_watch(watch);
+        }
     }
     
-    // Execute command directly (unfiltered) - only if NOT an AI query
-    int result = system(cmd);
+    watch_process(getpid(), "awesh", 0, 0);
+    watch_process(state.security_agent_pid, "awesh_sec", 0, 0);
+    proc_watch_t* sandbox = watch_process(state.sandbox_pid, "awesh_sandbox", 0, 1);
+    proc_watch_t* backend = watch_process(state.backend_pid, "awesh_backend", 0, 1);
+    watch_process(git_status.worker_pid, "awesh_git", 0, 0);
+    if (sandbox) watch_children(sandbox);
+    if (backend) watch_children(backend);
+    
+    for (int i = 0; i < RESOURCE_MAX_PROCS; i++) {
+        proc_watch_t* watch = &proc_watches[i];
+        if (!watch->pid) continue;
+        if (watch->current) read_proc_watch(watch, now);
+        if (!watch->current) release_proc_watch(watch);
+    }
+}
+
+void sample_resources(void) {
+    if (get_time_ms() - last_resource_sample_ms < RESOURCE_MIN_INTERVAL_MS) return;
+    sample_resources_now();
+}
+
+// CPU% between the newest sample and the oldest one still inside the window;
+// -1 until there are two
+static double proc_watch_cpu(const proc_watch_t* watch) {
+    if (watch->samples < 2) return -1;
+    int newest = (watch->samples - 1) % RESOURCE_SAMPLES;
+    int available = watch->samples < RESOURCE_SAMPLES ? watch->samples : RESOURCE_SAMPLES;
+    int oldest = -1;
+    for (int age = available - 1; age >= 1; age--) {
+        int slot = (watch->samples - 1 - age) % RESOURCE_SAMPLES;
+        if (watch->at_ms[newest] - watch->at_ms[slot] <= RESOURCE_WINDOW_MS) {
+            oldest = slot;
+            break;
+        }
+    }
+    if (oldest < 0) return -1;
+    long elapsed_ms = watch->at_ms[newest] - watch->at_ms[oldest];
+    if (elapsed_ms <= 0) return -1;
+    double cpu_ms = (watch->ticks[newest] - watch->ticks[oldest]) * 1000.0 / sysconf(_SC_CLK_TCK);
+    return 100.0 * cpu_ms / elapsed_ms;
+}
+
+// Sum of every series of one metric family in another process's Prometheus
+// output (its socket in ~/.awesh_metrics). A family the process has not
+// registered yet counts as 0; -1 if the process did not answer
+static int scrape_metric(const char* role, pid_t pid, const char* name, double* value) {
+    const char* home = getenv("HOME");
+    if (!home || pid <= 0) return -1;
     
-    int exit_code = WEXITSTATUS(result);
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s/" METRICS_DIR_NAME "/%s.%d.sock", home, role, (int)pid);
     
-    if (state.verbose >= 2) {
-        printf("DEBUG: Command result - exit_code=%d\n", exit_code);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
     }
     
-    // POST-FACTO DETECTION: Only treat non-zero exit codes as anomalous
-    int is_anomalous = (exit_code != 0);
-    if (is_anomalous && state.verbose >= 2) {
-        printf("🚨 Anomalous exit code detected: %d\n", exit_code);
+    // Speaking HTTP first gets an answer without the raw-reader wait
+    const char* request = "GET /metrics HTTP/1.0\r\n\r\n";
+    send(fd, request, strlen(request), MSG_NOSIGNAL);
+    abuf_t body;
+    if (abuf_init(&body, &request_arena, RECV_CHUNK) != 0) {
+        close(fd);
+        return -1;
     }
-
-    // If anomalous and looks like an interactive program, rerun with TTY
-    if (is_anomalous) {
-        char first_word[64] = {0};
-        sscanf(cmd, "%63s", first_word);
-        if (strcmp(first_word, "top") == 0 || strcmp(first_word, "watch") == 0 ||
-            strcmp(first_word, "vi") == 0 || strcmp(first_word, "vim") == 0 ||
-            strcmp(first_word, "less") == 0) {
-            // Only rerun interactively if we have a TTY (real user session)
-            if (isatty(STDIN_FILENO)) {
-                if (state.verbose >= 2) {
-                    printf("🖥️ Detected interactive program after failure - rerunning with TTY: %s\n", first_word);
-                }
-                run_interactive_command(cmd);
-                return;
+    struct pollfd pfd = {fd, POLLIN, 0};
+    while (poll(&pfd, 1, 200) > 0 && abuf_recv(&body, fd, RECV_CHUNK, 0) > 0) {
+    }
+    close(fd);
+    
+    if (body.len == 0) return -1;
+    
+    size_t name_len = strlen(name);
+    *value = 0;
+    for (char* line = body.data; line && *line; ) {
+        char* next = strchr(line, '\n');
+        if (next) *next++ = '\0';
+        if (strncmp(line, name, name_len) == 0 && (line[name_len] == '{' || line[name_len] == ' ')) {
+            char* space = strrchr(line, ' ');
+            if (space) {
+                *value += atof(space + 1);
             }
         }
+        line = next;
     }
-    
-    // If no anomalies detected, command executed successfully
-    if (!is_anomalous) {
-        if (state.verbose >= 2) {
-            printf("✅ Command executed successfully (no anomalies)\n");
-        }
-        return;
+    return 0;
+}
+
+static void print_scraped(const char* label, const char* role, pid_t pid, const char* name) {
+    double value;
+    if (scrape_metric(role, pid, name, &value) == 0) {
+        printf("  %-34s %g\n", label, value);
+    } else {
+        printf("  %-34s -\n", label);
+    }
+}
+
+void print_resource_table(void) {
+    // A CPU% needs two samples inside the window; take a short one if the
+    // prompt loop has not left one recently
+    sample_resources_now();
+    int need_second = 0;
+    for (int i = 0; i < RESOURCE_MAX_PROCS; i++) {
+        if (proc_watches[i].pid && proc_watch_cpu(&proc_watches[i]) < 0) need_second = 1;
+    }
+    if (need_second) {
+        usleep(200000);
+        sample_resources_now();
     }
     
-    // ANOMALOUS RESULT DETECTED - Get backend assistance
-    if (backend_ready) {
-        if (state.verbose >= 2) {
-            printf("🤔 Anomalous result detected - getting backend assistance\n");
+    printf("\n🧮 Resources:\n");
+    printf("  %-22s %7s %9s %6s %5s %4s\n", "COMPONENT", "PID", "RSS", "CPU%", "FDS", "THR");
+    long total_kb = 0;
+    double total_cpu = 0;
+    // Helpers in a fixed order, each followed by its workers
+    const char* order[] = {"awesh", "awesh_backend", "awesh_sec", "awesh_sandbox"};
+    for (size_t r = 0; r < sizeof(order) / sizeof(order[0]); r++) {
+        for (int pass = 0; pass < 2; pass++) {
+            for (int i = 0; i < RESOURCE_MAX_PROCS; i++) {
+                proc_watch_t* watch = &proc_watches[i];
+                if (!watch->pid || watch->depth != pass) continue;
+                size_t len = strlen(order[r]);
+                if (strncmp(watch->role, order[r], len) != 0 || (watch->role[len] && watch->role[len] != ' ')) continue;
+                
+                char name[sizeof(watch->role)];
+                if (pass) {
+                    snprintf(name, sizeof(name), "  %s", watch->comm);
+                } else {
+                    snprintf(name, sizeof(name), "%s", watch->role);
+                }
+                double cpu = proc_watch_cpu(watch);
+                char cpu_text[16];
+                if (cpu >= 0) {
+                    snprintf(cpu_text, sizeof(cpu_text), "%.1f", cpu);
+                    total_cpu += cpu;
+                } else {
+                    snprintf(cpu_text, sizeof(cpu_text), "-");
+                }
+                printf("  %-22s %7d %7.1fMB %6s %5d %4ld\n", name, (int)watch->pid, watch->rss_kb / 1024.0,
+                       cpu_text, watch->fds, watch->threads);
+                total_kb += watch->rss_kb;
+            }
         }
-        
-        // Show thinking dots while processing
-        printf("🤔 Thinking");
-        fflush(stdout);
-        
-        // Send to backend with context about the anomaly
-        send_to_backend_directly(cmd);
+    }
+    printf("  %-22s %7s %7.1fMB %6.1f\n", "total", "", total_kb / 1024.0, total_cpu);
+    
+    // Bytes waiting on the frontend's end of the backend socket, and what the
+    // processes themselves report as queued or in progress
+    printf("\n📬 IPC:\n");
+    int unread = 0, unsent = 0;
+    if (state.socket_fd >= 0 && ioctl(state.socket_fd, SIOCINQ, &unread) == 0 &&
+        ioctl(state.socket_fd, SIOCOUTQ, &unsent) == 0) {
+        printf("  %-34s %d unread, %d unsent\n", "backend socket bytes", unread, unsent);
     } else {
-        // No backend available - show error
-        if (state.verbose >= 1) {
-            printf("❌ Command failed (exit %d)\n", exit_code);
+        printf("  %-34s not connected\n", "backend socket bytes");
+    }
+    print_scraped("backend in-flight requests", "awesh_backend", state.backend_pid, "awesh_backend_inflight_requests");
+    print_scraped("backend dispatch queue", "awesh_backend", state.backend_pid, "awesh_backend_dispatch_queue_depth");
+    print_scraped("security agent connections", "awesh_sec", state.security_agent_pid, "awesh_security_connections");
+}
+
+// ============================================================================
+// Startup profile (awesh --profile-startup)
+//
+// Every process appends its phase marks to one file (trace_startup_mark);
+// once the first prompt is ready the frontend reads them back and prints a
+// per-process breakdown and the critical path to that prompt. The frontend
+// blocks on the backend's socket, so the path runs through the backend's
+// interpreter start and imports; the sandbox and security agent start in
+// parallel and only show up in the breakdown.
+// ============================================================================
+
+#define STARTUP_MAX_MARKS 128
+
+typedef struct {
+    uint64_t ns;
+    char process[32];
+    int pid;
+    char phase[64];
+} startup_mark_t;
+
+static int startup_mark_compare(const void* a, const void* b) {
+    const startup_mark_t* x = a;
+    const startup_mark_t* y = b;
+    return x->ns < y->ns ? -1 : (x->ns > y->ns ? 1 : 0);
+}
+
+static const startup_mark_t* find_startup_mark(const startup_mark_t* marks, int count,
+                                               const char* process, const char* phase) {
+    for (int i = 0; i < count; i++) {
+        if (strcmp(marks[i].process, process) == 0 && strcmp(marks[i].phase, phase) == 0) {
+            return &marks[i];
         }
     }
+    return NULL;
 }
 
-void handle_bash_with_ai_fallback(const char* cmd) {
-    // If AI is ready, try bash and capture output for AI context
-    if (state.socket_fd >= 0 && state.ai_status == AI_READY) {
-        // Capture both stdout and stderr for AI context
-        char temp_file[] = "/tmp/awesh_bash_XXXXXX";
-        int fd = mkstemp(temp_file);
-        if (fd != -1) {
-            close(fd);
-            
-            char bash_cmd[MAX_CMD_LEN + 100];
-            snprintf(bash_cmd, sizeof(bash_cmd), "%s >%s 2>&1", cmd, temp_file);
-            int result = system(bash_cmd);
-            
-            if (result == 0) {
-                // Bash succeeded - show output and clean up immediately
-                char cat_cmd[200];
-                snprintf(cat_cmd, sizeof(cat_cmd), "cat %s", temp_file);
-                system(cat_cmd);
-                unlink(temp_file);
-                return; // Exit immediately - no AI processing needed
+static void print_path_step(const char* process, const char* label, uint64_t from_ns, uint64_t to_ns, uint64_t total_ns) {
+    double ms = (to_ns - from_ns) / 1e6;
+    int bar = total_ns ? (int)((to_ns - from_ns) * 30 / total_ns) : 0;
+    printf("  %9.1fms %5.1f%%  %-14s %-28s ", ms, total_ns ? 100.0 * (to_ns - from_ns) / total_ns : 0.0, process, label);
+    for (int i = 0; i < bar; i++) printf("█");
+    printf("\n");
+}
+
+// Consecutive phases of one process between two instants, as path steps
+static void print_process_path(const startup_mark_t* marks, int count, const char* process,
+                               uint64_t* cursor, uint64_t until_ns, uint64_t total_ns) {
+    for (int i = 0; i < count; i++) {
+        if (strcmp(marks[i].process, process) != 0) continue;
+        if (marks[i].ns <= *cursor || marks[i].ns > until_ns) continue;
+        print_path_step(process, marks[i].phase, *cursor, marks[i].ns, total_ns);
+        *cursor = marks[i].ns;
+    }
+}
+
+// startup.<pid>.log of shells that have exited; each profiled start leaves one
+static void remove_stale_startup_profiles(const char* dir_path) {
+    DIR* dir = opendir(dir_path);
+    if (!dir) return;
+    
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        int pid = 0;
+        int end = 0;
+        if (sscanf(entry->d_name, "startup.%d.log%n", &pid, &end) != 1 || entry->d_name[end] != '\0') continue;
+        if (pid > 0 && kill(pid, 0) != 0 && errno == ESRCH) {
+            char path[1024];
+            snprintf(path, sizeof(path), "%s/%s", dir_path, entry->d_name);
+            unlink(path);
+        }
+    }
+    closedir(dir);
+}
+
+void print_startup_profile(const char* path) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        printf("⚠️ No startup profile recorded (%s)\n", path);
+        return;
+    }
+    
+    startup_mark_t marks[STARTUP_MAX_MARKS];
+    int count = 0;
+    char line[256];
+    while (count < STARTUP_MAX_MARKS && fgets(line, sizeof(line), file)) {
+        unsigned long long ns;
+        startup_mark_t* mark = &marks[count];
+        if (sscanf(line, "%llu %31s %d %63s", &ns, mark->process, &mark->pid, mark->phase) == 4) {
+            mark->ns = ns;
+            count++;
+        }
+    }
+    fclose(file);
+    qsort(marks, count, sizeof(marks[0]), startup_mark_compare);
+    
+    const startup_mark_t* start = find_startup_mark(marks, count, "awesh", "main");
+    const startup_mark_t* prompt = find_startup_mark(marks, count, "awesh", "first_prompt");
+    if (!start || !prompt) {
+        printf("⚠️ Startup profile incomplete (%d marks in %s)\n", count, path);
+        return;
+    }
+    uint64_t total_ns = prompt->ns - start->ns;
+    
+    printf("\n🚀 Startup profile: first prompt after %.1fms\n", total_ns / 1e6);
+    
+    // Per process: each phase as time since the frontend's main(), and how
+    // long the process spent getting there from its previous phase
+    const char* processes[] = {"awesh", "awesh_backend", "awesh_sandbox", "awesh_sec"};
+    for (size_t p = 0; p < sizeof(processes) / sizeof(processes[0]); p++) {
+        uint64_t previous = 0;
+        int shown = 0;
+        for (int i = 0; i < count; i++) {
+            if (strcmp(marks[i].process, processes[p]) != 0) continue;
+            if (!shown++) printf("\n  %s (PID %d)\n", processes[p], marks[i].pid);
+            double at_ms = ((int64_t)(marks[i].ns - start->ns)) / 1e6;
+            if (previous) {
+                printf("    %9.1fms  %-30s %+9.1fms%s\n", at_ms, marks[i].phase, (marks[i].ns - previous) / 1e6,
+                       marks[i].ns > prompt->ns ? "  (after prompt)" : "");
             } else {
-                // Bash failed - send command and output to AI as context
-                if (state.verbose >= 1) {
-                    printf("Command failed (exit %d), trying AI assistance...\n", result);
-                    // Debug: show what was captured
-                    printf("🔧 Error output captured in temp file:\n");
-                    char cat_debug[200];
-                    snprintf(cat_debug, sizeof(cat_debug), "cat %s", temp_file);
-                    system(cat_debug);
-                    printf("🔧 End of captured output\n");
-                }
-                
-                // Send command with bash failure context to backend
-                char context_cmd[MAX_CMD_LEN + 200];
-                snprintf(context_cmd, sizeof(context_cmd), "BASH_FAILED:%d:%s:%s", result, cmd, temp_file);
-                send_command(context_cmd);
-                unlink(temp_file);
+                printf("    %9.1fms  %-30s\n", at_ms, marks[i].phase);
             }
-        } else {
-            // Fallback if temp file creation fails
-            int result = system(cmd);
-            if (result != 0 && state.verbose >= 1) {
-                printf("Command failed (exit %d), trying AI assistance...\n", result);
-                send_command(cmd);
+            previous = marks[i].ns;
+        }
+    }
+    
+    // Critical path: the frontend up to forking the backend, the backend up to
+    // listening, the frontend's wait for the connection, then the rest of the
+    // frontend. Without a backend it is the frontend alone
+    printf("\n  Critical path:\n");
+    uint64_t cursor = start->ns;
+    const startup_mark_t* forked = find_startup_mark(marks, count, "awesh", "backend_forked");
+    const startup_mark_t* connected = find_startup_mark(marks, count, "awesh", "backend_connected");
+    const startup_mark_t* listening = find_startup_mark(marks, count, "awesh_backend", "listening");
+    if (forked && connected && listening && forked->ns < listening->ns && listening->ns <= connected->ns) {
+        print_process_path(marks, count, "awesh", &cursor, forked->ns, total_ns);
+        
+        const startup_mark_t* python_start = NULL;
+        for (int i = 0; i < count && !python_start; i++) {
+            if (strcmp(marks[i].process, "awesh_backend") == 0 && marks[i].ns > forked->ns) {
+                python_start = &marks[i];
             }
         }
-    } else {
-        // No AI available, run bash normally (show errors)
-        system(cmd);
+        if (python_start && python_start->ns < listening->ns) {
+            print_path_step("awesh_backend", "exec + interpreter start", cursor, python_start->ns, total_ns);
+            cursor = python_start->ns;
+        }
+        print_process_path(marks, count, "awesh_backend", &cursor, listening->ns, total_ns);
+        print_path_step("awesh", "connect retry wait", cursor, connected->ns, total_ns);
+        cursor = connected->ns;
     }
+    print_process_path(marks, count, "awesh", &cursor, prompt->ns, total_ns);
+    printf("\n");
 }
 
-
-int main() {
+int awesh_main(int argc, char** argv) {
+    uint64_t main_start = trace_now_ns();
+    
+    // awesh --profile-startup: every process marks its startup phases into
+    // one file, summarised when the first prompt is ready
+    char startup_profile_path[600] = "";
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--profile-startup") == 0) {
+            char dir[512];
+            if (trace_dir(dir, sizeof(dir)) == 0) {
+                remove_stale_startup_profiles(dir);
+                snprintf(startup_profile_path, sizeof(startup_profile_path), "%s/startup.%d.log", dir, (int)getpid());
+                unlink(startup_profile_path);
+                setenv(STARTUP_PROFILE_ENV, startup_profile_path, 1);
+            }
+        }
+    }
+    trace_startup_mark_at("main", main_start);
+    
     // Setup signal handlers
     signal(SIGINT, handle_sigint);     // Ctrl+C returns to prompt
     signal(SIGTERM, cleanup_and_exit); // SIGTERM exits cleanly
@@ -2350,6 +8859,23 @@ int main() {
     
     // Load configuration FIRST, before any startup messages
     load_config();
+    init_terminal_output();
+    trace_startup_mark("config_loaded");
+    arena_init(&request_arena, 0);
+    trace_init("awesh");
+    flight_create();
+    flight_init("awesh");
+    flight_install_crash_handler();
+    init_frontend_metrics();
+    trace_startup_mark("trace_metrics_ready");
+    
+    // Compile the local intent table (microsecond lookups, no backend needed)
+    init_intent_engine();
+    trace_startup_mark("intent_engine_compiled");
+    
+    // Command -> package index for install hints, rebuilt in the background if stale
+    refresh_package_index();
+    trace_startup_mark("package_index_checked");
     
     // Set VERBOSE environment variable for all child processes
     char verbose_str[8];
@@ -2368,25 +8894,12 @@ int main() {
     if (init_frontend_socket() != 0) {
         printf("⚠️ Warning: Could not initialize Frontend socket server\n");
     }
+    trace_startup_mark("sockets_ready");
     
     // Start Sandbox as separate process (non-blocking)
-    pid_t sandbox_pid = fork();
-    if (sandbox_pid == 0) {
-        // Child: ignore SIGINT to prevent Ctrl+C from reaching Sandbox
-        signal(SIGINT, SIG_IGN);
-        
-        // Start Sandbox from ~/.local/bin
-        const char* home = getenv("HOME");
-        if (home) {
-            char sandbox_path[512];
-            snprintf(sandbox_path, sizeof(sandbox_path), "%s/.local/bin/awesh_sandbox", home);
-            execl(sandbox_path, "awesh_sandbox", NULL);
-        }
-        // Fallback to local binary
-        execl("./awesh_sandbox", "awesh_sandbox", NULL);
-        perror("Failed to start Sandbox");
-        exit(1);
-    } else if (sandbox_pid < 0) {
+    pid_t sandbox_pid = spawn_helper_role("awesh_sandbox");
+    trace_startup_mark("sandbox_forked");
+    if (sandbox_pid < 0) {
         printf("⚠️ Warning: Could not start Sandbox\n");
     } else {
         state.sandbox_pid = sandbox_pid;
@@ -2397,23 +8910,9 @@ int main() {
     }
     
     // Start Security Agent as separate process (non-blocking)
-    pid_t security_agent_pid = fork();
-    if (security_agent_pid == 0) {
-        // Child: ignore SIGINT to prevent Ctrl+C from reaching Security Agent
-        signal(SIGINT, SIG_IGN);
-        
-        // Start Security Agent from ~/.local/bin
-        const char* home = getenv("HOME");
-        if (home) {
-            char security_agent_path[512];
-            snprintf(security_agent_path, sizeof(security_agent_path), "%s/.local/bin/awesh_sec", home);
-            execl(security_agent_path, "awesh_sec", NULL);
-        }
-        // Fallback to local binary
-        execl("./awesh_sec", "awesh_sec", NULL);
-        perror("Failed to start Security Agent");
-        exit(1);
-    } else if (security_agent_pid < 0) {
+    pid_t security_agent_pid = spawn_helper_role("awesh_sec");
+    trace_startup_mark("security_agent_forked");
+    if (security_agent_pid < 0) {
         printf("⚠️ Warning: Could not start Security Agent\n");
     } else {
         state.security_agent_pid = security_agent_pid;
@@ -2450,7 +8949,7 @@ int main() {
         char* username;
         char hostname[64];
         char cwd[256];
-        char git_branch[64] = "";
+        char git_segment[96];
         char k8s_context[64] = "";
         char k8s_namespace[64] = "";
         
@@ -2480,7 +8979,12 @@ int main() {
         long prompt_start = get_time_ms();
         
         // Get prompt data with caching optimization
-        get_prompt_data_cached(git_branch, k8s_context, k8s_namespace, 64);
+        get_prompt_data_cached(k8s_context, k8s_namespace, 64);
+        
+        // Branch and dirty counts, published by the git status worker
+        git_status_follow();
+        git_status_flush();
+        git_status_segment(git_segment, sizeof(git_segment));
         
         // Build context parts string with emojis (clean format)
         char context_parts[256] = "";
@@ -2492,9 +8996,9 @@ int main() {
             strcat(context_parts, ":☸️");
             strcat(context_parts, k8s_namespace);
         }
-        if (strlen(git_branch) > 0) {
+        if (git_segment[0]) {
             strcat(context_parts, ":🌿");
-            strcat(context_parts, git_branch);
+            strcat(context_parts, git_segment);
         }
         
         // Get security agent status
@@ -2537,8 +9041,21 @@ int main() {
         }
         
         // Generate secure prompt with integrated security status (security comes right after user@host)
-        snprintf(prompt, sizeof(prompt), "%s:%s:%s:%s%s\033[0m@\033[36m%s\033[0m:\033[34m%s\033[0m%s%s\n> ",
-                 backend_emoji, security_emoji, sandbox_emoji, user_color, username, hostname, cwd, security_context, context_parts);
+        if (term.low_bandwidth) {
+            // Plain status line (threats keep their colour), drawn again only when it changes
+            char status_line[sizeof(term.status_line)];
+            snprintf(status_line, sizeof(status_line), "%s:%s:%s:%s@%s:%s%s%s",
+                     backend_emoji, security_emoji, sandbox_emoji, username, hostname, cwd, security_context, context_parts);
+            if (strcmp(status_line, term.status_line) == 0) {
+                snprintf(prompt, sizeof(prompt), "> ");
+            } else {
+                snprintf(prompt, sizeof(prompt), "%s\n> ", status_line);
+                memcpy(term.status_line, status_line, sizeof(status_line));
+            }
+        } else {
+            snprintf(prompt, sizeof(prompt), "%s:%s:%s:%s%s\033[0m@\033[36m%s\033[0m:\033[34m%s\033[0m%s%s\n> ",
+                     backend_emoji, security_emoji, sandbox_emoji, user_color, username, hostname, cwd, security_context, context_parts);
+        }
         
         // Debug total prompt generation time
         debug_perf("total prompt generation", prompt_start);
@@ -2583,6 +9100,14 @@ int main() {
         
         // Handle incoming connections from middleware (non-blocking)
         handle_frontend_connections();
+        sample_resources();
+        
+        if (startup_profile_path[0]) {
+            trace_startup_mark("first_prompt");
+            print_startup_profile(startup_profile_path);
+            unsetenv(STARTUP_PROFILE_ENV);  // Restarted helpers are not startup
+            startup_profile_path[0] = '\0';
+        }
         
         // Get input with readline (supports history, editing)
         line = readline(prompt);
@@ -2600,6 +9125,15 @@ int main() {
         // Add to history
         add_history(line);
         
+        // Every line gets a trace id; it prefixes each IPC message the line causes
+        int is_trace_command = strncmp(line, "awet", 4) == 0;
+        uint64_t line_start = trace_now_ns();
+        metric_inc(frontend_metrics.input_lines);
+        uint64_t line_trace_id = trace_new_id();
+        trace_set_current(line_trace_id);
+        trace_span_t line_span = trace_begin("input_line");
+        flight_record(FLIGHT_STATE, "line", 0, line);
+        
         // AI-driven mode detection: Let AI decide command vs edit mode
         // No longer need to parse AI mode - all commands go through sandbox
         
@@ -2609,6 +9143,7 @@ int main() {
             if (state.verbose >= 2) {
                 printf("DEBUG: Detected awesh command: %s\n", line);
             }
+            metric_inc(frontend_metrics.route_builtin);
             handle_awesh_command(line);
         } else if (strcmp(line, "quit") == 0 || strcmp(line, "exit") == 0) {
             // Built-in commands - handled by frontend, not backend
@@ -2621,7 +9156,19 @@ int main() {
             execute_command_securely(line);
         }
         
+        trace_end(&line_span, line);
+        trace_set_current(0);
+        uint64_t line_ns = trace_now_ns() - line_start;
+        metric_observe_ms(frontend_metrics.line_seconds, line_ns / 1e6);
+        flight_record(FLIGHT_TIMING, "line_done", (int64_t)(line_ns / 1000), NULL);
+        metrics_serve();
+        metrics_write_textfile(0);
+        if (!is_trace_command) {
+            last_line_trace_id = line_trace_id;
+        }
+        
         free(line);
+        arena_reset(&request_arena);
     }
     
     cleanup_and_exit(0);
@@ -2663,4 +9210,8 @@ void run_interactive_command(const char* cmd) {
     }
 }
 
-
+#ifndef AWESH_MULTICALL
+int main(int argc, char** argv) {
+    return awesh_main(argc, argv);
+}
+#endif
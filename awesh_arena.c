@@ -0,0 +1,224 @@
+#define _POSIX_C_SOURCE 200809L
+#include "awesh_arena.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#define ARENA_ALIGN 16
+
+static size_t align_up(size_t n) {
+    return (n + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+static arena_block_t* arena_new_block(size_t size) {
+    arena_block_t* block = malloc(sizeof(arena_block_t) + size);
+    if (!block) return NULL;
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+void arena_init(arena_t* arena, size_t block_size) {
+    memset(arena, 0, sizeof(*arena));
+    arena->block_size = block_size ? block_size : ARENA_DEFAULT_BLOCK_SIZE;
+}
+
+void* arena_alloc(arena_t* arena, size_t size) {
+    size = align_up(size ? size : 1);
+
+    if (!arena->first) {
+        size_t first_size = size > arena->block_size ? size : arena->block_size;
+        arena->first = arena_new_block(first_size);
+        if (!arena->first) return NULL;
+        arena->current = arena->first;
+        arena->block_count = 1;
+        if (first_size > arena->block_size) arena->oversized++;
+    }
+
+    // Walk forward through blocks kept from earlier requests before growing the chain
+    while (arena->current->used + size > arena->current->size) {
+        arena_block_t* next = arena->current->next;
+        if (next && next->size >= size) {
+            next->used = 0;
+            arena->current = next;
+            continue;
+        }
+
+        size_t block_size = size > arena->block_size ? size : arena->block_size;
+        arena_block_t* block = arena_new_block(block_size);
+        if (!block) return NULL;
+        block->next = next;
+        arena->current->next = block;
+        arena->current = block;
+        arena->block_count++;
+        if (block_size > arena->block_size) arena->oversized++;
+    }
+
+    void* ptr = arena->current->data + arena->current->used;
+    arena->current->used += size;
+    return ptr;
+}
+
+char* arena_strdup(arena_t* arena, const char* s) {
+    size_t len = strlen(s);
+    char* copy = arena_alloc(arena, len + 1);
+    if (copy) memcpy(copy, s, len + 1);
+    return copy;
+}
+
+void arena_reset(arena_t* arena) {
+    if (!arena->first) return;
+
+    // A spike (huge response) grew the chain: give the surplus back
+    if (arena->block_count > ARENA_MAX_RETAINED_BLOCKS || arena->oversized > 0) {
+        arena_block_t* keep = arena->first;
+        int kept = 1;
+        arena_block_t* block = keep->next;
+        keep->next = NULL;
+        while (block) {
+            arena_block_t* next = block->next;
+            if (kept < ARENA_MAX_RETAINED_BLOCKS && block->size == arena->block_size) {
+                keep->next = block;
+                keep = block;
+                keep->next = NULL;
+                kept++;
+            } else {
+                free(block);
+            }
+            block = next;
+        }
+        if (arena->first->size > arena->block_size) {
+            arena_block_t* oversized_first = arena->first;
+            arena->first = oversized_first->next;
+            free(oversized_first);
+            kept--;
+        }
+        arena->block_count = kept;
+        arena->oversized = 0;
+        if (!arena->first) {
+            arena->current = NULL;
+            return;
+        }
+    }
+
+    arena->current = arena->first;
+    arena->first->used = 0;
+}
+
+void arena_destroy(arena_t* arena) {
+    arena_block_t* block = arena->first;
+    while (block) {
+        arena_block_t* next = block->next;
+        free(block);
+        block = next;
+    }
+    memset(arena, 0, sizeof(*arena));
+}
+
+int abuf_init(abuf_t* buf, arena_t* arena, size_t initial) {
+    buf->arena = arena;
+    buf->len = 0;
+    buf->cap = align_up((initial ? initial : 256) + 1) - 1;
+    buf->data = arena_alloc(arena, buf->cap + 1);
+    if (!buf->data) {
+        buf->cap = 0;
+        return -1;
+    }
+    buf->data[0] = '\0';
+    return 0;
+}
+
+int abuf_reserve(abuf_t* buf, size_t extra) {
+    if (buf->len + extra <= buf->cap) return 0;
+
+    size_t needed = buf->len + extra;
+    arena_block_t* block = buf->arena->current;
+
+    // Last allocation in the block: grow in place when there is room
+    if (block && buf->data + align_up(buf->cap + 1) == block->data + block->used) {
+        size_t grown = align_up(needed + 1);
+        size_t start = (size_t)(buf->data - block->data);
+        if (start + grown <= block->size) {
+            block->used = start + grown;
+            buf->cap = grown - 1;
+            return 0;
+        }
+    }
+
+    size_t new_cap = buf->cap * 2;
+    if (new_cap < needed) new_cap = needed;
+    char* data = arena_alloc(buf->arena, new_cap + 1);
+    if (!data) return -1;
+    memcpy(data, buf->data, buf->len + 1);
+    buf->data = data;
+    buf->cap = align_up(new_cap + 1) - 1;
+    return 0;
+}
+
+int abuf_append(abuf_t* buf, const void* data, size_t len) {
+    if (abuf_reserve(buf, len) != 0) return -1;
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+    buf->data[buf->len] = '\0';
+    return 0;
+}
+
+int abuf_puts(abuf_t* buf, const char* s) {
+    return abuf_append(buf, s, strlen(s));
+}
+
+int abuf_printf(abuf_t* buf, const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int needed = vsnprintf(buf->data + buf->len, buf->cap - buf->len + 1, fmt, args);
+    va_end(args);
+    if (needed < 0) return -1;
+
+    if ((size_t)needed > buf->cap - buf->len) {
+        if (abuf_reserve(buf, (size_t)needed) != 0) return -1;
+        va_start(args, fmt);
+        vsnprintf(buf->data + buf->len, buf->cap - buf->len + 1, fmt, args);
+        va_end(args);
+    }
+    buf->len += (size_t)needed;
+    return needed;
+}
+
+void abuf_clear(abuf_t* buf) {
+    buf->len = 0;
+    if (buf->data) buf->data[0] = '\0';
+}
+
+void abuf_truncate(abuf_t* buf, size_t len) {
+    if (len < buf->len) {
+        buf->len = len;
+        buf->data[len] = '\0';
+    }
+}
+
+// recv() straight into spare capacity; returns what recv returned
+ssize_t abuf_recv(abuf_t* buf, int fd, size_t chunk, int flags) {
+    if (abuf_reserve(buf, chunk) != 0) return -1;
+    ssize_t bytes = recv(fd, buf->data + buf->len, chunk, flags);
+    if (bytes > 0) {
+        buf->len += (size_t)bytes;
+        buf->data[buf->len] = '\0';
+    }
+    return bytes;
+}
+
+ssize_t abuf_read(abuf_t* buf, int fd, size_t chunk) {
+    if (abuf_reserve(buf, chunk) != 0) return -1;
+    ssize_t bytes = read(fd, buf->data + buf->len, chunk);
+    if (bytes > 0) {
+        buf->len += (size_t)bytes;
+        buf->data[buf->len] = '\0';
+    }
+    return bytes;
+}
@@ -0,0 +1,53 @@
+#ifndef AWESH_ARENA_H
+#define AWESH_ARENA_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+// Per-request arena: bump allocation out of chained blocks, released all at
+// once by arena_reset() at the end of the request. Reset is O(1) - blocks are
+// kept and reused - except after a spike, when blocks beyond the steady-state
+// working set are handed back to the allocator so RSS settles again.
+#define ARENA_DEFAULT_BLOCK_SIZE (16 * 1024)
+#define ARENA_MAX_RETAINED_BLOCKS 4
+
+typedef struct arena_block {
+    struct arena_block* next;
+    size_t size;
+    size_t used;
+    char data[];
+} arena_block_t;
+
+typedef struct {
+    arena_block_t* first;
+    arena_block_t* current;
+    size_t block_size;
+    int block_count;
+    int oversized;      // Blocks larger than block_size (freed at reset)
+} arena_t;
+
+// Growable byte buffer living in an arena; data is always NUL-terminated
+typedef struct {
+    arena_t* arena;
+    char* data;
+    size_t len;
+    size_t cap;
+} abuf_t;
+
+void arena_init(arena_t* arena, size_t block_size);
+void* arena_alloc(arena_t* arena, size_t size);
+char* arena_strdup(arena_t* arena, const char* s);
+void arena_reset(arena_t* arena);
+void arena_destroy(arena_t* arena);
+
+int abuf_init(abuf_t* buf, arena_t* arena, size_t initial);
+int abuf_reserve(abuf_t* buf, size_t extra);
+int abuf_append(abuf_t* buf, const void* data, size_t len);
+int abuf_puts(abuf_t* buf, const char* s);
+int abuf_printf(abuf_t* buf, const char* fmt, ...);
+void abuf_clear(abuf_t* buf);
+void abuf_truncate(abuf_t* buf, size_t len);
+ssize_t abuf_recv(abuf_t* buf, int fd, size_t chunk, int flags);
+ssize_t abuf_read(abuf_t* buf, int fd, size_t chunk);
+
+#endif
@@ -2,7 +2,16 @@
 awesh_backend - Python backend library for awesh shell
 """
 
+from . import startup_profile
+
+startup_profile.mark("package_import")
+# With --profile-startup, time server's imports one module at a time
+startup_profile.time_imports(__name__, ("config", "ai_client", "file_agent", "file_editor", "execution_agent",
+                                        "todo_agent", "man_index", "tracing", "metrics", "flight_recorder"))
+
 from .server import AweshSocketBackend
 
+startup_profile.mark("server_imported")
+
 __version__ = "0.1.0"
 __all__ = ["AweshSocketBackend"]
@@ -5,6 +5,7 @@ AI client for awesh - handles OpenAI API interactions
 import os
 import sys
 import asyncio
+import time
 from typing import Optional, AsyncGenerator, Dict, Any
 from pathlib import Path
 
@@ -13,6 +14,11 @@ openai = None
 AsyncOpenAI = None
 
 from .config import Config
+from . import tracing
+from . import metrics
+from . import flight_recorder
+from . import startup_profile
+from . import redaction
 
 # Global verbose setting - same as server.py
 def debug_log(message):
@@ -34,19 +40,25 @@ class AweshAIClient:
         """Initialize the AI client and load system prompt"""
         debug_log("Starting AI client initialization...")
         
-        # Import OpenAI when actually needed
-        global AsyncOpenAI
-        if AsyncOpenAI is None:
-            debug_log("Importing AsyncOpenAI...")
-            from openai import AsyncOpenAI
-            
-        # Initialize OpenAI client (supports OpenRouter, Ollama)
         ai_provider = os.getenv('AI_PROVIDER', 'openai')
         debug_log(f"AI Provider: {ai_provider}")
         debug_log(f"Model from config: {self.config.model}")
         debug_log(f"MODEL env var: {os.getenv('MODEL', 'not set')}")
         
-        if ai_provider == 'openrouter':
+        # Import OpenAI when actually needed (the mock provider never needs it)
+        global AsyncOpenAI
+        if AsyncOpenAI is None and ai_provider != 'mock':
+            debug_log("Importing AsyncOpenAI...")
+            from openai import AsyncOpenAI
+            startup_profile.mark("import.openai")
+            
+        # Initialize OpenAI client (supports OpenRouter, Ollama)
+        if ai_provider == 'mock':
+            # Offline deterministic provider for performance testing
+            from .mock_llm import MockAsyncClient
+            debug_log("Creating mock client (no network)")
+            self.client = MockAsyncClient()
+        elif ai_provider == 'openrouter':
             # Using OpenRouter
             api_key = os.getenv('OPENROUTER_API_KEY')
             if not api_key:
@@ -293,13 +305,14 @@ This controls awesh's loop (max 10 iterations per goal).
             if context_str:
                 messages.append({
                     "role": "system",
-                    "content": f"Current context:\n{context_str}"
+                    "content": f"Current context:\n{redaction.redact(context_str)}"
                 })
         
-        # Add user prompt
+        # Add user prompt - command output and file contents included, so
+        # secrets are redacted before they leave the machine
         messages.append({
             "role": "user",
-            "content": user_prompt
+            "content": redaction.redact(user_prompt)
         })
         
         try:
@@ -333,6 +346,7 @@ This controls awesh's loop (max 10 iterations per goal).
                     # Streaming response
                     api_params["stream"] = True
                     debug_log(f"Starting streaming request with model {model_name}")
+                    request_start = time.monotonic_ns()
                     stream = await self.client.chat.completions.create(**api_params)
                     
                     chunk_count = 0
@@ -340,6 +354,10 @@ This controls awesh's loop (max 10 iterations per goal).
                     async for chunk in stream:
                         chunk_count += 1
                         if chunk.choices[0].delta.content:
+                            if content_chunks == 0:
+                                tracing.record("ai_client.ttft", request_start, time.monotonic_ns(), model_name)
+                                self._observe_latency("awesh_ai_provider_ttft_seconds",
+                                                      "Time from request to the first streamed token", request_start)
                             content_chunks += 1
                             debug_log(f"Yielding chunk {content_chunks}: '{chunk.choices[0].delta.content[:50]}...'")
                             yield chunk.choices[0].delta.content
@@ -347,10 +365,14 @@ This controls awesh's loop (max 10 iterations per goal).
                             debug_log(f"Empty chunk {chunk_count} (no content)")
                     
                     debug_log(f"Streaming complete - {chunk_count} total chunks, {content_chunks} with content")
+                    tracing.record("ai_client.request", request_start, time.monotonic_ns(), model_name)
+                    self._observe_latency("awesh_ai_provider_request_seconds",
+                                          "Time for a complete provider request", request_start)
                     return
                     
                 except Exception as e:
                     error_msg = str(e)
+                    self._count_error(e)
                     # For Ollama, don't fallback - fail clearly if streaming fails
                     ai_provider = os.getenv('AI_PROVIDER', 'openai')
                     if ai_provider == 'ollama':
@@ -384,7 +406,11 @@ This controls awesh's loop (max 10 iterations per goal).
             
             debug_log(f"Using non-streaming request with model {model_name}")
             try:
-                response = await self.client.chat.completions.create(**api_params_nonstream)
+                request_start = time.monotonic_ns()
+                with tracing.span("ai_client.request", model_name):
+                    response = await self.client.chat.completions.create(**api_params_nonstream)
+                self._observe_latency("awesh_ai_provider_request_seconds",
+                                      "Time for a complete provider request", request_start)
                 
                 content = response.choices[0].message.content
                 debug_log(f"Non-streaming response length: {len(content) if content else 0} chars")
@@ -407,6 +433,7 @@ This controls awesh's loop (max 10 iterations per goal).
                     yield f"💡 Verify model '{model_name}' exists: ollama list\n"
                 else:
                     yield f"❌ Error processing prompt: {e}\n"
+                self._count_error(e)
                     
         except Exception as e:
             ai_provider = os.getenv('AI_PROVIDER', 'openai')
@@ -416,6 +443,18 @@ This controls awesh's loop (max 10 iterations per goal).
             else:
                 yield f"❌ Error processing prompt: {e}\n"
             
+    def _observe_latency(self, name: str, help_text: str, start_ns: int):
+        provider = os.getenv('AI_PROVIDER', 'openai')
+        elapsed_ns = time.monotonic_ns() - start_ns
+        metrics.histogram(name, help_text, provider=provider).observe(elapsed_ns / 1e9)
+        event = name.replace("awesh_ai_provider_", "provider.").replace("_seconds", "")
+        flight_recorder.record(flight_recorder.TIMING, event, elapsed_ns // 1000, provider)
+
+    def _count_error(self, error: Exception):
+        provider = os.getenv('AI_PROVIDER', 'openai')
+        metrics.counter("awesh_ai_provider_errors_total", "Failed provider requests", provider=provider).inc()
+        flight_recorder.record(flight_recorder.ERROR, "provider.error", detail=f"{provider}: {error}")
+
     def _format_context(self, context: Dict[str, Any]) -> str:
         """Format context information for the AI"""
         context_parts = []
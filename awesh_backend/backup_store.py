@@ -0,0 +1,341 @@
+"""
+Content-addressed backup store for the file editor.
+
+Before each AI edit the file is split into chunks by content (FastCDC, see
+awesh_chunk.h), and each chunk is stored once under its BLAKE2b hash in
+~/.awesh_backups/chunks/. A backup is then only a list of chunk hashes,
+appended to the file's version index in ~/.awesh_backups/index/. Iterating
+on a large file costs the chunks an edit touched, and identical content in
+other files or older versions is not stored twice.
+
+Versions are garbage-collected by age (BACKUP_MAX_AGE_DAYS) and by the size
+of the chunks they keep alive (BACKUP_MAX_MB), oldest first, at most once
+per GC_INTERVAL_S. libawesh_chunk.so (built by `make`) finds the chunk
+boundaries; without it the same algorithm runs in Python, far slower.
+Listing and restoring by hand: python3 -m awesh_backend.backups
+"""
+
+import ctypes
+import hashlib
+import json
+import os
+import sys
+import time
+from dataclasses import dataclass
+from pathlib import Path
+from typing import Dict, List, Optional
+
+from . import metrics
+
+LIBRARY_NAME = "libawesh_chunk.so"
+CHUNK_MIN = 2048                    # Same sizes and masks as awesh_chunk.c
+CHUNK_AVG = 8192
+CHUNK_MAX = 65536
+MASK_STRICT = 0xfffe000000000000
+MASK_LOOSE = 0xffe0000000000000
+GEAR_SEED = 0x61776573685f6364
+GC_INTERVAL_S = 3600
+ORPHAN_GRACE_S = 600                # Unreferenced chunks younger than this may belong to a backup in progress
+MASK64 = 0xFFFFFFFFFFFFFFFF
+
+
+def _load_library():
+    candidates = [os.getenv("AWESH_CHUNK_LIB"), Path(__file__).parent / LIBRARY_NAME,
+                  Path(__file__).parent.parent / LIBRARY_NAME]
+    for path in candidates:
+        if not path or not Path(path).exists():
+            continue
+        try:
+            lib = ctypes.CDLL(str(path))
+        except OSError:
+            continue
+        lib.chunk_boundaries.argtypes = [ctypes.c_char_p, ctypes.c_size_t, ctypes.POINTER(ctypes.c_size_t),
+                                         ctypes.c_size_t]
+        lib.chunk_boundaries.restype = ctypes.c_size_t
+        return lib
+    if os.getenv("VERBOSE", "0") == "1":
+        print(f"🔧 Backup store: {LIBRARY_NAME} not built, chunking in Python", file=sys.stderr)
+    return None
+
+
+_lib = _load_library()
+
+
+def _gear_table():
+    table = []
+    state = GEAR_SEED
+    for _ in range(256):
+        state = (state + 0x9e3779b97f4a7c15) & MASK64
+        z = state
+        z = ((z ^ (z >> 30)) * 0xbf58476d1ce4e5b9) & MASK64
+        z = ((z ^ (z >> 27)) * 0x94d049bb133111eb) & MASK64
+        table.append(z ^ (z >> 31))
+    return table
+
+
+_gear = None
+
+
+def _next_chunk_python(data: bytes, offset: int) -> int:
+    n = len(data) - offset
+    if n <= CHUNK_MIN:
+        return n
+    normal = min(n, CHUNK_AVG)
+    limit = min(n, CHUNK_MAX)
+    value = 0
+    for i in range(CHUNK_MIN, limit):
+        value = ((value << 1) + _gear[data[offset + i]]) & MASK64
+        if not value & (MASK_STRICT if i < normal else MASK_LOOSE):
+            return i + 1
+    return limit
+
+
+def chunk_ends(data: bytes) -> List[int]:
+    """End offset of each content-defined chunk of data"""
+    global _gear
+    if _lib:
+        capacity = 16 + len(data) // CHUNK_MIN     # Retried once, with the exact count, if too small
+        while True:
+            ends = (ctypes.c_size_t * capacity)()
+            count = _lib.chunk_boundaries(data, len(data), ends, capacity)
+            if count <= capacity:
+                return ends[:count]
+            capacity = count
+    if _gear is None:
+        _gear = _gear_table()
+    ends = []
+    offset = 0
+    while offset < len(data):
+        offset += _next_chunk_python(data, offset)
+        ends.append(offset)
+    return ends
+
+
+def native() -> bool:
+    return _lib is not None
+
+
+@dataclass
+class BackupRef:
+    """One stored version of a file"""
+    path: str
+    version: int
+    size: int
+    new_bytes: int                  # What storing it cost after deduplication
+
+    def __str__(self):
+        return f"{self.path}@{self.version}"
+
+
+class BackupStore:
+    """Deduplicated, versioned copies of files, kept under root"""
+
+    def __init__(self, root: Path, max_age_s: Optional[float] = None, max_bytes: Optional[int] = None):
+        self.root = Path(root)
+        self.chunks = self.root / "chunks"
+        self.index = self.root / "index"
+        self.max_age_s = max_age_s if max_age_s is not None else float(os.getenv("BACKUP_MAX_AGE_DAYS", "30")) * 86400
+        self.max_bytes = max_bytes if max_bytes is not None else int(float(os.getenv("BACKUP_MAX_MB", "512")) * 2**20)
+
+    # Layout
+
+    def _chunk_path(self, digest: str) -> Path:
+        return self.chunks / digest[:2] / digest[2:]
+
+    def _index_path(self, path: str) -> Path:
+        return self.index / (hashlib.blake2b(path.encode(), digest_size=8).hexdigest() + ".json")
+
+    def _read_index(self, index_path: Path) -> Optional[Dict]:
+        try:
+            return json.loads(index_path.read_text())
+        except (OSError, ValueError):
+            return None
+
+    def _write_atomic(self, path: Path, data: bytes):
+        temp = path.with_name(f"{path.name}.{os.getpid()}.tmp")
+        try:
+            with open(os.open(temp, os.O_WRONLY | os.O_CREAT | os.O_TRUNC, 0o600), "wb") as file:
+                file.write(data)
+            temp.replace(path)          # Readers never see half a chunk or index
+        except OSError:
+            temp.unlink(missing_ok=True)
+            raise
+
+    # Storing and restoring
+
+    def backup(self, file_path) -> BackupRef:
+        """Store the current content of file_path as its next version"""
+        path = str(Path(file_path).expanduser().resolve())
+        data = Path(path).read_bytes()
+        mode = os.stat(path).st_mode & 0o7777
+
+        self.chunks.mkdir(mode=0o700, parents=True, exist_ok=True)
+        digests = []
+        new_bytes = 0
+        start = 0
+        for end in chunk_ends(data):
+            chunk = data[start:end]
+            digest = hashlib.blake2b(chunk, digest_size=16).hexdigest()
+            chunk_path = self._chunk_path(digest)
+            try:
+                os.utime(chunk_path)    # Present already: keep it clear of the orphan sweep
+            except FileNotFoundError:
+                chunk_path.parent.mkdir(mode=0o700, parents=True, exist_ok=True)
+                self._write_atomic(chunk_path, chunk)
+                new_bytes += len(chunk)
+            digests.append(digest)
+            start = end
+
+        self.index.mkdir(mode=0o700, parents=True, exist_ok=True)
+        index_path = self._index_path(path)
+        entry = self._read_index(index_path) or {"path": path, "versions": []}
+        versions = entry["versions"]
+        if versions and versions[-1]["chunks"] == digests and versions[-1]["mode"] == mode:
+            versions[-1]["time"] = time.time()      # Unchanged since the last backup
+        else:
+            number = versions[-1]["version"] + 1 if versions else 1
+            versions.append({"version": number, "time": time.time(), "size": len(data), "mode": mode,
+                             "chunks": digests})
+        self._write_atomic(index_path, json.dumps(entry).encode())
+
+        metrics.counter("awesh_backend_backup_bytes_total", "Bytes backed up before file edits",
+                        stored="new").inc(new_bytes)
+        metrics.counter("awesh_backend_backup_bytes_total", "Bytes backed up before file edits",
+                        stored="deduplicated").inc(len(data) - new_bytes)
+        self.maybe_gc()
+        return BackupRef(path, versions[-1]["version"], len(data), new_bytes)
+
+    def versions(self, file_path) -> List[Dict]:
+        path = str(Path(file_path).expanduser().resolve())
+        entry = self._read_index(self._index_path(path))
+        return entry["versions"] if entry else []
+
+    def _version(self, path: str, version: Optional[int]) -> Dict:
+        versions = self.versions(path)
+        if not versions:
+            raise LookupError(f"no backups of {path}")
+        if version is None:
+            return versions[-1]
+        for candidate in versions:
+            if candidate["version"] == version:
+                return candidate
+        raise LookupError(f"no version {version} of {path}")
+
+    def read(self, file_path, version: Optional[int] = None) -> bytes:
+        """Content of a version (the newest for None)"""
+        entry = self._version(file_path, version)
+        data = b"".join(self._chunk_path(digest).read_bytes() for digest in entry["chunks"])
+        if len(data) != entry["size"]:
+            raise ValueError(f"version {entry['version']} of {file_path} is damaged")
+        return data
+
+    def restore(self, file_path, version: Optional[int] = None) -> int:
+        """Put a version (the newest for None) back in place; which one it was"""
+        path = Path(file_path).expanduser().resolve()
+        entry = self._version(str(path), version)
+        data = self.read(path, entry["version"])
+        path.parent.mkdir(parents=True, exist_ok=True)
+        temp = path.with_name(f".{path.name}.{os.getpid()}.restore")
+        try:
+            with open(os.open(temp, os.O_WRONLY | os.O_CREAT | os.O_TRUNC, entry["mode"]), "wb") as file:
+                file.write(data)
+            os.chmod(temp, entry["mode"])
+            temp.replace(path)
+        except OSError:
+            temp.unlink(missing_ok=True)
+            raise
+        return entry["version"]
+
+    # Garbage collection
+
+    def maybe_gc(self):
+        stamp = self.root / "gc.stamp"
+        try:
+            if time.time() - stamp.stat().st_mtime < GC_INTERVAL_S:
+                return
+        except OSError:
+            pass
+        stamp.touch()
+        try:
+            self.gc()
+        except OSError as e:
+            if os.getenv("VERBOSE", "0") == "1":
+                print(f"🔧 Backup store: GC failed: {e}", file=sys.stderr)
+
+    def gc(self) -> Dict:
+        """Drop versions past the age limit, then the oldest until the chunks fit the budget,
+        always keeping each file's newest version"""
+        now = time.time()
+        indexes = {}
+        for index_path in self.index.glob("*.json") if self.index.is_dir() else []:
+            entry = self._read_index(index_path)
+            if entry:
+                indexes[index_path] = entry
+
+        sizes = {}
+        for chunk_path in self.chunks.glob("*/*") if self.chunks.is_dir() else []:
+            if not chunk_path.name.endswith(".tmp"):
+                sizes[chunk_path.parent.name + chunk_path.name] = chunk_path.stat().st_size
+        refs = {}
+        for entry in indexes.values():
+            for version in entry["versions"]:
+                for digest in version["chunks"]:
+                    refs[digest] = refs.get(digest, 0) + 1
+        used = sum(sizes.get(digest, 0) for digest in refs)
+
+        # Each file's newest version, which backup() has just written, is what
+        # undo restores, so it is never dropped, whatever its age or size
+        dropped = 0
+        queue = sorted(((version["time"], id(entry), entry, version) for entry in indexes.values()
+                        for version in entry["versions"][:-1]), key=lambda item: item[:2])
+        for stamp, _, entry, version in queue:
+            if now - stamp <= self.max_age_s and used <= self.max_bytes:
+                break
+            entry["versions"].remove(version)
+            dropped += 1
+            for digest in version["chunks"]:
+                refs[digest] -= 1
+                if refs[digest] == 0:
+                    used -= sizes.get(digest, 0)
+
+        if used > self.max_bytes:
+            print(f"⚠️ Backup store: the newest backups alone take {used / 2**20:.1f} MB, over the "
+                  f"{self.max_bytes / 2**20:.1f} MB budget (BACKUP_MAX_MB); none of them were dropped", file=sys.stderr)
+
+        for index_path, entry in indexes.items():
+            if not entry["versions"]:
+                index_path.unlink(missing_ok=True)
+            elif dropped:
+                self._write_atomic(index_path, json.dumps(entry).encode())
+
+        freed = 0
+        for digest, size in sizes.items():
+            if refs.get(digest, 0) > 0:
+                continue
+            chunk_path = self._chunk_path(digest)
+            try:
+                if now - chunk_path.stat().st_mtime > ORPHAN_GRACE_S:
+                    chunk_path.unlink()
+                    freed += size
+            except OSError:
+                pass
+
+        # Full copies left by the editor before this store existed
+        for legacy in self.root.glob("*.backup"):
+            try:
+                if now - legacy.stat().st_mtime > self.max_age_s:
+                    legacy.unlink()
+            except OSError:
+                pass
+        return {"versions_dropped": dropped, "bytes_freed": freed, "bytes_used": used}
+
+    def files(self) -> List[Dict]:
+        """Version index of every backed-up file: {"path": ..., "versions": [...]}"""
+        entries = map(self._read_index, self.index.glob("*.json")) if self.index.is_dir() else []
+        return sorted((entry for entry in entries if entry and entry["versions"]), key=lambda entry: entry["path"])
+
+    def stats(self) -> Dict:
+        files = self.files()
+        chunks = list(self.chunks.glob("*/*")) if self.chunks.is_dir() else []
+        return {"files": len(files), "versions": sum(len(entry["versions"]) for entry in files),
+                "chunks": len(chunks), "bytes": sum(chunk.stat().st_size for chunk in chunks)}
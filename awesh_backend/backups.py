@@ -0,0 +1,57 @@
+"""
+Lists and restores the file editor's backups (see backup_store.py).
+
+    python3 -m awesh_backend.backups list                 # every backed-up file
+    python3 -m awesh_backend.backups list FILE            # its versions
+    python3 -m awesh_backend.backups restore FILE@3       # as printed after an edit; the newest without @
+    python3 -m awesh_backend.backups gc                   # apply BACKUP_MAX_AGE_DAYS and BACKUP_MAX_MB now
+"""
+
+import argparse
+import sys
+import time
+from pathlib import Path
+
+from .backup_store import BackupStore
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(description="Inspect and restore awesh file edit backups")
+    commands = parser.add_subparsers(dest="command", required=True)
+    listing = commands.add_parser("list", help="versions of a file, or every backed-up file")
+    listing.add_argument("file", nargs="?")
+    restore = commands.add_parser("restore", help="put a version back, the newest without @VERSION")
+    restore.add_argument("file", help="FILE or FILE@VERSION, as printed after an edit")
+    commands.add_parser("gc", help="apply BACKUP_MAX_AGE_DAYS and BACKUP_MAX_MB now")
+    args = parser.parse_args(argv)
+    store = BackupStore(Path.home() / ".awesh_backups")
+
+    try:
+        if args.command == "list" and args.file:
+            for version in store.versions(args.file):
+                when = time.strftime("%Y-%m-%d %H:%M:%S", time.localtime(version["time"]))
+                print(f"{version['version']:>5}  {when}  {version['size']:>10} bytes  {len(version['chunks'])} chunks")
+        elif args.command == "list":
+            for entry in store.files():
+                print(f"{len(entry['versions']):>5} versions  {entry['path']}")
+            stats = store.stats()
+            print(f"📦 {stats['files']} files, {stats['versions']} versions in {stats['chunks']} chunks, "
+                  f"{stats['bytes'] / 2**20:.1f} MB")
+        elif args.command == "restore":
+            file, _, version = args.file.rpartition("@")
+            if not file or not version.isdigit():
+                file, version = args.file, ""
+            restored = store.restore(file, int(version) if version else None)
+            print(f"↩️ Restored version {restored} of {Path(file).expanduser().resolve()}")
+        else:
+            result = store.gc()
+            print(f"🧹 Dropped {result['versions_dropped']} versions, freed {result['bytes_freed'] / 2**20:.1f} MB, "
+                  f"{result['bytes_used'] / 2**20:.1f} MB in use")
+    except (OSError, LookupError, ValueError) as e:
+        print(f"❌ {e}", file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -30,13 +30,17 @@ Features:
 - Capture stdout, stderr, exit codes
 - Provide results back to AI for iteration
 - Multi-step execution with feedback loops
+- Slow read-only commands answered from the result cache shared with the
+  frontend (RESULT_CACHE=1, see result_cache.py)
+- Commands that may change files previewed in a copy-on-write overlay and
+  kept only when the user confirms (AI_PREVIEW=1, see preview.py)
 - Safe execution environment
 - NO interference with user's direct command execution
 """
 
 import os
+import re
 import sys
-import socket
 import json
 import asyncio
 import subprocess
@@ -45,6 +49,9 @@ from pathlib import Path
 from typing import Dict, List, Optional, Tuple
 from dataclasses import dataclass
 
+from . import preview, result_cache, tracing
+from .preview import Preview
+
 def debug_log(message):
     """Log debug message if verbose mode is enabled"""
     verbose = os.getenv('VERBOSE', '0') == '1'
@@ -61,6 +68,7 @@ class ExecutionResult:
     stderr: str
     success: bool
     execution_time: float = 0.0
+    preview: Optional[Preview] = None  # Set when the command only ran in an overlay
 
 
 class ExecutionAgent:
@@ -79,6 +87,8 @@ class ExecutionAgent:
         self.sandbox_socket_path = sandbox_socket_path or os.path.expanduser("~/.awesh_sandbox.sock")
         self.execution_history = []  # Track execution history
         self.max_iterations = 5  # Max iterations for AI feedback loop
+        self.cwd = None  # Frontend's directory (CWD: sync), part of the result cache key
+        self._refreshes = set()  # Background refreshes of stale cache entries
         
     async def execute_command(self, command: str) -> ExecutionResult:
         """
@@ -93,12 +103,15 @@ class ExecutionAgent:
         debug_log(f"Executing command: {command}")
         
         try:
-            # Use sandbox if available, otherwise execute directly
-            if os.path.exists(self.sandbox_socket_path):
-                result = await self._execute_in_sandbox(command)
+            cached = self._cached_result(command)
+            if cached:
+                self.execution_history.append(cached)
+                return cached
+            
+            if preview.enabled() and not preview.is_read_only(command):
+                result = await self._preview(command)
             else:
-                # Fallback to direct execution
-                result = await self._execute_directly(command)
+                result = await self._run(command)
             
             # Store in history
             self.execution_history.append(result)
@@ -115,77 +128,115 @@ class ExecutionAgent:
                 success=False
             )
     
+    async def _run(self, command: str) -> ExecutionResult:
+        # Use sandbox if available, otherwise execute directly
+        with tracing.span("execution_agent.execute", command):
+            if os.path.exists(self.sandbox_socket_path):
+                result = await self._execute_in_sandbox(command)
+            else:
+                # Fallback to direct execution
+                result = await self._execute_directly(command)
+        if result_cache.enabled():
+            result_cache.record(command, self.cwd or os.getcwd(), result.exit_code,
+                                result.stdout + result.stderr, int(result.execution_time * 1000))
+        return result
+    
+    async def _preview(self, command: str) -> ExecutionResult:
+        """Run a command that may change files in the sandbox's overlay; the frontend asks before it is kept"""
+        cwd = self.cwd or os.getcwd()
+        reason = preview.external_reason(command)
+        directory = None
+        if reason:
+            result = ExecutionResult(command=command, exit_code=0, stdout="", stderr="", success=True)
+        else:
+            with tracing.span("execution_agent.preview", command):
+                result, directory = await self._preview_in_sandbox(command, cwd)
+            if directory:
+                reason = preview.outcome_reason(result.stdout + result.stderr)
+            else:
+                reason = f"could not be previewed ({result.stderr.strip() or 'sandbox not running'})"
+        debug_log(f"Previewed in {directory or 'nothing'}{f' ({reason})' if reason else ''}: {command}")
+        result.preview = preview.record(directory, reason, cwd, command)
+        return result
+    
+    async def _preview_in_sandbox(self, command: str, cwd: str) -> Tuple[ExecutionResult, Optional[str]]:
+        import time
+        start_time = time.time()
+        base = preview.chain_base()
+        try:
+            ack, exit_code, stdout, stderr = await self._sandbox_request(f"PREVIEW:{base or '-'}\n{cwd}\n{command}")
+        except (OSError, ValueError, asyncio.TimeoutError) as e:
+            ack, exit_code, stdout, stderr = "ERROR", -1, "", str(e)
+        result = ExecutionResult(command=command, exit_code=exit_code, stdout=stdout, stderr=stderr,
+                                 success=exit_code == 0, execution_time=time.time() - start_time)
+        return result, ack[len("PREVIEW:"):] if ack.startswith("PREVIEW:") else None
+    
+    async def _sandbox_request(self, message: str) -> Tuple[str, int, str, str]:
+        """Send one request to the sandbox: its acknowledgement, exit code, stdout and stderr
+        
+        Awaited rather than blocking, so a slow command does not hold up the
+        event loop and the reply keeps streaming while it runs."""
+        reader, writer = await asyncio.wait_for(asyncio.open_unix_connection(self.sandbox_socket_path), timeout=30)
+        try:
+            # Carry the trace id so the sandbox's spans line up; INLINE: asks for the
+            # result on this connection, since the shared output file may be
+            # rewritten by the frontend's own requests before we get to read it
+            writer.write(tracing.prefix("INLINE:" + message).encode('utf-8'))
+            await writer.drain()
+            reply = await asyncio.wait_for(reader.read(), timeout=30)
+        finally:
+            writer.close()
+        
+        # The acknowledgement, then the result as length-prefixed fields
+        ack, _, data = reply.partition(b"\n")
+        ack = ack.decode('utf-8', errors='replace')
+        match = re.match(rb"EXIT_CODE:(-?\d+)\nSTDOUT_LEN:(\d+)\nSTDOUT:", data)
+        if not match:
+            raise ValueError("Unreadable sandbox result")
+        stdout_end = match.end() + int(match.group(2))
+        stdout = data[match.end():stdout_end]
+        rest = data[stdout_end + 1:]
+        stderr_match = re.match(rb"STDERR_LEN:(\d+)\nSTDERR:", rest)
+        stderr = rest[stderr_match.end():stderr_match.end() + int(stderr_match.group(1))] if stderr_match else b""
+        return ack, int(match.group(1)), stdout.decode('utf-8', errors='replace'), stderr.decode('utf-8', errors='replace')
+    
+    def _cached_result(self, command: str) -> Optional[ExecutionResult]:
+        """Stored output of a recent identical run, refreshing it in the background when stale"""
+        if not result_cache.enabled():
+            return None
+        cwd = self.cwd or os.getcwd()
+        cached = result_cache.lookup(command, cwd)
+        if not cached:
+            return None
+        output, age, stale = cached
+        debug_log(f"Result cache hit ({age:.0f}s old{', stale' if stale else ''}): {command}")
+        lock = result_cache.claim_refresh(command, cwd) if stale else None
+        if lock:
+            task = asyncio.create_task(self._refresh(command, lock))
+            self._refreshes.add(task)
+            task.add_done_callback(self._refreshes.discard)
+        return ExecutionResult(command=command, exit_code=0, stdout=output, stderr="", success=True)
+    
+    async def _refresh(self, command: str, lock: Path):
+        try:
+            await self._run(command)
+        finally:
+            lock.unlink(missing_ok=True)
+    
     async def _execute_in_sandbox(self, command: str) -> ExecutionResult:
         """Execute command via sandbox socket"""
         import time
         start_time = time.time()
         
         try:
-            # Connect to sandbox
-            sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
-            sock.settimeout(30)  # 30 second timeout
-            sock.connect(self.sandbox_socket_path)
-            
-            # Send command
-            sock.sendall(command.encode('utf-8'))
-            
-            # Receive response (from mmap)
-            response = sock.recv(1024).decode('utf-8')
-            sock.close()
-            
-            # Read from mmap file
-            mmap_path = "/tmp/awesh_sandbox_output.mmap"
-            if os.path.exists(mmap_path):
-                with open(mmap_path, 'r') as f:
-                    mmap_content = f.read()
-                
-                # Parse the mmap content (JSON format)
-                try:
-                    result_data = json.loads(mmap_content)
-                    execution_time = time.time() - start_time
-                    
-                    return ExecutionResult(
-                        command=command,
-                        exit_code=result_data.get('exit_code', -1),
-                        stdout=result_data.get('stdout', ''),
-                        stderr=result_data.get('stderr', ''),
-                        success=result_data.get('exit_code', -1) == 0,
-                        execution_time=execution_time
-                    )
-                except json.JSONDecodeError:
-                    # Fall back to text parsing
-                    exit_code = 0
-                    stdout = ""
-                    stderr = ""
-                    
-                    for line in mmap_content.split('\n'):
-                        if line.startswith('EXIT_CODE:'):
-                            exit_code = int(line.split(':')[1])
-                        elif line.startswith('STDOUT:'):
-                            stdout = line.split(':', 1)[1] if ':' in line else ""
-                        elif line.startswith('STDERR:'):
-                            stderr = line.split(':', 1)[1] if ':' in line else ""
-                    
-                    execution_time = time.time() - start_time
-                    
-                    return ExecutionResult(
-                        command=command,
-                        exit_code=exit_code,
-                        stdout=stdout,
-                        stderr=stderr,
-                        success=exit_code == 0,
-                        execution_time=execution_time
-                    )
-            
-            # No mmap file - return error
-            execution_time = time.time() - start_time
+            _, exit_code, stdout, stderr = await self._sandbox_request(command)
             return ExecutionResult(
                 command=command,
-                exit_code=-1,
-                stdout="",
-                stderr="Sandbox mmap file not found",
-                success=False,
-                execution_time=execution_time
+                exit_code=exit_code,
+                stdout=stdout,
+                stderr=stderr,
+                success=exit_code == 0,
+                execution_time=time.time() - start_time
             )
             
         except Exception as e:
@@ -210,7 +261,8 @@ class ExecutionAgent:
             process = await asyncio.create_subprocess_shell(
                 command,
                 stdout=asyncio.subprocess.PIPE,
-                stderr=asyncio.subprocess.PIPE
+                stderr=asyncio.subprocess.PIPE,
+                cwd=self.cwd
             )
             
             stdout, stderr = await asyncio.wait_for(
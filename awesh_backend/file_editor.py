@@ -7,7 +7,7 @@ The AI provides the old content and new content, and the tool applies the change
 Features:
 - Search/replace with exact matching
 - Multiple edits in one operation
-- Automatic backup creation
+- Automatic backups, deduplicated and versioned (backup_store.py)
 - Validation and error handling
 - Context-aware editing (shows surrounding lines)
 - Undo support
@@ -16,12 +16,12 @@ Features:
 import os
 import sys
 import re
-import shutil
 import tempfile
 from pathlib import Path
 from typing import List, Dict, Tuple, Optional
 from dataclasses import dataclass
-from datetime import datetime
+
+from .backup_store import BackupRef, BackupStore
 
 def debug_log(message):
     """Log debug message if verbose mode is enabled"""
@@ -59,13 +59,14 @@ class FileEditor:
         Initialize file editor
         
         Args:
-            backup_dir: Directory for backup files (default: ~/.awesh_backups)
+            backup_dir: Root of the backup store (default: ~/.awesh_backups)
             create_backups: Whether to create backups before editing
         """
         self.create_backups = create_backups
         self.backup_dir = Path(backup_dir or Path.home() / '.awesh_backups')
-        self.backup_dir.mkdir(parents=True, exist_ok=True)
-        self.undo_stack = []  # Stack of backup paths for undo operations
+        self.backup_dir.mkdir(mode=0o700, parents=True, exist_ok=True)
+        self.store = BackupStore(self.backup_dir)
+        self.undo_stack: List[BackupRef] = []  # Versions to restore, newest last
         
     def parse_edit_block(self, content: str) -> List[FileEdit]:
         """
@@ -123,21 +124,17 @@ class FileEditor:
         
         return edits
     
-    def create_backup(self, file_path: Path) -> Optional[Path]:
-        """Create a backup of the file before editing"""
+    def create_backup(self, file_path: Path) -> Optional[BackupRef]:
+        """Store the file's current content as a new version before editing"""
         if not self.create_backups:
             return None
         
         try:
-            timestamp = datetime.now().strftime("%Y%m%d_%H%M%S")
-            backup_name = f"{file_path.name}.{timestamp}.backup"
-            backup_path = self.backup_dir / backup_name
-            
-            shutil.copy2(file_path, backup_path)
-            self.undo_stack.append(backup_path)
-            debug_log(f"Created backup: {backup_path}")
+            backup = self.store.backup(file_path)
+            self.undo_stack.append(backup)
+            debug_log(f"Created backup: {backup} ({backup.new_bytes} of {backup.size} bytes new)")
             
-            return backup_path
+            return backup
         except Exception as e:
             debug_log(f"Failed to create backup: {e}")
             return None
@@ -205,7 +202,7 @@ class FileEditor:
                 )
         
         # Create backup
-        backup_path = self.create_backup(file_path)
+        backup = self.create_backup(file_path)
         
         # Apply the edit
         try:
@@ -231,15 +228,18 @@ class FileEditor:
                 success=True,
                 message=f"Successfully edited {file_path.name}",
                 file_path=str(file_path),
-                backup_path=str(backup_path) if backup_path else None,
+                backup_path=str(backup) if backup else None,
                 changes_made=1
             )
             
         except Exception as e:
             # Restore from backup if edit fails
-            if backup_path and backup_path.exists():
-                shutil.copy2(backup_path, file_path)
-                debug_log(f"Restored from backup after error: {e}")
+            if backup:
+                try:
+                    self.store.restore(backup.path, backup.version)
+                    debug_log(f"Restored from backup after error: {e}")
+                except (OSError, LookupError, ValueError) as restore_error:
+                    debug_log(f"Failed to restore {backup}: {restore_error}")
             
             return EditResult(
                 success=False,
@@ -280,35 +280,22 @@ class FileEditor:
                 file_path=""
             )
         
-        backup_path = self.undo_stack.pop()
-        
-        if not backup_path.exists():
-            return EditResult(
-                success=False,
-                message=f"Backup not found: {backup_path}",
-                file_path=str(backup_path)
-            )
-        
-        # Extract original file path from backup name
-        # Format: filename.YYYYMMDD_HHMMSS.backup
-        original_name = backup_path.name.rsplit('.', 2)[0]
-        # Find the original file (could be in different directory)
-        # For simplicity, assume it's in the current directory
-        original_path = Path(original_name)
+        backup = self.undo_stack.pop()
+        original_path = Path(backup.path)
         
         try:
-            shutil.copy2(backup_path, original_path)
+            self.store.restore(backup.path, backup.version)
             return EditResult(
                 success=True,
-                message=f"Undid edit to {original_name}",
-                file_path=str(original_path),
-                backup_path=str(backup_path)
+                message=f"Undid edit to {original_path.name}",
+                file_path=backup.path,
+                backup_path=str(backup)
             )
         except Exception as e:
             return EditResult(
                 success=False,
                 message=f"Failed to undo edit: {e}",
-                file_path=str(original_path)
+                file_path=backup.path
             )
     
     def _normalize_whitespace(self, text: str) -> str:
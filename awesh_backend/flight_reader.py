@@ -0,0 +1,88 @@
+"""
+Reader for awesh flight recorder dumps.
+
+    python3 -m awesh_backend.flight_reader ~/.awesh_flight/flight-<time>-<pid>-<reason>.bin
+    python3 -m awesh_backend.flight_reader --last 50 /dev/shm/awesh_flight.<pid>
+
+Prints the events of every lane merged into one timeline, counted back from
+the newest event - usually the timeout or crash that triggered the dump.
+The layout is defined in awesh_flight.h and mirrored in flight_recorder.py.
+"""
+
+import argparse
+import struct
+import sys
+
+from .flight_recorder import EVENT, HEADER, HEADER_SIZE, KIND_NAMES, LANE, MAGIC, TIMING
+
+
+def _cstr(raw: bytes) -> str:
+    return raw.split(b"\0", 1)[0].decode("utf-8", errors="replace")
+
+
+def decode(data: bytes):
+    """Return (owner_pid, lanes, events); events are dicts sorted by time"""
+    magic, _, lanes, slots, event_size, owner_pid = HEADER.unpack_from(data, 0)[:6]
+    if magic != MAGIC or event_size != EVENT.size:
+        raise ValueError("not an awesh flight recorder dump")
+
+    lane_info = []
+    events = []
+    for i in range(lanes):
+        role, pid, _, claimed = LANE.unpack_from(data, HEADER.size + i * LANE.size)
+        role = _cstr(role)
+        lane_info.append((role, pid, claimed))
+        base = HEADER_SIZE + i * slots * EVENT.size
+        for slot in range(max(0, claimed - slots), claimed):
+            seq, ts_ns, trace_id, value, event_pid, kind, _, name, detail = \
+                EVENT.unpack_from(data, base + (slot % slots) * EVENT.size)
+            if seq != slot + 1:
+                continue
+            events.append({"ts_ns": ts_ns, "role": role, "pid": event_pid, "kind": kind,
+                           "name": _cstr(name), "value": value, "trace_id": trace_id,
+                           "detail": _cstr(detail)})
+    events.sort(key=lambda event: event["ts_ns"])
+    return owner_pid, lane_info, events
+
+
+def _format_value(event) -> str:
+    if event["kind"] == TIMING:
+        return f"{event['value'] / 1000.0:.3f}ms"
+    return str(event["value"]) if event["value"] else ""
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(description="Decode an awesh flight recorder dump")
+    parser.add_argument("dump", help="dump file from ~/.awesh_flight/, or a live /dev/shm/awesh_flight.<pid>")
+    parser.add_argument("--last", type=int, default=0, help="only show the last N events")
+    args = parser.parse_args(argv)
+
+    try:
+        with open(args.dump, "rb") as f:
+            owner_pid, lanes, events = decode(f.read())
+    except (OSError, ValueError, struct.error) as e:
+        print(f"❌ {args.dump}: {e}", file=sys.stderr)
+        return 1
+
+    print(f"🛩️ Flight recorder of awesh {owner_pid}: {len(events)} events")
+    for role, pid, claimed in lanes:
+        print(f"   {role:<14} pid {pid:<7} {claimed} recorded")
+    if args.last > 0:
+        events = events[-args.last:]
+    if not events:
+        return 0
+
+    # Times count back from the newest event, which is usually the failure
+    newest = events[-1]["ts_ns"]
+    print(f"\n{'ms':>12}  {'process':<20} {'kind':<6} {'event':<22} {'value':>12}  {'trace':<16}  detail")
+    for event in events:
+        process = f"{event['role']}[{event['pid']}]"
+        trace = f"{event['trace_id']:016x}" if event["trace_id"] else "-"
+        detail = event["detail"].replace("\n", "\\n")
+        print(f"{(event['ts_ns'] - newest) / 1e6:>12.3f}  {process:<20} {KIND_NAMES.get(event['kind'], '?'):<6} "
+              f"{event['name']:<22} {_format_value(event):>12}  {trace:<16}  {detail}")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,83 @@
+"""
+Flight recorder for the awesh backend.
+
+The frontend creates a shared-memory segment (/dev/shm/awesh_flight.<pid>,
+named in AWESH_FLIGHT_RECORDER) holding one ring of fixed-size event slots
+per process; see awesh_flight.h for the layout, which the structs below
+mirror. The backend writes its recent requests, replies, provider timings
+and errors into the awesh_backend lane. The C processes copy the whole
+segment to ~/.awesh_flight/ on timeouts, helper deaths and crashes.
+
+flight_reader.py decodes the dumps. FLIGHT_RECORDER=0 disables recording.
+"""
+
+import mmap
+import os
+import struct
+import threading
+import time
+
+from . import tracing
+
+MAGIC = b"AWFLIGHT"
+HEADER_SIZE = 256
+HEADER = struct.Struct("<8sIIIIiI")         # magic, version, lanes, lane_slots, event_size, owner_pid
+LANE = struct.Struct("<16siIQ")             # role, pid, reserved, next
+EVENT = struct.Struct("<QQQqiHH24s64s")     # seq, ts_ns, trace_id, value, pid, kind, reserved, name, detail
+ROLE = "awesh_backend"
+
+IPC_SEND, IPC_RECV, STATE, TIMING, ERROR = 1, 2, 3, 4, 5
+KIND_NAMES = {IPC_SEND: "send", IPC_RECV: "recv", STATE: "state", TIMING: "timing", ERROR: "ERROR"}
+
+_lock = threading.Lock()
+_map = None
+_lane = None        # (lane header offset, first event offset, slots)
+
+
+def enabled() -> bool:
+    return os.getenv("FLIGHT_RECORDER", "1") != "0"
+
+
+def init():
+    """Attach to the frontend's segment and claim the backend's lane"""
+    global _map, _lane
+    name = os.getenv("AWESH_FLIGHT_RECORDER")
+    if not enabled() or not name:
+        return
+    try:
+        with open("/dev/shm" + name, "r+b") as f:
+            segment = mmap.mmap(f.fileno(), 0)
+    except (OSError, ValueError):
+        return
+
+    magic, _, lanes, slots, event_size = HEADER.unpack_from(segment, 0)[:5]
+    if magic != MAGIC or event_size != EVENT.size:
+        segment.close()
+        return
+    for i in range(lanes):
+        offset = HEADER.size + i * LANE.size
+        role = LANE.unpack_from(segment, offset)[0].rstrip(b"\0").decode()
+        if role == ROLE:
+            _map = segment
+            _lane = (offset, HEADER_SIZE + i * slots * EVENT.size, slots)
+            struct.pack_into("<i", segment, offset + 16, os.getpid())
+            record(STATE, "start", detail=ROLE)
+            return
+    segment.close()
+
+
+def record(kind: int, name: str, value: int = 0, detail: str = None):
+    """Write one event into the backend's lane; cheap enough for every message"""
+    if _map is None:
+        return
+    lane_offset, events_offset, slots = _lane
+    detail_bytes = detail.encode("utf-8", errors="replace")[:63] if detail else b""
+    with _lock:
+        slot = struct.unpack_from("<Q", _map, lane_offset + 24)[0]
+        struct.pack_into("<Q", _map, lane_offset + 24, slot + 1)
+        offset = events_offset + (slot % slots) * EVENT.size
+        # seq is written last so a concurrent dump skips a half-written slot
+        struct.pack_into("<Q", _map, offset, 0)
+        EVENT.pack_into(_map, offset, 0, time.monotonic_ns(), tracing.current(), int(value), os.getpid(),
+                        kind, 0, name.encode()[:23], detail_bytes)
+        struct.pack_into("<Q", _map, offset, slot + 1)
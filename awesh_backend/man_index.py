@@ -0,0 +1,560 @@
+"""
+Man Page Index for awesh - local answers for "how do I" questions
+
+Parses installed man pages (and, on opt-in, cached --help output of known
+tools that ship without one) into a BM25 index of option descriptions, so questions like
+"how do I make tar preserve permissions" can be answered without the
+provider, or sent to it with the relevant options as grounded context.
+
+Features:
+- One document per option (".TP"/".IP"/".It" entry) plus the NAME line
+- Segments per source directory in ~/.awesh_manindex/, read through mmap
+- Segments rebuilt by a niced subprocess when their source dir changes
+- "cmd:<name>" terms restrict a query to the command it mentions
+- Confident hits answered locally, weaker ones injected into the prompt
+
+Segment layout (little-endian):
+  header   magic, doc_count, term_count, total_length, section offsets
+  docs     doc_count x (text_offset, text_length, token_count, source: 0 man, 1 --help)
+  terms    term_count x (term_offset, term_length, postings_offset, df), sorted
+  postings df x (doc_id, tf) per term
+  strings  UTF-8 blob: "command\\toption\\tdescription" per doc, then terms
+"""
+
+import os
+import re
+import asyncio
+import sys
+import gzip
+import math
+import mmap
+import time
+import shlex
+import shutil
+import struct
+import tempfile
+import subprocess
+from pathlib import Path
+from typing import Dict, List, Optional, Tuple
+
+def debug_log(message):
+    """Log debug message if verbose mode is enabled"""
+    verbose = os.getenv('VERBOSE', '0') in ['1', '2']
+    if verbose:
+        print(f"📖 Man Index: {message}", file=sys.stderr)
+
+
+SEGMENT_MAGIC = b'AWMIDX02'
+HEADER = struct.Struct('<8sIIQIIII')   # magic, docs, terms, total_len, 4 section offsets
+DOC_ENTRY = struct.Struct('<IIHBx')    # text offset, text length, token count, source
+SOURCES = ('man', 'help')
+TERM_ENTRY = struct.Struct('<IHxxII')  # term offset, term length, postings offset, df
+POSTING = struct.Struct('<IH')         # doc id, term frequency
+
+INDEX_DIR = Path.home() / '.awesh_manindex'
+HELP_CACHE_DIR = Path.home() / '.awesh_help_cache'
+MAN_DIRS = [
+    '/usr/share/man/man1', '/usr/share/man/man8',
+    '/usr/local/share/man/man1', '/usr/local/share/man/man8',
+]
+
+BM25_K1 = 1.2
+BM25_B = 0.75
+MAX_DESCRIPTION = 400
+
+STOP_WORDS = {
+    'a', 'an', 'the', 'how', 'do', 'does', 'i', 'can', 'to', 'make', 'get', 'is', 'it',
+    'in', 'of', 'on', 'for', 'with', 'what', 'which', 'flag', 'option', 'way', 'my',
+    'me', 'and', 'or', 'be', 'there', 'should', 'would', 'when', 'using', 'use', 'want',
+}
+
+HOWTO_PATTERN = re.compile(
+    r"^\s*(how (do|can|to|would|should) |what('s| is) the (flag|option)|"
+    r"which (flag|option)|is there an? (flag|option))", re.IGNORECASE)
+
+# Tools often installed without a man page whose --help only prints usage. Nothing
+# else on PATH is run; MAN_INDEX_HELP_COMMANDS adds names (space or comma separated).
+HELP_ALLOWLIST = {
+    'kubectl', 'helm', 'kustomize', 'kind', 'minikube', 'k3d', 'eksctl', 'istioctl', 'argocd', 'flux',
+    'stern', 'velero', 'oc', 'skaffold', 'terraform', 'packer', 'vault', 'consul', 'nomad', 'doctl',
+    'gh', 'glab', 'aws', 'gcloud', 'az', 'docker-compose', 'podman', 'buildah', 'skopeo', 'crane',
+    'go', 'cargo', 'rustup', 'deno', 'bun', 'npm', 'npx', 'yarn', 'pnpm', 'poetry', 'pipx', 'uv',
+    'ruff', 'black', 'mypy', 'pytest', 'tox', 'pre-commit', 'yq', 'fd', 'rg', 'bat', 'delta', 'just',
+    'hyperfine', 'tokei', 'bazel', 'protoc', 'buf', 'grpcurl', 'sops', 'cosign', 'trivy', 'hadolint',
+    'shellcheck', 'shfmt',
+}
+SANDBOX_SOCKET = Path.home() / '.awesh_sandbox.sock'
+
+ROFF_ESCAPES = [
+    (re.compile(r'\\f(\[[^\]]*\]|\(..|.)'), ''),   # font changes
+    (re.compile(r'\\\*(\[[^\]]*\]|\(..|.)'), ''),  # string registers
+    (re.compile(r'\\\((em|en|hy|mi)'), '-'),
+    (re.compile(r'\\\((lq|rq|oq|cq|dq)'), '"'),
+    (re.compile(r'\\\(..'), ''),
+    (re.compile(r'\\[-]'), '-'),
+    (re.compile(r'\\[&%/,|^:]'), ''),
+    (re.compile(r'\\[e\\]'), r'\\'),
+    (re.compile(r'\\ '), ' '),
+]
+
+
+def _stem(word: str) -> str:
+    """Light suffix stripping so preserve/preserving/preserves share a term"""
+    for suffix, min_len in (('ing', 6), ('ed', 5), ('es', 5), ('s', 4), ('e', 5)):
+        if len(word) >= min_len and word.endswith(suffix) and not word.endswith('ss'):
+            return word[:-len(suffix)]
+    return word
+
+
+def tokenize(text: str) -> List[str]:
+    """Lowercase alphanumeric tokens, stop words removed, lightly stemmed"""
+    return [_stem(t) for t in re.findall(r'[a-z0-9]+', text.lower()) if t not in STOP_WORDS]
+
+
+def roff_to_text(line: str) -> str:
+    """Strip roff escapes from a line of man source"""
+    for pattern, replacement in ROFF_ESCAPES:
+        line = pattern.sub(replacement, line)
+    return line.replace('\\', '')
+
+
+def _macro_args(line: str) -> str:
+    """Text carried by a formatting macro like .B/.BR/.IP"""
+    parts = re.findall(r'"([^"]*)"|(\S+)', line)
+    words = [quoted or bare for quoted, bare in parts][1:]
+    if line.startswith(('.BR', '.RB', '.IR', '.RI', '.BI', '.IB')):
+        return ''.join(words)
+    return ' '.join(words)
+
+
+def parse_man_page(command: str, source: str) -> List[Tuple[str, str, str]]:
+    """Extract (command, option, description) documents from roff/mdoc source"""
+    docs = []
+    section = ''
+    tag = None
+    body: List[str] = []
+    expect_tag = False
+
+    def flush():
+        nonlocal tag, body
+        if tag is not None and tag.lstrip().startswith('-'):
+            text = ' '.join(' '.join(body).split())
+            if text:
+                docs.append((command, ' '.join(tag.split()), text[:MAX_DESCRIPTION]))
+        tag = None
+        body = []
+
+    for raw in source.splitlines():
+        if raw.startswith(('.\\"', "'\\\"")):
+            continue
+        if raw.startswith('.'):
+            macro = raw.split(None, 1)[0] if raw.strip() else '.'
+            if macro in ('.SH', '.Sh'):
+                flush()
+                section = roff_to_text(_macro_args(raw)).upper()
+            elif macro == '.TP':
+                flush()
+                expect_tag = True
+            elif macro == '.IP':
+                flush()
+                tag = roff_to_text(_macro_args(raw))
+            elif macro == '.It':
+                flush()
+                tag = roff_to_text(raw[3:].replace('Fl ', '-').replace(' Ar ', ' ').replace(' Ns ', ''))
+            elif macro in ('.PP', '.P', '.LP', '.Pp'):
+                flush()
+            elif macro in ('.B', '.I', '.BR', '.RB', '.IR', '.RI', '.BI', '.IB', '.SM'):
+                text = roff_to_text(_macro_args(raw))
+                if expect_tag:
+                    tag, expect_tag = text, False
+                elif tag is not None:
+                    body.append(text)
+            continue
+
+        text = roff_to_text(raw)
+        if expect_tag:
+            tag, expect_tag = text, False
+        elif section == 'NAME' and ' - ' in text:
+            docs.append((command, '', ' '.join(text.split())[:MAX_DESCRIPTION]))
+        elif tag is not None:
+            body.append(text)
+    flush()
+    return docs
+
+
+def parse_help_output(command: str, text: str) -> List[Tuple[str, str, str]]:
+    """Extract option documents from `cmd --help` output"""
+    docs = []
+    current = None
+    for line in text.splitlines():
+        match = re.match(r'^\s{1,8}(-\S.*?)(?:\s{2,}(\S.*))?$', line)
+        if match:
+            if current:
+                docs.append(current)
+            current = (command, match.group(1).strip(), (match.group(2) or '').strip())
+        elif current and line.startswith(' ' * 10) and line.strip():
+            current = (current[0], current[1], (current[2] + ' ' + line.strip()).strip())
+        elif current:
+            docs.append(current)
+            current = None
+    if current:
+        docs.append(current)
+    return [(c, o, d[:MAX_DESCRIPTION]) for c, o, d in docs if d]
+
+
+def write_segment(path: Path, docs: List[Tuple[str, str, str]], source: str = 'man'):
+    """Serialise documents into a BM25 segment, atomically replacing `path`.
+    `source` ('man' or 'help') is recorded per document for the answer's attribution."""
+    source_id = SOURCES.index(source)
+    strings = bytearray()
+    doc_entries = []
+    postings: Dict[str, List[Tuple[int, int]]] = {}
+    total_length = 0
+
+    for doc_id, (command, option, description) in enumerate(docs):
+        text = f"{command}\t{option}\t{description}".encode('utf-8', 'replace')
+        tokens = tokenize(f"{command} {option} {description}")
+        counts: Dict[str, int] = {}
+        for token in tokens:
+            counts[token] = counts.get(token, 0) + 1
+        counts[f"cmd:{command}"] = 1
+        for term, tf in counts.items():
+            postings.setdefault(term, []).append((doc_id, min(tf, 0xFFFF)))
+        doc_entries.append((len(strings), len(text), min(len(tokens), 0xFFFF), source_id))
+        total_length += len(tokens)
+        strings += text
+
+    terms = sorted(postings, key=lambda t: t.encode('utf-8'))
+    term_entries = []
+    postings_blob = bytearray()
+    for term in terms:
+        encoded = term.encode('utf-8')[:0xFFFF]
+        term_entries.append((len(strings), len(encoded), len(postings_blob) // POSTING.size, len(postings[term])))
+        strings += encoded
+        for doc_id, tf in postings[term]:
+            postings_blob += POSTING.pack(doc_id, tf)
+
+    docs_offset = HEADER.size
+    terms_offset = docs_offset + DOC_ENTRY.size * len(doc_entries)
+    postings_offset = terms_offset + TERM_ENTRY.size * len(term_entries)
+    strings_offset = postings_offset + len(postings_blob)
+
+    path.parent.mkdir(parents=True, exist_ok=True)
+    temp_path = path.with_suffix(f'.{os.getpid()}.tmp')
+    with open(temp_path, 'wb') as f:
+        f.write(HEADER.pack(SEGMENT_MAGIC, len(doc_entries), len(term_entries), total_length,
+                            docs_offset, terms_offset, postings_offset, strings_offset))
+        for entry in doc_entries:
+            f.write(DOC_ENTRY.pack(*entry))
+        for entry in term_entries:
+            f.write(TERM_ENTRY.pack(*entry))
+        f.write(postings_blob)
+        f.write(strings)
+    os.replace(temp_path, path)
+
+
+class Segment:
+    """Read-only mmap view of one segment file"""
+
+    def __init__(self, path: Path):
+        self.path = path
+        self.mtime = path.stat().st_mtime
+        with open(path, 'rb') as f:
+            self.map = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+        (magic, self.doc_count, self.term_count, self.total_length, self.docs_offset,
+         self.terms_offset, self.postings_offset, self.strings_offset) = HEADER.unpack_from(self.map, 0)
+        if magic != SEGMENT_MAGIC:
+            self.map.close()
+            raise ValueError(f"bad segment magic in {path}")
+
+    def close(self):
+        self.map.close()
+
+    def _term_at(self, index: int) -> Tuple[bytes, int, int]:
+        offset, length, postings, df = TERM_ENTRY.unpack_from(self.map, self.terms_offset + index * TERM_ENTRY.size)
+        start = self.strings_offset + offset
+        return self.map[start:start + length], postings, df
+
+    def lookup(self, term: str) -> Tuple[int, int]:
+        """Binary search the term table; returns (postings index, df) or (0, 0)"""
+        key = term.encode('utf-8')
+        low, high = 0, self.term_count
+        while low < high:
+            mid = (low + high) // 2
+            if self._term_at(mid)[0] < key:
+                low = mid + 1
+            else:
+                high = mid
+        if low < self.term_count:
+            found, postings, df = self._term_at(low)
+            if found == key:
+                return postings, df
+        return 0, 0
+
+    def postings(self, start: int, df: int):
+        base = self.postings_offset + start * POSTING.size
+        for i in range(df):
+            yield POSTING.unpack_from(self.map, base + i * POSTING.size)
+
+    def doc_length(self, doc_id: int) -> int:
+        return DOC_ENTRY.unpack_from(self.map, self.docs_offset + doc_id * DOC_ENTRY.size)[2]
+
+    def doc(self, doc_id: int) -> Tuple[str, str, str, str]:
+        offset, length, _, source_id = DOC_ENTRY.unpack_from(self.map, self.docs_offset + doc_id * DOC_ENTRY.size)
+        start = self.strings_offset + offset
+        command, option, description = self.map[start:start + length].decode('utf-8', 'replace').split('\t', 2)
+        return command, option, description, SOURCES[source_id] if source_id < len(SOURCES) else 'man'
+
+
+def segment_current(path: Path) -> bool:
+    """True if `path` exists and was written in this version's layout"""
+    try:
+        with open(path, 'rb') as f:
+            return f.read(len(SEGMENT_MAGIC)) == SEGMENT_MAGIC
+    except OSError:
+        return False
+
+
+async def run_help_in_sandbox(executable: str, scratch: str) -> Optional[str]:
+    """`executable --help` in a throwaway sandbox overlay: read-only system, no network.
+    None if the sandbox is not running; the tool is never run outside it."""
+    command = f"LANG=C {shlex.quote(executable)} --help < /dev/null 2>&1"
+    try:
+        ack, data = await _sandbox_request(f"PREVIEW:-\n{scratch}\n{command}")
+    except (OSError, asyncio.TimeoutError):
+        return None
+    if not ack.startswith('PREVIEW:'):
+        return ''
+    try:
+        await _sandbox_request(f"PREVIEW_DISCARD:{ack[len('PREVIEW:'):]}")
+    except (OSError, asyncio.TimeoutError):
+        pass
+    match = re.match(rb"EXIT_CODE:-?\d+\nSTDOUT_LEN:(\d+)\nSTDOUT:", data)
+    return data[match.end():match.end() + int(match.group(1))].decode('utf-8', errors='replace') if match else ''
+
+
+async def _sandbox_request(message: str) -> Tuple[str, bytes]:
+    """Acknowledgement and result of one sandbox request, both read off its own connection"""
+    reader, writer = await asyncio.wait_for(asyncio.open_unix_connection(str(SANDBOX_SOCKET)), timeout=30)
+    try:
+        writer.write(f"INLINE:{message}".encode('utf-8'))
+        await writer.drain()
+        reply = await asyncio.wait_for(reader.read(), timeout=30)
+    finally:
+        writer.close()
+    ack, _, data = reply.partition(b"\n")
+    return ack.decode('utf-8', errors='replace'), data
+
+
+class ManIndex:
+    """BM25 search over man page and --help option descriptions"""
+
+    def __init__(self, index_dir: Path = INDEX_DIR):
+        self.index_dir = index_dir
+        self.enabled = os.getenv('MAN_INDEX', '1') != '0'
+        self.answer_locally = os.getenv('MAN_INDEX_ANSWER', '1') != '0'
+        self.segments: Dict[str, Segment] = {}
+        self.build_process = None
+
+    # ---- building (runs in the indexer subprocess) ----
+
+    @staticmethod
+    def _segment_name(source_dir: str) -> str:
+        return source_dir.strip('/').replace('/', '_') + '.seg'
+
+    def stale_sources(self) -> List[str]:
+        """Source directories whose segment is missing or older than the directory"""
+        stale = []
+        for source_dir in MAN_DIRS:
+            if not os.path.isdir(source_dir):
+                continue
+            segment = self.index_dir / self._segment_name(source_dir)
+            if not segment_current(segment) or segment.stat().st_mtime < os.stat(source_dir).st_mtime:
+                stale.append(source_dir)
+        return stale
+
+    def build_man_segment(self, source_dir: str):
+        docs = []
+        for entry in sorted(os.listdir(source_dir)):
+            path = os.path.join(source_dir, entry)
+            command = entry[:-3] if entry.endswith('.gz') else entry
+            command = command.rsplit('.', 1)[0]
+            try:
+                opener = gzip.open if entry.endswith('.gz') else open
+                with opener(path, 'rt', encoding='utf-8', errors='replace') as f:
+                    source = f.read()
+            except (OSError, EOFError):
+                continue
+            if source.startswith('.so '):
+                continue  # Alias page pointing at another page
+            docs.extend(parse_man_page(command, source))
+        write_segment(self.index_dir / self._segment_name(source_dir), docs)
+        debug_log(f"{source_dir}: {len(docs)} option documents")
+
+    async def build_help_segment(self):
+        """Opt-in: cache and index `--help` of allowlisted tools that have no man page"""
+        documented = set()
+        for source_dir in MAN_DIRS:
+            if os.path.isdir(source_dir):
+                documented.update(e.split('.', 1)[0] for e in os.listdir(source_dir))
+        names = HELP_ALLOWLIST | set(re.split(r'[\s,]+', os.getenv('MAN_INDEX_HELP_COMMANDS', '').strip())) - {''}
+
+        HELP_CACHE_DIR.mkdir(parents=True, exist_ok=True)
+        scratch = tempfile.mkdtemp(prefix='awesh_help_')
+        docs = []
+        try:
+            for name in sorted(names - documented):
+                executable = shutil.which(name)
+                if not executable:
+                    continue
+                cache = HELP_CACHE_DIR / f"{name}.txt"
+                if not cache.exists():
+                    output = await run_help_in_sandbox(executable, scratch)
+                    if output is None:
+                        debug_log("sandbox not reachable, --help index left for the next build")
+                        return
+                    cache.write_text(output)
+                docs.extend(parse_help_output(name, cache.read_text(errors='replace')))
+        finally:
+            shutil.rmtree(scratch, ignore_errors=True)
+        write_segment(self.index_dir / 'help.seg', docs, source='help')
+        debug_log(f"--help cache: {len(docs)} option documents")
+
+    def build(self):
+        """Rebuild every stale segment (indexer subprocess entry point)"""
+        start = time.time()
+        for source_dir in self.stale_sources():
+            self.build_man_segment(source_dir)
+        if os.getenv('MAN_INDEX_HELP', '0') == '1':
+            help_segment = self.index_dir / 'help.seg'
+            if not segment_current(help_segment) or time.time() - help_segment.stat().st_mtime > 7 * 86400:
+                asyncio.run(self.build_help_segment())
+        debug_log(f"build finished in {time.time() - start:.1f}s")
+
+    def start_background_build(self):
+        """Launch the niced indexer subprocess if any segment is stale"""
+        if not self.enabled or (self.build_process and self.build_process.poll() is None):
+            return
+        help_wanted = os.getenv('MAN_INDEX_HELP', '0') == '1' and not segment_current(self.index_dir / 'help.seg')
+        if not self.stale_sources() and not help_wanted:
+            return
+        try:
+            self.build_process = subprocess.Popen(
+                [sys.executable, os.path.abspath(__file__)],  # stdlib only - skip the package import
+                stdin=subprocess.DEVNULL, stdout=subprocess.DEVNULL,
+                preexec_fn=lambda: os.nice(10))
+            debug_log(f"indexer started (pid {self.build_process.pid})")
+        except OSError as e:
+            debug_log(f"could not start indexer: {e}")
+
+    # ---- searching (runs in the backend) ----
+
+    def _refresh_segments(self):
+        """Open new segments and remap ones the indexer replaced"""
+        if not self.index_dir.is_dir():
+            return
+        for path in self.index_dir.glob('*.seg'):
+            current = self.segments.get(path.name)
+            try:
+                if current and current.mtime == path.stat().st_mtime:
+                    continue
+                segment = Segment(path)
+            except (OSError, ValueError, struct.error) as e:
+                debug_log(f"skipping segment {path.name}: {e}")
+                continue
+            if current:
+                current.close()
+            self.segments[path.name] = segment
+
+    def search(self, question: str, limit: int = 5) -> List[Tuple[float, Tuple[str, str, str, str]]]:
+        """Top BM25 hits as (score, (command, option, description, source))"""
+        if not self.enabled:
+            return []
+        self._refresh_segments()
+        if not self.segments:
+            return []
+
+        words = re.findall(r'[A-Za-z0-9][\w.+-]*', question.lower())
+        segments = list(self.segments.values())
+        doc_total = sum(s.doc_count for s in segments)
+        if doc_total == 0:
+            return []
+        avg_length = sum(s.total_length for s in segments) / doc_total
+
+        # A command named in the question narrows the search to its options
+        commands = [w for w in words if any(s.lookup(f"cmd:{w}")[1] for s in segments)]
+        if any(c not in STOP_WORDS for c in commands):
+            commands = [c for c in commands if c not in STOP_WORDS]  # "make grep ..." is about grep
+        terms = [t for t in tokenize(' '.join(words)) if t not in commands]
+        if not terms:
+            return []
+
+        scores: Dict[Tuple[str, int], float] = {}
+        for term in set(terms):
+            df = sum(s.lookup(term)[1] for s in segments)
+            if df == 0:
+                continue
+            idf = math.log(1 + (doc_total - df + 0.5) / (df + 0.5))
+            for segment in segments:
+                start, segment_df = segment.lookup(term)
+                for doc_id, tf in segment.postings(start, segment_df):
+                    length = segment.doc_length(doc_id)
+                    norm = tf * (BM25_K1 + 1) / (tf + BM25_K1 * (1 - BM25_B + BM25_B * length / avg_length))
+                    key = (segment.path.name, doc_id)
+                    scores[key] = scores.get(key, 0.0) + idf * norm
+
+        if commands:
+            allowed = set()
+            for segment in segments:
+                for command in commands:
+                    start, df = segment.lookup(f"cmd:{command}")
+                    allowed.update((segment.path.name, doc_id) for doc_id, _ in segment.postings(start, df))
+            scores = {key: score for key, score in scores.items() if key in allowed}
+
+        ranked = sorted(scores.items(), key=lambda item: item[1], reverse=True)[:limit]
+        return [(score, self.segments[name].doc(doc_id)) for (name, doc_id), score in ranked]
+
+    @staticmethod
+    def is_howto_question(prompt: str) -> bool:
+        return bool(HOWTO_PATTERN.match(prompt))
+
+    def answer(self, question: str) -> Tuple[Optional[str], Optional[str]]:
+        """Returns (local answer, None) when confident, else (None, prompt context)"""
+        start = time.time()
+        hits = self.search(question)
+        debug_log(f"search took {(time.time() - start) * 1000:.1f}ms, {len(hits)} hits")
+        if not hits:
+            return None, None
+
+        mentions_command = hits[0][1][0] in re.findall(r'[\w.+-]+', question.lower())
+        top_score = hits[0][0]
+        runner_up = hits[1][0] if len(hits) > 1 else 0.0
+        if self.answer_locally and mentions_command and hits[0][1][1] and top_score >= 4.0 \
+                and top_score >= 1.3 * runner_up:
+            command, option, description, source = hits[0][1]
+            origin = f"{command} --help" if source == 'help' else f"man {command}"
+            answer = f"📖 From `{origin}`:\n  {option}\n      {description}\n"
+            related = [h[1] for h in hits[1:3] if h[1][0] == command and h[1][1] and h[0] >= 0.6 * top_score]
+            for _, other_option, other_description, _ in related:
+                answer += f"  {other_option}\n      {other_description}\n"
+            return answer, None
+
+        context = "Reference from local man pages (prefer these options):\n"
+        for _, (command, option, description, _) in hits:
+            context += f"- {command} {option}: {description}\n" if option else f"- {description}\n"
+        return None, context
+
+
+# Singleton instance
+_man_index_instance = None
+
+def get_man_index() -> ManIndex:
+    """Get or create the global man index instance"""
+    global _man_index_instance
+    if _man_index_instance is None:
+        _man_index_instance = ManIndex()
+    return _man_index_instance
+
+
+if __name__ == '__main__':
+    get_man_index().build()
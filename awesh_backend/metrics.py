@@ -0,0 +1,196 @@
+"""
+Prometheus metrics for the awesh backend.
+
+Same model and output as the C processes (awesh_metrics.c): counters, gauges
+and latency histograms rendered in Prometheus text format, served on
+~/.awesh_metrics/awesh_backend.<pid>.sock (plain text for a raw connect,
+an HTTP response for "GET", so `curl --unix-socket` works) and, with
+METRICS_TEXTFILE_DIR set, written to <dir>/awesh_backend_<pid>.prom for
+node_exporter's textfile collector. Every series carries role and pid
+labels. METRICS=0 disables the socket and the textfile.
+
+Standard library only - no prometheus_client dependency.
+"""
+
+import asyncio
+import os
+import sys
+from pathlib import Path
+
+ROLE = "awesh_backend"
+METRICS_DIR = Path.home() / ".awesh_metrics"
+TEXTFILE_INTERVAL = 15.0
+BUCKETS = (0.001, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0, 10.0)
+
+_families = {}      # name -> (type, help), in registration order
+_series = {}        # (name, labels) -> metric
+
+
+def enabled() -> bool:
+    return os.getenv("METRICS", "1") != "0"
+
+
+class Counter:
+    def __init__(self):
+        self.value = 0
+
+    def inc(self, amount=1):
+        self.value += amount
+
+
+class Gauge:
+    def __init__(self):
+        self.value = 0
+
+    def set(self, value):
+        self.value = value
+
+    def inc(self, amount=1):
+        self.value += amount
+
+    def dec(self, amount=1):
+        self.value -= amount
+
+
+class Histogram:
+    def __init__(self):
+        self.buckets = [0] * len(BUCKETS)
+        self.count = 0
+        self.sum = 0.0
+
+    def observe(self, seconds: float):
+        for i, bound in enumerate(BUCKETS):
+            if seconds <= bound:
+                self.buckets[i] += 1
+                break
+        self.count += 1
+        self.sum += seconds
+
+
+def _get(kind, cls, name, help_text, labels):
+    key = (name, tuple(sorted(labels.items())))
+    metric = _series.get(key)
+    if metric is None:
+        _families.setdefault(name, (kind, help_text))
+        metric = _series[key] = cls()
+    return metric
+
+
+def counter(name: str, help_text: str, **labels) -> Counter:
+    return _get("counter", Counter, name, help_text, labels)
+
+
+def gauge(name: str, help_text: str, **labels) -> Gauge:
+    return _get("gauge", Gauge, name, help_text, labels)
+
+
+def histogram(name: str, help_text: str, **labels) -> Histogram:
+    return _get("histogram", Histogram, name, help_text, labels)
+
+
+def _labels(labels, extra=None):
+    pairs = [("role", ROLE), ("pid", str(os.getpid()))] + list(labels)
+    if extra:
+        pairs.append(extra)
+    return "{" + ",".join(f'{key}="{value}"' for key, value in pairs) + "}"
+
+
+def _format_bound(bound):
+    return f"{bound:g}"
+
+
+def render() -> str:
+    lines = []
+    for name, (kind, help_text) in _families.items():
+        lines.append(f"# HELP {name} {help_text}")
+        lines.append(f"# TYPE {name} {kind}")
+        for (series_name, labels), metric in _series.items():
+            if series_name != name:
+                continue
+            if kind != "histogram":
+                lines.append(f"{name}{_labels(labels)} {metric.value}")
+                continue
+            cumulative = 0
+            for bound, count in zip(BUCKETS, metric.buckets):
+                cumulative += count
+                lines.append(f"{name}_bucket{_labels(labels, ('le', _format_bound(bound)))} {cumulative}")
+            lines.append(f"{name}_bucket{_labels(labels, ('le', '+Inf'))} {metric.count}")
+            lines.append(f"{name}_sum{_labels(labels)} {metric.sum:.6f}")
+            lines.append(f"{name}_count{_labels(labels)} {metric.count}")
+    return "\n".join(lines) + "\n"
+
+
+def socket_path() -> Path:
+    return METRICS_DIR / f"{ROLE}.{os.getpid()}.sock"
+
+
+def textfile_path():
+    directory = os.getenv("METRICS_TEXTFILE_DIR")
+    return Path(directory) / f"{ROLE}_{os.getpid()}.prom" if directory else None
+
+
+async def _handle_scrape(reader, writer):
+    try:
+        # An HTTP client speaks first; a raw reader (socat, nc -U) does not
+        try:
+            request = await asyncio.wait_for(reader.read(512), timeout=0.05)
+        except asyncio.TimeoutError:
+            request = b""
+        body = render().encode("utf-8")
+        if request.startswith(b"GET "):
+            writer.write(b"HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                         b"Content-Length: %d\r\nConnection: close\r\n\r\n" % len(body))
+        writer.write(body)
+        await writer.drain()
+    except (ConnectionError, OSError):
+        pass
+    finally:
+        writer.close()
+
+
+def write_textfile():
+    path = textfile_path()
+    if not path:
+        return
+    tmp_path = path.with_name(path.name + ".tmp")
+    try:
+        tmp_path.write_text(render())
+        tmp_path.replace(path)
+    except OSError as e:
+        if os.getenv("VERBOSE", "0") == "1":
+            print(f"🔧 Metrics: cannot write {path}: {e}", file=sys.stderr)
+
+
+async def _textfile_loop():
+    while True:
+        write_textfile()
+        await asyncio.sleep(TEXTFILE_INTERVAL)
+
+
+async def start():
+    """Serve the metrics socket and keep the textfile fresh; returns the server or None"""
+    if not enabled():
+        return None
+    if textfile_path():
+        asyncio.create_task(_textfile_loop())
+    try:
+        METRICS_DIR.mkdir(mode=0o700, exist_ok=True)
+        path = socket_path()
+        try:
+            path.unlink()
+        except OSError:
+            pass
+        return await asyncio.start_unix_server(_handle_scrape, path=str(path))
+    except OSError as e:
+        if os.getenv("VERBOSE", "0") == "1":
+            print(f"🔧 Metrics: socket unavailable: {e}", file=sys.stderr)
+        return None
+
+
+def stop():
+    for path in (socket_path(), textfile_path()):
+        if path:
+            try:
+                path.unlink()
+            except OSError:
+                pass
@@ -0,0 +1,406 @@
+"""
+Deterministic mock LLM for offline performance testing
+
+Two ways in:
+
+* AI_PROVIDER=mock - AweshAIClient uses MockAsyncClient in place of
+  AsyncOpenAI, so the whole backend (ai_client, response agent, execution
+  agent, security proxy, frontend) runs with no network and no openai
+  package.
+* python3 -m awesh_backend.mock_llm --port 8089 - a local HTTP stand-in
+  serving the OpenAI-compatible (/v1/chat/completions, /v1/models) and
+  Ollama (/api/chat, /api/generate, /api/tags) endpoints, for exercising
+  the real HTTP client paths: AI_PROVIDER=ollama
+  OLLAMA_BASE_URL=http://127.0.0.1:8089/v1
+
+Both replay scripted responses with the same timing model:
+
+    MOCK_LLM_SCRIPT          JSON script (see below); built-in reply if unset
+    MOCK_LLM_TTFT_MS         time to first token (default 200)
+    MOCK_LLM_TOKENS_PER_SEC  generation speed after the first token (default 50)
+    MOCK_LLM_JITTER_MS       +/- jitter applied to every token delay (default 0)
+    MOCK_LLM_ERROR_RATE      fraction of requests that fail, 0.0-1.0 (default 0)
+    MOCK_LLM_ERROR_MODE      "request" (fails before any token, HTTP 500) or
+                             "midstream" (stream breaks halfway) (default request)
+    MOCK_LLM_SEED            seed for jitter and error injection (default 0)
+
+Randomness is seeded from MOCK_LLM_SEED and the prompt text, so the same
+prompt gets the same timings and the same failure decision on every run,
+whatever the request order.
+
+Script format:
+
+    {
+      "default": "Reply used when no rule matches",
+      "responses": [
+        {"match": "disk|space", "response": "awesh: df -h",
+         "ttft_ms": 50, "tokens_per_sec": 200, "error": "midstream"}
+      ]
+    }
+
+"match" is a regular expression searched in the last user message;
+per-rule ttft_ms / tokens_per_sec / jitter_ms / error override the
+environment.
+"""
+
+import argparse
+import asyncio
+import json
+import os
+import random
+import re
+import sys
+import time
+import zlib
+from dataclasses import dataclass, field
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from typing import List, Optional, Tuple
+
+
+def debug_log(message):
+    """Log debug message if verbose mode is enabled"""
+    verbose = os.getenv('VERBOSE', '0') == '1'
+    if verbose:
+        print(f"🔧 MockLLM: {message}", file=sys.stderr)
+
+
+DEFAULT_REPLY = """This is a mock response from the awesh offline provider.
+
+- Prompt received and answered without any network access
+- Timing follows MOCK_LLM_TTFT_MS and MOCK_LLM_TOKENS_PER_SEC
+
+Set MOCK_LLM_SCRIPT to replay scripted replies instead of this one.
+"""
+
+TOKEN_PATTERN = re.compile(r"\s*\S+|\s+")
+
+
+class MockLLMError(Exception):
+    """Injected failure (MOCK_LLM_ERROR_RATE or a script rule's "error")"""
+
+
+def _env_float(name: str, default: float) -> float:
+    try:
+        return float(os.getenv(name, default))
+    except ValueError:
+        return default
+
+
+@dataclass
+class MockSettings:
+    ttft_ms: float = 200.0
+    tokens_per_sec: float = 50.0
+    jitter_ms: float = 0.0
+    error_rate: float = 0.0
+    error_mode: str = "request"
+    seed: int = 0
+
+    @classmethod
+    def from_env(cls) -> 'MockSettings':
+        return cls(
+            ttft_ms=_env_float('MOCK_LLM_TTFT_MS', 200.0),
+            tokens_per_sec=_env_float('MOCK_LLM_TOKENS_PER_SEC', 50.0),
+            jitter_ms=_env_float('MOCK_LLM_JITTER_MS', 0.0),
+            error_rate=_env_float('MOCK_LLM_ERROR_RATE', 0.0),
+            error_mode=os.getenv('MOCK_LLM_ERROR_MODE', 'request'),
+            seed=int(_env_float('MOCK_LLM_SEED', 0)),
+        )
+
+
+@dataclass
+class MockPlan:
+    """One scripted reply: (delay before token in seconds, token) pairs and where it fails"""
+    text: str
+    tokens: List[Tuple[float, str]] = field(default_factory=list)
+    error_mode: Optional[str] = None   # None, "request" or "midstream"
+
+    @property
+    def fail_at(self) -> int:
+        """Index of the first token that is not delivered"""
+        if self.error_mode == "request":
+            return 0
+        if self.error_mode == "midstream":
+            return max(1, len(self.tokens) // 2)
+        return len(self.tokens)
+
+
+class MockLLM:
+    """Script + timing model shared by the in-process client and the HTTP stand-in"""
+
+    def __init__(self, settings: Optional[MockSettings] = None, script_path: Optional[str] = None):
+        self.settings = settings or MockSettings.from_env()
+        self.default_reply = DEFAULT_REPLY
+        self.rules = []
+        script_path = script_path or os.getenv('MOCK_LLM_SCRIPT')
+        if script_path:
+            self._load_script(script_path)
+
+    def _load_script(self, path: str):
+        with open(os.path.expanduser(path), 'r', encoding='utf-8') as f:
+            script = json.load(f)
+        self.default_reply = script.get('default', self.default_reply)
+        for rule in script.get('responses', []):
+            self.rules.append((re.compile(rule.get('match', ''), re.IGNORECASE), rule))
+        debug_log(f"Loaded {len(self.rules)} scripted responses from {path}")
+
+    @staticmethod
+    def last_user_message(messages) -> str:
+        for message in reversed(messages or []):
+            if message.get('role') == 'user':
+                content = message.get('content', '')
+                return content if isinstance(content, str) else json.dumps(content)
+        return ''
+
+    def plan(self, messages) -> MockPlan:
+        prompt = self.last_user_message(messages)
+        rule = {}
+        for pattern, candidate in self.rules:
+            if pattern.search(prompt):
+                rule = candidate
+                break
+        text = rule.get('response', self.default_reply)
+
+        s = self.settings
+        ttft = float(rule.get('ttft_ms', s.ttft_ms)) / 1000.0
+        tokens_per_sec = float(rule.get('tokens_per_sec', s.tokens_per_sec))
+        per_token = 1.0 / tokens_per_sec if tokens_per_sec > 0 else 0.0
+        jitter = float(rule.get('jitter_ms', s.jitter_ms)) / 1000.0
+
+        # Same seed + same prompt -> same timings and failures, in any request order
+        rng = random.Random(s.seed * 1000003 + zlib.crc32(prompt.encode('utf-8')))
+        plan = MockPlan(text=text)
+        for index, token in enumerate(TOKEN_PATTERN.findall(text)):
+            delay = ttft if index == 0 else per_token
+            if jitter:
+                delay += rng.uniform(-jitter, jitter)
+            plan.tokens.append((max(0.0, delay), token))
+
+        if 'error' in rule:
+            plan.error_mode = rule['error']
+        elif s.error_rate > 0 and rng.random() < s.error_rate:
+            plan.error_mode = s.error_mode
+        return plan
+
+    async def stream(self, messages, plan: Optional[MockPlan] = None):
+        """Async token stream; raises MockLLMError where the plan fails"""
+        plan = plan or self.plan(messages)
+        for index, (delay, token) in enumerate(plan.tokens):
+            if index == plan.fail_at:
+                raise MockLLMError(f"injected {plan.error_mode} failure")
+            await asyncio.sleep(delay)
+            yield token
+        if plan.error_mode and plan.fail_at >= len(plan.tokens):
+            raise MockLLMError(f"injected {plan.error_mode} failure")
+
+    def stream_sync(self, plan: MockPlan):
+        """Blocking token stream for the HTTP stand-in; stops where the plan fails"""
+        for index, (delay, token) in enumerate(plan.tokens):
+            if index == plan.fail_at:
+                return
+            time.sleep(delay)
+            yield token
+
+
+# ---------------------------------------------------------------------------
+# In-process client: just enough of AsyncOpenAI for AweshAIClient
+# ---------------------------------------------------------------------------
+
+class _Obj:
+    def __init__(self, **kwargs):
+        self.__dict__.update(kwargs)
+
+
+def _chunk(content: Optional[str]):
+    return _Obj(choices=[_Obj(delta=_Obj(content=content), finish_reason=None)])
+
+
+class _MockCompletions:
+    def __init__(self, llm: MockLLM):
+        self.llm = llm
+
+    async def create(self, model=None, messages=None, stream=False, **kwargs):
+        plan = self.llm.plan(messages)
+        if plan.fail_at == 0:
+            # Like an HTTP error status: the request itself fails
+            raise MockLLMError("injected request failure")
+
+        if stream:
+            plan_stream = self.llm.stream(messages, plan)
+
+            async def chunks():
+                async for token in plan_stream:
+                    yield _chunk(token)
+            return chunks()
+
+        content = []
+        async for token in self.llm.stream(messages, plan):
+            content.append(token)
+        return _Obj(choices=[_Obj(message=_Obj(content=''.join(content)), finish_reason='stop')])
+
+
+class MockAsyncClient:
+    """Drop-in for AsyncOpenAI's chat.completions.create (streaming and not)"""
+
+    def __init__(self, llm: Optional[MockLLM] = None):
+        self.llm = llm or MockLLM()
+        self.chat = _Obj(completions=_MockCompletions(self.llm))
+
+    async def close(self):
+        pass
+
+
+# ---------------------------------------------------------------------------
+# HTTP stand-in: OpenAI-compatible and Ollama endpoints
+# ---------------------------------------------------------------------------
+
+class MockHTTPHandler(BaseHTTPRequestHandler):
+    protocol_version = 'HTTP/1.1'
+    llm: MockLLM = None
+
+    def log_message(self, format, *args):
+        debug_log(format % args)
+
+    def _send_json(self, status: int, body):
+        data = json.dumps(body).encode('utf-8')
+        self.send_response(status)
+        self.send_header('Content-Type', 'application/json')
+        self.send_header('Content-Length', str(len(data)))
+        self.end_headers()
+        self.wfile.write(data)
+
+    def _start_stream(self, content_type: str):
+        self.send_response(200)
+        self.send_header('Content-Type', content_type)
+        self.send_header('Transfer-Encoding', 'chunked')
+        self.send_header('Cache-Control', 'no-cache')
+        self.end_headers()
+
+    def _write_chunk(self, data: bytes):
+        self.wfile.write(f"{len(data):x}\r\n".encode() + data + b"\r\n")
+        self.wfile.flush()
+
+    def _read_body(self):
+        length = int(self.headers.get('Content-Length', 0))
+        try:
+            return json.loads(self.rfile.read(length) or b'{}')
+        except ValueError:
+            return None
+
+    def do_GET(self):
+        if self.path.rstrip('/') in ('/v1/models', '/models'):
+            self._send_json(200, {"object": "list", "data": [{"id": "mock", "object": "model", "owned_by": "awesh"}]})
+        elif self.path.rstrip('/') == '/api/tags':
+            self._send_json(200, {"models": [{"name": "mock", "model": "mock", "size": 0}]})
+        else:
+            self._send_json(404, {"error": f"unknown endpoint {self.path}"})
+
+    def do_POST(self):
+        body = self._read_body()
+        if body is None:
+            self._send_json(400, {"error": "invalid JSON body"})
+            return
+
+        path = self.path.rstrip('/')
+        if path in ('/v1/chat/completions', '/chat/completions'):
+            self._openai_chat(body)
+        elif path == '/api/chat':
+            self._ollama(body, body.get('messages', []), chat=True)
+        elif path == '/api/generate':
+            self._ollama(body, [{"role": "user", "content": body.get('prompt', '')}], chat=False)
+        else:
+            self._send_json(404, {"error": f"unknown endpoint {self.path}"})
+
+    def _openai_chat(self, body):
+        plan = self.llm.plan(body.get('messages', []))
+        model = body.get('model', 'mock')
+        if plan.fail_at == 0:
+            self._send_json(500, {"error": {"message": "injected request failure", "type": "server_error"}})
+            return
+
+        created = int(time.time())
+        if not body.get('stream'):
+            text = ''.join(self.llm.stream_sync(plan))
+            if plan.error_mode:
+                self._send_json(500, {"error": {"message": "injected midstream failure", "type": "server_error"}})
+                return
+            self._send_json(200, {
+                "id": "chatcmpl-mock", "object": "chat.completion", "created": created, "model": model,
+                "choices": [{"index": 0, "message": {"role": "assistant", "content": text}, "finish_reason": "stop"}],
+                "usage": {"prompt_tokens": 0, "completion_tokens": len(plan.tokens), "total_tokens": len(plan.tokens)},
+            })
+            return
+
+        self._start_stream('text/event-stream')
+        for token in self.llm.stream_sync(plan):
+            event = {"id": "chatcmpl-mock", "object": "chat.completion.chunk", "created": created, "model": model,
+                     "choices": [{"index": 0, "delta": {"content": token}, "finish_reason": None}]}
+            self._write_chunk(f"data: {json.dumps(event)}\n\n".encode('utf-8'))
+        if plan.error_mode:
+            self.close_connection = True   # Drop the stream without [DONE]
+            return
+        done = {"id": "chatcmpl-mock", "object": "chat.completion.chunk", "created": created, "model": model,
+                "choices": [{"index": 0, "delta": {}, "finish_reason": "stop"}]}
+        self._write_chunk(f"data: {json.dumps(done)}\n\ndata: [DONE]\n\n".encode('utf-8'))
+        self._write_chunk(b"")
+
+    def _ollama(self, body, messages, chat: bool):
+        plan = self.llm.plan(messages)
+        model = body.get('model', 'mock')
+        if plan.fail_at == 0:
+            self._send_json(500, {"error": "injected request failure"})
+            return
+
+        def message(token: str, done: bool):
+            entry = {"model": model, "created_at": time.strftime('%Y-%m-%dT%H:%M:%SZ', time.gmtime()), "done": done}
+            if chat:
+                entry["message"] = {"role": "assistant", "content": token}
+            else:
+                entry["response"] = token
+            return entry
+
+        if body.get('stream', True) is False:
+            text = ''.join(self.llm.stream_sync(plan))
+            if plan.error_mode:
+                self._send_json(500, {"error": "injected midstream failure"})
+            else:
+                self._send_json(200, message(text, True))
+            return
+
+        self._start_stream('application/x-ndjson')
+        for token in self.llm.stream_sync(plan):
+            self._write_chunk((json.dumps(message(token, False)) + "\n").encode('utf-8'))
+        if plan.error_mode:
+            self.close_connection = True
+            return
+        self._write_chunk((json.dumps(message("", True)) + "\n").encode('utf-8'))
+        self._write_chunk(b"")
+
+
+def serve(host: str, port: int, llm: Optional[MockLLM] = None) -> ThreadingHTTPServer:
+    handler = type('BoundMockHTTPHandler', (MockHTTPHandler,), {'llm': llm or MockLLM()})
+    server = ThreadingHTTPServer((host, port), handler)
+    server.daemon_threads = True
+    return server
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Local OpenAI/Ollama-compatible mock LLM server")
+    parser.add_argument('--host', default='127.0.0.1')
+    parser.add_argument('--port', type=int, default=8089)
+    parser.add_argument('--script', help='JSON response script (overrides MOCK_LLM_SCRIPT)')
+    args = parser.parse_args()
+
+    server = serve(args.host, args.port, MockLLM(script_path=args.script))
+    print(f"🧪 Mock LLM listening on http://{args.host}:{server.server_address[1]} "
+          f"(OpenAI: /v1/chat/completions, Ollama: /api/chat)", file=sys.stderr)
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+    finally:
+        server.server_close()
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
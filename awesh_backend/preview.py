@@ -0,0 +1,267 @@
+"""
+Preview-then-commit for commands the AI proposes.
+
+A command that may change files is not run on the real system straight away.
+The sandbox first runs it in a copy-on-write overlay of the project tree (the
+git work tree around the directory, else the directory itself). The overlay
+runs in its own mount, pid and network namespaces, and the rest of the
+filesystem is read-only. The reply shows the command's exit code, its output
+and the files it would change. The frontend then asks once for the whole
+reply. On "y" the sandbox moves the overlay's files onto the real tree, so
+nothing runs a second time. Anything else throws the overlay away.
+
+An overlay of the tree cannot hold every effect. Some commands talk to a
+cluster, a cloud API, a daemon or another host. Others write outside the
+tree or need the network. These are flagged, and on confirmation they run
+for real instead.
+
+The reply's commands are queued in ~/.awesh_preview/pending.<frontend pid>,
+which the frontend reads after showing the reply; the backend is the
+frontend's child, so each shell session has its own queue. Each line has the form
+"<preview dir or ->\t<reason to run for real or ->\t<cwd>\t<command>".
+Consecutive previews of one tree build on each other, so a later command
+sees the files an earlier one would have written.
+AI_PREVIEW=0 runs the AI's commands directly, as before.
+"""
+
+import os
+import re
+import shlex
+from dataclasses import dataclass, field
+from pathlib import Path
+from typing import List, Optional
+
+from . import metrics
+
+MAX_LISTED_CHANGES = 20
+
+# Commands that only read, and the subcommands that only read for tools that also write
+READ_ONLY_COMMANDS = frozenset((
+    "ls", "cat", "head", "tail", "less", "more", "grep", "egrep", "fgrep", "rg", "ag", "find", "locate",
+    "which", "whereis", "type", "file", "stat", "wc", "du", "df", "free", "uptime", "uname", "hostname",
+    "whoami", "id", "groups", "date", "printenv", "echo", "printf", "pwd", "ps", "top", "pgrep",
+    "lsof", "ss", "netstat", "lsblk", "tree", "diff", "cmp", "md5sum", "sha1sum", "sha256sum", "sort",
+    "uniq", "cut", "tr", "jq", "yq", "column", "nl", "od", "xxd", "hexdump", "strings", "realpath",
+    "readlink", "basename", "dirname", "man", "journalctl", "dmesg", "nproc", "lscpu", "getent", "dig",
+    "nslookup", "host", "test", "true", "false", "seq", "sleep", "cd",
+))
+READ_ONLY_SUBCOMMANDS = {
+    "git": {"status", "log", "diff", "show", "blame", "grep", "ls-files", "rev-parse", "describe", "shortlog"},
+    "kubectl": {"get", "describe", "logs", "top", "explain", "api-resources", "api-versions", "version",
+                "cluster-info"},
+    "docker": {"ps", "images", "inspect", "logs", "version", "info", "stats", "top", "port"},
+    "helm": {"list", "ls", "status", "get", "history", "show", "search", "version"},
+    "systemctl": {"status", "is-active", "is-enabled", "is-failed", "list-units", "list-unit-files", "show", "cat"},
+    "apt": {"list", "show", "search", "policy"},
+    "pip": {"list", "show", "freeze"},
+    "npm": {"ls", "list", "view", "outdated"},
+}
+WRITING_OPTIONS = {
+    "sort": ("-o", "--output", "--compress-program"),
+    "find": ("-delete", "-exec", "-execdir", "-ok", "-okdir", "-fprint", "-fprint0", "-fprintf", "-fls"),
+    "xxd": ("-r", "-revert"),
+    "tree": ("-o",),
+    "git": ("--output", "-O", "--open-files-in-pager"),
+    "less": ("-o", "-O", "--log-file", "--LOG-FILE"),
+    "date": ("-s", "--set"),
+    "dmesg": ("-c", "-C", "--clear", "--read-clear"),
+    "journalctl": ("--vacuum", "--rotate", "--flush", "--sync", "--relinquish-var", "--setup-keys",
+                   "--update-catalog"),
+    "ss": ("-K", "--kill"),
+    "file": ("-C", "--compile"),
+    "yq": ("-i", "--inplace"),
+}
+# Read-only only up to this many operands: the next one is an output file (or a new hostname)
+MAX_READ_ONLY_OPERANDS = {"uniq": 1, "xxd": 1, "hostname": 0}
+
+# Commands that run the argv after their own options, which is classified in their place.
+# name: (options without a value, options taking the next word, operands before the argv)
+WRAPPER_COMMANDS = {
+    "env": ({"-i", "-", "--ignore-environment", "-0", "--null"}, {"-u", "--unset"}, 0),
+    "nice": (set(), {"-n", "--adjustment"}, 0),
+    "time": ({"-p"}, set(), 0),
+    "timeout": ({"--preserve-status", "--foreground", "-v", "--verbose"}, {"-s", "--signal", "-k", "--kill-after"}, 1),
+}
+
+# Reached outside any overlay of the tree, so they are not run in one
+EXTERNAL_COMMANDS = {
+    "kubectl": "talks to a Kubernetes cluster", "helm": "talks to a Kubernetes cluster",
+    "oc": "talks to a Kubernetes cluster", "docker": "talks to the Docker daemon",
+    "docker-compose": "talks to the Docker daemon", "podman": "talks to the container engine",
+    "aws": "calls a cloud API", "gcloud": "calls a cloud API", "gsutil": "calls a cloud API", "az": "calls a cloud API",
+    "terraform": "changes cloud infrastructure", "pulumi": "changes cloud infrastructure",
+    "systemctl": "manages system services", "service": "manages system services",
+    "kill": "signals other processes", "pkill": "signals other processes", "killall": "signals other processes",
+    "ssh": "runs on another host", "scp": "copies to or from another host", "sftp": "copies to or from another host",
+    "crontab": "changes scheduled jobs", "at": "schedules a job",
+    "shutdown": "affects the whole machine", "reboot": "affects the whole machine",
+    "poweroff": "affects the whole machine", "halt": "affects the whole machine",
+    "sudo": "needs root", "su": "needs root", "doas": "needs root",
+    "mail": "sends mail", "mailx": "sends mail", "sendmail": "sends mail",
+}
+PUBLISHING_SUBCOMMANDS = {
+    "git": {"push": "pushes to a remote", "send-email": "sends mail"},
+    "npm": {"publish": "publishes a package"}, "yarn": {"publish": "publishes a package"},
+    "pnpm": {"publish": "publishes a package"}, "cargo": {"publish": "publishes a package"},
+    "twine": {"upload": "publishes a package"}, "gh": {"pr": "calls the GitHub API", "release": "calls the GitHub API"},
+}
+_SENDS_DATA = re.compile(r"(?:^|\s)(?:-X\s*(?!GET\b)\w+|--request\s+(?!GET\b)\w+|-d|--data\S*|-F|--form|-T|"
+                         r"--upload-file|--post-data|--post-file|--method)(?:[\s=]|$)")
+_HARMLESS_REDIRECTIONS = re.compile(r"\d?>&\d|&?\d?>\s*/dev/null")
+_SEGMENT_SEPARATORS = re.compile(r"\|\||&&|[|;&\n]")
+_WROTE_OUTSIDE = re.compile(r"Read-only file system")
+_NEEDED_NETWORK = re.compile(r"Could not resolve host|Temporary failure in name resolution|Name or service not known|"
+                             r"Network is unreachable|no such host|Failed to establish a new connection")
+
+
+@dataclass
+class Preview:
+    directory: Optional[str]            # Overlay holding the command's changes, None if it did not run in one
+    reason: Optional[str]               # Why it has to run for real instead, None to apply the overlay
+    changes: List[str] = field(default_factory=list)
+
+
+def enabled() -> bool:
+    return os.getenv("AI_PREVIEW", "1") != "0"
+
+
+def pending_path() -> Path:
+    return Path.home() / ".awesh_preview" / f"pending.{os.getppid()}"
+
+
+def _segments(command: str):
+    """argv of each simple command in a pipeline or list, leading VAR=value dropped"""
+    for segment in _SEGMENT_SEPARATORS.split(command):
+        try:
+            words = shlex.split(segment)
+        except ValueError:
+            words = segment.split()
+        while words and re.match(r"^[A-Za-z_][A-Za-z0-9_]*=", words[0]):
+            words.pop(0)
+        if words:
+            yield [os.path.basename(words[0])] + words[1:]
+
+
+def _unwrap(words: List[str]) -> Optional[List[str]]:
+    """argv a wrapper command runs ([] for none), None if it has an option we do not know"""
+    while words and words[0] in WRAPPER_COMMANDS:
+        plain, valued, operands = WRAPPER_COMMANDS[words[0]]
+        rest = words[1:]
+        while rest and rest[0].startswith("-"):
+            option = rest.pop(0)
+            name = option.split("=", 1)[0]
+            if option == "--":
+                break
+            if name in valued and "=" not in option:
+                if not rest:
+                    return None
+                rest.pop(0)
+            elif name not in plain and name not in valued:
+                return None
+        if words[0] == "env":
+            while rest and re.match(r"^[A-Za-z_][A-Za-z0-9_]*=", rest[0]):
+                rest.pop(0)
+        rest = rest[operands:]
+        words = [os.path.basename(rest[0])] + rest[1:] if rest else []
+    return words
+
+
+def _subcommand(words: List[str]) -> str:
+    return next((word for word in words[1:] if not word.startswith("-")), "")
+
+
+def is_read_only(command: str) -> bool:
+    """True only for commands known not to change anything; everything else is previewed"""
+    if "`" in command or "$(" in command or ">" in _HARMLESS_REDIRECTIONS.sub("", command):
+        return False
+    for words in _segments(command):
+        words = _unwrap(words)
+        if words is None:
+            return False
+        if not words:
+            continue
+        name = words[0]
+        if name in READ_ONLY_SUBCOMMANDS:
+            if _subcommand(words) not in READ_ONLY_SUBCOMMANDS[name]:
+                return False
+        elif name not in READ_ONLY_COMMANDS:
+            return False
+        if any(word.startswith(option) for word in words[1:] for option in WRITING_OPTIONS.get(name, ())):
+            return False
+        operands = [word for word in words[1:] if not word.startswith("-")]
+        if len(operands) > MAX_READ_ONLY_OPERANDS.get(name, len(operands)):
+            return False
+    return True
+
+
+def external_reason(command: str) -> Optional[str]:
+    """Why a command reaches past the overlay, or None if previewing it shows its whole effect"""
+    for words in _segments(command):
+        words = _unwrap(words) or words
+        name = words[0]
+        if name in EXTERNAL_COMMANDS:
+            return EXTERNAL_COMMANDS[name]
+        reason = PUBLISHING_SUBCOMMANDS.get(name, {}).get(_subcommand(words))
+        if reason:
+            return reason
+        if name in ("curl", "wget") and _SENDS_DATA.search(" ".join(words[1:])):
+            return "sends data to a server"
+        if name == "rsync" and any(":" in word for word in words[1:] if not word.startswith("-")):
+            return "copies to or from another host"
+    return None
+
+
+def outcome_reason(output: str) -> Optional[str]:
+    """Why a previewed run does not show the command's real effect, judged from its output"""
+    if _WROTE_OUTSIDE.search(output):
+        return "writes outside the project tree"
+    if _NEEDED_NETWORK.search(output):
+        return "needs the network"
+    return None
+
+
+def chain_base() -> Optional[str]:
+    """The reply's latest plain preview, for the next one to build on"""
+    try:
+        lines = pending_path().read_text().splitlines()
+    except OSError:
+        return None
+    if not lines:
+        return None
+    directory, reason = (lines[-1].split("\t") + ["", ""])[:2]
+    return directory if directory != "-" and reason == "-" else None
+
+
+def record(directory: Optional[str], reason: Optional[str], cwd: str, command: str) -> Preview:
+    """Queue a command for the frontend's confirmation"""
+    path = pending_path()
+    path.parent.mkdir(mode=0o700, exist_ok=True)
+    with open(path, "a") as file:
+        file.write(f"{directory or '-'}\t{reason or '-'}\t{cwd}\t{command}\n")
+    changes = []
+    if directory:
+        try:
+            changes = (Path(directory) / "changes").read_text().splitlines()
+        except OSError:
+            pass
+    metrics.counter("awesh_backend_previews_total", "AI commands held for confirmation",
+                    outcome="overlay" if directory and not reason else "run-for-real").inc()
+    return Preview(directory, reason, changes)
+
+
+def describe(command: str, exit_code: int, output: str, preview: Preview) -> List[str]:
+    """Lines shown in the reply for a previewed command"""
+    if not preview.directory:
+        return [f"⏸ {command}", f"   Not run yet, because it {preview.reason}. It runs for real if you apply."]
+    lines = [f"🔍 {command}   (preview, exit {exit_code})"]
+    if output.strip():
+        lines.append("   " + output.rstrip().replace("\n", "\n   "))
+    if preview.changes:
+        lines.extend(f"   {change}" for change in preview.changes[:MAX_LISTED_CHANGES])
+        if len(preview.changes) > MAX_LISTED_CHANGES:
+            lines.append(f"   ... and {len(preview.changes) - MAX_LISTED_CHANGES} more")
+    else:
+        lines.append("   No files changed")
+    if preview.reason:
+        lines.append(f"   ⚠️ The preview cannot show all of it: it {preview.reason}. It runs for real if you apply.")
+    return lines
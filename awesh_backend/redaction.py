@@ -0,0 +1,132 @@
+"""
+Secret redaction for everything the backend sends to an AI provider.
+
+Prompts carry captured command output, file contents and BASH_FAILED output
+files, any of which may hold AWS keys, API tokens, private keys, kubeconfig
+credentials or passwords. redact() replaces each with "[REDACTED:<kind>]"
+before the request leaves the process.
+
+The scan is native: libawesh_redact.so (awesh_redact.c, built by `make`)
+makes one vectorised pass over the UTF-8 bytes and only looks closely at
+the few bytes that can anchor a secret. Without the library the same rules
+run as Python regular expressions, correct but far slower.
+REDACT=0 disables redaction.
+
+Benchmark: python3 tests/bench_redact.py
+"""
+
+import ctypes
+import math
+import os
+import re
+import sys
+from pathlib import Path
+
+from . import metrics
+
+LIBRARY_NAME = "libawesh_redact.so"
+KINDS = ("aws-key", "github-token", "slack-token", "api-key", "private-key", "jwt", "url-password", "secret")
+
+
+class _Match(ctypes.Structure):
+    _fields_ = [("offset", ctypes.c_size_t), ("length", ctypes.c_size_t), ("kind", ctypes.c_int)]
+
+
+def _load_library():
+    candidates = [os.getenv("AWESH_REDACT_LIB"), Path(__file__).parent / LIBRARY_NAME,
+                  Path(__file__).parent.parent / LIBRARY_NAME]
+    for path in candidates:
+        if not path or not Path(path).exists():
+            continue
+        try:
+            lib = ctypes.CDLL(str(path))
+        except OSError:
+            continue
+        lib.redact_scan.argtypes = [ctypes.c_char_p, ctypes.c_size_t, ctypes.POINTER(_Match), ctypes.c_size_t]
+        lib.redact_scan.restype = ctypes.c_size_t
+        return lib
+    if os.getenv("VERBOSE", "0") == "1":
+        print(f"🔧 Redaction: {LIBRARY_NAME} not built, using the Python scanner", file=sys.stderr)
+    return None
+
+
+_lib = _load_library()
+
+
+def enabled() -> bool:
+    return os.getenv("REDACT", "1") != "0"
+
+
+def native() -> bool:
+    return _lib is not None
+
+
+def scan_native(data: bytes):
+    """(offset, length, kind) byte ranges found by the native scanner"""
+    capacity = 64 + len(data) // 4096       # Retried once, with the exact count, if too small
+    while True:
+        matches = (_Match * capacity)()
+        count = _lib.redact_scan(data, len(data), matches, capacity)
+        if count <= capacity:
+            return [(m.offset, m.length, KINDS[m.kind]) for m in matches[:count]]
+        capacity = count
+
+
+# Fallback: the rules of awesh_redact.c as regular expressions
+
+_SECRET_KEY = re.compile(r"(?i)(?:pass|pwd|secret|token|key|credential|authorization|certificate-data)")
+_PATTERNS = re.compile(
+    rb"(?P<aws>(?<![A-Za-z0-9])(?:AKIA|ASIA|AGPA|AIDA|AROA|ANPA|ANVA|AIPA)[A-Z0-9]{16}(?![A-Za-z0-9]))"
+    rb"|(?P<github>(?<![A-Za-z0-9_])(?:gh[pousr]_|github_pat_)[A-Za-z0-9_]{20,})"
+    rb"|(?P<slack>(?<![A-Za-z0-9])xox[abprs]-[A-Za-z0-9_-]{10,})"
+    rb"|(?P<api>(?<![A-Za-z0-9])(?:sk-[A-Za-z0-9_-]{20,}|[sr]k_(?:live|test)_[A-Za-z0-9]{16,}))"
+    rb"|(?P<pem>-----BEGIN [^\n]{0,48}?PRIVATE KEY[^\n]{0,48}?-----.*?(?:-----END [^\n]*?-----|\Z))"
+    rb"|(?P<jwt>(?<![A-Za-z0-9_-])eyJ[A-Za-z0-9_-]{8,}\.[A-Za-z0-9_-]{10,}\.[A-Za-z0-9_-]{10,})"
+    rb"|://[^\s/@:]*:(?P<url>[^\s:/@]+)@"
+    rb"|(?P<key>[A-Za-z0-9_.-]{3,48})[\"' ]{0,3}[=:][ \t]*[\"']?(?:(?:[Bb]earer|[Bb]asic|[Tt]oken) )?"
+    rb"(?!/)(?P<value>(?<=[\"'])[^\"'\n]+|[^\s\"'`,;&})\]<>]+)",
+    re.DOTALL)
+_GROUP_KINDS = {"aws": "aws-key", "github": "github-token", "slack": "slack-token", "api": "api-key",
+                "pem": "private-key", "jwt": "jwt", "url": "url-password", "value": "secret"}
+
+
+def _entropy(value: bytes) -> float:
+    value = value[:64]
+    return -sum(n / len(value) * math.log2(n / len(value)) for n in (value.count(c) for c in set(value)))
+
+
+def scan_python(data: bytes):
+    found = []
+    for match in _PATTERNS.finditer(data):
+        group = match.lastgroup
+        if group == "value":
+            key = match.group("key").decode("ascii", "replace")
+            value = match.group("value")
+            if (not _SECRET_KEY.search(key) or "public" in key.lower() or value[:1] in b"$*{%[(" or
+                    len(value) < 8 or _entropy(value) < 2.5):
+                # Not a secret by its name, but the value may still be a token (SLACK=xoxb-...)
+                start = match.start(group)
+                found.extend((start + offset, length, kind) for offset, length, kind in scan_python(value))
+                continue
+        found.append((match.start(group), match.end(group) - match.start(group), _GROUP_KINDS[group]))
+    return found
+
+
+def redact(text: str) -> str:
+    """text with every secret replaced by [REDACTED:<kind>]"""
+    if not text or not enabled():
+        return text
+    data = text.encode("utf-8", errors="surrogatepass")
+    found = scan_native(data) if _lib else scan_python(data)
+    if not found:
+        return text
+
+    parts = []
+    position = 0
+    for offset, length, kind in found:
+        parts.append(data[position:offset])
+        parts.append(f"[REDACTED:{kind}]".encode())
+        position = offset + length
+        metrics.counter("awesh_backend_redactions_total", "Secrets redacted from provider requests", kind=kind).inc()
+    parts.append(data[position:])
+    return b"".join(parts).decode("utf-8", errors="surrogatepass")
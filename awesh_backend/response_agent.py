@@ -40,14 +40,22 @@ Features:
 - Detects code blocks that should be written to files
 - Delegates processing to specialized agents
 - Routes all commands through Shell Agent (C-based) for fast execution
+- Pipelines execution: complete awesh: lines and closed edit fences are
+  dispatched while the model is still generating (ResponsePipeline)
 """
 
 import os
 import sys
 import re
+import asyncio
+import time
 from typing import Optional, List, Dict
 from pathlib import Path
 
+from . import tracing
+from . import metrics
+from . import preview
+
 def debug_log(message):
     """Log debug message if verbose mode is enabled"""
     verbose = os.getenv('VERBOSE', '0') == '1'
@@ -68,6 +76,11 @@ class ResponseAgent:
         """
         self.file_editor = file_editor
         self.execution_agent = execution_agent
+        self.streaming_enabled = os.getenv('STREAMING_EXECUTION', '1') != '0'
+    
+    def create_pipeline(self) -> 'ResponsePipeline':
+        """Start an incremental parser for a response that is still streaming"""
+        return ResponsePipeline(self)
     
     async def process_response(self, ai_response: str) -> tuple[str, bool]:
         """
@@ -186,8 +199,10 @@ class ResponseAgent:
         
         # Apply edits
         results = self.file_editor.apply_multiple_edits(edits)
-        
-        # Format response
+        return self._format_edit_results(results, ai_response)
+    
+    def _format_edit_results(self, results, ai_response: str) -> str:
+        """Format file editor results, with any preamble from the AI response"""
         output = "📝 File Edit Results:\n\n"
         success_count = 0
         created_files = []
@@ -238,14 +253,10 @@ class ResponseAgent:
             if in_code_block or stripped.startswith('#'):
                 continue
             
-            match = re.match(r'^\s*awesh:\s*(.+)$', line)
-            if match:
-                cmd = match.group(1).strip()
-                if cmd and not cmd.startswith('#') and len(cmd) > 0:
-                    words = cmd.split()
-                    if len(words) >= 2 or any(char in cmd for char in ['/', '|', '&', ';', '(', ')', '{', '}', '$', '`']):
-                        awesh_commands.append(cmd)
-                        debug_log(f"Found awesh: command: '{cmd}'")
+            cmd = self.parse_awesh_line(line)
+            if cmd:
+                awesh_commands.append(cmd)
+                debug_log(f"Found awesh: command: '{cmd}'")
         
         if not awesh_commands:
             debug_log("No valid awesh: commands found")
@@ -261,10 +272,29 @@ class ResponseAgent:
             result = await self.execution_agent.execute_command(command)
             results.append((command, result))
         
-        # Format results
+        return self._format_command_results(results)
+    
+    def parse_awesh_line(self, line: str) -> Optional[str]:
+        """Return the command on an `awesh:` line if it passes validation, else None"""
+        match = re.match(r'^\s*awesh:\s*(.+)$', line)
+        if not match:
+            return None
+        cmd = match.group(1).strip()
+        if not cmd or cmd.startswith('#'):
+            return None
+        words = cmd.split()
+        if len(words) >= 2 or any(char in cmd for char in ['/', '|', '&', ';', '(', ')', '{', '}', '$', '`']):
+            return cmd
+        return None
+    
+    def _format_command_results(self, results) -> str:
+        """Format (command, ExecutionResult) pairs for display"""
         output_lines = []
         for command, result in results:
-            if result.success:
+            if result.preview:
+                output_lines.extend(preview.describe(command, result.exit_code, result.stdout + result.stderr,
+                                                     result.preview))
+            elif result.success:
                 output = result.stdout if result.stdout else "Command executed successfully"
                 output_lines.append(f"✅ {command}")
                 if output and output.strip():
@@ -383,6 +413,143 @@ class ResponseAgent:
         return None
 
 
+class ResponsePipeline:
+    """
+    Incremental parser for a response that is still streaming
+    
+    Complete `awesh:` lines and closed ```edit: fences are validated and
+    queued to a worker as soon as they arrive, so the first command runs
+    while the model is still generating the rest. Items run one at a time,
+    in the order they appear. Ollama "Thinking..." preambles are skipped.
+    
+    Edits keep their priority over commands, as in process_response: once
+    an edit block shows up, commands that have not started are dropped and
+    later ones are ignored. Commands that ran before it are still reported.
+    """
+    
+    def __init__(self, agent: ResponseAgent):
+        self.agent = agent
+        self.pending = ""              # Partial line awaiting its newline
+        self.in_code_block = False
+        self.fence_lines = None        # Lines of the ```edit: fence being collected
+        self.in_thinking = None        # None until the first non-blank line decides
+        self.queue = asyncio.Queue()
+        self.worker = None
+        self.command_results = []
+        self.edit_results = []
+        self.applied_fences = []
+        self.saw_edits = False
+        self.dispatched = 0
+    
+    def feed(self, chunk: str):
+        """Consume a streamed chunk; dispatches anything it completes"""
+        self.pending += chunk
+        while '\n' in self.pending:
+            line, self.pending = self.pending.split('\n', 1)
+            self._feed_line(line)
+    
+    def _feed_line(self, line: str):
+        stripped = line.strip()
+        if self.in_thinking is None and stripped:
+            self.in_thinking = stripped.lower().startswith('thinking')
+        if self.in_thinking:
+            if 'done thinking' in stripped.lower():
+                self.in_thinking = False
+            return
+        
+        if self.fence_lines is not None:
+            self.fence_lines.append(line)
+            if stripped == '```':
+                block = '\n'.join(self.fence_lines)
+                self.fence_lines = None
+                self.in_code_block = False
+                self._dispatch('edit', block)
+            return
+        
+        if stripped.startswith('```'):
+            if not self.in_code_block and stripped.startswith('```edit:'):
+                self.fence_lines = [line]
+                self.saw_edits = True
+            self.in_code_block = not self.in_code_block
+            return
+        if self.in_code_block or stripped.startswith('#'):
+            return
+        if stripped.startswith('EDIT:'):
+            self.saw_edits = True   # Simplified block, applied from the full text in finish()
+            return
+        
+        command = self.agent.parse_awesh_line(line)
+        if command and not self.saw_edits:
+            self._dispatch('command', command)
+    
+    def _dispatch(self, kind: str, payload: str):
+        debug_log(f"Streaming dispatch ({kind}) before generation finished: '{payload[:50]}'")
+        self.dispatched += 1
+        if self.worker is None:
+            self.worker = asyncio.ensure_future(self._run())
+        self.queue.put_nowait((kind, payload))
+        self._queue_depth().set(self.queue.qsize())
+    
+    @staticmethod
+    def _queue_depth():
+        return metrics.gauge("awesh_backend_dispatch_queue_depth",
+                             "Commands and edits parsed from a streaming reply, waiting to run")
+
+    async def _run(self):
+        while True:
+            item = await self.queue.get()
+            self._queue_depth().set(self.queue.qsize())
+            if item is None:
+                return
+            kind, payload = item
+            if kind == 'command' and self.saw_edits:
+                debug_log(f"Edits take priority, dropping queued command: '{payload[:50]}'")
+                continue
+            dispatch_start = time.monotonic_ns()
+            try:
+                if kind == 'command':
+                    result = await self.agent.execution_agent.execute_command(payload)
+                    self.command_results.append((payload, result))
+                else:
+                    edits = self.agent.file_editor.parse_edit_block(payload)
+                    self.edit_results.extend(self.agent.file_editor.apply_multiple_edits(edits))
+                    self.applied_fences.append(payload)
+            except Exception as e:
+                debug_log(f"Streaming dispatch failed for '{payload[:50]}': {e}")
+            tracing.record("response_agent.dispatch", dispatch_start, time.monotonic_ns(), kind)
+    
+    async def finish(self, full_response: str) -> tuple[str, bool]:
+        """Wait for dispatched work and format the combined results"""
+        if self.pending:
+            self._feed_line(self.pending)
+            self.pending = ""
+        if self.worker is None:
+            return await self.agent.process_response(full_response)
+        
+        self.queue.put_nowait(None)
+        await self.worker
+        
+        # Simplified EDIT: blocks are not fenced, so they only show up in the full text
+        remaining = full_response
+        for fence in self.applied_fences:
+            remaining = remaining.replace(fence, '')
+        late_edits = self.agent.file_editor.parse_edit_block(remaining)
+        if late_edits:
+            self.edit_results.extend(self.agent.file_editor.apply_multiple_edits(late_edits))
+        
+        sections = []
+        if self.edit_results:
+            sections.append(self.agent._format_edit_results(self.edit_results, self.agent._clean_thinking(full_response)))
+        if self.command_results:
+            sections.append(self.agent._format_command_results(self.command_results))
+        return "\n".join(sections), True
+    
+    def cancel(self):
+        """Abandon queued work (e.g. the generation timed out)"""
+        if self.worker is not None and not self.worker.done():
+            self.worker.cancel()
+
+
 def get_response_agent(file_editor, execution_agent):
     """Get or create response agent instance"""
     return ResponseAgent(file_editor, execution_agent)
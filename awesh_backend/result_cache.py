@@ -0,0 +1,206 @@
+"""
+TTL result cache for slow read-only commands, shared with the frontend.
+
+kubectl get, docker ps, gcloud ... list and the like take seconds and are
+run again and again, by users and by the AI's own iterations. With
+RESULT_CACHE=1 their output is kept in ~/.awesh_cache/, keyed by command,
+working directory and the environment that selects what they talk to
+(KUBECONFIG, AWS_PROFILE, ...). Within a rule's TTL the stored output is
+returned as is; within its stale window after that it is returned and the
+command is rerun in the background. Any other command of a cached tool
+(kubectl apply) drops that tool's entries, and only successful runs are kept.
+
+The entry format, key hash and rules are those of the "Result cache" section
+of awesh.c, so entries written by either side are served by the other.
+"""
+
+import fnmatch
+import os
+import re
+import time
+from pathlib import Path
+from typing import Optional, Tuple
+
+MAGIC = "AWCACHE1"
+MAX_OUTPUT = 1024 * 1024            # Larger outputs are not stored
+MAX_AGE_S = 3600                    # Entries are pruned after this, whatever their rule
+LOCK_STALE_S = 120                  # A refresh lock older than this is abandoned
+
+# Same list as default_cache_rules in awesh.c
+DEFAULT_RULES = (
+    "10 60 kubectl get *",
+    "10 60 kubectl describe *",
+    "5 30 kubectl top *",
+    "300 3600 kubectl api-resources*",
+    "3 30 docker ps*",
+    "30 300 docker images*",
+    "15 120 helm list*",
+    "15 120 helm ls*",
+    "60 600 gcloud * list*",
+    "60 600 aws * describe-*",
+    "60 600 aws * list-*",
+)
+KEY_ENV = ("KUBECONFIG", "AWS_PROFILE", "AWS_REGION", "AWS_DEFAULT_REGION", "CLOUDSDK_CORE_PROJECT",
+           "CLOUDSDK_ACTIVE_CONFIG_NAME", "DOCKER_HOST", "DOCKER_CONTEXT", "HELM_NAMESPACE")
+_NEVER_FINISHES = re.compile(r"(?:^|\s)(?:-w|--watch\S*|--follow)(?:\s|$)")
+
+_rules = []
+_rules_mtime = -1
+
+
+def enabled() -> bool:
+    return os.getenv("RESULT_CACHE", "0") == "1"
+
+
+def cache_dir() -> Path:
+    return Path.home() / ".awesh_cache"
+
+
+def _parse_rule(line: str):
+    parts = line.split(None, 2)
+    if len(parts) < 3 or not parts[0].isdigit() or not parts[1].isdigit():
+        return None
+    return int(parts[0]), int(parts[1]), parts[2].rstrip()
+
+
+def _load_rules():
+    global _rules, _rules_mtime
+    path = Path.home() / ".awesh_cache_rules"
+    try:
+        mtime = int(path.stat().st_mtime)
+    except OSError:
+        mtime = 0
+    if mtime == _rules_mtime:
+        return
+    lines = [line for line in path.read_text().splitlines() if not line.startswith("#")] if mtime else []
+    _rules = [rule for rule in map(_parse_rule, [*lines, *DEFAULT_RULES]) if rule]
+    _rules_mtime = mtime
+
+
+def rule_for(command: str) -> Optional[Tuple[int, int]]:
+    """(ttl, stale) seconds of the first rule matching command, None if it is not cached"""
+    _load_rules()
+    if re.search(r"[<>;&`]|\$\(", command) or _NEVER_FINISHES.search(command):
+        return None
+    for ttl, stale, pattern in _rules:
+        if fnmatch.fnmatchcase(command, pattern):
+            return (ttl, stale) if ttl > 0 else None
+    return None
+
+
+def _tool(command: str) -> str:
+    return command.split(None, 1)[0] if command.strip() else ""
+
+
+def _fnv(value: int, text: str) -> int:
+    for byte in text.encode() + b"\0":
+        value = ((value ^ byte) * 1099511628211) & 0xFFFFFFFFFFFFFFFF
+    return value
+
+
+def key(command: str, cwd: str) -> str:
+    value = _fnv(_fnv(14695981039346656037, command), cwd)
+    names = list(KEY_ENV) + re.split(r"[ ,]+", os.getenv("RESULT_CACHE_ENV", "").strip())
+    for name in filter(None, names):
+        if name in os.environ:
+            value = _fnv(value, f"{name}={os.environ[name]}")
+    return f"{value:016x}"
+
+
+def _read(path: Path):
+    """(stored_ms, duration_ms, tool, command, cwd, output bytes) or None"""
+    try:
+        data = path.read_bytes()
+        header, command, cwd, output = data.split(b"\n", 3)
+        magic, stored_ms, duration_ms, tool = header.decode().split(" ", 3)
+    except (OSError, ValueError, UnicodeDecodeError):
+        return None
+    if magic != MAGIC:
+        return None
+    return int(stored_ms), int(duration_ms), tool, command.decode(errors="replace"), cwd.decode(errors="replace"), output
+
+
+def lookup(command: str, cwd: str):
+    """(output, age in seconds, stale) of a servable entry, or None"""
+    rule = rule_for(command)
+    if not rule:
+        return None
+    entry = _read(cache_dir() / key(command, cwd))
+    if not entry or entry[3] != command or entry[4] != cwd:
+        return None
+    age = time.time() - entry[0] / 1000
+    ttl, stale = rule
+    if not 0 <= age < ttl + stale:
+        return None
+    return entry[5].decode("utf-8", errors="replace"), age, age >= ttl
+
+
+def _prune(directory: Path):
+    now = time.time()
+    for path in directory.iterdir():
+        limit = MAX_AGE_S if len(path.name) == 16 else LOCK_STALE_S
+        try:
+            if now - path.stat().st_mtime > limit:
+                path.unlink()
+        except OSError:
+            pass
+
+
+def store(command: str, cwd: str, output: str, duration_ms: int):
+    data = output.encode("utf-8", errors="surrogateescape")
+    if len(data) > MAX_OUTPUT:
+        return
+    directory = cache_dir()
+    directory.mkdir(mode=0o700, exist_ok=True)
+    _prune(directory)
+    path = directory / key(command, cwd)
+    temp = path.with_name(f"{path.name}.{os.getpid()}.tmp")
+    header = f"{MAGIC} {int(time.time() * 1000)} {duration_ms} {_tool(command)}\n{command}\n{cwd}\n"
+    try:
+        with open(os.open(temp, os.O_WRONLY | os.O_CREAT | os.O_TRUNC, 0o600), "wb") as file:  # Output may hold secrets
+            file.write(header.encode() + data)
+        temp.replace(path)              # Readers never see half an entry
+    except OSError:
+        temp.unlink(missing_ok=True)
+
+
+def invalidate(tool: Optional[str] = None) -> int:
+    """Drop every entry of a tool (all of them for None); how many went"""
+    removed = 0
+    directory = cache_dir()
+    if not directory.is_dir():
+        return 0
+    for path in directory.iterdir():
+        if len(path.name) != 16:
+            continue
+        entry = _read(path) if tool else None
+        if tool is None or (entry and entry[2] == tool):
+            path.unlink(missing_ok=True)
+            removed += 1
+    return removed
+
+
+def record(command: str, cwd: str, exit_code: int, output: str, duration_ms: int):
+    """After running a command: store it if a rule covers it, else invalidate its tool"""
+    if rule_for(command):
+        if exit_code == 0:
+            store(command, cwd, output, duration_ms)
+        return
+    tool = _tool(command)
+    if any(ttl > 0 and pattern.startswith(tool + " ") for ttl, _, pattern in _rules):
+        invalidate(tool)
+
+
+def claim_refresh(command: str, cwd: str) -> Optional[Path]:
+    """Lock for refreshing an entry, None if someone (frontend or backend) already is"""
+    lock = cache_dir() / f"{key(command, cwd)}.lock"
+    try:
+        if time.time() - lock.stat().st_mtime > LOCK_STALE_S:
+            lock.unlink()
+    except OSError:
+        pass
+    try:
+        os.close(os.open(lock, os.O_WRONLY | os.O_CREAT | os.O_EXCL, 0o600))
+    except OSError:
+        return None
+    return lock
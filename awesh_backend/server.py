@@ -17,6 +17,12 @@ from .file_agent import FileAgent
 from .file_editor import FileEditor, get_file_editor
 from .execution_agent import ExecutionAgent, get_execution_agent
 from .todo_agent import TODOAgent, get_todo_agent, TaskStatus
+from .man_index import get_man_index
+from . import tracing
+from . import metrics
+from . import flight_recorder
+from . import startup_profile
+from . import preview
 
 # Global verbose setting
 def debug_log(message):
@@ -28,6 +34,10 @@ def debug_log(message):
 import os
 SOCKET_PATH = os.path.expanduser("~/.awesh.sock")
 
+# Message types counted separately in awesh_backend_requests_total; anything else is a query
+SPECULATION_STARTED_MARKER = "SPECULATION_STARTED\n"
+REQUEST_KINDS = ("STATUS", "VERBOSE", "SPECULATE", "COMMIT", "CANCEL", "AI_PROVIDER", "CWD", "BASH_FAILED", "QUERY", "MODEL")
+
 class AweshSocketBackend:
     """Socket-based backend for C frontend"""
     
@@ -39,6 +49,9 @@ class AweshSocketBackend:
         self.socket = None
         self.current_dir = os.getcwd()  # Track current working directory
         self.last_user_command = ""  # Track last user command for retry
+        self.speculative_task = None  # In-flight SPECULATE: request (cancellable)
+        self.speculative_gate = None  # Set by COMMIT: the speculative reply may run its commands
+        self.metrics_server = None
         # Initialize file agent with config
         file_agent_enabled = os.getenv('FILE_AGENT_ENABLED', '1') == '1'
         file_agent_ai_enhance = True  # Always enabled for built-in agents
@@ -63,6 +76,9 @@ class AweshSocketBackend:
         # Initialize TODO agent
         self.todo_agent = get_todo_agent()
         
+        # Initialize man page index (answers "how do I" questions locally)
+        self.man_index = get_man_index()
+        
         # Initialize response agent (coordinates other agents)
         # Agent hierarchy: Response Agent → File Editor / Execution / File / TODO / Shell (C-based)
         from awesh_backend.response_agent import get_response_agent
@@ -70,6 +86,9 @@ class AweshSocketBackend:
         
     async def initialize(self):
         """Initialize AI components"""
+        # Man page indexer runs as a niced subprocess - never blocks startup
+        self.man_index.start_background_build()
+        
         try:
             verbose = os.getenv('VERBOSE', '0') == '1'
             if verbose:
@@ -77,6 +96,8 @@ class AweshSocketBackend:
             self.ai_client = AweshAIClient(self.config)
             await self.ai_client.initialize()
             self.ai_ready = True
+            flight_recorder.record(flight_recorder.STATE, "ai_ready")
+            startup_profile.mark("ai_ready")
             if verbose:
                 print("✅ Backend: AI client ready!", file=sys.stderr)
             
@@ -87,14 +108,15 @@ class AweshSocketBackend:
             import traceback
             traceback.print_exc(file=sys.stderr)
             self.ai_ready = False
+            flight_recorder.record(flight_recorder.ERROR, "ai_init_failed", detail=str(e))
             # Still mark backend as ready for non-AI commands
             if "OPENAI_API_KEY" in str(e):
                 print("Backend: Running without AI - set OPENAI_API_KEY to enable AI features", file=sys.stderr)
     
     
     
-    async def process_command(self, command: str) -> str:
-        """Process command and return response"""
+    async def process_command(self, command: str, gate: asyncio.Event = None) -> str:
+        """Process command and return response; with a gate, nothing the reply asks for runs before it is set"""
         try:
             debug_log(f"process_command: Starting with command: {command}")
             
@@ -105,6 +127,7 @@ class AweshSocketBackend:
                 new_dir = command[4:]  # Remove 'CWD:' prefix
                 debug_log(f"Syncing working directory to: {new_dir}")
                 self.current_dir = new_dir
+                self.execution_agent.cwd = new_dir
                 # Bash execution handled by C frontend
                 return "OK"  # Send acknowledgment
                 
@@ -138,7 +161,8 @@ class AweshSocketBackend:
                         'stderr': bash_output if exit_code != 0 else ""
                     }
                     
-                    return await self._handle_ai_prompt(original_cmd, bash_result)
+                    with tracing.span("backend.ai_prompt", original_cmd):
+                        return await self._handle_ai_prompt(original_cmd, bash_result)
                 else:
                     debug_log("process_command: Invalid BASH_FAILED format")
                     return "Error: Invalid bash failure context\n"
@@ -156,7 +180,8 @@ class AweshSocketBackend:
             
             # Bash execution handled by C frontend - send everything to AI
             debug_log("process_command: Sending to AI (bash handled by frontend)")
-            return await self._handle_ai_prompt(command)
+            with tracing.span("backend.ai_prompt", command):
+                return await self._handle_ai_prompt(command, gate=gate)
                 
         except Exception as e:
             debug_log(f"process_command: Exception: {e}")
@@ -248,11 +273,23 @@ Respond with:
             debug_log(f"Error in RAG analysis: {e}")
             return "ANALYSIS_ERROR"
 
-    async def _handle_ai_prompt(self, prompt: str, bash_result: dict = None, retry_count: int = 0) -> str:
+    async def _handle_ai_prompt(self, prompt: str, bash_result: dict = None, retry_count: int = 0,
+                                gate: asyncio.Event = None) -> str:
         """Handle AI prompt and return response"""
         # Store last user command for retry mechanism
         if retry_count == 0:
             self.last_user_command = prompt
+        
+        # "How do I" questions: answer from the local man page index, or ground the prompt with it
+        man_context = None
+        if not bash_result and retry_count == 0 and self.man_index.is_howto_question(prompt):
+            local_answer, man_context = self.man_index.answer(prompt)
+            result = "answered" if local_answer else "context" if man_context else "miss"
+            metrics.counter("awesh_man_index_lookups_total",
+                            "How-do-I questions looked up in the local man page index", result=result).inc()
+            if local_answer:
+                debug_log("Answered from local man page index")
+                return local_answer
             
         if not self.ai_ready:
             # AI not ready - if this was a bash failure, show the bash output
@@ -286,7 +323,11 @@ Bash result:
 Help the user based on this result."""
             else:
                 # Simple user prompt - system prompt already has all instructions
-                ai_input = prompt
+                ai_input = f"{man_context}\n{prompt}" if man_context else prompt
+            
+            # Commands and edit fences start executing while the rest is still generating,
+            # unless the request is speculative and the frontend may still run the line as bash
+            pipeline = self.response_agent.create_pipeline() if self.response_agent.streaming_enabled and not gate else None
             
             # Collect response with timeout (compatible with older Python)
             output = "🤖 "
@@ -298,6 +339,8 @@ Help the user based on this result."""
                     async for chunk in self.ai_client.process_prompt(ai_input):
                         result += chunk
                         chunk_count += 1
+                        if pipeline:
+                            pipeline.feed(chunk)
                         debug_log(f"Received chunk {chunk_count}: {chunk[:50]}...")
                     debug_log(f"Total chunks: {chunk_count}, total length: {len(result)}")
                     
@@ -311,6 +354,14 @@ Help the user based on this result."""
                 debug_log(f"Calling collect_response with timeout: {timeout_seconds}s (provider: {ai_provider})")
                 response = await asyncio.wait_for(collect_response(), timeout=timeout_seconds)
                 debug_log(f"Got response: {len(response)} chars")
+                if gate:
+                    await gate.wait()
+                
+                # Pipelined work already started - wait for it and report everything together
+                if pipeline and pipeline.dispatched:
+                    debug_log(f"Pipeline dispatched {pipeline.dispatched} items during generation")
+                    processed_output, _ = await pipeline.finish(response)
+                    return processed_output
                 
                 # Check for file edits first
                 if '```edit:' in response or 'EDIT:' in response:
@@ -362,10 +413,19 @@ Help the user based on this result."""
                     return processed_output + "\n"
             except asyncio.TimeoutError:
                 return f"❌ AI response timeout - request took too long\n"
+            except asyncio.CancelledError:
+                raise  # Not an Exception on Python >= 3.8, but it is on 3.7
             except Exception as stream_error:
                 # If streaming fails, try non-streaming fallback
                 return f"❌ AI streaming error: {stream_error}\n"
+            finally:
+                # finish() drains the worker on success; on any other exit (timeout,
+                # stream error, a CANCEL) queued commands must not run unreported
+                if pipeline:
+                    pipeline.cancel()
                 
+        except asyncio.CancelledError:
+            raise
         except Exception as e:
             return f"❌ AI error: {e}\n"
     
@@ -753,6 +813,9 @@ Help the user based on this result."""
         try:
             result = await self.execution_agent.execute_command(command)
             
+            if result.preview:
+                return "\n".join(preview.describe(command, result.exit_code, result.stdout + result.stderr,
+                                                  result.preview))
             if result.success:
                 output = result.stdout if result.stdout else "Command executed successfully"
                 return f"✅ {output}"
@@ -1043,10 +1106,20 @@ awesh: <command>"""
                         break
                     
                     command = data.decode('utf-8').strip()
+                    # Adopt the frontend's trace id; tasks started below inherit it
+                    command, trace_id = tracing.strip_prefix(command)
+                    tracing.set_current(trace_id)
                     if not command:
                         continue
+                    flight_recorder.record(flight_recorder.IPC_RECV, "request", len(data), command)
                     
                     # Handle special commands
+                    kind = command.split(":", 1)[0]
+                    if kind not in REQUEST_KINDS:
+                        kind = "QUERY"
+                    metrics.counter("awesh_backend_requests_total", "Messages received from the frontend",
+                                    kind=kind.lower()).inc()
+                    
                     if command == "STATUS":
                         if self.ai_ready:
                             response = "AI_READY"
@@ -1067,10 +1140,28 @@ awesh: <command>"""
                             response = f"🔧 Verbose mode: {'enabled' if current_verbose else 'disabled'}\n"
                         
                         debug_log(f"VERBOSE command: {verbose_setting} -> {os.getenv('VERBOSE', '0')}")
+                    elif command.startswith("SPECULATE:"):
+                        # Speculative AI request racing the frontend's sandbox validation.
+                        # Runs as a task so a CANCEL can arrive while it is generating.
+                        query = command[len("SPECULATE:"):]
+                        debug_log(f"Speculative request: {query}")
+                        # Acked before anything else on the stream: the frontend holds
+                        # COMMIT/CANCEL until then, so neither shares this read
+                        await loop.sock_sendall(client_socket, SPECULATION_STARTED_MARKER.encode('utf-8'))
+                        self._start_speculative_request(client_socket, query)
+                        continue
+                    elif command == "COMMIT":
+                        # The sandbox verdict went to the AI: the speculative reply may now
+                        # run its commands and edits, and sends itself when done
+                        if self.speculative_gate:
+                            self.speculative_gate.set()
+                        continue
+                    elif command == "CANCEL":
+                        response = await self._cancel_speculative_request()
                     elif command.startswith("AI_PROVIDER:"):
                         # Switch AI provider dynamically
                         provider = command.split(":", 1)[1].strip()
-                        if provider in ["openai", "openrouter", "ollama", "perplexity"]:
+                        if provider in ["openai", "openrouter", "ollama", "perplexity", "mock"]:
                             # Update config and reinitialize AI client
                             self.config.ai_provider = provider
                             response = f"🤖 Switching to {provider}... (restart awesh to take effect)\n"
@@ -1080,17 +1171,30 @@ awesh: <command>"""
                     else:
                         # Process regular command
                         debug_log(f"Processing command: {command}")
-                        response = await self.process_command(command)
+                        inflight = metrics.gauge("awesh_backend_inflight_requests", "Requests being processed")
+                        inflight.inc()
+                        started = loop.time()
+                        try:
+                            with tracing.span("backend.process_command", command):
+                                response = await self.process_command(command)
+                        finally:
+                            inflight.dec()
+                            metrics.histogram("awesh_backend_request_seconds",
+                                              "Time to process one request, AI round trips included").observe(loop.time() - started)
                         debug_log(f"Response ready: {response[:50]}...")
 
                     # Send response using asyncio
                     debug_log("Sending response...")
-                    await loop.sock_sendall(client_socket, response.encode('utf-8'))
+                    with tracing.span("backend.send_response"):
+                        payload = response.encode('utf-8')
+                        await loop.sock_sendall(client_socket, payload)
+                    flight_recorder.record(flight_recorder.IPC_SEND, "reply", len(payload), response)
                     debug_log("Response sent successfully")
                     
                 except ConnectionResetError:
                     break
                 except Exception as e:
+                    flight_recorder.record(flight_recorder.ERROR, "request.failed", detail=str(e))
                     verbose = os.getenv('VERBOSE', '0') == '1'
                     if verbose:
                         print(f"❌ Command processing error: {e}", file=sys.stderr)
@@ -1101,8 +1205,51 @@ awesh: <command>"""
             if verbose:
                 print(f"💥 Client handler error: {e}", file=sys.stderr)
         finally:
+            if self.speculative_task and not self.speculative_task.done():
+                self.speculative_task.cancel()  # Its frontend is gone, COMMIT will never come
             client_socket.close()
     
+    def _start_speculative_request(self, client_socket, query: str):
+        """Start a speculative AI request whose response is sent only if it is not cancelled"""
+        loop = asyncio.get_event_loop()
+
+        # Generation starts now; executing the reply waits for COMMIT, so a line the
+        # frontend ends up running as bash never also runs the AI's commands
+        gate = asyncio.Event()
+
+        async def run_speculative():
+            with tracing.span("backend.speculative_request", query):
+                response = await self.process_command(query, gate=gate)
+            payload = response.encode('utf-8')
+            await loop.sock_sendall(client_socket, payload)
+            flight_recorder.record(flight_recorder.IPC_SEND, "speculative.reply", len(payload), response)
+            metrics.counter("awesh_backend_speculative_total", "Speculative AI requests by outcome",
+                            outcome="delivered").inc()
+            debug_log("Speculative response sent (sandbox did not win)")
+
+        self.speculative_gate = gate
+        self.speculative_task = asyncio.create_task(run_speculative())
+
+    async def _cancel_speculative_request(self) -> str:
+        """Cancel the in-flight speculative request - the sandbox gave a confident bash verdict"""
+        task = self.speculative_task
+        self.speculative_task = None
+        self.speculative_gate = None
+        if task and not task.done():
+            task.cancel()
+            try:
+                await task
+            except asyncio.CancelledError:
+                pass
+            except Exception as e:
+                debug_log(f"Speculative request ended with error while cancelling: {e}")
+            debug_log("Speculative AI request cancelled")
+            flight_recorder.record(flight_recorder.STATE, "speculative.cancelled")
+            metrics.counter("awesh_backend_speculative_total", "Speculative AI requests by outcome",
+                            outcome="cancelled").inc()
+        # Always acknowledge - the frontend discards everything up to this marker
+        return "SPECULATION_CANCELLED"
+
     async def run_server(self):
         """Run socket server"""
         # Remove existing socket
@@ -1115,6 +1262,7 @@ awesh: <command>"""
         self.socket = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
         self.socket.bind(SOCKET_PATH)
         self.socket.listen(1)
+        startup_profile.mark("listening")
         
         verbose = os.getenv('VERBOSE', '0') == '1'
         if verbose:
@@ -1128,6 +1276,9 @@ awesh: <command>"""
         
         # Accept connections
         loop = asyncio.get_event_loop()
+        tracing.install_export_signal(loop)
+        flight_recorder.init()
+        self.metrics_server = await metrics.start()
         while True:
             try:
                 client_socket, _ = await loop.sock_accept(self.socket)
@@ -1146,6 +1297,7 @@ awesh: <command>"""
     
     def cleanup(self):
         """Cleanup resources"""
+        metrics.stop()
         if self.socket:
             self.socket.close()
         try:
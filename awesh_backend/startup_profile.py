@@ -0,0 +1,48 @@
+"""
+Startup phase marks for `awesh --profile-startup`.
+
+The frontend names a file in AWESH_PROFILE_STARTUP; every process appends
+"<CLOCK_MONOTONIC ns> <process> <pid> <phase>" lines to it (see
+trace_startup_mark in awesh_trace.c) and the frontend prints the breakdown
+once the first prompt is up. time.monotonic_ns() is the same clock, so the
+backend's marks line up with the C processes'.
+
+Standard library only: this is imported before anything else in the package.
+"""
+
+import importlib
+import os
+import time
+
+ENV = "AWESH_PROFILE_STARTUP"
+PROCESS = "awesh_backend"
+
+
+def enabled() -> bool:
+    return bool(os.getenv(ENV))
+
+
+def mark(phase: str):
+    """Append one phase mark; a single O_APPEND write, so processes never interleave"""
+    path = os.getenv(ENV)
+    if not path:
+        return
+    line = f"{time.monotonic_ns()} {PROCESS} {os.getpid()} {phase}\n"
+    try:
+        fd = os.open(path, os.O_WRONLY | os.O_APPEND | os.O_CREAT, 0o600)
+        try:
+            os.write(fd, line.encode())
+        finally:
+            os.close(fd)
+    except OSError:
+        pass
+
+
+def time_imports(package: str, modules):
+    """Import the package's submodules one by one, marking each, so the
+    profile shows which import dominates. Later imports find them cached"""
+    if not enabled():
+        return
+    for name in modules:
+        importlib.import_module(f"{package}.{name}")
+        mark(f"import.{name}")
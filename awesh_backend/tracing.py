@@ -0,0 +1,113 @@
+"""
+Cross-process tracing for the awesh backend.
+
+The frontend mints a trace id per input line and prefixes every IPC message
+with "TRACE:<16 hex>:". The backend strips the prefix, carries the id in a
+context variable (asyncio tasks inherit it) and records spans into a bounded
+in-memory ring. On SIGUSR2 the ring is written to
+~/.awesh_trace/awesh_backend.<pid>.jsonl as Chrome Trace Event JSON lines,
+in the same format and CLOCK_MONOTONIC timebase as the C processes, so the
+frontend's awet builtin can merge everything into one timeline.
+
+TRACING=0 disables recording and prefixing.
+"""
+
+import contextvars
+import json
+import os
+import re
+import signal
+import threading
+import time
+from collections import deque
+from contextlib import contextmanager
+from pathlib import Path
+
+PROCESS_NAME = "awesh_backend"
+RING_SIZE = 2048
+TRACE_DIR = Path.home() / ".awesh_trace"
+
+_PREFIX = re.compile(r"^TRACE:([0-9a-f]{16}):")
+
+_current = contextvars.ContextVar("awesh_trace_id", default=0)
+_ring = deque(maxlen=RING_SIZE)
+
+
+def enabled() -> bool:
+    return os.getenv("TRACING", "1") != "0"
+
+
+def strip_prefix(message: str):
+    """Split "TRACE:<id>:rest" into (rest, id); id is 0 when there is no prefix"""
+    match = _PREFIX.match(message)
+    if not match:
+        return message, 0
+    return message[match.end():], int(match.group(1), 16)
+
+
+def set_current(trace_id: int):
+    _current.set(trace_id)
+
+
+def current() -> int:
+    return _current.get()
+
+
+def prefix(message: str) -> str:
+    """Prefix an outgoing IPC message with the current trace id"""
+    trace_id = _current.get()
+    if not trace_id or not enabled():
+        return message
+    return f"TRACE:{trace_id:016x}:{message}"
+
+
+def record(name: str, start_ns: int, end_ns: int, detail: str = None):
+    if not enabled():
+        return
+    # deque.append is atomic, so worker threads can record too
+    _ring.append((name, _current.get(), start_ns, end_ns, threading.get_native_id(), detail))
+
+
+@contextmanager
+def span(name: str, detail: str = None):
+    """Record the duration of the with-block as one span"""
+    start_ns = time.monotonic_ns()
+    try:
+        yield
+    finally:
+        record(name, start_ns, time.monotonic_ns(), detail[:47] if detail else None)
+
+
+def export(path: Path):
+    """Write the ring as Chrome Trace Event JSON lines"""
+    pid = os.getpid()
+    lines = [json.dumps({"name": "process_name", "ph": "M", "pid": pid, "tid": pid,
+                         "args": {"name": PROCESS_NAME}}, separators=(",", ":"))]
+    for name, trace_id, start_ns, end_ns, tid, detail in list(_ring):
+        args = {"trace_id": f"{trace_id:016x}"}
+        if detail:
+            args["detail"] = detail
+        lines.append(json.dumps({"name": name, "cat": PROCESS_NAME, "ph": "X",
+                                 "ts": start_ns / 1000.0, "dur": (end_ns - start_ns) / 1000.0,
+                                 "pid": pid, "tid": tid, "args": args}, separators=(",", ":")))
+    path.write_text("\n".join(lines) + "\n")
+
+
+def export_on_request():
+    """SIGUSR2 handler body: export under a temporary name, then rename"""
+    try:
+        TRACE_DIR.mkdir(mode=0o700, exist_ok=True)
+        path = TRACE_DIR / f"{PROCESS_NAME}.{os.getpid()}.jsonl"
+        tmp_path = path.with_name(path.name + ".tmp")
+        export(tmp_path)
+        tmp_path.replace(path)
+    except OSError:
+        pass
+
+
+def install_export_signal(loop):
+    """Export on SIGUSR2, handled on the event loop rather than mid-coroutine"""
+    try:
+        loop.add_signal_handler(signal.SIGUSR2, export_on_request)
+    except (NotImplementedError, RuntimeError):
+        pass
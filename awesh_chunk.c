@@ -0,0 +1,56 @@
+#include "awesh_chunk.h"
+
+#include <stdint.h>
+
+// Top bits of the hash: they depend on the last 64 bytes, the low ones on
+// only the last few. 15 bits before CHUNK_AVG, 11 after (FastCDC level 2)
+#define MASK_STRICT 0xfffe000000000000ULL
+#define MASK_LOOSE 0xffe0000000000000ULL
+#define GEAR_SEED 0x61776573685f6364ULL     // "awesh_cd"; backup_store.py derives the same table
+
+static uint64_t gear[256];
+static int gear_ready = 0;
+
+// splitmix64, so the table is reproducible without being pasted in here
+static void init_gear(void) {
+    uint64_t state = GEAR_SEED;
+    for (int i = 0; i < 256; i++) {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        gear[i] = z ^ (z >> 31);
+    }
+    gear_ready = 1;
+}
+
+// Length of the chunk starting at p, n bytes being left
+static size_t next_chunk(const unsigned char* p, size_t n) {
+    if (n <= CHUNK_MIN) return n;
+    size_t normal = n < CHUNK_AVG ? n : CHUNK_AVG;
+    size_t limit = n < CHUNK_MAX ? n : CHUNK_MAX;
+    uint64_t hash = 0;
+    size_t i = CHUNK_MIN;           // Nothing can cut before the minimum, so it is not hashed either
+
+    for (; i < normal; i++) {
+        hash = (hash << 1) + gear[p[i]];
+        if (!(hash & MASK_STRICT)) return i + 1;
+    }
+    for (; i < limit; i++) {
+        hash = (hash << 1) + gear[p[i]];
+        if (!(hash & MASK_LOOSE)) return i + 1;
+    }
+    return limit;
+}
+
+size_t chunk_boundaries(const char* data, size_t len, size_t* ends, size_t max_ends) {
+    if (!gear_ready) init_gear();
+    const unsigned char* p = (const unsigned char*)data;
+    size_t count = 0;
+    size_t offset = 0;
+    while (offset < len) {
+        offset += next_chunk(p + offset, len - offset);
+        if (count < max_ends) ends[count] = offset;
+        count++;
+    }
+    return count;
+}
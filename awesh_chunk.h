@@ -0,0 +1,21 @@
+#ifndef AWESH_CHUNK_H
+#define AWESH_CHUNK_H
+
+#include <stddef.h>
+
+// Content-defined chunking for the file editor's backup store
+// (awesh_backend/backup_store.py loads it through ctypes). Boundaries are
+// FastCDC's: a gear rolling hash is tested against a stricter mask before
+// the average chunk size and a looser one after it, so sizes cluster around
+// the average. A boundary depends only on the 64 bytes before it, so an
+// edit moves the boundaries next to it and leaves all others in place.
+#define CHUNK_MIN 2048
+#define CHUNK_AVG 8192
+#define CHUNK_MAX 65536
+
+// Splits data into chunks and stores the end offset of each in ends. Fills
+// at most max_ends entries and returns how many chunks there are in total,
+// so a caller whose array was too small can retry with a larger one
+size_t chunk_boundaries(const char* data, size_t len, size_t* ends, size_t max_ends);
+
+#endif
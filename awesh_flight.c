@@ -0,0 +1,327 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+#include "awesh_flight.h"
+#include "awesh_trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define FLIGHT_SIZE (FLIGHT_HEADER_SIZE + (size_t)FLIGHT_LANES * FLIGHT_LANE_SLOTS * sizeof(flight_event_t))
+
+_Static_assert(sizeof(flight_event_t) == 128, "flight_event_t is shared with flight_recorder.py");
+_Static_assert(sizeof(flight_header_t) <= FLIGHT_HEADER_SIZE, "flight header overflows its page");
+
+// Lane order is part of the format
+static const char* lane_roles[FLIGHT_LANES] = {"awesh", "awesh_sec", "awesh_sandbox", "awesh_backend"};
+
+static char* region = NULL;         // Inherited across fork, so helpers keep the frontend's mapping
+static flight_event_t* lane_events = NULL;
+static flight_lane_t* lane = NULL;
+static int32_t lane_pid = 0;
+static const char* flight_role = "awesh";
+static int flight_enabled = 1;
+static pid_t owner_pid = 0;         // Only the creator unlinks the segment
+static char shm_name[64];
+static char dump_dir[512];
+
+static int read_enabled(void) {
+    const char* enabled = getenv("FLIGHT_RECORDER");
+    return !(enabled && strcmp(enabled, "0") == 0);
+}
+
+// Segments left by frontends that were killed outright
+static void remove_stale_segments(void) {
+    DIR* dir = opendir("/dev/shm");
+    if (!dir) return;
+
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, "awesh_flight.", 13) != 0) continue;
+        pid_t pid = (pid_t)atoi(entry->d_name + 13);
+        if (pid > 0 && kill(pid, 0) != 0 && errno == ESRCH) {
+            char name[300];
+            snprintf(name, sizeof(name), "/%s", entry->d_name);
+            shm_unlink(name);
+        }
+    }
+    closedir(dir);
+}
+
+static void remove_segment(void) {
+    if (getpid() == owner_pid && shm_name[0]) {
+        shm_unlink(shm_name);
+        shm_name[0] = '\0';
+    }
+}
+
+// Frontend only, before any helper is started: create and map the segment
+// and advertise it to exec'd children through the environment
+int flight_create(void) {
+    flight_enabled = read_enabled();
+    if (!flight_enabled) return -1;
+
+    remove_stale_segments();
+    owner_pid = getpid();
+    snprintf(shm_name, sizeof(shm_name), "/awesh_flight.%d", (int)owner_pid);
+
+    int fd = shm_open(shm_name, O_CREAT | O_TRUNC | O_RDWR, 0600);
+    if (fd < 0) return -1;
+    if (ftruncate(fd, (off_t)FLIGHT_SIZE) != 0) {
+        close(fd);
+        shm_unlink(shm_name);
+        return -1;
+    }
+    void* map = mmap(NULL, FLIGHT_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        shm_unlink(shm_name);
+        return -1;
+    }
+
+    region = map;
+    flight_header_t* header = (flight_header_t*)region;
+    memcpy(header->magic, FLIGHT_MAGIC, sizeof(header->magic));
+    header->version = FLIGHT_VERSION;
+    header->lanes = FLIGHT_LANES;
+    header->lane_slots = FLIGHT_LANE_SLOTS;
+    header->event_size = sizeof(flight_event_t);
+    header->owner_pid = (int32_t)owner_pid;
+    for (int i = 0; i < FLIGHT_LANES; i++) {
+        snprintf(header->lane[i].role, sizeof(header->lane[i].role), "%s", lane_roles[i]);
+    }
+
+    setenv(FLIGHT_ENV, shm_name, 1);
+    atexit(remove_segment);
+    return 0;
+}
+
+// Separate builds exec their helpers, so there is no inherited mapping
+static void attach_from_env(void) {
+    const char* name = getenv(FLIGHT_ENV);
+    if (!name || !*name) return;
+
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0) return;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < FLIGHT_SIZE) {
+        close(fd);
+        return;
+    }
+    void* map = mmap(NULL, FLIGHT_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return;
+    if (memcmp(map, FLIGHT_MAGIC, 8) != 0) {
+        munmap(map, FLIGHT_SIZE);
+        return;
+    }
+    region = map;
+}
+
+// Called by every process, helpers at the top of their role main: pick the
+// role's lane. A restarted helper carries on in the same lane, so a dump
+// shows what happened before and after the restart
+void flight_init(const char* role) {
+    flight_enabled = read_enabled();
+    flight_role = role;
+    lane = NULL;
+    lane_events = NULL;
+    if (!flight_enabled) return;
+    if (!region) attach_from_env();
+    if (!region) return;
+
+    for (int i = 0; i < FLIGHT_LANES; i++) {
+        if (strcmp(role, lane_roles[i]) == 0) {
+            flight_header_t* header = (flight_header_t*)region;
+            lane = &header->lane[i];
+            lane_events = (flight_event_t*)(region + FLIGHT_HEADER_SIZE) + (size_t)i * FLIGHT_LANE_SLOTS;
+            break;
+        }
+    }
+    if (!lane) return;
+
+    lane_pid = (int32_t)getpid();
+    __atomic_store_n(&lane->pid, lane_pid, __ATOMIC_RELAXED);
+
+    const char* home = getenv("HOME");
+    if (home) {
+        snprintf(dump_dir, sizeof(dump_dir), "%s/" FLIGHT_DIR_NAME, home);
+    }
+    flight_record(FLIGHT_STATE, "start", 0, role);
+}
+
+static void copy_field(char* dest, const char* src, size_t size) {
+    size_t i = 0;
+    if (src) {
+        for (; i < size - 1 && src[i]; i++) {
+            dest[i] = src[i];
+        }
+    }
+    memset(dest + i, 0, size - i);
+}
+
+// Lock-free and async-signal-safe: claim a slot with one atomic add, fill
+// it, then publish its seq. Several processes can share a lane
+void flight_record(flight_kind_t kind, const char* name, int64_t value, const char* detail) {
+    if (!lane) return;
+
+    uint64_t slot = __atomic_fetch_add(&lane->next, 1, __ATOMIC_RELAXED);
+    flight_event_t* event = &lane_events[slot % FLIGHT_LANE_SLOTS];
+    __atomic_store_n(&event->seq, 0, __ATOMIC_RELAXED);
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    event->ts_ns = (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+    event->trace_id = trace_current();
+    event->value = value;
+    event->pid = lane_pid;
+    event->kind = (uint16_t)kind;
+    event->reserved = 0;
+    copy_field(event->name, name, sizeof(event->name));
+    copy_field(event->detail, detail, sizeof(event->detail));
+    __atomic_store_n(&event->seq, slot + 1, __ATOMIC_RELEASE);
+}
+
+static int write_all(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t written = write(fd, data, len);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        data += written;
+        len -= (size_t)written;
+    }
+    return 0;
+}
+
+static int is_dump_file(const struct dirent* entry) {
+    size_t len = strlen(entry->d_name);
+    return strncmp(entry->d_name, "flight-", 7) == 0 && len > 4 && strcmp(entry->d_name + len - 4, ".bin") == 0;
+}
+
+// Names start with the Unix time, so alphabetical order is oldest first
+static void prune_dumps(void) {
+    struct dirent** entries;
+    int count = scandir(dump_dir, &entries, is_dump_file, alphasort);
+    if (count < 0) return;
+
+    for (int i = 0; i < count; i++) {
+        if (i < count - FLIGHT_MAX_DUMPS) {
+            char path[800];
+            snprintf(path, sizeof(path), "%s/%s", dump_dir, entries[i]->d_name);
+            unlink(path);
+        }
+        free(entries[i]);
+    }
+    free(entries);
+}
+
+// Copy the whole segment - every lane - to
+// ~/.awesh_flight/flight-<unix time>-<pid>-<reason>.bin
+int flight_dump(const char* reason, char* path, size_t size) {
+    if (!region || !dump_dir[0]) return -1;
+    if (mkdir(dump_dir, 0700) != 0 && errno != EEXIST) return -1;
+
+    char dump_path[700];
+    char tmp_path[710];
+    snprintf(dump_path, sizeof(dump_path), "%s/flight-%lld-%d-%s.bin",
+             dump_dir, (long long)time(NULL), (int)getpid(), reason);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", dump_path);
+
+    flight_record(FLIGHT_STATE, "dump", 0, reason);
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) return -1;
+    int failed = write_all(fd, region, FLIGHT_SIZE);
+    if (close(fd) != 0 || failed || rename(tmp_path, dump_path) != 0) {
+        unlink(tmp_path);
+        return -1;
+    }
+
+    prune_dumps();
+    if (path) snprintf(path, size, "%s", dump_path);
+    return 0;
+}
+
+// ============================================================================
+// Crash dumps
+// ============================================================================
+
+// Only async-signal-safe calls below: no stdio, no malloc
+static char* append_str(char* out, char* end, const char* s) {
+    while (*s && out < end) *out++ = *s++;
+    return out;
+}
+
+static char* append_num(char* out, char* end, long long n) {
+    char digits[24];
+    int len = 0;
+    if (n < 0) n = 0;
+    do {
+        digits[len++] = (char)('0' + n % 10);
+        n /= 10;
+    } while (n > 0);
+    while (len > 0 && out < end) *out++ = digits[--len];
+    return out;
+}
+
+static void handle_crash_signal(int sig) {
+    flight_record(FLIGHT_ERROR, "crash", sig, flight_role);
+
+    if (region && dump_dir[0]) {
+        char path[700];
+        char* end = path + sizeof(path) - 1;
+        char* out = append_str(path, end, dump_dir);
+        out = append_str(out, end, "/flight-");
+        out = append_num(out, end, (long long)time(NULL));
+        out = append_str(out, end, "-");
+        out = append_num(out, end, (long long)getpid());
+        out = append_str(out, end, "-crash-");
+        out = append_str(out, end, flight_role);
+        out = append_str(out, end, ".bin");
+        *out = '\0';
+
+        mkdir(dump_dir, 0700);
+        int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+        if (fd >= 0) {
+            write_all(fd, region, FLIGHT_SIZE);
+            close(fd);
+        }
+    }
+
+    // SA_RESETHAND restored the default action; a fault re-raises on return,
+    // a signal sent with kill() is redelivered once the handler unblocks it
+    raise(sig);
+}
+
+// Dump on SIGSEGV/SIGBUS/SIGFPE/SIGILL/SIGABRT, on an alternate stack so a
+// stack overflow still gets its dump
+void flight_install_crash_handler(void) {
+    if (!lane) return;
+
+    static char alt_stack[64 * 1024];
+    stack_t ss;
+    memset(&ss, 0, sizeof(ss));
+    ss.ss_sp = alt_stack;
+    ss.ss_size = sizeof(alt_stack);
+    sigaltstack(&ss, NULL);
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_crash_signal;
+    sa.sa_flags = SA_RESETHAND | SA_ONSTACK;
+    sigemptyset(&sa.sa_mask);
+
+    const int signals[] = {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT};
+    for (size_t i = 0; i < sizeof(signals) / sizeof(signals[0]); i++) {
+        sigaction(signals[i], &sa, NULL);
+    }
+}
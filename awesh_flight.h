@@ -0,0 +1,73 @@
+#ifndef AWESH_FLIGHT_H
+#define AWESH_FLIGHT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Always-on flight recorder. The frontend creates one shared-memory segment
+// (/dev/shm/awesh_flight.<pid>) before starting its helpers; every process -
+// forked helpers by inheritance, the Python backend through
+// AWESH_FLIGHT_RECORDER - writes recent structured events (IPC messages,
+// state changes, timings, errors) into its own lane of fixed-size slots.
+// Writing is a clock read and a 128-byte store, no syscall. The whole
+// segment is copied to ~/.awesh_flight/ when something goes wrong: a
+// timeout, a helper dying (before it is restarted), or a crash signal in
+// any C process. `python3 -m awesh_backend.flight_reader <dump>` decodes it.
+// FLIGHT_RECORDER=0 disables recording and dumps.
+#define FLIGHT_MAGIC "AWFLIGHT"
+#define FLIGHT_VERSION 1
+#define FLIGHT_LANES 4              // awesh, awesh_sec, awesh_sandbox, awesh_backend
+#define FLIGHT_LANE_SLOTS 512       // Events kept per lane; oldest are overwritten
+#define FLIGHT_HEADER_SIZE 256
+#define FLIGHT_NAME_LEN 24
+#define FLIGHT_DETAIL_LEN 64
+#define FLIGHT_MAX_DUMPS 20         // Older dump files are pruned
+#define FLIGHT_ENV "AWESH_FLIGHT_RECORDER"
+#define FLIGHT_DIR_NAME ".awesh_flight"
+
+typedef enum {
+    FLIGHT_IPC_SEND = 1,
+    FLIGHT_IPC_RECV,
+    FLIGHT_STATE,
+    FLIGHT_TIMING,              // value is a duration in microseconds
+    FLIGHT_ERROR
+} flight_kind_t;
+
+// Shared layout - awesh_backend/flight_recorder.py mirrors these structs
+typedef struct {
+    uint64_t seq;               // Lane slot number + 1 once complete; 0 while being written
+    uint64_t ts_ns;             // CLOCK_MONOTONIC, same timebase as tracing
+    uint64_t trace_id;
+    int64_t value;
+    int32_t pid;
+    uint16_t kind;
+    uint16_t reserved;
+    char name[FLIGHT_NAME_LEN];
+    char detail[FLIGHT_DETAIL_LEN];
+} flight_event_t;               // 128 bytes
+
+typedef struct {
+    char role[16];
+    int32_t pid;                // Current writer
+    uint32_t reserved;
+    uint64_t next;              // Slots claimed so far
+} flight_lane_t;                // 32 bytes
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t lanes;
+    uint32_t lane_slots;
+    uint32_t event_size;
+    int32_t owner_pid;
+    uint32_t reserved;
+    flight_lane_t lane[FLIGHT_LANES];
+} flight_header_t;
+
+int flight_create(void);
+void flight_init(const char* role);
+void flight_record(flight_kind_t kind, const char* name, int64_t value, const char* detail);
+int flight_dump(const char* reason, char* path, size_t size);
+void flight_install_crash_handler(void);
+
+#endif
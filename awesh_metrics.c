@@ -0,0 +1,336 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+#include "awesh_metrics.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+static const uint64_t bucket_bounds_us[METRICS_BUCKETS] = {
+    1000, 5000, 10000, 25000, 50000, 100000,
+    250000, 500000, 1000000, 2500000, 5000000, 10000000,
+};
+
+static metric_t registry[METRICS_MAX];
+static int registry_count = 0;
+static metric_t overflow_metric;    // Handed out when the registry is full, never rendered
+
+static const char* metrics_role = "awesh";
+static int metrics_enabled = 1;
+static int listen_fd = -1;
+static pid_t owner_pid = 0;         // Forked children must not remove the parent's files
+static char socket_path[600];
+static char textfile_path[600];
+static long last_textfile_ms = 0;
+
+static long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000L;
+}
+
+// Also called at the top of each multi-call role, to drop whatever the
+// frontend had registered before the fork
+void metrics_init(const char* role) {
+    const char* enabled = getenv("METRICS");
+    metrics_enabled = !(enabled && strcmp(enabled, "0") == 0);
+    metrics_role = role;
+    memset(registry, 0, sizeof(registry));
+    registry_count = 0;
+    listen_fd = -1;
+    owner_pid = getpid();
+    socket_path[0] = '\0';
+    textfile_path[0] = '\0';
+    last_textfile_ms = 0;
+}
+
+static metric_t* metrics_register(metric_type_t type, const char* name, const char* labels, const char* help) {
+    if (registry_count >= METRICS_MAX) {
+        return &overflow_metric;
+    }
+    metric_t* metric = &registry[registry_count++];
+    metric->name = name;
+    metric->labels = labels;
+    metric->help = help;
+    metric->type = type;
+    return metric;
+}
+
+metric_t* metrics_counter(const char* name, const char* labels, const char* help) {
+    return metrics_register(METRIC_COUNTER, name, labels, help);
+}
+
+metric_t* metrics_gauge(const char* name, const char* labels, const char* help) {
+    return metrics_register(METRIC_GAUGE, name, labels, help);
+}
+
+metric_t* metrics_histogram(const char* name, const char* labels, const char* help) {
+    return metrics_register(METRIC_HISTOGRAM, name, labels, help);
+}
+
+void metric_inc(metric_t* metric) {
+    __atomic_fetch_add(&metric->value, 1, __ATOMIC_RELAXED);
+}
+
+void metric_add(metric_t* metric, int64_t delta) {
+    __atomic_fetch_add(&metric->value, delta, __ATOMIC_RELAXED);
+}
+
+void metric_set(metric_t* metric, int64_t value) {
+    __atomic_store_n(&metric->value, value, __ATOMIC_RELAXED);
+}
+
+void metric_observe_ms(metric_t* metric, double ms) {
+    uint64_t us = ms > 0 ? (uint64_t)(ms * 1000.0) : 0;
+    for (int i = 0; i < METRICS_BUCKETS; i++) {
+        if (us <= bucket_bounds_us[i]) {
+            __atomic_fetch_add(&metric->buckets[i], 1, __ATOMIC_RELAXED);
+            break;
+        }
+    }
+    __atomic_fetch_add(&metric->sum_us, us, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&metric->count, 1, __ATOMIC_RELAXED);
+}
+
+static void render_labels(FILE* out, const metric_t* metric, const char* le) {
+    fprintf(out, "{role=\"%s\",pid=\"%d\"", metrics_role, (int)owner_pid);
+    if (metric->labels) fprintf(out, ",%s", metric->labels);
+    if (le) fprintf(out, ",le=\"%s\"", le);
+    fputc('}', out);
+}
+
+static void render_series(FILE* out, const metric_t* metric) {
+    if (metric->type != METRIC_HISTOGRAM) {
+        fprintf(out, "%s", metric->name);
+        render_labels(out, metric, NULL);
+        fprintf(out, " %lld\n", (long long)__atomic_load_n(&metric->value, __ATOMIC_RELAXED));
+        return;
+    }
+
+    uint64_t cumulative = 0;
+    char le[16];
+    for (int i = 0; i < METRICS_BUCKETS; i++) {
+        cumulative += __atomic_load_n(&metric->buckets[i], __ATOMIC_RELAXED);
+        snprintf(le, sizeof(le), "%g", bucket_bounds_us[i] / 1e6);
+        fprintf(out, "%s_bucket", metric->name);
+        render_labels(out, metric, le);
+        fprintf(out, " %llu\n", (unsigned long long)cumulative);
+    }
+    uint64_t count = __atomic_load_n(&metric->count, __ATOMIC_RELAXED);
+    fprintf(out, "%s_bucket", metric->name);
+    render_labels(out, metric, "+Inf");
+    fprintf(out, " %llu\n", (unsigned long long)count);
+    fprintf(out, "%s_sum", metric->name);
+    render_labels(out, metric, NULL);
+    fprintf(out, " %.6f\n", __atomic_load_n(&metric->sum_us, __ATOMIC_RELAXED) / 1e6);
+    fprintf(out, "%s_count", metric->name);
+    render_labels(out, metric, NULL);
+    fprintf(out, " %llu\n", (unsigned long long)count);
+}
+
+// One HELP/TYPE header per family, followed by all of its labelled series
+void metrics_render(FILE* out) {
+    static const char* type_names[] = {"counter", "gauge", "histogram"};
+
+    for (int i = 0; i < registry_count; i++) {
+        int seen = 0;
+        for (int j = 0; j < i && !seen; j++) {
+            seen = strcmp(registry[j].name, registry[i].name) == 0;
+        }
+        if (seen) continue;
+
+        fprintf(out, "# HELP %s %s\n", registry[i].name, registry[i].help);
+        fprintf(out, "# TYPE %s %s\n", registry[i].name, type_names[registry[i].type]);
+        for (int j = i; j < registry_count; j++) {
+            if (strcmp(registry[j].name, registry[i].name) == 0) {
+                render_series(out, &registry[j]);
+            }
+        }
+    }
+}
+
+static int metrics_dir(char* path, size_t size) {
+    const char* home = getenv("HOME");
+    if (!home) return -1;
+    snprintf(path, size, "%s/" METRICS_DIR_NAME, home);
+    if (mkdir(path, 0700) != 0 && errno != EEXIST) return -1;
+    return 0;
+}
+
+// Sockets and textfiles left behind by processes that were killed outright:
+// awesh*.<pid>.sock and awesh*_<pid>.prom whose pid no longer exists
+static void remove_stale_files(const char* dir_path, const char* suffix) {
+    DIR* dir = opendir(dir_path);
+    if (!dir) return;
+
+    size_t suffix_len = strlen(suffix);
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        size_t len = strlen(entry->d_name);
+        if (strncmp(entry->d_name, "awesh", 5) != 0 || len <= suffix_len ||
+            strcmp(entry->d_name + len - suffix_len, suffix) != 0) {
+            continue;
+        }
+        const char* digits = entry->d_name + len - suffix_len;
+        while (digits > entry->d_name && digits[-1] >= '0' && digits[-1] <= '9') digits--;
+        pid_t pid = (pid_t)atoi(digits);
+        if (pid > 0 && kill(pid, 0) != 0 && errno == ESRCH) {
+            char path[1024];
+            snprintf(path, sizeof(path), "%s/%s", dir_path, entry->d_name);
+            unlink(path);
+        }
+    }
+    closedir(dir);
+}
+
+int metrics_listen(void) {
+    if (!metrics_enabled) return -1;
+
+    char dir[512];
+    if (metrics_dir(dir, sizeof(dir)) != 0) return -1;
+    remove_stale_files(dir, ".sock");
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+
+    snprintf(socket_path, sizeof(socket_path), "%s/%s.%d.sock", dir, metrics_role, (int)owner_pid);
+    unlink(socket_path);
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 4) < 0) {
+        close(fd);
+        socket_path[0] = '\0';
+        return -1;
+    }
+
+    // Never block the owner's loop, and keep the fd out of commands it runs
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    listen_fd = fd;
+
+    static int registered = 0;
+    if (!registered) {
+        atexit(metrics_shutdown);
+        registered = 1;
+    }
+    return fd;
+}
+
+int metrics_fd(void) {
+    return listen_fd;
+}
+
+int metrics_socket_path(char* path, size_t size) {
+    if (!socket_path[0]) return -1;
+    snprintf(path, size, "%s", socket_path);
+    return 0;
+}
+
+static void send_all(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t sent = send(fd, data, len, MSG_NOSIGNAL);
+        if (sent <= 0) return;
+        data += sent;
+        len -= (size_t)sent;
+    }
+}
+
+static void serve_client(int client_fd) {
+    // A short send timeout so a stalled scraper cannot hold up the shell
+    struct timeval send_timeout = {0, 200000};
+    setsockopt(client_fd, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+
+    // An HTTP client speaks first; a raw reader (socat, nc -U) does not
+    char request[512];
+    ssize_t request_len = 0;
+    struct pollfd pfd = {client_fd, POLLIN, 0};
+    if (poll(&pfd, 1, 50) > 0) {
+        request_len = recv(client_fd, request, sizeof(request) - 1, MSG_DONTWAIT);
+    }
+    int is_http = request_len >= 4 && strncmp(request, "GET ", 4) == 0;
+
+    char* body = NULL;
+    size_t body_len = 0;
+    FILE* out = open_memstream(&body, &body_len);
+    if (!out) return;
+    metrics_render(out);
+    fclose(out);
+
+    if (is_http) {
+        char header[160];
+        int header_len = snprintf(header, sizeof(header),
+                                  "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                                  "Content-Length: %zu\r\nConnection: close\r\n\r\n", body_len);
+        send_all(client_fd, header, (size_t)header_len);
+    }
+    send_all(client_fd, body, body_len);
+    free(body);
+}
+
+// Answer every scrape that is already waiting, then return
+void metrics_serve(void) {
+    if (listen_fd < 0) return;
+
+    while (1) {
+        int client_fd = accept(listen_fd, NULL, NULL);
+        if (client_fd < 0) return;
+        serve_client(client_fd);
+        close(client_fd);
+    }
+}
+
+// Textfile-collector output, at most once per interval unless forced
+void metrics_write_textfile(int force) {
+    if (!metrics_enabled) return;
+    const char* dir = getenv("METRICS_TEXTFILE_DIR");
+    if (!dir || !*dir) return;
+
+    long now = now_ms();
+    if (!force && last_textfile_ms && now - last_textfile_ms < METRICS_TEXTFILE_INTERVAL_MS) return;
+    if (!last_textfile_ms) remove_stale_files(dir, ".prom");
+    last_textfile_ms = now;
+
+    char tmp_path[620];
+    snprintf(textfile_path, sizeof(textfile_path), "%s/%s_%d.prom", dir, metrics_role, (int)owner_pid);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", textfile_path);
+
+    FILE* out = fopen(tmp_path, "w");
+    if (!out) return;
+    metrics_render(out);
+    if (fclose(out) == 0) {
+        rename(tmp_path, textfile_path);
+    } else {
+        unlink(tmp_path);
+    }
+}
+
+void metrics_shutdown(void) {
+    if (getpid() != owner_pid) return;
+
+    if (listen_fd >= 0) {
+        close(listen_fd);
+        listen_fd = -1;
+    }
+    if (socket_path[0]) {
+        unlink(socket_path);
+        socket_path[0] = '\0';
+    }
+    if (textfile_path[0]) {
+        unlink(textfile_path);
+        textfile_path[0] = '\0';
+    }
+}
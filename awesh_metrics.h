@@ -0,0 +1,54 @@
+#ifndef AWESH_METRICS_H
+#define AWESH_METRICS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Per-process counters, gauges and latency histograms in Prometheus text
+// format. Each process serves them on ~/.awesh_metrics/<role>.<pid>.sock
+// (plain text for a raw connect, an HTTP response for "GET", so
+// `curl --unix-socket` works) and, with METRICS_TEXTFILE_DIR set, also
+// writes <dir>/awesh_<role>_<pid>.prom for node_exporter's textfile
+// collector. Every series carries role and pid labels so files from several
+// sessions never collide. METRICS=0 disables the socket and the textfile.
+#define METRICS_MAX 64
+#define METRICS_BUCKETS 12          // Latency buckets, 1ms .. 10s, plus +Inf
+#define METRICS_DIR_NAME ".awesh_metrics"
+#define METRICS_TEXTFILE_INTERVAL_MS 15000
+
+typedef enum {
+    METRIC_COUNTER,
+    METRIC_GAUGE,
+    METRIC_HISTOGRAM
+} metric_type_t;
+
+typedef struct {
+    const char* name;           // String literals - stored by pointer
+    const char* labels;         // Extra labels, e.g. "route=\"ai\"", or NULL
+    const char* help;
+    metric_type_t type;
+    int64_t value;              // Counter or gauge
+    uint64_t buckets[METRICS_BUCKETS];  // Histogram: per-bucket (not cumulative) counts
+    uint64_t count;
+    uint64_t sum_us;
+} metric_t;
+
+void metrics_init(const char* role);
+metric_t* metrics_counter(const char* name, const char* labels, const char* help);
+metric_t* metrics_gauge(const char* name, const char* labels, const char* help);
+metric_t* metrics_histogram(const char* name, const char* labels, const char* help);
+
+void metric_inc(metric_t* metric);
+void metric_add(metric_t* metric, int64_t delta);
+void metric_set(metric_t* metric, int64_t value);
+void metric_observe_ms(metric_t* metric, double ms);
+
+void metrics_render(FILE* out);
+int metrics_listen(void);
+int metrics_fd(void);
+void metrics_serve(void);
+void metrics_write_textfile(int force);
+int metrics_socket_path(char* path, size_t size);
+void metrics_shutdown(void);
+
+#endif
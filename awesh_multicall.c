@@ -0,0 +1,42 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "awesh_roles.h"
+
+// Helper roles; the frontend is the default when nothing else matches
+static const awesh_role_t roles[] = {
+    {"awesh_sandbox", "sandbox", awesh_sandbox_main},
+    {"awesh_sec", "sec", security_agent_main},
+};
+
+const awesh_role_t* find_awesh_role(const char* name) {
+    if (!name) return NULL;
+
+    for (size_t i = 0; i < sizeof(roles) / sizeof(roles[0]); i++) {
+        if (strcmp(name, roles[i].name) == 0 || strcmp(name, roles[i].subcommand) == 0) {
+            return &roles[i];
+        }
+    }
+    return NULL;
+}
+
+int main(int argc, char** argv) {
+    // Invoked through a symlink: awesh_sandbox -> awesh
+    const char* invoked = argc > 0 ? strrchr(argv[0], '/') : NULL;
+    invoked = invoked ? invoked + 1 : (argc > 0 ? argv[0] : "awesh");
+
+    const awesh_role_t* role = find_awesh_role(invoked);
+    if (role) {
+        return role->main(argc, argv);
+    }
+
+    // Invoked as "awesh <role> ...": drop the role word before handing over
+    if (argc > 1) {
+        role = find_awesh_role(argv[1]);
+        if (role) {
+            return role->main(argc - 1, argv + 1);
+        }
+    }
+
+    return awesh_main(argc, argv);
+}
@@ -0,0 +1,37 @@
+#ifndef AWESH_REDACT_H
+#define AWESH_REDACT_H
+
+#include <stddef.h>
+
+// Secret scanner run over everything the backend sends to an AI provider
+// (awesh_backend/redaction.py loads it through ctypes). One pass over the
+// text: 16-byte blocks without any trigger byte are skipped with a vector
+// compare, and each trigger byte is checked against the literal anchors that
+// contain it - AWS key ids, GitHub/Slack/API tokens, PEM private keys, JWTs,
+// URL passwords and "password=/token:/..." assignments, the latter only when
+// the value looks random enough (Shannon entropy).
+typedef enum {
+    REDACT_AWS_KEY,
+    REDACT_GITHUB_TOKEN,
+    REDACT_SLACK_TOKEN,
+    REDACT_API_KEY,
+    REDACT_PRIVATE_KEY,
+    REDACT_JWT,
+    REDACT_URL_PASSWORD,
+    REDACT_SECRET,              // Value of a password/token/key assignment
+    REDACT_KINDS
+} redact_kind_t;
+
+typedef struct {
+    size_t offset;              // Byte range to replace
+    size_t length;
+    int kind;
+} redact_match_t;
+
+// Finds secrets in text, in order and non-overlapping. Fills at most
+// max_matches entries and returns how many there are in total, so a caller
+// whose array was too small can retry with a larger one
+size_t redact_scan(const char* text, size_t len, redact_match_t* matches, size_t max_matches);
+const char* redact_kind_name(int kind);
+
+#endif
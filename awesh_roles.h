@@ -0,0 +1,20 @@
+#ifndef AWESH_ROLES_H
+#define AWESH_ROLES_H
+
+// Multi-call binary: awesh, awesh_sandbox and awesh_sec are roles of one
+// executable, picked by argv[0] (symlink name) or by subcommand
+// ("awesh sandbox"). The frontend starts the helper roles by forking its
+// own image instead of exec'ing separate binaries from disk.
+typedef struct {
+    const char* name;        // argv[0] basename, e.g. "awesh_sandbox"
+    const char* subcommand;  // "awesh <subcommand>", e.g. "sandbox"
+    int (*main)(int argc, char** argv);
+} awesh_role_t;
+
+int awesh_main(int argc, char** argv);
+int awesh_sandbox_main(int argc, char** argv);
+int security_agent_main(int argc, char** argv);
+
+const awesh_role_t* find_awesh_role(const char* name);
+
+#endif
@@ -1,5 +1,6 @@
 #define _POSIX_C_SOURCE 200809L
 #define _DEFAULT_SOURCE
+#define _GNU_SOURCE             // unshare() for command previews
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -21,10 +22,25 @@
 #include <sys/stat.h>
 #include <sys/wait.h>
 #include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <sys/xattr.h>
+#include <sys/ioctl.h>
+#include <net/if.h>
+#include <sched.h>
+#include <poll.h>
+#include <dirent.h>
+#include <limits.h>
+#include <stdint.h>
 
-#define MAX_CMD_LEN 1024
-#define MAX_RESPONSE_LEN 65536
-#define MMAP_SIZE (1024 * 1024)  // 1MB mmap file
+#include "awesh_arena.h"
+#include "awesh_trace.h"
+#include "awesh_metrics.h"
+#include "awesh_flight.h"
+#include "awesh_roles.h"
+
+#define MMAP_SIZE (1024 * 1024)  // Initial mmap file size; grows for larger results
+#define READ_CHUNK 4096
 
 static char socket_path[512];
 static char sandbox_root[512] = "/tmp/awesh_sandbox_root";
@@ -32,6 +48,33 @@ static char mmap_path[512] = "/tmp/awesh_sandbox_output.mmap";
 static int sandbox_fs_setup = 0;
 static int mmap_fd = -1;
 static char* mmap_ptr = NULL;
+static size_t mmap_size = MMAP_SIZE;
+
+// Per-request memory: command, captured output and scratch copies, reset after each reply
+static arena_t request_arena;
+
+static struct {
+    metric_t* requests_ok;
+    metric_t* requests_failed;
+    metric_t* exec_seconds;
+    metric_t* output_bytes;
+    metric_t* mmap_bytes;
+} sandbox_metrics;
+
+static void init_sandbox_metrics(void) {
+    metrics_init("awesh_sandbox");
+    sandbox_metrics.requests_ok = metrics_counter("awesh_sandbox_requests_total", "result=\"ok\"",
+                                                  "Commands run in the sandbox");
+    sandbox_metrics.requests_failed = metrics_counter("awesh_sandbox_requests_total", "result=\"error\"",
+                                                      "Commands run in the sandbox");
+    sandbox_metrics.exec_seconds = metrics_histogram("awesh_sandbox_exec_seconds", NULL,
+                                                     "Time to run one command in the sandbox bash");
+    sandbox_metrics.output_bytes = metrics_counter("awesh_sandbox_output_bytes_total", NULL,
+                                                   "Command output written to the shared result file");
+    sandbox_metrics.mmap_bytes = metrics_gauge("awesh_sandbox_mmap_bytes", NULL,
+                                               "Current size of the shared result file");
+    metric_set(sandbox_metrics.mmap_bytes, (int64_t)mmap_size);
+}
 
 // Setup mmap file for output communication
 int setup_mmap_file(void) {
@@ -72,7 +115,7 @@ int setup_mmap_file(void) {
 // Cleanup mmap file
 void cleanup_mmap_file(void) {
     if (mmap_ptr && mmap_ptr != MAP_FAILED) {
-        munmap(mmap_ptr, MMAP_SIZE);
+        munmap(mmap_ptr, mmap_size);
         mmap_ptr = NULL;
     }
     if (mmap_fd >= 0) {
@@ -82,71 +125,97 @@ void cleanup_mmap_file(void) {
     unlink(mmap_path);
 }
 
+// Grow the shared file when a result does not fit; readers size their mapping with fstat
+static int ensure_mmap_capacity(size_t needed) {
+    if (needed <= mmap_size) return 0;
+    
+    size_t new_size = mmap_size;
+    while (new_size < needed) new_size *= 2;
+    if (ftruncate(mmap_fd, new_size) < 0) return -1;
+    
+    char* remapped = mmap(NULL, new_size, PROT_READ | PROT_WRITE, MAP_SHARED, mmap_fd, 0);
+    if (remapped == MAP_FAILED) return -1;
+    munmap(mmap_ptr, mmap_size);
+    mmap_ptr = remapped;
+    mmap_size = new_size;
+    metric_set(sandbox_metrics.mmap_bytes, (int64_t)mmap_size);
+    return 0;
+}
+
 // Write command result to mmap file
 void write_result_to_mmap(int exit_code, const char* stdout_content, const char* stderr_content) {
     if (!mmap_ptr || mmap_ptr == MAP_FAILED) {
         return;
     }
     
-    // Clear the mmap area
-    memset(mmap_ptr, 0, MMAP_SIZE);
-    
-    // Write simple format result with proper escaping
-    // Use a more robust format that handles special characters
-    char* ptr = mmap_ptr;
-    int remaining = MMAP_SIZE - 1;
-    
-    // Write EXIT_CODE
-    int written = snprintf(ptr, remaining, "EXIT_CODE:%d\n", exit_code);
-    if (written > 0 && written < remaining) {
-        ptr += written;
-        remaining -= written;
-    }
-    
-    // Write STDOUT with length prefix to handle special characters
     const char* stdout_str = stdout_content ? stdout_content : "";
-    size_t stdout_len = strlen(stdout_str);
-    written = snprintf(ptr, remaining, "STDOUT_LEN:%zu\nSTDOUT:", stdout_len);
-    if (written > 0 && written < remaining) {
-        ptr += written;
-        remaining -= written;
-        
-        // Write stdout content directly (no formatting to avoid issues with special chars)
-        if (stdout_len > 0 && (int)stdout_len < remaining) {
-            memcpy(ptr, stdout_str, stdout_len);
-            ptr += stdout_len;
-            remaining -= (int)stdout_len;
-        }
-        if (remaining > 0) {
-            *ptr++ = '\n';
-            remaining--;
-        }
-    }
-    
-    // Write STDERR with length prefix
     const char* stderr_str = stderr_content ? stderr_content : "";
+    size_t stdout_len = strlen(stdout_str);
     size_t stderr_len = strlen(stderr_str);
-    written = snprintf(ptr, remaining, "STDERR_LEN:%zu\nSTDERR:", stderr_len);
-    if (written > 0 && written < remaining) {
-        ptr += written;
-        remaining -= written;
-        
-        // Write stderr content directly
-        if (stderr_len > 0 && (int)stderr_len < remaining) {
-            memcpy(ptr, stderr_str, stderr_len);
-            ptr += stderr_len;
-            remaining -= (int)stderr_len;
-        }
-        if (remaining > 0) {
-            *ptr++ = '\n';
-            remaining--;
-        }
+    
+    // Header lines are bounded; the length prefixes delimit the content, so the
+    // area never needs clearing first
+    const size_t header_room = 128;
+    if (ensure_mmap_capacity(stdout_len + stderr_len + header_room) != 0) {
+        // Could not grow - keep what fits rather than writing nothing
+        size_t room = mmap_size - header_room;
+        if (stdout_len > room) stdout_len = room;
+        if (stderr_len > room - stdout_len) stderr_len = room - stdout_len;
     }
     
-    // Ensure null termination
+    char* ptr = mmap_ptr;
+    ptr += sprintf(ptr, "EXIT_CODE:%d\nSTDOUT_LEN:%zu\nSTDOUT:", exit_code, stdout_len);
+    memcpy(ptr, stdout_str, stdout_len);
+    ptr += stdout_len;
+    *ptr++ = '\n';
+    
+    ptr += sprintf(ptr, "STDERR_LEN:%zu\nSTDERR:", stderr_len);
+    memcpy(ptr, stderr_str, stderr_len);
+    ptr += stderr_len;
+    *ptr++ = '\n';
     *ptr = '\0';
 }
 
+// Clients other than the frontend prefix a request with INLINE: to get the
+// result on their own connection, after the ack and a newline, in the mmap
+// file's format. The shared file belongs to whoever asked last, so a result
+// read from it after the ack may already be another request's
+static int reply_inline = 0;
+
+static int send_all(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t sent = send(fd, data, len, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent <= 0) return -1;
+        data += sent;
+        len -= (size_t)sent;
+    }
+    return 0;
+}
+
+// Answer the request: ack plus result, inline or through the mmap file
+static void send_result(int client_fd, const char* ack, int exit_code, const char* stdout_content,
+                        const char* stderr_content) {
+    if (!reply_inline) {
+        write_result_to_mmap(exit_code, stdout_content, stderr_content);
+        send(client_fd, ack, strlen(ack), MSG_NOSIGNAL);
+        return;
+    }
+    const char* stdout_str = stdout_content ? stdout_content : "";
+    const char* stderr_str = stderr_content ? stderr_content : "";
+    char header[PATH_MAX + 96];
+    int len = snprintf(header, sizeof(header), "%s\nEXIT_CODE:%d\nSTDOUT_LEN:%zu\nSTDOUT:", ack, exit_code,
+                       strlen(stdout_str));
+    if (len < 0 || (size_t)len >= sizeof(header) || send_all(client_fd, header, (size_t)len) != 0 ||
+        send_all(client_fd, stdout_str, strlen(stdout_str)) != 0) {
+        return;
+    }
+    len = snprintf(header, sizeof(header), "\nSTDERR_LEN:%zu\nSTDERR:", strlen(stderr_str));
+    if (send_all(client_fd, header, (size_t)len) == 0 && send_all(client_fd, stderr_str, strlen(stderr_str)) == 0) {
+        send_all(client_fd, "\n", 1);
+    }
+}
+
 // Setup sandbox with read-only mount of entire root filesystem
 int setup_sandbox_filesystem(void) {
     if (sandbox_fs_setup) {
@@ -214,7 +283,7 @@ static struct {
     int bash_ready;
 } bash_sandbox = {0};
 
-int spawn_bash_sandbox(void) {
+static int spawn_bash_sandbox(void) {
     // Create PTY for proper TTY support
     char slave_name[256];
     
@@ -282,7 +351,7 @@ int spawn_bash_sandbox(void) {
     }
 }
 
-void cleanup_bash_sandbox(void) {
+static void cleanup_bash_sandbox(void) {
     if (bash_sandbox.bash_ready) {
         // Send exit command to bash sandbox
         if (bash_sandbox.master_fd >= 0) {
@@ -299,14 +368,22 @@ void cleanup_bash_sandbox(void) {
     }
 }
 
-int execute_command_in_sandbox(const char* cmd, char* stdout_buf, char* stderr_buf, int* exit_code) {
+// Does the line [line, line + len) contain `needle`?
+static int line_contains(const char* line, size_t len, const char* needle) {
+    size_t needle_len = strlen(needle);
+    for (size_t i = 0; i + needle_len <= len; i++) {
+        if (memcmp(line + i, needle, needle_len) == 0) return 1;
+    }
+    return 0;
+}
+
+int execute_command_in_sandbox(const char* cmd, abuf_t* out, abuf_t* err, int* exit_code) {
     if (!bash_sandbox.bash_ready) {
         return -1;
     }
     
-    // Clear output buffers
-    memset(stdout_buf, 0, MAX_RESPONSE_LEN);
-    memset(stderr_buf, 0, MAX_RESPONSE_LEN);
+    abuf_clear(out);
+    abuf_clear(err);
     *exit_code = 0;
     
     // Clear any existing output from PTY before sending command
@@ -327,10 +404,13 @@ int execute_command_in_sandbox(const char* cmd, char* stdout_buf, char* stderr_b
     }
     
     // Send command to bash sandbox via PTY master with shell expansion
-    char full_cmd[MAX_CMD_LEN + 50];
-    snprintf(full_cmd, sizeof(full_cmd), "bash -c '%s'; echo \"EXIT_CODE:$?\"\n", cmd);
+    abuf_t full_cmd;
+    if (abuf_init(&full_cmd, out->arena, strlen(cmd) + 64) != 0 ||
+        abuf_printf(&full_cmd, "bash -c '%s'; echo \"EXIT_CODE:$?\"\n", cmd) < 0) {
+        return -1;
+    }
     
-    if (write(bash_sandbox.master_fd, full_cmd, strlen(full_cmd)) < 0) {
+    if (write(bash_sandbox.master_fd, full_cmd.data, full_cmd.len) < 0) {
         return -1;
     }
     
@@ -377,7 +457,6 @@ int execute_command_in_sandbox(const char* cmd, char* stdout_buf, char* stderr_b
     // Now run the actual command and check if PS1 appears at the end
     // Read output with timeout from PTY master
     char buffer[1024];
-    int total_len = 0;
     int prompt_detected = 0;
     int max_attempts = 50;  // Increased attempts to capture all output (5 seconds total)
     int attempts = 0;
@@ -399,9 +478,8 @@ int execute_command_in_sandbox(const char* cmd, char* stdout_buf, char* stderr_b
             ssize_t bytes_read = read(bash_sandbox.master_fd, buffer, sizeof(buffer) - 1);
             if (bytes_read > 0) {
                 buffer[bytes_read] = '\0';
-                if (total_len + bytes_read < MAX_RESPONSE_LEN - 1) {
-                    memcpy(stdout_buf + total_len, buffer, bytes_read);
-                    total_len += bytes_read;
+                if (abuf_append(out, buffer, (size_t)bytes_read) != 0) {
+                    return -1;
                 }
                 
                 // Reset consecutive empty reads counter
@@ -422,7 +500,7 @@ int execute_command_in_sandbox(const char* cmd, char* stdout_buf, char* stderr_b
             }
         } else {
             // Timeout - check if we have any output
-            if (total_len > 0 && prompt_detected) {
+            if (out->len > 0 && prompt_detected) {
                 break;  // We have output and prompt detected, command completed
             }
             attempts++;
@@ -435,8 +513,9 @@ int execute_command_in_sandbox(const char* cmd, char* stdout_buf, char* stderr_b
         timeout.tv_usec = 100000;  // 100ms
     }
     
-    // Null-terminate the output
-    stdout_buf[total_len] = '\0';
+    // Filters below work in place on the captured output
+    char* stdout_buf = out->data;
+    int total_len = (int)out->len;
     
     // Filter out command echo and bash prompt from output
     // Remove any lines that match the command or common bash prompts
@@ -450,32 +529,22 @@ int execute_command_in_sandbox(const char* cmd, char* stdout_buf, char* stderr_b
             line_end = line_start + strlen(line_start);
         }
         
-        // Extract current line
+        // Compare the line in place - no copy, so long lines are not dropped
         size_t line_len = line_end - line_start;
-        char current_line[256];
-        if (line_len < sizeof(current_line)) {
-            strncpy(current_line, line_start, line_len);
-            current_line[line_len] = '\0';
-            
-            // Remove trailing newline for comparison
-            if (current_line[line_len - 1] == '\n') {
-                current_line[line_len - 1] = '\0';
-            }
+        size_t cmd_len = strlen(cmd);
+        
+        // Skip lines that are command echo or bash prompts
+        // Also skip lines that start with the command (in case of partial echo)
+        if (line_len > 0 &&
+            !(line_len >= cmd_len && strncmp(line_start, cmd, cmd_len) == 0) &&
+            !line_contains(line_start, line_len, "$ ") &&
+            !line_contains(line_start, line_len, "# ") &&
+            !line_contains(line_start, line_len, "> ")) {
             
-            // Skip lines that are command echo or bash prompts
-            // Also skip lines that start with the command (in case of partial echo)
-            if (strcmp(current_line, cmd) != 0 && 
-                strncmp(current_line, cmd, strlen(cmd)) != 0 &&
-                strstr(current_line, "$ ") == NULL &&
-                strstr(current_line, "# ") == NULL &&
-                strstr(current_line, "> ") == NULL &&
-                strlen(current_line) > 0) {
-                
-                // Keep this line
-                memmove(filtered_buf, line_start, line_len);
-                filtered_buf += line_len;
-                filtered_len += line_len;
-            }
+            // Keep this line
+            memmove(filtered_buf, line_start, line_len);
+            filtered_buf += line_len;
+            filtered_len += line_len;
         }
         
         // Move to next line
@@ -509,6 +578,7 @@ int execute_command_in_sandbox(const char* cmd, char* stdout_buf, char* stderr_b
     }
     *clean_ptr = '\0';
     total_len = clean_ptr - stdout_buf;
+    out->len = (size_t)total_len;
     
     // Debug: Print what we detected (only in verbose mode)
     // Note: We can't access frontend verbose level from sandbox, so we'll check environment
@@ -540,7 +610,8 @@ int execute_command_in_sandbox(const char* cmd, char* stdout_buf, char* stderr_b
         }
         
         // Send special response indicating interactive command
-        strcpy(stdout_buf, "INTERACTIVE_COMMAND");
+        abuf_clear(out);
+        abuf_puts(out, "INTERACTIVE_COMMAND");
         *exit_code = -103;  // Negative prime number for interactive commands (fits in 8-bit)
         return 0;
     }
@@ -556,9 +627,10 @@ int execute_command_in_sandbox(const char* cmd, char* stdout_buf, char* stderr_b
         
         // Only route to AI if command has 3+ words (natural language queries)
         int word_count = 0;
-        char cmd_copy_for_token[MAX_CMD_LEN];
-        strncpy(cmd_copy_for_token, cmd, sizeof(cmd_copy_for_token) - 1);
-        cmd_copy_for_token[sizeof(cmd_copy_for_token) - 1] = '\0';
+        char* cmd_copy_for_token = arena_strdup(out->arena, cmd);
+        if (!cmd_copy_for_token) {
+            return -1;
+        }
         char* word = strtok(cmd_copy_for_token, " \t");
         while (word && word_count < 10) { // Limit word count to prevent buffer overflow
             word_count++;
@@ -601,6 +673,7 @@ int execute_command_in_sandbox(const char* cmd, char* stdout_buf, char* stderr_b
         
         // Update total_len
         total_len -= line_len;
+        out->len = (size_t)total_len;
     } else {
         *exit_code = 0;    // Success (no explicit exit code found)
     }
@@ -608,6 +681,767 @@ int execute_command_in_sandbox(const char* cmd, char* stdout_buf, char* stderr_b
     return 0;  // Success
 }
 
+// Copy-on-write previews of AI commands.
+//
+// A command the AI proposes that may change files runs here first, in its
+// own mount, pid, network and IPC namespaces (plus a user namespace when not
+// root). / is remounted read-only. The project tree - the git work tree
+// around the command's directory, else the directory itself - gets an
+// overlayfs whose upper layer is a preview directory. /tmp and /run get empty
+// tmpfs mounts. Writes to the tree land in the upper layer and writes
+// anywhere else fail with EROFS. Nothing reaches the network, no outside
+// process can be signalled, and daemon sockets under /run are out of reach.
+// The upper layer is the command's diff. PREVIEW_COMMIT moves it onto the
+// real tree, so an approved command is not run a second time. A preview can
+// build on an earlier one (that preview's upper layer becomes a lower layer),
+// so the commands of one reply see each other's changes, and committing the
+// last preview applies the whole chain.
+//
+//   PREVIEW:<base preview or ->\n<cwd>\n<command>   ack "PREVIEW:<dir>"; exit code and output as for any command
+//   PREVIEW_COMMIT:<dir>    apply <dir> and the previews it builds on, oldest first
+//   PREVIEW_DISCARD:<dir>   remove them
+
+#define PREVIEW_TIMEOUT_MS 20000            // Under the backend's 30s socket timeout, so the result still reaches it
+#define PREVIEW_MAX_OUTPUT (1024 * 1024)    // Per stream; the rest is dropped
+#define PREVIEW_MAX_AGE_S (24 * 3600)       // Abandoned previews are removed after this
+#define PREVIEW_MAX_CHAIN 32
+#define PREVIEW_MAX_CONFLICTS 20
+#define PREVIEW_OPTIONS_MAX 4000            // Overlay mount options must fit in a page
+
+#ifndef SYS_open_tree
+#define SYS_open_tree 428
+#endif
+#ifndef SYS_mount_setattr
+#define SYS_mount_setattr 442
+#endif
+#ifndef OPEN_TREE_CLONE
+#define OPEN_TREE_CLONE 1
+#endif
+#ifndef OPEN_TREE_CLOEXEC
+#define OPEN_TREE_CLOEXEC O_CLOEXEC
+#endif
+#ifndef AT_RECURSIVE
+#define AT_RECURSIVE 0x8000
+#endif
+#ifndef MOUNT_ATTR_RDONLY
+#define MOUNT_ATTR_RDONLY 0x00000001
+#endif
+
+// struct mount_attr, which older C libraries do not declare
+typedef struct {
+    uint64_t attr_set;
+    uint64_t attr_clr;
+    uint64_t propagation;
+    uint64_t userns_fd;
+} preview_mount_attr_t;
+
+typedef struct {
+    char tree[PATH_MAX];
+    char cwd[PATH_MAX];
+    char base[PATH_MAX];                    // Preview this one builds on, "" if none
+    char lower[PREVIEW_OPTIONS_MAX];        // Overlay lowerdir, newest layer first
+    long long started_ms;
+    int exit_code;                          // -1 until the command has finished
+} preview_meta_t;
+
+static long long preview_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int path_within(const char* path, const char* dir) {
+    size_t len = strlen(dir);
+    if (len == 1 && dir[0] == '/') return 1;
+    return strncmp(path, dir, len) == 0 && (path[len] == '/' || path[len] == '\0');
+}
+
+static void remove_tree(const char* path) {
+    struct stat st;
+    if (lstat(path, &st) != 0) return;
+    if (!S_ISDIR(st.st_mode)) {
+        unlink(path);
+        return;
+    }
+    DIR* dir = opendir(path);
+    if (!dir && errno == EACCES && chmod(path, 0700) == 0) {
+        dir = opendir(path);                // overlay leaves a mode 000 work/work directory
+    }
+    if (dir) {
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != NULL) {
+            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+            char child[PATH_MAX];
+            if (snprintf(child, sizeof(child), "%s/%s", path, entry->d_name) >= (int)sizeof(child)) continue;
+            remove_tree(child);
+        }
+        closedir(dir);
+    }
+    rmdir(path);
+}
+
+// Directories previews may live in, in order of preference
+static int preview_roots(char roots[3][PATH_MAX]) {
+    int count = 0;
+    const char* home = getenv("HOME");
+    if (home) snprintf(roots[count++], PATH_MAX, "%s/.awesh_preview", home);
+    snprintf(roots[count++], PATH_MAX, "/var/tmp/awesh_preview_%u", (unsigned)getuid());
+    snprintf(roots[count++], PATH_MAX, "/tmp/awesh_preview_%u", (unsigned)getuid());
+    return count;
+}
+
+// The upper layer may not lie inside the tree it covers (nor the other way
+// round), so a preview of $HOME lives under /var/tmp
+static int preview_pick_root(const char* tree, char* root, size_t size) {
+    char roots[3][PATH_MAX];
+    int count = preview_roots(roots);
+    for (int i = 0; i < count; i++) {
+        if (path_within(roots[i], tree) || path_within(tree, roots[i])) continue;
+        struct stat st;
+        if (mkdir(roots[i], 0700) != 0 && errno != EEXIST) continue;
+        if (lstat(roots[i], &st) != 0 || !S_ISDIR(st.st_mode) || st.st_uid != getuid()) continue;
+        snprintf(root, size, "%s", roots[i]);
+        return 0;
+    }
+    return -1;
+}
+
+// Only directories this sandbox created are ever committed or removed
+static int is_preview_dir(const char* dir) {
+    char roots[3][PATH_MAX];
+    int count = preview_roots(roots);
+    for (int i = 0; i < count; i++) {
+        size_t len = strlen(roots[i]);
+        if (path_within(dir, roots[i]) && dir[len] == '/' && dir[len + 1] &&
+            !strchr(dir + len + 1, '/') && strcmp(dir + len + 1, "..") != 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void preview_remove_stale(const char* root) {
+    DIR* dir = opendir(root);
+    if (!dir) return;
+    time_t now = time(NULL);
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, "p.", 2) != 0) continue;
+        char path[PATH_MAX];
+        struct stat st;
+        if (snprintf(path, sizeof(path), "%s/%s", root, entry->d_name) >= (int)sizeof(path)) continue;
+        if (lstat(path, &st) == 0 && S_ISDIR(st.st_mode) && now - st.st_mtime > PREVIEW_MAX_AGE_S) {
+            remove_tree(path);
+        }
+    }
+    closedir(dir);
+}
+
+// The git work tree around cwd, else cwd itself
+static void preview_find_tree(const char* cwd, char* tree, size_t size) {
+    char dir[PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s", cwd);
+    while (1) {
+        char probe[PATH_MAX + 8];
+        struct stat st;
+        snprintf(probe, sizeof(probe), "%s/.git", dir);
+        if (lstat(probe, &st) == 0) {
+            snprintf(tree, size, "%s", dir);
+            return;
+        }
+        char* slash = strrchr(dir, '/');
+        if (!slash || slash == dir) break;
+        *slash = '\0';
+    }
+    snprintf(tree, size, "%s", cwd);
+}
+
+static int preview_write_meta(const char* dir, const preview_meta_t* meta, const char* command) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/meta", dir);
+    FILE* file = fopen(path, "w");
+    if (!file) return -1;
+    fprintf(file, "tree=%s\ncwd=%s\nstarted=%lld\nbase=%s\nlower=%s\nexit=%d\ncommand=%s\n",
+            meta->tree, meta->cwd, meta->started_ms, meta->base[0] ? meta->base : "-", meta->lower,
+            meta->exit_code, command);
+    return fclose(file);
+}
+
+static int preview_read_meta(const char* dir, preview_meta_t* meta) {
+    char path[PATH_MAX];
+    char line[PATH_MAX + PREVIEW_OPTIONS_MAX];
+    snprintf(path, sizeof(path), "%s/meta", dir);
+    FILE* file = fopen(path, "r");
+    if (!file) return -1;
+    memset(meta, 0, sizeof(*meta));
+    meta->exit_code = -1;
+    while (fgets(line, sizeof(line), file)) {
+        line[strcspn(line, "\n")] = '\0';
+        char* value = strchr(line, '=');
+        if (!value) continue;
+        *value++ = '\0';
+        if (strcmp(line, "tree") == 0) snprintf(meta->tree, sizeof(meta->tree), "%s", value);
+        else if (strcmp(line, "cwd") == 0) snprintf(meta->cwd, sizeof(meta->cwd), "%s", value);
+        else if (strcmp(line, "started") == 0) meta->started_ms = atoll(value);
+        else if (strcmp(line, "base") == 0 && strcmp(value, "-") != 0) snprintf(meta->base, sizeof(meta->base), "%s", value);
+        else if (strcmp(line, "lower") == 0) snprintf(meta->lower, sizeof(meta->lower), "%s", value);
+        else if (strcmp(line, "exit") == 0) meta->exit_code = atoi(value);
+    }
+    fclose(file);
+    return meta->tree[0] ? 0 : -1;
+}
+
+static int is_whiteout(const struct stat* st) {
+    return S_ISCHR(st->st_mode) && st->st_rdev == 0;
+}
+
+// Root mounts the overlay with trusted.* xattrs, a user namespace with user.*
+static int is_opaque_dir(const char* path) {
+    char value[4];
+    ssize_t len = lgetxattr(path, "trusted.overlay.opaque", value, sizeof(value));
+    if (len <= 0) len = lgetxattr(path, "user.overlay.opaque", value, sizeof(value));
+    return len > 0 && value[0] == 'y';
+}
+
+static int write_proc_file(const char* path, const char* text) {
+    int fd = open(path, O_WRONLY);
+    if (fd < 0) return -1;
+    ssize_t written = write(fd, text, strlen(text));
+    close(fd);
+    return written == (ssize_t)strlen(text) ? 0 : -1;
+}
+
+static void preview_setup_failed(int status_fd, const char* step) {
+    dprintf(status_fd, "%s: %s", step, strerror(errno));
+    _exit(125);
+}
+
+// Runs in the forked child: enter the namespaces, build the mounts, then run
+// the command as the first process of the new pid namespace. Setup errors go
+// to status_fd; it is close-on-exec, so EOF on it means bash started
+static void preview_child(const preview_meta_t* meta, const char* dir, const char* command,
+                          int out_fd, int err_fd, int status_fd) {
+    uid_t uid = getuid();
+    gid_t gid = getgid();
+    int flags = CLONE_NEWNS | CLONE_NEWPID | CLONE_NEWNET | CLONE_NEWIPC;
+    if (uid != 0) flags |= CLONE_NEWUSER;   // Root can mount without one
+    if (unshare(flags) != 0) preview_setup_failed(status_fd, "unshare");
+    if (uid != 0) {
+        char map[64];
+        write_proc_file("/proc/self/setgroups", "deny");
+        snprintf(map, sizeof(map), "%u %u 1", (unsigned)uid, (unsigned)uid);
+        if (write_proc_file("/proc/self/uid_map", map) != 0) preview_setup_failed(status_fd, "uid_map");
+        snprintf(map, sizeof(map), "%u %u 1", (unsigned)gid, (unsigned)gid);
+        if (write_proc_file("/proc/self/gid_map", map) != 0) preview_setup_failed(status_fd, "gid_map");
+    }
+    if (mount(NULL, "/", NULL, MS_REC | MS_PRIVATE, NULL) != 0) preview_setup_failed(status_fd, "mount propagation");
+    
+    // The upper layer has to stay writable once / is read-only, so keep a
+    // detached copy of its mount and hand that to overlayfs
+    int keep_fd = (int)syscall(SYS_open_tree, AT_FDCWD, dir, OPEN_TREE_CLONE | OPEN_TREE_CLOEXEC);
+    if (keep_fd < 0) preview_setup_failed(status_fd, "open_tree");
+    preview_mount_attr_t attr = {.attr_set = MOUNT_ATTR_RDONLY};
+    if (syscall(SYS_mount_setattr, AT_FDCWD, "/", AT_RECURSIVE, &attr, sizeof(attr)) != 0) {
+        preview_setup_failed(status_fd, "read-only remount");
+    }
+    char options[PREVIEW_OPTIONS_MAX + 128];
+    snprintf(options, sizeof(options), "lowerdir=%s,upperdir=/proc/self/fd/%d/upper,workdir=/proc/self/fd/%d/work%s",
+             meta->lower, keep_fd, keep_fd, uid != 0 ? ",userxattr" : "");
+    if (mount("overlay", meta->tree, "overlay", 0, options) != 0) preview_setup_failed(status_fd, "overlay mount");
+    close(keep_fd);
+    
+    // Scratch space that is thrown away, and no daemon sockets (docker, dbus, systemd)
+    if (!path_within(meta->tree, "/tmp")) mount("tmpfs", "/tmp", "tmpfs", MS_NOSUID | MS_NODEV, "mode=1777");
+    if (!path_within(meta->tree, "/run")) mount("tmpfs", "/run", "tmpfs", MS_NOSUID | MS_NODEV, "mode=755");
+    mount("tmpfs", "/dev/shm", "tmpfs", MS_NOSUID | MS_NODEV, "mode=1777");
+    
+    // The new network namespace has only loopback, and it starts down
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock >= 0) {
+        struct ifreq request;
+        memset(&request, 0, sizeof(request));
+        strncpy(request.ifr_name, "lo", IFNAMSIZ - 1);
+        if (ioctl(sock, SIOCGIFFLAGS, &request) == 0) {
+            request.ifr_flags |= IFF_UP;
+            ioctl(sock, SIOCSIFFLAGS, &request);
+        }
+        close(sock);
+    }
+    
+    pid_t pid = fork();
+    if (pid < 0) preview_setup_failed(status_fd, "fork");
+    if (pid == 0) {
+        // Pid 1 of the namespace: when it goes, every process it started goes too
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+        mount("proc", "/proc", "proc", MS_NOSUID | MS_NODEV | MS_NOEXEC, NULL);  // Containers may refuse; ps then shows the host
+        if (chdir(meta->cwd) != 0) preview_setup_failed(status_fd, meta->cwd);
+        int null_fd = open("/dev/null", O_RDONLY);
+        if (null_fd < 0) preview_setup_failed(status_fd, "/dev/null");
+        dup2(null_fd, STDIN_FILENO);        // Nothing may wait for input that cannot come
+        dup2(out_fd, STDOUT_FILENO);
+        dup2(err_fd, STDERR_FILENO);
+        close(null_fd);
+        close(out_fd);
+        close(err_fd);
+        execl("/bin/bash", "bash", "-c", command, (char*)NULL);
+        preview_setup_failed(status_fd, "/bin/bash");
+    }
+    close(status_fd);
+    close(out_fd);
+    close(err_fd);
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+    }
+    _exit(WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status));
+}
+
+// Drain the command's stdout and stderr until both close or the time is up
+static int preview_collect(int out_fd, int err_fd, abuf_t* out, abuf_t* err) {
+    struct pollfd fds[2] = {{out_fd, POLLIN, 0}, {err_fd, POLLIN, 0}};
+    abuf_t* bufs[2] = {out, err};
+    long long deadline = preview_now_ms() + PREVIEW_TIMEOUT_MS;
+    int open_count = 2;
+    char discard[READ_CHUNK];
+    
+    while (open_count > 0) {
+        long long left = deadline - preview_now_ms();
+        if (left <= 0) return -1;
+        if (poll(fds, 2, (int)left) < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        for (int i = 0; i < 2; i++) {
+            if (fds[i].fd < 0 || !(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+            ssize_t bytes = bufs[i]->len < PREVIEW_MAX_OUTPUT ? abuf_read(bufs[i], fds[i].fd, READ_CHUNK)
+                                                              : read(fds[i].fd, discard, sizeof(discard));
+            if (bytes <= 0 && !(bytes < 0 && errno == EINTR)) {
+                fds[i].fd = -1;
+                open_count--;
+            }
+        }
+    }
+    return 0;
+}
+
+// "A path", "M path" and "D path" lines for what the upper layer changes in
+// the real tree; new directories end in '/'
+static void preview_list_changes(const char* upper, const char* real, const char* rel, abuf_t* list) {
+    DIR* dir = opendir(upper);
+    if (!dir) return;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        char from[PATH_MAX], to[PATH_MAX], name[PATH_MAX];
+        if (snprintf(from, sizeof(from), "%s/%s", upper, entry->d_name) >= (int)sizeof(from) ||
+            snprintf(to, sizeof(to), "%s/%s", real, entry->d_name) >= (int)sizeof(to) ||
+            snprintf(name, sizeof(name), "%s%s%s", rel, rel[0] ? "/" : "", entry->d_name) >= (int)sizeof(name)) {
+            continue;
+        }
+        struct stat st, target;
+        if (lstat(from, &st) != 0) continue;
+        int exists = lstat(to, &target) == 0;
+        if (is_whiteout(&st)) {
+            if (exists) abuf_printf(list, "D %s\n", name);
+        } else if (S_ISDIR(st.st_mode)) {
+            if (!exists || !S_ISDIR(target.st_mode)) {
+                abuf_printf(list, "A %s/\n", name);
+            } else if (is_opaque_dir(from)) {
+                // Replaced wholesale: whatever the new one lacks is gone
+                DIR* old = opendir(to);
+                struct dirent* child;
+                while (old && (child = readdir(old)) != NULL) {
+                    char probe[PATH_MAX];
+                    struct stat ignored;
+                    if (strcmp(child->d_name, ".") == 0 || strcmp(child->d_name, "..") == 0) continue;
+                    if (snprintf(probe, sizeof(probe), "%s/%s", from, child->d_name) >= (int)sizeof(probe)) continue;
+                    if (lstat(probe, &ignored) != 0) abuf_printf(list, "D %s/%s\n", name, child->d_name);
+                }
+                if (old) closedir(old);
+            }
+            preview_list_changes(from, to, name, list);
+        } else {
+            abuf_printf(list, "%c %s\n", exists ? 'M' : 'A', name);
+        }
+    }
+    closedir(dir);
+}
+
+static int preview_run(const char* base, const char* cwd, const char* command,
+                       abuf_t* out, abuf_t* err, int* exit_code, char* dir, size_t dir_size) {
+    preview_meta_t meta, base_meta;
+    memset(&meta, 0, sizeof(meta));
+    char root[PATH_MAX];
+    
+    if (!realpath(cwd, meta.cwd)) {
+        abuf_printf(err, "%s: %s", cwd, strerror(errno));
+        return -1;
+    }
+    preview_find_tree(meta.cwd, meta.tree, sizeof(meta.tree));
+    if (strcmp(meta.tree, "/") == 0) {
+        abuf_puts(err, "cannot preview a command run from /");
+        return -1;
+    }
+    if (strpbrk(meta.tree, ",:\\")) {
+        abuf_printf(err, "%s: overlay paths may not contain ',', ':' or '\\'", meta.tree);
+        return -1;
+    }
+    if (strlen(meta.tree) >= sizeof(meta.lower)) {
+        abuf_printf(err, "%s: path too long", meta.tree);
+        return -1;
+    }
+    if (preview_pick_root(meta.tree, root, sizeof(root)) != 0) {
+        abuf_puts(err, "no directory to keep the preview in");
+        return -1;
+    }
+    preview_remove_stale(root);
+    
+    if (snprintf(dir, dir_size, "%s/p.XXXXXX", root) >= (int)dir_size || !mkdtemp(dir)) {
+        abuf_printf(err, "preview directory: %s", strerror(errno));
+        return -1;
+    }
+    char upper[PATH_MAX + 8], work[PATH_MAX + 8];
+    snprintf(upper, sizeof(upper), "%s/upper", dir);
+    snprintf(work, sizeof(work), "%s/work", dir);
+    if (mkdir(upper, 0755) != 0 || mkdir(work, 0700) != 0) {
+        abuf_printf(err, "preview directory: %s", strerror(errno));
+        remove_tree(dir);
+        return -1;
+    }
+    
+    // Stack on the base preview's layers when it covers the same tree
+    memcpy(meta.lower, meta.tree, strlen(meta.tree) + 1);
+    if (base && is_preview_dir(base) && preview_read_meta(base, &base_meta) == 0 &&
+        strcmp(base_meta.tree, meta.tree) == 0 && !strpbrk(base, ",:\\")) {
+        if (snprintf(meta.lower, sizeof(meta.lower), "%s/upper:%s", base, base_meta.lower) >= (int)sizeof(meta.lower)) {
+            abuf_puts(err, "too many stacked previews; confirm or discard the earlier ones first");
+            remove_tree(dir);
+            return -1;
+        }
+        snprintf(meta.base, sizeof(meta.base), "%s", base);
+    }
+    meta.started_ms = preview_now_ms();
+    meta.exit_code = -1;
+    if (preview_write_meta(dir, &meta, command) != 0) {
+        abuf_printf(err, "preview metadata: %s", strerror(errno));
+        remove_tree(dir);
+        return -1;
+    }
+    
+    int out_pipe[2], err_pipe[2], status_pipe[2];
+    if (pipe2(out_pipe, O_CLOEXEC) != 0 || pipe2(err_pipe, O_CLOEXEC) != 0 || pipe2(status_pipe, O_CLOEXEC) != 0) {
+        abuf_printf(err, "pipe: %s", strerror(errno));
+        remove_tree(dir);
+        return -1;
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(out_pipe[0]);
+        close(err_pipe[0]);
+        close(status_pipe[0]);
+        preview_child(&meta, dir, command, out_pipe[1], err_pipe[1], status_pipe[1]);
+    }
+    close(out_pipe[1]);
+    close(err_pipe[1]);
+    close(status_pipe[1]);
+    
+    // Setup takes milliseconds; a message instead of EOF means it failed
+    abuf_t setup_error;
+    int setup_ok = pid > 0 && abuf_init(&setup_error, out->arena, 256) == 0;
+    while (setup_ok) {
+        ssize_t bytes = abuf_read(&setup_error, status_pipe[0], 256);
+        if (bytes == 0) break;
+        if (bytes < 0 && errno != EINTR) setup_ok = 0;
+    }
+    close(status_pipe[0]);
+    int timed_out = 0;
+    if (setup_ok && setup_error.len == 0) {
+        timed_out = preview_collect(out_pipe[0], err_pipe[0], out, err) != 0;
+        if (timed_out) kill(pid, SIGKILL);
+    }
+    close(out_pipe[0]);
+    close(err_pipe[0]);
+    
+    int status = 0;
+    if (pid > 0) {
+        while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+        }
+    }
+    if (!setup_ok || setup_error.len > 0) {
+        abuf_clear(err);
+        abuf_printf(err, "preview sandbox unavailable (%s)", pid > 0 && setup_ok ? setup_error.data : strerror(errno));
+        remove_tree(dir);
+        return -1;
+    }
+    *exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    if (timed_out) {
+        abuf_printf(err, "%spreview stopped after %ds\n", err->len && err->data[err->len - 1] != '\n' ? "\n" : "",
+                    PREVIEW_TIMEOUT_MS / 1000);
+        *exit_code = 124;
+    }
+    meta.exit_code = *exit_code;
+    preview_write_meta(dir, &meta, command);
+    
+    // Left next to the layers for the backend and the frontend to show
+    abuf_t changes;
+    char changes_path[PATH_MAX + 16];
+    if (abuf_init(&changes, out->arena, READ_CHUNK) == 0) {
+        preview_list_changes(upper, meta.tree, "", &changes);
+        snprintf(changes_path, sizeof(changes_path), "%s/changes", dir);
+        FILE* file = fopen(changes_path, "w");
+        if (file) {
+            fwrite(changes.data, 1, changes.len, file);
+            fclose(file);
+        }
+    }
+    return 0;
+}
+
+// The preview and the ones it builds on, oldest first
+static int preview_chain(const char* dir, char (*chain)[PATH_MAX], preview_meta_t* metas) {
+    int count = 0;
+    char next[PATH_MAX];
+    snprintf(next, sizeof(next), "%s", dir);
+    while (next[0] && count < PREVIEW_MAX_CHAIN && is_preview_dir(next) && preview_read_meta(next, &metas[count]) == 0) {
+        snprintf(chain[count], PATH_MAX, "%s", next);
+        snprintf(next, sizeof(next), "%s", metas[count].base);
+        count++;
+    }
+    for (int i = 0; i < count / 2; i++) {
+        char swap[PATH_MAX];
+        preview_meta_t swap_meta = metas[i];
+        memcpy(swap, chain[i], PATH_MAX);
+        memcpy(chain[i], chain[count - 1 - i], PATH_MAX);
+        memcpy(chain[count - 1 - i], swap, PATH_MAX);
+        metas[i] = metas[count - 1 - i];
+        metas[count - 1 - i] = swap_meta;
+    }
+    return count;
+}
+
+// Paths the previews change that something else changed since they started
+static void preview_find_conflicts(const char* upper, const char* real, const char* rel,
+                                   long long since_ms, abuf_t* report, int* conflicts) {
+    DIR* dir = opendir(upper);
+    if (!dir) return;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        char from[PATH_MAX], to[PATH_MAX], name[PATH_MAX];
+        if (snprintf(from, sizeof(from), "%s/%s", upper, entry->d_name) >= (int)sizeof(from) ||
+            snprintf(to, sizeof(to), "%s/%s", real, entry->d_name) >= (int)sizeof(to) ||
+            snprintf(name, sizeof(name), "%s%s%s", rel, rel[0] ? "/" : "", entry->d_name) >= (int)sizeof(name)) {
+            continue;
+        }
+        struct stat st, target;
+        if (lstat(from, &st) != 0 || lstat(to, &target) != 0) continue;
+        if (S_ISDIR(st.st_mode) && S_ISDIR(target.st_mode)) {
+            preview_find_conflicts(from, to, name, since_ms, report, conflicts);
+            continue;
+        }
+        long long changed_ms = (long long)target.st_ctim.tv_sec * 1000 + target.st_ctim.tv_nsec / 1000000;
+        if (changed_ms >= since_ms) {
+            if (*conflicts < PREVIEW_MAX_CONFLICTS) abuf_printf(report, "  %s\n", name);
+            (*conflicts)++;
+        }
+    }
+    closedir(dir);
+}
+
+static int copy_file(const char* from, const char* to, mode_t mode) {
+    char temp[PATH_MAX + 16];
+    char buffer[64 * 1024];
+    snprintf(temp, sizeof(temp), "%s.awesh_preview", to);
+    int in = open(from, O_RDONLY);
+    int out = in >= 0 ? open(temp, O_WRONLY | O_CREAT | O_TRUNC, mode & 07777) : -1;
+    ssize_t bytes = 0;
+    while (out >= 0 && (bytes = read(in, buffer, sizeof(buffer))) > 0) {
+        if (write(out, buffer, (size_t)bytes) != bytes) {
+            bytes = -1;
+            break;
+        }
+    }
+    if (in >= 0) close(in);
+    if (out < 0 || close(out) != 0 || bytes < 0 || fchmodat(AT_FDCWD, temp, mode & 07777, 0) != 0 ||
+        rename(temp, to) != 0) {
+        int saved = errno;
+        unlink(temp);
+        errno = saved;
+        return -1;
+    }
+    return 0;
+}
+
+// Make the real tree match one upper layer; whiteouts delete, opaque
+// directories replace, files and symlinks are moved into place
+static void preview_apply(const char* upper, const char* real, int* applied, abuf_t* errors) {
+    DIR* dir = opendir(upper);
+    if (!dir) return;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        char from[PATH_MAX], to[PATH_MAX];
+        if (snprintf(from, sizeof(from), "%s/%s", upper, entry->d_name) >= (int)sizeof(from) ||
+            snprintf(to, sizeof(to), "%s/%s", real, entry->d_name) >= (int)sizeof(to)) {
+            continue;
+        }
+        struct stat st, target;
+        if (lstat(from, &st) != 0) continue;
+        int exists = lstat(to, &target) == 0;
+        
+        if (is_whiteout(&st)) {
+            if (exists) {
+                remove_tree(to);
+                (*applied)++;
+            }
+            continue;
+        }
+        if (S_ISDIR(st.st_mode)) {
+            if (exists && !S_ISDIR(target.st_mode)) {
+                remove_tree(to);
+                exists = 0;
+            }
+            if (!exists) {
+                if (mkdir(to, st.st_mode & 07777) != 0) {
+                    abuf_printf(errors, "  %s: %s\n", to, strerror(errno));
+                    continue;
+                }
+                (*applied)++;
+            } else {
+                if (is_opaque_dir(from)) {
+                    remove_tree(to);
+                    if (mkdir(to, st.st_mode & 07777) != 0) {
+                        abuf_printf(errors, "  %s: %s\n", to, strerror(errno));
+                        continue;
+                    }
+                    (*applied)++;
+                }
+                if ((target.st_mode & 07777) != (st.st_mode & 07777)) chmod(to, st.st_mode & 07777);
+            }
+            preview_apply(from, to, applied, errors);
+            continue;
+        }
+        if (exists && S_ISDIR(target.st_mode)) remove_tree(to);
+        
+        int result = 0;
+        if (S_ISREG(st.st_mode)) {
+            // Same filesystem: the upper file simply becomes the real one
+            result = rename(from, to);
+            if (result != 0 && errno == EXDEV) result = copy_file(from, to, st.st_mode);
+        } else if (S_ISLNK(st.st_mode)) {
+            char link_target[PATH_MAX], temp[PATH_MAX + 16];
+            ssize_t len = readlink(from, link_target, sizeof(link_target) - 1);
+            snprintf(temp, sizeof(temp), "%s.awesh_preview", to);
+            unlink(temp);
+            result = len < 0 ? -1 : 0;
+            if (result == 0) {
+                link_target[len] = '\0';
+                result = symlink(link_target, temp) == 0 && rename(temp, to) == 0 ? 0 : -1;
+            }
+        } else {
+            continue;                       // Devices, fifos and sockets are not carried over
+        }
+        if (result != 0) {
+            abuf_printf(errors, "  %s: %s\n", to, strerror(errno));
+        } else {
+            (*applied)++;
+        }
+    }
+    closedir(dir);
+}
+
+static int preview_commit(const char* dir, abuf_t* out, abuf_t* err) {
+    char (*chain)[PATH_MAX] = arena_alloc(out->arena, sizeof(*chain) * PREVIEW_MAX_CHAIN);
+    preview_meta_t* metas = arena_alloc(out->arena, sizeof(*metas) * PREVIEW_MAX_CHAIN);
+    if (!chain || !metas) return -1;
+    int count = preview_chain(dir, chain, metas);
+    if (count == 0) {
+        abuf_printf(err, "%s: no such preview", dir);
+        return 1;
+    }
+    
+    // A command that failed may have stopped halfway; its partial changes are not applied
+    for (int i = 0; i < count; i++) {
+        if (metas[i].exit_code != 0) {
+            if (metas[i].exit_code < 0) abuf_printf(err, "%s: the previewed command did not finish", chain[i]);
+            else abuf_printf(err, "%s: the previewed command exited %d", chain[i], metas[i].exit_code);
+            abuf_puts(err, "; nothing was applied\n");
+            return 1;
+        }
+    }
+    
+    char upper[PATH_MAX + 8];
+    int conflicts = 0;
+    abuf_t report;
+    if (abuf_init(&report, out->arena, 256) != 0) return -1;
+    for (int i = 0; i < count; i++) {
+        snprintf(upper, sizeof(upper), "%s/upper", chain[i]);
+        preview_find_conflicts(upper, metas[i].tree, "", metas[0].started_ms, &report, &conflicts);
+    }
+    if (conflicts > 0) {
+        abuf_printf(err, "%d path%s changed on disk after the preview ran; nothing was applied:\n%s",
+                    conflicts, conflicts == 1 ? "" : "s", report.data);
+        if (conflicts > PREVIEW_MAX_CONFLICTS) abuf_printf(err, "  ... and %d more\n", conflicts - PREVIEW_MAX_CONFLICTS);
+        return 1;
+    }
+    
+    int applied = 0;
+    for (int i = 0; i < count; i++) {
+        snprintf(upper, sizeof(upper), "%s/upper", chain[i]);
+        preview_apply(upper, metas[i].tree, &applied, err);
+    }
+    for (int i = 0; i < count; i++) {
+        remove_tree(chain[i]);
+    }
+    abuf_printf(out, "Applied %d change%s to %s", applied, applied == 1 ? "" : "s", metas[count - 1].tree);
+    return err->len > 0;
+}
+
+// Handle a PREVIEW* request; 0 if the message is an ordinary command
+static int handle_preview_request(const char* request, int client_fd, abuf_t* out, abuf_t* err) {
+    int exit_code = 0;
+    char ack[PATH_MAX + 16] = "OK";
+    
+    if (strncmp(request, "PREVIEW:", 8) == 0) {
+        const char* cwd = strchr(request + 8, '\n');
+        const char* command = cwd ? strchr(cwd + 1, '\n') : NULL;
+        if (!command) {
+            abuf_puts(err, "malformed preview request");
+            exit_code = -1;
+        } else {
+            char* base = arena_alloc(out->arena, (size_t)(cwd - request - 8) + 1);
+            char* dir_cwd = arena_alloc(out->arena, (size_t)(command - cwd));
+            char dir[PATH_MAX];
+            if (!base || !dir_cwd) return -1;
+            memcpy(base, request + 8, (size_t)(cwd - request - 8));
+            base[cwd - request - 8] = '\0';
+            memcpy(dir_cwd, cwd + 1, (size_t)(command - cwd - 1));
+            dir_cwd[command - cwd - 1] = '\0';
+            if (preview_run(strcmp(base, "-") == 0 ? NULL : base, dir_cwd, command + 1, out, err, &exit_code,
+                            dir, sizeof(dir)) == 0) {
+                snprintf(ack, sizeof(ack), "PREVIEW:%s", dir);
+            } else {
+                exit_code = -1;
+                snprintf(ack, sizeof(ack), "ERROR");
+            }
+        }
+    } else if (strncmp(request, "PREVIEW_COMMIT:", 15) == 0) {
+        exit_code = preview_commit(request + 15, out, err);
+    } else if (strncmp(request, "PREVIEW_DISCARD:", 16) == 0) {
+        preview_meta_t* metas = arena_alloc(out->arena, sizeof(*metas) * PREVIEW_MAX_CHAIN);
+        char (*chain)[PATH_MAX] = arena_alloc(out->arena, sizeof(*chain) * PREVIEW_MAX_CHAIN);
+        if (!chain || !metas) return -1;
+        int count = preview_chain(request + 16, chain, metas);
+        for (int i = 0; i < count; i++) {
+            remove_tree(chain[i]);
+        }
+    } else {
+        return 0;
+    }
+    
+    send_result(client_fd, ack, exit_code, out->data, err->data);
+    return 1;
+}
+
 // Send request to middleware
 int send_to_middleware(const char* request, char* response, size_t response_size) {
     // Connect to middleware socket
@@ -672,14 +1506,21 @@ void execute_and_send_to_frontend(const char* command) {
     FILE* pipe = popen(command, "r");
     if (pipe) {
         char buffer[1024];
-        char output[4096] = {0};
-        while (fgets(buffer, sizeof(buffer), pipe)) {
-            strncat(output, buffer, sizeof(output) - strlen(output) - 1);
+        abuf_t output;
+        if (abuf_init(&output, &request_arena, READ_CHUNK) != 0) {
+            pclose(pipe);
+            write_result_to_mmap(-1, "", "Out of memory");
+            return;
+        }
+        size_t bytes;
+        while ((bytes = fread(buffer, 1, sizeof(buffer), pipe)) > 0) {
+            abuf_append(&output, buffer, bytes);
         }
         int exit_code = pclose(pipe);
         
         // Send result to frontend via mmap
-        write_result_to_mmap(exit_code, output, "");
+        write_result_to_mmap(exit_code, output.data, "");
+        arena_reset(&request_arena);
     } else {
         write_result_to_mmap(-1, "", "Failed to execute command");
     }
@@ -696,37 +1537,80 @@ void send_error_to_frontend(const char* error) {
 }
 
 void handle_client_request(int client_fd) {
-    char cmd[MAX_CMD_LEN];
-    char stdout_buf[MAX_RESPONSE_LEN];
-    char stderr_buf[MAX_RESPONSE_LEN];
+    abuf_t cmd;
+    abuf_t stdout_buf;
+    abuf_t stderr_buf;
     int exit_code;
     
-    // Read command from client (frontend)
-    ssize_t bytes_received = recv(client_fd, cmd, sizeof(cmd) - 1, 0);
+    if (abuf_init(&cmd, &request_arena, READ_CHUNK) != 0 ||
+        abuf_init(&stdout_buf, &request_arena, READ_CHUNK) != 0 ||
+        abuf_init(&stderr_buf, &request_arena, 256) != 0) {
+        arena_reset(&request_arena);
+        return;
+    }
+    
+    // Read command from client (frontend); anything past the first read is
+    // already queued, so drain it without waiting
+    ssize_t bytes_received = abuf_recv(&cmd, client_fd, READ_CHUNK, 0);
     if (bytes_received <= 0) {
+        arena_reset(&request_arena);
         return;
     }
-    cmd[bytes_received] = '\0';
+    while (abuf_recv(&cmd, client_fd, READ_CHUNK, MSG_DONTWAIT) > 0) {
+    }
     
+    // Adopt the frontend's trace id so these spans join its timeline
+    uint64_t trace_id;
+    const char* command = trace_strip_prefix(cmd.data, &trace_id);
+    trace_set_current(trace_id);
+    reply_inline = strncmp(command, "INLINE:", 7) == 0;
+    if (reply_inline) command += 7;
+    trace_span_t request_span = trace_begin("sandbox_request");
+    flight_record(FLIGHT_IPC_RECV, "request", (int64_t)cmd.len, command);
+
+    // Previews run in their own namespaces, not in the persistent bash
+    trace_span_t preview_span = trace_begin("sandbox_preview");
+    int preview = handle_preview_request(command, client_fd, &stdout_buf, &stderr_buf);
+    if (preview != 0) {
+        trace_end(&preview_span, preview > 0 ? "ok" : "error");
+        trace_end(&request_span, preview > 0 ? "ok" : "error");
+        trace_set_current(0);
+        arena_reset(&request_arena);
+        return;
+    }
+
     // Execute command in sandbox for validation
-    if (execute_command_in_sandbox(cmd, stdout_buf, stderr_buf, &exit_code) == 0) {
-        // Write result to mmap file for frontend to read
-        write_result_to_mmap(exit_code, stdout_buf, stderr_buf);
-        
-        // Send simple acknowledgment to client
-        char ack[] = "OK";
-        send(client_fd, ack, strlen(ack), 0);
+    trace_span_t exec_span = trace_begin("sandbox_exec");
+    uint64_t exec_start = trace_now_ns();
+    int exec_result = execute_command_in_sandbox(command, &stdout_buf, &stderr_buf, &exit_code);
+    uint64_t exec_ns = trace_now_ns() - exec_start;
+    metric_observe_ms(sandbox_metrics.exec_seconds, exec_ns / 1e6);
+    flight_record(exec_result == 0 ? FLIGHT_TIMING : FLIGHT_ERROR, "exec", (int64_t)(exec_ns / 1000),
+                  exec_result == 0 ? "ok" : "failed");
+    metric_inc(exec_result == 0 ? sandbox_metrics.requests_ok : sandbox_metrics.requests_failed);
+    trace_end(&exec_span, command);
+    
+    if (exec_result == 0) {
+        // Result to the mmap file (or inline), then the acknowledgment
+        trace_span_t mmap_span = trace_begin("mmap_write");
+        send_result(client_fd, "OK", exit_code, stdout_buf.data, stderr_buf.data);
+        metric_add(sandbox_metrics.output_bytes, (int64_t)(stdout_buf.len + stderr_buf.len));
+        trace_end(&mmap_span, NULL);
     } else {
-        // Write error result to mmap file
-        write_result_to_mmap(-1, "", "Sandbox execution failed");
-        
-        // Send simple acknowledgment to client
-        char ack[] = "ERROR";
-        send(client_fd, ack, strlen(ack), 0);
+        send_result(client_fd, "ERROR", -1, "", "Sandbox execution failed");
     }
+    
+    trace_end(&request_span, exec_result == 0 ? "ok" : "error");
+    trace_set_current(0);
+    
+    // Everything this request allocated goes in one step
+    arena_reset(&request_arena);
 }
 
-int main() {
+int awesh_sandbox_main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    
     // Setup socket path
     const char* home = getenv("HOME");
     if (!home) {
@@ -735,6 +1619,13 @@ int main() {
     }
     
     snprintf(socket_path, sizeof(socket_path), "%s/.awesh_sandbox.sock", home);
+    arena_init(&request_arena, 0);
+    trace_init("awesh_sandbox");
+    trace_startup_mark("main");
+    trace_install_export_signal();
+    flight_init("awesh_sandbox");
+    flight_install_crash_handler();
+    init_sandbox_metrics();
     
     // Remove existing socket
     unlink(socket_path);
@@ -764,6 +1655,7 @@ int main() {
         close(server_fd);
         return 1;
     }
+    trace_startup_mark("listening");
     
     // Setup mmap file for output communication
     if (setup_mmap_file() != 0) {
@@ -771,6 +1663,7 @@ int main() {
         close(server_fd);
         return 1;
     }
+    trace_startup_mark("mmap_ready");
     
     // Spawn bash sandbox
     if (spawn_bash_sandbox() != 0) {
@@ -779,17 +1672,52 @@ int main() {
         close(server_fd);
         return 1;
     }
+    trace_startup_mark("bash_spawned");
     
-    // Main server loop
+    // Main server loop: command requests, plus metrics scrapes between them
+    int metrics_listen_fd = metrics_listen();
+    metrics_write_textfile(1);
     while (1) {
+        fd_set readfds;
+        FD_ZERO(&readfds);
+        FD_SET(server_fd, &readfds);
+        int max_fd = server_fd;
+        if (metrics_listen_fd >= 0) {
+            FD_SET(metrics_listen_fd, &readfds);
+            if (metrics_listen_fd > max_fd) max_fd = metrics_listen_fd;
+        }
+        
+        if (select(max_fd + 1, &readfds, NULL, NULL, NULL) < 0) {
+            if (errno == EINTR) trace_export_if_requested();
+            continue;
+        }
+        if (metrics_listen_fd >= 0 && FD_ISSET(metrics_listen_fd, &readfds)) {
+            metrics_serve();
+        }
+        if (!FD_ISSET(server_fd, &readfds)) {
+            continue;
+        }
+        
         int client_fd = accept(server_fd, NULL, NULL);
         if (client_fd < 0) {
+            // SIGUSR2 interrupts accept() to ask for a trace export
+            if (errno == EINTR && trace_export_if_requested()) {
+                continue;
+            }
             perror("Failed to accept connection");
             continue;
         }
         
+        // Hold export requests until the command's select()/read() loop is done
+        sigset_t export_mask, saved_mask;
+        sigemptyset(&export_mask);
+        sigaddset(&export_mask, SIGUSR2);
+        sigprocmask(SIG_BLOCK, &export_mask, &saved_mask);
         handle_client_request(client_fd);
         close(client_fd);
+        sigprocmask(SIG_SETMASK, &saved_mask, NULL);
+        trace_export_if_requested();
+        metrics_write_textfile(0);
     }
     
     // Cleanup
@@ -801,3 +1729,9 @@ int main() {
     
     return 0;
 }
+
+#ifndef AWESH_MULTICALL
+int main(int argc, char** argv) {
+    return awesh_sandbox_main(argc, argv);
+}
+#endif
@@ -0,0 +1,269 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+#include "awesh_trace.h"
+#include "awesh_flight.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+typedef struct {
+    uint64_t seq;           // Slot number + 1 once complete; 0 while being written
+    const char* name;
+    uint64_t trace_id;
+    uint64_t start_ns;
+    uint64_t end_ns;
+    char detail[TRACE_DETAIL_LEN];
+} trace_event_t;
+
+static trace_event_t ring[TRACE_RING_SIZE];
+static uint64_t ring_next = 0;
+static uint64_t current_trace_id = 0;
+static const char* trace_process_name = "awesh";
+static int tracing_enabled = 1;
+static volatile sig_atomic_t export_requested = 0;
+
+// Also called at the top of each multi-call role: a forked helper must not
+// export the spans it inherited from the frontend
+void trace_init(const char* process_name) {
+    const char* enabled = getenv("TRACING");
+    tracing_enabled = !(enabled && strcmp(enabled, "0") == 0);
+    trace_process_name = process_name;
+    memset(ring, 0, sizeof(ring));
+    ring_next = 0;
+    current_trace_id = 0;
+}
+
+int trace_enabled(void) {
+    return tracing_enabled;
+}
+
+uint64_t trace_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Unique enough across processes and restarts: time, pid and a counter mixed
+uint64_t trace_new_id(void) {
+    static uint64_t counter = 0;
+    uint64_t x = trace_now_ns() ^ ((uint64_t)getpid() << 40) ^ (++counter * 0x9E3779B97F4A7C15ull);
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    return x ? x : 1;
+}
+
+void trace_set_current(uint64_t trace_id) {
+    current_trace_id = trace_id;
+}
+
+uint64_t trace_current(void) {
+    return current_trace_id;
+}
+
+trace_span_t trace_begin(const char* name) {
+    trace_span_t span = {name, current_trace_id, tracing_enabled ? trace_now_ns() : 0};
+    return span;
+}
+
+void trace_end(const trace_span_t* span, const char* detail) {
+    if (!tracing_enabled) return;
+    trace_record(span->name, span->trace_id, span->start_ns, trace_now_ns(), detail);
+}
+
+// Lock-free: claim a slot with one atomic add, fill it, then publish its seq
+void trace_record(const char* name, uint64_t trace_id, uint64_t start_ns, uint64_t end_ns, const char* detail) {
+    if (!tracing_enabled) return;
+
+    uint64_t slot = __atomic_fetch_add(&ring_next, 1, __ATOMIC_RELAXED);
+    trace_event_t* event = &ring[slot % TRACE_RING_SIZE];
+    __atomic_store_n(&event->seq, 0, __ATOMIC_RELAXED);
+    event->name = name;
+    event->trace_id = trace_id;
+    event->start_ns = start_ns;
+    event->end_ns = end_ns;
+    if (detail) {
+        strncpy(event->detail, detail, TRACE_DETAIL_LEN - 1);
+        event->detail[TRACE_DETAIL_LEN - 1] = '\0';
+    } else {
+        event->detail[0] = '\0';
+    }
+    __atomic_store_n(&event->seq, slot + 1, __ATOMIC_RELEASE);
+}
+
+// "TRACE:<16 hex>:rest" -> rest, with *trace_id set; anything else is returned as is
+const char* trace_strip_prefix(const char* msg, uint64_t* trace_id) {
+    if (trace_id) *trace_id = 0;
+    if (strncmp(msg, TRACE_PREFIX, 6) != 0 || strlen(msg) < TRACE_PREFIX_LEN || msg[TRACE_PREFIX_LEN - 1] != ':') {
+        return msg;
+    }
+
+    uint64_t id = 0;
+    for (int i = 6; i < TRACE_PREFIX_LEN - 1; i++) {
+        char c = msg[i];
+        int digit;
+        if (c >= '0' && c <= '9') digit = c - '0';
+        else if (c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+        else return msg;
+        id = (id << 4) | (uint64_t)digit;
+    }
+    if (trace_id) *trace_id = id;
+    return msg + TRACE_PREFIX_LEN;
+}
+
+// send() with the current trace id prefixed, in one syscall so the
+// receiver's single recv() sees the prefix and the message together.
+// Every IPC message goes through here, so this is also where the flight
+// recorder sees them
+ssize_t trace_send(int fd, const void* msg, size_t len, int flags) {
+    char detail[FLIGHT_DETAIL_LEN];
+    size_t detail_len = len < sizeof(detail) - 1 ? len : sizeof(detail) - 1;
+    memcpy(detail, msg, detail_len);
+    detail[detail_len] = '\0';
+    flight_record(FLIGHT_IPC_SEND, "ipc.send", (int64_t)len, detail);
+    
+    if (!tracing_enabled || current_trace_id == 0) {
+        return send(fd, msg, len, flags);
+    }
+
+    char prefix[TRACE_PREFIX_LEN + 1];
+    snprintf(prefix, sizeof(prefix), TRACE_PREFIX "%016llx:", (unsigned long long)current_trace_id);
+
+    struct iovec iov[2] = {
+        {prefix, TRACE_PREFIX_LEN},
+        {(void*)msg, len},
+    };
+    struct msghdr header;
+    memset(&header, 0, sizeof(header));
+    header.msg_iov = iov;
+    header.msg_iovlen = 2;
+
+    ssize_t sent = sendmsg(fd, &header, flags);
+    if (sent < 0) return sent;
+    return sent >= TRACE_PREFIX_LEN ? sent - TRACE_PREFIX_LEN : 0;
+}
+
+int trace_dir(char* path, size_t size) {
+    const char* home = getenv("HOME");
+    if (!home) return -1;
+    snprintf(path, size, "%s/" TRACE_DIR_NAME, home);
+    if (mkdir(path, 0700) != 0 && access(path, W_OK) != 0) return -1;
+    return 0;
+}
+
+static void write_json_string(FILE* out, const char* s) {
+    fputc('"', out);
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') {
+            fputc('\\', out);
+            fputc(c, out);
+        } else if (c < 0x20) {
+            fprintf(out, "\\u%04x", c);
+        } else {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+// One Chrome Trace Event per line: a process_name record, then complete ("X")
+// events with microsecond timestamps
+int trace_export(const char* path) {
+    FILE* out = fopen(path, "w");
+    if (!out) return -1;
+
+    pid_t pid = getpid();
+    fprintf(out, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":", pid, pid);
+    write_json_string(out, trace_process_name);
+    fprintf(out, "}}\n");
+
+    uint64_t end = __atomic_load_n(&ring_next, __ATOMIC_ACQUIRE);
+    uint64_t begin = end > TRACE_RING_SIZE ? end - TRACE_RING_SIZE : 0;
+    for (uint64_t slot = begin; slot < end; slot++) {
+        trace_event_t* event = &ring[slot % TRACE_RING_SIZE];
+        if (__atomic_load_n(&event->seq, __ATOMIC_ACQUIRE) != slot + 1) continue;
+
+        fprintf(out, "{\"name\":");
+        write_json_string(out, event->name);
+        fprintf(out, ",\"cat\":");
+        write_json_string(out, trace_process_name);
+        fprintf(out, ",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d,"
+                     "\"args\":{\"trace_id\":\"%016llx\"",
+                event->start_ns / 1000.0, (event->end_ns - event->start_ns) / 1000.0, pid, pid,
+                (unsigned long long)event->trace_id);
+        if (event->detail[0]) {
+            fprintf(out, ",\"detail\":");
+            write_json_string(out, event->detail);
+        }
+        fprintf(out, "}}\n");
+    }
+
+    return fclose(out) == 0 ? 0 : -1;
+}
+
+static void handle_export_signal(int sig) {
+    (void)sig;
+    export_requested = 1;
+}
+
+// No SA_RESTART: a blocking accept()/select() returns EINTR so the main
+// loop gets to export promptly
+void trace_install_export_signal(void) {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_export_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGUSR2, &sa, NULL);
+}
+
+// Write <dir>/<process>.<pid>.jsonl if SIGUSR2 arrived; returns 1 if it did.
+// Written under a temporary name and renamed, so whoever is collecting the
+// files never sees a partial one
+int trace_export_if_requested(void) {
+    if (!export_requested) return 0;
+    export_requested = 0;
+
+    char dir[512];
+    char path[600];
+    char tmp_path[610];
+    if (trace_dir(dir, sizeof(dir)) != 0) return 1;
+    snprintf(path, sizeof(path), "%s/%s.%d.jsonl", dir, trace_process_name, (int)getpid());
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    if (trace_export(tmp_path) == 0) {
+        rename(tmp_path, path);
+    } else {
+        unlink(tmp_path);
+    }
+    return 1;
+}
+
+// One write() per mark on an O_APPEND file, so lines from concurrently
+// starting processes never interleave. Costs nothing when not profiling
+void trace_startup_mark_at(const char* phase, uint64_t ns) {
+    const char* path = getenv(STARTUP_PROFILE_ENV);
+    if (!path || !*path) return;
+
+    char line[160];
+    int len = snprintf(line, sizeof(line), "%llu %s %d %s\n",
+                       (unsigned long long)ns, trace_process_name, (int)getpid(), phase);
+    if (len <= 0 || (size_t)len >= sizeof(line)) return;
+
+    int fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) return;
+    ssize_t written = write(fd, line, (size_t)len);
+    (void)written;
+    close(fd);
+}
+
+void trace_startup_mark(const char* phase) {
+    trace_startup_mark_at(phase, trace_now_ns());
+}
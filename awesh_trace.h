@@ -0,0 +1,53 @@
+#ifndef AWESH_TRACE_H
+#define AWESH_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// Cross-process tracing. The frontend mints a trace id per input line and
+// every IPC message carries it as a "TRACE:<16 hex>:" prefix. Each process
+// records spans into its own lock-free ring and writes them out as Chrome
+// Trace Event JSON lines on request (SIGUSR2, or awet in the frontend).
+// Everything is timestamped with CLOCK_MONOTONIC, so the per-process files
+// merge into a single timeline. TRACING=0 disables recording and prefixes.
+#define TRACE_PREFIX "TRACE:"
+#define TRACE_PREFIX_LEN 23       // "TRACE:" + 16 hex digits + ':'
+#define TRACE_RING_SIZE 2048      // Spans kept per process; oldest are overwritten
+#define TRACE_DETAIL_LEN 48
+#define TRACE_DIR_NAME ".awesh_trace"
+
+// Startup profiling (awesh --profile-startup): while AWESH_PROFILE_STARTUP
+// names a file, every process appends "<monotonic ns> <process> <pid> <phase>"
+// lines to it as it reaches each startup phase
+#define STARTUP_PROFILE_ENV "AWESH_PROFILE_STARTUP"
+
+typedef struct {
+    const char* name;       // String literal - stored by pointer
+    uint64_t trace_id;
+    uint64_t start_ns;
+} trace_span_t;
+
+void trace_init(const char* process_name);
+int trace_enabled(void);
+uint64_t trace_now_ns(void);
+uint64_t trace_new_id(void);
+void trace_set_current(uint64_t trace_id);
+uint64_t trace_current(void);
+
+trace_span_t trace_begin(const char* name);
+void trace_end(const trace_span_t* span, const char* detail);
+void trace_record(const char* name, uint64_t trace_id, uint64_t start_ns, uint64_t end_ns, const char* detail);
+
+const char* trace_strip_prefix(const char* msg, uint64_t* trace_id);
+ssize_t trace_send(int fd, const void* msg, size_t len, int flags);
+
+int trace_dir(char* path, size_t size);
+int trace_export(const char* path);
+void trace_install_export_signal(void);
+int trace_export_if_requested(void);
+
+void trace_startup_mark(const char* phase);
+void trace_startup_mark_at(const char* phase, uint64_t ns);
+
+#endif
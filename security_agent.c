@@ -13,6 +13,11 @@
 #include <regex.h>
 #include <errno.h>
 
+#include "awesh_roles.h"
+#include "awesh_trace.h"
+#include "awesh_metrics.h"
+#include "awesh_flight.h"
+
 // Transparent middleware proxy - intercepts ALL frontend-backend communication
 static int running = 1;
 static int verbose_level = 0;
@@ -20,6 +25,57 @@ static int frontend_socket_fd = -1;  // Frontend connects here
 static int backend_socket_fd = -1;   // We connect to backend here
 static char backend_socket_path[512];
 
+static struct {
+    metric_t* allowed;
+    metric_t* blocked;
+    metric_t* validate_seconds;
+    metric_t* bytes_to_backend;
+    metric_t* bytes_to_frontend;
+    metric_t* backend_connect_failures;
+    metric_t* connections;
+} security_metrics;
+
+static void init_security_metrics(void) {
+    metrics_init("awesh_sec");
+    security_metrics.allowed = metrics_counter("awesh_security_checks_total", "result=\"allowed\"",
+                                               "Frontend messages checked by the security agent");
+    security_metrics.blocked = metrics_counter("awesh_security_checks_total", "result=\"blocked\"",
+                                               "Frontend messages checked by the security agent");
+    security_metrics.validate_seconds = metrics_histogram("awesh_security_validate_seconds", NULL,
+                                                          "Time to match one message against the security patterns");
+    security_metrics.bytes_to_backend = metrics_counter("awesh_security_proxied_bytes_total", "direction=\"to_backend\"",
+                                                        "Bytes forwarded by the proxy");
+    security_metrics.bytes_to_frontend = metrics_counter("awesh_security_proxied_bytes_total", "direction=\"to_frontend\"",
+                                                         "Bytes forwarded by the proxy");
+    security_metrics.backend_connect_failures = metrics_counter("awesh_security_backend_connect_failures_total", NULL,
+                                                                "Frontend connections dropped because the backend was unreachable");
+    security_metrics.connections = metrics_gauge("awesh_security_connections", NULL,
+                                                 "Frontend connections currently being proxied");
+}
+
+// Block in select() on fd and the metrics socket, answering scrapes meanwhile.
+// Returns 1 when fd is readable, 0 on timeout or interruption
+static int wait_readable_serving_metrics(int fd) {
+    int metrics_listen_fd = metrics_fd();
+    fd_set readfds;
+    FD_ZERO(&readfds);
+    FD_SET(fd, &readfds);
+    int max_fd = fd;
+    if (metrics_listen_fd >= 0) {
+        FD_SET(metrics_listen_fd, &readfds);
+        if (metrics_listen_fd > max_fd) max_fd = metrics_listen_fd;
+    }
+    
+    if (select(max_fd + 1, &readfds, NULL, NULL, NULL) < 0) {
+        if (errno == EINTR) trace_export_if_requested();
+        return 0;
+    }
+    if (metrics_listen_fd >= 0 && FD_ISSET(metrics_listen_fd, &readfds)) {
+        metrics_serve();
+    }
+    return FD_ISSET(fd, &readfds) ? 1 : 0;
+}
+
 // Read configuration from ~/.aweshrc and set environment variables
 int read_config_and_set_env(void) {
     const char* home = getenv("HOME");
@@ -196,7 +252,7 @@ int setup_frontend_socket(void) {
     return 0;
 }
 
-void cleanup_and_exit(int sig __attribute__((unused))) {
+static void cleanup_and_exit(int sig __attribute__((unused))) {
     running = 0;
     
     if (frontend_socket_fd >= 0) {
@@ -214,10 +270,19 @@ void cleanup_and_exit(int sig __attribute__((unused))) {
     exit(0);
 }
 
-int main() {
+int security_agent_main(int argc, char** argv) {
+    (void)argc;
+    (void)argv;
+    
     // Setup signal handlers
     signal(SIGINT, cleanup_and_exit);
     signal(SIGTERM, cleanup_and_exit);
+    trace_init("awesh_sec");
+    trace_startup_mark("main");
+    trace_install_export_signal();
+    flight_init("awesh_sec");
+    flight_install_crash_handler();
+    init_security_metrics();
     
     // Load configuration and set environment variables
     read_config_and_set_env();
@@ -228,6 +293,7 @@ int main() {
     
     // Initialize security patterns
     init_security_patterns();
+    trace_startup_mark("patterns_compiled");
     
     // Setup frontend socket (frontend connects here)
     if (setup_frontend_socket() != 0) {
@@ -238,6 +304,9 @@ int main() {
     if (verbose_level >= 2) {
         fprintf(stderr, "SecurityAgent: Frontend socket ready\n");
     }
+    trace_startup_mark("listening");
+    metrics_listen();
+    metrics_write_textfile(1);
     
     // Main proxy loop
     while (running) {
@@ -245,9 +314,15 @@ int main() {
         struct sockaddr_un client_addr;
         socklen_t client_len = sizeof(client_addr);
         
+        if (!wait_readable_serving_metrics(frontend_socket_fd)) {
+            continue;
+        }
         int client_fd = accept(frontend_socket_fd, (struct sockaddr*)&client_addr, &client_len);
         if (client_fd < 0) {
-            if (errno == EINTR) continue;
+            if (errno == EINTR) {
+                trace_export_if_requested();
+                continue;
+            }
             perror("accept");
             continue;
         }
@@ -261,6 +336,8 @@ int main() {
             if (verbose_level >= 1) {
                 fprintf(stderr, "SecurityAgent: Failed to connect to backend\n");
             }
+            metric_inc(security_metrics.backend_connect_failures);
+            flight_record(FLIGHT_ERROR, "backend.connect_failed", errno, NULL);
             close(client_fd);
             continue;
         }
@@ -268,6 +345,7 @@ int main() {
         if (verbose_level >= 2) {
             fprintf(stderr, "SecurityAgent: Connected to backend\n");
         }
+        metric_set(security_metrics.connections, 1);
         
         // Proxy communication between frontend and backend
         while (running) {
@@ -278,6 +356,11 @@ int main() {
             FD_ZERO(&readfds);
             FD_SET(client_fd, &readfds);
             FD_SET(backend_socket_fd, &readfds);
+            int metrics_listen_fd = metrics_fd();
+            if (metrics_listen_fd >= 0) {
+                FD_SET(metrics_listen_fd, &readfds);
+                if (metrics_listen_fd > max_fd) max_fd = metrics_listen_fd;
+            }
             
             timeout.tv_sec = 1;
             timeout.tv_usec = 0;
@@ -285,13 +368,21 @@ int main() {
             int result = select(max_fd + 1, &readfds, NULL, NULL, &timeout);
             
             if (result < 0) {
-                if (errno == EINTR) continue;
+                if (errno == EINTR) {
+                    trace_export_if_requested();
+                    continue;
+                }
                 perror("select");
                 break;
             }
             
+            metrics_write_textfile(0);  // Rate limited
             if (result == 0) continue; // Timeout
             
+            if (metrics_listen_fd >= 0 && FD_ISSET(metrics_listen_fd, &readfds)) {
+                metrics_serve();
+            }
+            
             // Data from frontend to backend
             if (FD_ISSET(client_fd, &readfds)) {
                 char buffer[4096];
@@ -309,9 +400,23 @@ int main() {
                 fprintf(stderr, "🔒✓\n");
                 fflush(stderr);
                 
-                // Validate command before forwarding to backend
-                if (validate_command(buffer)) {
+                // Validate command before forwarding to backend. The trace
+                // prefix is not part of the command, but the backend needs it,
+                // so the original buffer is what gets forwarded
+                uint64_t trace_id;
+                const char* command = trace_strip_prefix(buffer, &trace_id);
+                trace_set_current(trace_id);
+                flight_record(FLIGHT_IPC_RECV, "frontend.recv", bytes, command);
+                trace_span_t validate_span = trace_begin("security_validate");
+                uint64_t validate_start = trace_now_ns();
+                int allowed = validate_command(command);
+                metric_observe_ms(security_metrics.validate_seconds, (trace_now_ns() - validate_start) / 1e6);
+                metric_inc(allowed ? security_metrics.allowed : security_metrics.blocked);
+                trace_end(&validate_span, allowed ? "allowed" : "blocked");
+                
+                if (allowed) {
                     // Forward to backend
+                    metric_add(security_metrics.bytes_to_backend, bytes);
                     if (send(backend_socket_fd, buffer, bytes, 0) < 0) {
                         if (verbose_level >= 1) {
                             fprintf(stderr, "SecurityAgent: Failed to forward to backend\n");
@@ -320,6 +425,7 @@ int main() {
                     }
                 } else {
                     // Block command - send error response to frontend
+                    flight_record(FLIGHT_ERROR, "blocked", 0, command);
                     const char* error_msg = "SECURITY_BLOCKED: Command blocked by security agent\n";
                     send(client_fd, error_msg, strlen(error_msg), 0);
                 }
@@ -339,6 +445,8 @@ int main() {
                 buffer[bytes] = '\0';
                 
                 // Forward response to frontend (no validation needed for responses)
+                flight_record(FLIGHT_IPC_RECV, "backend.recv", bytes, buffer);
+                metric_add(security_metrics.bytes_to_frontend, bytes);
                 if (send(client_fd, buffer, bytes, 0) < 0) {
                     if (verbose_level >= 1) {
                         fprintf(stderr, "SecurityAgent: Failed to forward to frontend\n");
@@ -350,6 +458,8 @@ int main() {
         
         // Cleanup connection
         close(client_fd);
+        metric_set(security_metrics.connections, 0);
+        metrics_write_textfile(1);
         if (backend_socket_fd >= 0) {
             close(backend_socket_fd);
             backend_socket_fd = -1;
@@ -362,4 +472,10 @@ int main() {
     
     cleanup_and_exit(0);
     return 0;
-}
\ No newline at end of file
+}
+
+#ifndef AWESH_MULTICALL
+int main(int argc, char** argv) {
+    return security_agent_main(argc, argv);
+}
+#endif
@@ -102,19 +102,23 @@ def deploy():
         install_dir = Path.home() / ".local" / "bin"
         install_dir.mkdir(parents=True, exist_ok=True)
         
-        # Copy binaries
-        binaries = ['awesh', 'awesh_sec', 'awesh_sandbox']
-        for binary in binaries:
-            src = Path(binary)
-            dst = install_dir / binary
-            if src.exists():
-                import shutil
-                shutil.copy2(src, dst)
-                dst.chmod(0o755)
-                log(f"✅ Deployed {binary}")
-            else:
-                log(f"❌ {binary} not found")
-                return False
+        # Copy the multi-call binary; the helper roles are symlinks to it
+        src = Path('awesh')
+        dst = install_dir / 'awesh'
+        if not src.exists():
+            log("❌ awesh not found")
+            return False
+        import shutil
+        shutil.copy2(src, dst)
+        dst.chmod(0o755)
+        log("✅ Deployed awesh")
+        
+        for role in ['awesh_sec', 'awesh_sandbox']:
+            link = install_dir / role
+            if link.exists() or link.is_symlink():
+                link.unlink()
+            link.symlink_to('awesh')
+            log(f"✅ Linked {role} -> awesh")
         
         log("✅ Deployment complete")
         return True
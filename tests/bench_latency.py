@@ -0,0 +1,449 @@
+#!/usr/bin/env python3
+"""
+End-to-end latency benchmark for awesh
+
+Drives the real binary through a pseudo-terminal with scripted sessions
+(shell commands, AI queries, a bracketed paste, Ctrl+C) and reports
+per-scenario latency distributions plus CPU and RSS per process as JSON.
+
+Backends (--backend):
+    mock  tests/mock_backend.py answers the socket protocol directly, so the
+          numbers cover the frontend and IPC path only (default)
+    real  the Python backend with AI_PROVIDER=mock (awesh_backend/mock_llm.py),
+          covering ai_client, the response agent and the server as well
+
+Runs offline: HOME is a throwaway directory, so the user's ~/.aweshrc,
+sockets and history are never touched.
+
+Usage:
+    python3 tests/bench_latency.py                       # all scenarios
+    python3 tests/bench_latency.py --iterations 50 --json out.json
+    python3 tests/bench_latency.py --baseline base.json  # fail on regression
+    python3 tests/bench_latency.py --backend real --ai-ttft-ms 200
+"""
+
+import argparse
+import fcntl
+import json
+import os
+import pty
+import re
+import select
+import shutil
+import signal
+import struct
+import sys
+import tempfile
+import termios
+import time
+from pathlib import Path
+
+PROJECT_ROOT = Path(__file__).parent.parent
+BRACKETED_PASTE_ON = b"\x1b[?2004h"   # readline emits this when it starts reading a line
+BRACKETED_PASTE_OFF = b"\x1b[?2004l"
+CLK_TCK = os.sysconf("SC_CLK_TCK")
+
+sys.path.insert(0, str(Path(__file__).parent))
+from mock_backend import MOCK_REPLY  # noqa: E402
+
+BENCH_CONFIG = """VERBOSE=0
+PACKAGE_INDEX=0
+"""
+
+# name -> description; each runs as LatencyBench.scenario_<name>
+SCENARIOS = {
+    "shell_echo": "simple shell command: echo",
+    "shell_pipeline": "shell pipeline: ls | wc",
+    "ai_query": "natural language query answered by the mock backend",
+    "paste": "1 KB bracketed paste, then Enter",
+    "ctrl_c": "Ctrl+C while a command runs",
+}
+
+
+def prompt_ready(buf):
+    """readline is waiting for input: paste mode switched on and the prompt drawn"""
+    start = buf.rfind(BRACKETED_PASTE_ON)
+    return start >= 0 and buf.rfind(BRACKETED_PASTE_OFF) < start and buf.endswith(b"> ")
+
+
+def now_ms():
+    return time.perf_counter_ns() / 1e6
+
+
+def summarize(samples):
+    """Latency distribution for a list of millisecond samples"""
+    if not samples:
+        return None
+    ordered = sorted(samples)
+
+    def pct(p):
+        index = min(len(ordered) - 1, int(round(p / 100.0 * (len(ordered) - 1))))
+        return round(ordered[index], 3)
+
+    return {
+        "count": len(ordered),
+        "min": round(ordered[0], 3),
+        "p50": pct(50),
+        "p90": pct(90),
+        "p99": pct(99),
+        "max": round(ordered[-1], 3),
+        "mean": round(sum(ordered) / len(ordered), 3),
+    }
+
+
+def process_tree(root_pid):
+    """Snapshot of root_pid and its descendants: pid -> {comm, cpu_ms, rss_kb, hwm_kb}"""
+    parents = {}
+    for entry in os.listdir("/proc"):
+        if not entry.isdigit():
+            continue
+        try:
+            with open(f"/proc/{entry}/stat") as f:
+                stat = f.read()
+        except OSError:
+            continue
+        # comm may contain spaces; fields after it are fixed
+        fields = stat[stat.rindex(")") + 2:].split()
+        parents[int(entry)] = (int(fields[1]), stat[stat.index("(") + 1:stat.rindex(")")], fields)
+
+    tree = {}
+    wanted = {root_pid}
+    changed = True
+    while changed:
+        changed = False
+        for pid, (ppid, _, _) in parents.items():
+            if ppid in wanted and pid not in wanted:
+                wanted.add(pid)
+                changed = True
+
+    for pid in wanted:
+        if pid not in parents:
+            continue
+        _, comm, fields = parents[pid]
+        # schedstat has nanosecond run time; stat's utime+stime is in clock ticks
+        try:
+            with open(f"/proc/{pid}/schedstat") as f:
+                cpu_ms = int(f.read().split()[0]) / 1e6
+        except (OSError, ValueError, IndexError):
+            cpu_ms = (int(fields[11]) + int(fields[12])) * 1000.0 / CLK_TCK
+        rss_kb = hwm_kb = 0
+        try:
+            with open(f"/proc/{pid}/status") as f:
+                for line in f:
+                    if line.startswith("VmRSS:"):
+                        rss_kb = int(line.split()[1])
+                    elif line.startswith("VmHWM:"):
+                        hwm_kb = int(line.split()[1])
+        except OSError:
+            continue
+        tree[pid] = {
+            "comm": comm,
+            "cpu_ms": cpu_ms,
+            "rss_kb": rss_kb,
+            "hwm_kb": hwm_kb,
+        }
+    return tree
+
+
+def cpu_delta_by_comm(before, after):
+    """CPU spent between two snapshots, summed per process name"""
+    delta = {}
+    for pid, proc in after.items():
+        spent = proc["cpu_ms"] - before.get(pid, {"cpu_ms": 0.0})["cpu_ms"]
+        delta[proc["comm"]] = round(delta.get(proc["comm"], 0.0) + spent, 3)
+    return delta
+
+
+class PtySession:
+    """awesh running on a pseudo-terminal"""
+
+    def __init__(self, binary, home, workdir, pythonpath, cols=120, rows=40):
+        env = {
+            "HOME": str(home),
+            "PATH": os.environ.get("PATH", "/usr/bin:/bin"),
+            "TERM": "xterm-256color",
+            "LANG": os.environ.get("LANG", "C.UTF-8"),
+            "PYTHONPATH": pythonpath,
+        }
+        self.start_ms = now_ms()
+        self.pid, self.fd = pty.fork()
+        if self.pid == 0:
+            os.chdir(workdir)
+            os.execve(binary, [binary], env)
+        fcntl.ioctl(self.fd, termios.TIOCSWINSZ, struct.pack("HHHH", rows, cols, 0, 0))
+        self.buffer = b""
+
+    def send(self, data):
+        os.write(self.fd, data)
+        return now_ms()
+
+    def read_until(self, predicate, timeout=10.0):
+        """Read until predicate(buffer) holds. Returns (time first byte arrived, time matched)"""
+        self.buffer = b""
+        first_byte = None
+        deadline = time.monotonic() + timeout
+        while not predicate(self.buffer):
+            remaining = deadline - time.monotonic()
+            if remaining <= 0:
+                raise TimeoutError(f"timed out; last output: {self.buffer[-200:]!r}")
+            ready, _, _ = select.select([self.fd], [], [], remaining)
+            if not ready:
+                continue
+            try:
+                data = os.read(self.fd, 65536)
+            except OSError:
+                raise TimeoutError("awesh exited")
+            if not data:
+                raise TimeoutError("awesh exited")
+            if first_byte is None:
+                first_byte = now_ms()
+            self.buffer += data
+        return first_byte, now_ms()
+
+    def wait_prompt(self, timeout=10.0):
+        return self.read_until(prompt_ready, timeout)
+
+    def type_text(self, text, echo_samples):
+        """Type one key at a time, timing each keystroke until it is echoed"""
+        for ch in text.encode():
+            key = bytes([ch])
+            sent = self.send(key)
+            _, echoed = self.read_until(lambda buf, key=key: key in buf, timeout=2.0)
+            echo_samples.append(echoed - sent)
+
+    def press_enter(self, expect, timeout=30.0):
+        """Enter -> (ms until `expect` shows up in the command's output, ms to next prompt)
+
+        Output starts after readline switches paste mode off, so the redrawn
+        command line is never mistaken for output."""
+        sent = self.send(b"\r")
+        first_output = None
+        output = b""
+        deadline = time.monotonic() + timeout
+        while True:
+            remaining = deadline - time.monotonic()
+            if remaining <= 0:
+                raise TimeoutError(f"no prompt after Enter; last output: {output[-200:]!r}")
+            ready, _, _ = select.select([self.fd], [], [], remaining)
+            if not ready:
+                continue
+            data = os.read(self.fd, 65536)
+            if not data:
+                raise TimeoutError("awesh exited")
+            output += data
+            if first_output is None:
+                start = output.find(BRACKETED_PASTE_OFF)
+                if start >= 0 and expect.search(output, start):
+                    first_output = now_ms()
+            if prompt_ready(output):
+                self.buffer = output
+                if first_output is None:
+                    raise RuntimeError(f"expected output {expect.pattern!r} not seen")
+                return first_output - sent, now_ms() - sent
+
+    def close(self):
+        try:
+            self.send(b"exit\r")
+            deadline = time.monotonic() + 3.0
+            while time.monotonic() < deadline:
+                finished, _ = os.waitpid(self.pid, os.WNOHANG)
+                if finished:
+                    return
+                time.sleep(0.05)
+            os.kill(self.pid, signal.SIGTERM)
+            os.waitpid(self.pid, 0)
+        except (OSError, ChildProcessError):
+            pass
+        finally:
+            try:
+                os.close(self.fd)
+            except OSError:
+                pass
+
+
+class LatencyBench:
+    def __init__(self, args):
+        self.args = args
+        self.binary = str(Path(args.binary).resolve())
+        self.results = {}
+        self.errors = []
+
+    def setup_home(self):
+        """Throwaway HOME and working directory wired to the chosen backend"""
+        self.home = Path(tempfile.mkdtemp(prefix="awesh_bench_"))
+        self.workdir = self.home / "work"
+        self.workdir.mkdir()
+        config = BENCH_CONFIG
+        if self.args.backend == "real":
+            # Same canned reply as the protocol mock, so both modes expect the same output
+            script = self.home / "mock_script.json"
+            script.write_text(json.dumps({"default": MOCK_REPLY}))
+            config += (f"AI_PROVIDER=mock\nMAN_INDEX=0\nMOCK_LLM_SCRIPT={script}\n"
+                       f"MOCK_LLM_TTFT_MS={self.args.ai_ttft_ms}\nMOCK_LLM_TOKENS_PER_SEC=500\n")
+            self.pythonpath = str(PROJECT_ROOT)
+        else:
+            package = self.workdir / "awesh_backend"
+            package.mkdir()
+            (package / "__init__.py").write_text("")
+            # python3 -m awesh_backend resolves from the cwd first
+            (package / "__main__.py").write_text("from mock_backend import main\nraise SystemExit(main())\n")
+            config += f"MOCK_BACKEND_DELAY_MS={self.args.ai_ttft_ms}\n"
+            self.pythonpath = str(PROJECT_ROOT / "tests")
+        (self.home / ".aweshrc").write_text(config)
+        for i in range(20):
+            (self.workdir / f"file{i:02d}.txt").write_text("x" * (i * 100))
+
+    def run_command(self, session, scenario, command, expect):
+        echo = self.results[scenario].setdefault("keystroke_echo_ms", [])
+        session.type_text(command, echo)
+        first_output, prompt = session.press_enter(re.compile(expect))
+        self.results[scenario].setdefault("enter_to_first_output_ms", []).append(first_output)
+        self.results[scenario].setdefault("enter_to_prompt_ms", []).append(prompt)
+
+    def scenario_shell_echo(self, session):
+        self.run_command(session, "shell_echo", "echo awesh-bench", rb"awesh-bench")
+
+    def scenario_shell_pipeline(self, session):
+        self.run_command(session, "shell_pipeline", "ls -la | wc -l", rb"\d+\r\n")
+
+    def scenario_ai_query(self, session):
+        # First output is the first rendered line of the reply, not the thinking indicator
+        self.run_command(session, "ai_query", "please explain how unix file permissions work", rb"Mock answer")
+        if b"MOCK-RESPONSE-END" not in session.buffer:
+            raise RuntimeError("AI reply from the mock backend was cut short")
+
+    def scenario_paste(self, session):
+        text = "echo " + "p" * 1024
+        sent = session.send(b"\x1b[200~" + text.encode() + b"\x1b[201~")
+        _, echoed = session.read_until(lambda buf: buf.count(b"p") >= 1024, timeout=5.0)
+        self.results["paste"].setdefault("paste_echo_ms", []).append(echoed - sent)
+        first_output, prompt = session.press_enter(re.compile(rb"p{1024}"))
+        self.results["paste"].setdefault("enter_to_first_output_ms", []).append(first_output)
+        self.results["paste"].setdefault("enter_to_prompt_ms", []).append(prompt)
+
+    def scenario_ctrl_c(self, session):
+        session.type_text("sleep 30", [])
+        session.send(b"\r")
+        time.sleep(0.3)
+        sent = session.send(b"\x03")
+        _, prompt = session.wait_prompt(timeout=10.0)
+        self.results["ctrl_c"].setdefault("interrupt_to_prompt_ms", []).append(prompt - sent)
+
+    def run(self):
+        self.setup_home()
+        session = PtySession(self.binary, self.home, self.workdir, self.pythonpath)
+        report = {
+            "binary": self.binary,
+            "backend": self.args.backend,
+            "iterations": self.args.iterations,
+            "scenarios": {},
+        }
+        try:
+            _, ready = session.wait_prompt(timeout=30.0)
+            report["startup_ms"] = round(ready - session.start_ms, 3)
+            # Let the helpers settle (backend connect, sandbox bash) before timing
+            time.sleep(self.args.settle)
+            for _ in range(3):
+                session.type_text("echo warm", [])
+                session.press_enter(re.compile(rb"warm"))
+
+            for name in self.args.scenarios:
+                self.results[name] = {}
+                runner = getattr(self, f"scenario_{name}")
+                before = process_tree(session.pid)
+                failures = 0
+                for _ in range(self.args.iterations):
+                    try:
+                        runner(session)
+                    except (TimeoutError, RuntimeError) as e:
+                        failures += 1
+                        self.errors.append(f"{name}: {e}")
+                        session.wait_prompt(timeout=10.0)
+                after = process_tree(session.pid)
+                entry = {metric: summarize(samples) for metric, samples in self.results[name].items()}
+                entry["description"] = SCENARIOS[name]
+                entry["failures"] = failures
+                entry["cpu_ms"] = cpu_delta_by_comm(before, after)
+                report["scenarios"][name] = entry
+                print(f"  ⏱️  {name}: " + ", ".join(
+                    f"{metric} p50={stats['p50']}ms p90={stats['p90']}ms"
+                    for metric, stats in entry.items()
+                    if isinstance(stats, dict) and "p50" in stats
+                ), file=sys.stderr)
+
+            report["processes"] = sorted(
+                ({"pid": pid, **{k: round(v, 3) if isinstance(v, float) else v for k, v in proc.items()}}
+                 for pid, proc in process_tree(session.pid).items()),
+                key=lambda proc: proc["pid"],
+            )
+        finally:
+            session.close()
+            shutil.rmtree(self.home, ignore_errors=True)
+        report["errors"] = self.errors
+        return report
+
+
+def compare_to_baseline(report, baseline, tolerance, floor_ms):
+    """p50 regressions beyond tolerance (and an absolute noise floor)"""
+    regressions = []
+    for name, entry in report["scenarios"].items():
+        base_entry = baseline.get("scenarios", {}).get(name, {})
+        for metric, stats in entry.items():
+            base = base_entry.get(metric)
+            if not (isinstance(stats, dict) and isinstance(base, dict) and "p50" in stats and "p50" in base):
+                continue
+            limit = base["p50"] * (1.0 + tolerance) + floor_ms
+            if stats["p50"] > limit:
+                regressions.append(f"{name}.{metric}: p50 {stats['p50']}ms > {limit:.3f}ms (baseline {base['p50']}ms)")
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description="PTY-driven end-to-end latency benchmark for awesh")
+    parser.add_argument("--binary", default=str(PROJECT_ROOT / "awesh"), help="awesh binary to drive")
+    parser.add_argument("--iterations", type=int, default=20, help="runs per scenario")
+    parser.add_argument("--scenario", dest="scenarios", action="append", choices=list(SCENARIOS),
+                        help="scenario to run (repeatable; default all)")
+    parser.add_argument("--backend", choices=["mock", "real"], default="mock",
+                        help="protocol-level mock, or the real backend with AI_PROVIDER=mock")
+    parser.add_argument("--ai-ttft-ms", type=int, default=50, help="mock time to first AI token")
+    parser.add_argument("--settle", type=float, default=2.0, help="seconds to wait after the first prompt")
+    parser.add_argument("--json", help="write the JSON report here instead of stdout")
+    parser.add_argument("--baseline", help="earlier JSON report; exit 1 if any p50 regressed")
+    parser.add_argument("--tolerance", type=float, default=0.25, help="allowed p50 growth vs baseline (fraction)")
+    parser.add_argument("--floor-ms", type=float, default=2.0, help="absolute slack added to every baseline p50")
+    args = parser.parse_args()
+    args.scenarios = args.scenarios or list(SCENARIOS)
+
+    if not os.access(args.binary, os.X_OK):
+        print(f"❌ {args.binary} not found - run make first", file=sys.stderr)
+        return 2
+
+    print(f"🏁 Benchmarking {args.binary} ({args.iterations} iterations per scenario)", file=sys.stderr)
+    report = LatencyBench(args).run()
+
+    output = json.dumps(report, indent=2)
+    if args.json:
+        Path(args.json).write_text(output + "\n")
+        print(f"📄 Report written to {args.json}", file=sys.stderr)
+    else:
+        print(output)
+
+    status = 0
+    if report["errors"]:
+        print(f"⚠️ {len(report['errors'])} failed iterations, first: {report['errors'][0]}", file=sys.stderr)
+        status = 1
+    if args.baseline:
+        regressions = compare_to_baseline(report, json.loads(Path(args.baseline).read_text()),
+                                          args.tolerance, args.floor_ms)
+        for regression in regressions:
+            print(f"❌ Regression: {regression}", file=sys.stderr)
+        if regressions:
+            status = 1
+        else:
+            print("✅ No regressions against baseline", file=sys.stderr)
+    return status
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,142 @@
+#!/usr/bin/env python3
+"""
+Protocol-level stand-in for the awesh backend, used by bench_latency.py.
+
+Speaks the frontend's Unix socket protocol on ~/.awesh.sock (STATUS, CWD:,
+VERBOSE:, SPECULATE:, CANCEL, plain queries) and answers queries with a
+canned markdown reply streamed in chunks. Standard library only - no
+network, no model - so latency numbers measure the frontend and IPC path.
+
+Tunables (environment):
+    MOCK_BACKEND_DELAY_MS   delay before the first chunk (default 50)
+    MOCK_BACKEND_CHUNKS     number of chunks the reply is split into (default 8)
+    MOCK_BACKEND_CHUNK_MS   delay between chunks (default 5)
+"""
+
+import os
+import re
+import socket
+import sys
+import threading
+import time
+
+SOCKET_PATH = os.path.expanduser("~/.awesh.sock")
+TRACE_PREFIX = re.compile(r"^TRACE:[0-9a-f]{16}:")
+
+MOCK_REPLY = """## Mock answer
+
+This reply comes from the **mock backend**. It exercises the streaming
+renderer with a heading, a list and a code block:
+
+- first point with `inline code`
+- second point
+
+```sh
+ls -la | sort -k5 -n
+```
+
+MOCK-RESPONSE-END
+"""
+
+
+def env_int(name, default):
+    try:
+        return int(os.getenv(name, default))
+    except ValueError:
+        return default
+
+
+class MockBackend:
+    def __init__(self):
+        self.delay = env_int("MOCK_BACKEND_DELAY_MS", 50) / 1000.0
+        self.chunks = max(1, env_int("MOCK_BACKEND_CHUNKS", 8))
+        self.chunk_delay = env_int("MOCK_BACKEND_CHUNK_MS", 5) / 1000.0
+        self.send_lock = threading.Lock()
+        self.speculative = None
+
+    def send(self, client, text):
+        with self.send_lock:
+            client.sendall(text.encode("utf-8"))
+
+    def stream_reply(self, client, cancelled=None):
+        time.sleep(self.delay)
+        size = (len(MOCK_REPLY) + self.chunks - 1) // self.chunks
+        for start in range(0, len(MOCK_REPLY), size):
+            if cancelled is not None and cancelled.is_set():
+                return
+            self.send(client, MOCK_REPLY[start:start + size])
+            time.sleep(self.chunk_delay)
+
+    def start_speculative(self, client):
+        cancelled = threading.Event()
+        worker = threading.Thread(target=self.stream_reply, args=(client, cancelled), daemon=True)
+        self.speculative = (worker, cancelled)
+        worker.start()
+
+    def cancel_speculative(self, client):
+        if self.speculative:
+            worker, cancelled = self.speculative
+            cancelled.set()
+            worker.join()
+            self.speculative = None
+        self.send(client, "SPECULATION_CANCELLED")
+
+    def handle(self, client, command):
+        if command == "STATUS":
+            self.send(client, "AI_READY")
+        elif command.startswith("CWD:"):
+            self.send(client, "OK")
+        elif command.startswith("VERBOSE:"):
+            self.send(client, "🔧 Verbose mode unchanged (mock backend)\n")
+        elif command.startswith("SPECULATE:"):
+            self.send(client, "SPECULATION_STARTED\n")
+            self.start_speculative(client)
+        elif command == "CANCEL":
+            self.cancel_speculative(client)
+        else:
+            self.stream_reply(client)
+
+    def serve_client(self, client):
+        try:
+            while True:
+                data = client.recv(65536)
+                if not data:
+                    break
+                command = data.decode("utf-8", errors="replace").strip()
+                command = TRACE_PREFIX.sub("", command, count=1)
+                if command:
+                    self.handle(client, command)
+        except OSError:
+            pass
+        finally:
+            client.close()
+
+    def run(self):
+        try:
+            os.unlink(SOCKET_PATH)
+        except OSError:
+            pass
+        server = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        server.bind(SOCKET_PATH)
+        server.listen(4)
+        try:
+            while True:
+                client, _ = server.accept()
+                threading.Thread(target=self.serve_client, args=(client,), daemon=True).start()
+        except KeyboardInterrupt:
+            pass
+        finally:
+            server.close()
+            try:
+                os.unlink(SOCKET_PATH)
+            except OSError:
+                pass
+
+
+def main():
+    MockBackend().run()
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())